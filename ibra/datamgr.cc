@@ -19,6 +19,8 @@ Q_LOGGING_CATEGORY(log_data, "rascal.data  ")
 \******************************************************************************/
 DataMgr::DataMgr(void)
 		:_handle(0)
+		,_created(0)
+		,_reused(0)
 	{}
 
 
@@ -58,6 +60,7 @@ int DataMgr::blockFor(size_t size)
 			_candidate.removeAt(idx);
 			block->retain();
 			foundBlock = true;
+			_reused ++;
 			break;
 			}
 		idx ++;
@@ -76,6 +79,7 @@ int DataMgr::blockFor(size_t size)
 			{
 			block->retain();
 			_active[result] = block;
+			_created ++;
 			}
 		}
 
@@ -116,6 +120,7 @@ int DataMgr::fftBlockFor(size_t bins)
 			_candidate.removeAt(idx);
 			block->retain();
 			foundBlock = true;
+			_reused ++;
 			break;
 			}
 		idx ++;
@@ -134,6 +139,7 @@ int DataMgr::fftBlockFor(size_t bins)
 			{
 			block->retain();
 			_active[result] = block;
+			_created ++;
 			}
 		}
 
@@ -153,6 +159,29 @@ size_t DataMgr::extent(int64_t idx)
 	return extent;
 	}
 
+/******************************************************************************\
+|* Return how the pool is being used
+\******************************************************************************/
+DataMgr::PoolStats DataMgr::poolStats(void)
+	{
+	QMutexLocker guard(&_lock);
+	PoolStats stats;
+
+	stats.active		= _active.size();
+	stats.idle			= _candidate.size();
+	stats.activeBytes	= 0;
+	stats.idleBytes		= 0;
+	stats.created		= _created;
+	stats.reused		= _reused;
+
+	for (DataBlock *block : qAsConst(_active))
+		stats.activeBytes += block->maxSize();
+	for (DataBlock *block : qAsConst(_candidate))
+		stats.idleBytes += block->maxSize();
+
+	return stats;
+	}
+
 /******************************************************************************\
 |* Return the pointer to the data in various formats: as uint8_t
 \******************************************************************************/
@@ -17,6 +17,20 @@ class DataMgr : public Singleton<DataMgr>, public Testable
 	{
 	NON_COPYABLE_NOR_MOVEABLE(DataMgr);
 
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef struct
+			{
+			int			active;			// Blocks handed out
+			int			idle;			// Blocks waiting to be re-used
+			int64_t		activeBytes;	// Capacity of those handed out
+			int64_t		idleBytes;		// Capacity of those waiting
+			int64_t		created;		// Blocks ever allocated
+			int64_t		reused;			// Requests met from the idle list
+			} PoolStats;
+
 	private:
 		/**********************************************************************\
 		|* Private variables
@@ -25,6 +39,8 @@ class DataMgr : public Singleton<DataMgr>, public Testable
 		int64_t						_handle;		// Constantly increasing
 		QMap<int64_t, DataBlock*>	_active;		// Map of in-use blocks
 		QVector<DataBlock*>			_candidate;		// List of candidate blocks
+		int64_t						_created;		// Blocks ever allocated
+		int64_t						_reused;		// Blocks re-used
 
 	public:
 		/**********************************************************************\
@@ -64,6 +80,11 @@ class DataMgr : public Singleton<DataMgr>, public Testable
 		\**********************************************************************/
 		size_t extent(int64_t idx);
 
+		/**********************************************************************\
+		|* Public Method - return a snapshot of how the pool is being used
+		\**********************************************************************/
+		PoolStats poolStats(void);
+
 		/**********************************************************************\
 		|* Public Methods - interface for retain counts from client side
 		\**********************************************************************/
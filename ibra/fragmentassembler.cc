@@ -0,0 +1,369 @@
+#include <cstring>
+
+#include "constants.h"
+#include "fragmentassembler.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Limits on what we'll try to put back together
+\******************************************************************************/
+#define MAX_MESSAGE			(16 * 1024 * 1024)
+#define MAX_PARTIAL			8
+
+/******************************************************************************\
+|* A sender that restarts starts its sequence again from 0. Anything this far
+|* behind, or this many late messages in a row, means that's what happened
+\******************************************************************************/
+#define RESYNC_GAP			4096
+#define RESYNC_LATE			4
+
+/******************************************************************************\
+|* Is sequence a before sequence b, allowing for wrap-around
+\******************************************************************************/
+static inline bool _before(uint32_t a, uint32_t b)
+	{
+	return (int32_t)(a - b) < 0;
+	}
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+FragmentAssembler::FragmentAssembler(void)
+				  :_completed(0)
+				  ,_lost(0)
+				  ,_late(0)
+				  ,_malformed(0)
+				  ,_lastSequence(0)
+				  ,_haveSequence(false)
+				  ,_lateRun(0)
+				  ,_lateSequence(0)
+	{}
+
+/******************************************************************************\
+|* Number of fragments needed for a message
+\******************************************************************************/
+int FragmentAssembler::fragmentsFor(int length, int payload)
+	{
+	return (length + payload - 1) / payload;
+	}
+
+/******************************************************************************\
+|* Build one fragment of a message
+\******************************************************************************/
+void FragmentAssembler::fragment(const QByteArray& msg,
+								 uint32_t sequence,
+								 int payload,
+								 int idx,
+								 QByteArray& datagram)
+	{
+	int offset	= idx * payload;
+	int bytes	= msg.size() - offset;
+	bytes		= (bytes < payload) ? bytes : payload;
+
+	datagram.resize(sizeof(FragmentHeader) + bytes);
+
+	FragmentHeader *hdr	= reinterpret_cast<FragmentHeader *>(datagram.data());
+	hdr->magic			= FRAGMENT_MAGIC;
+	hdr->sequence		= sequence;
+	hdr->length			= msg.size();
+	hdr->offset			= offset;
+	hdr->fragment		= idx;
+	hdr->fragments		= fragmentsFor(msg.size(), payload);
+
+	memcpy(datagram.data() + sizeof(FragmentHeader),
+		   msg.constData() + offset,
+		   bytes);
+	}
+
+/******************************************************************************\
+|* Add a datagram
+\******************************************************************************/
+bool FragmentAssembler::add(const char *datagram, int size, QByteArray& msg)
+	{
+	if (size < (int)sizeof(FragmentHeader))
+		{
+		_malformed ++;
+		return false;
+		}
+
+	FragmentHeader hdr;
+	memcpy(&hdr, datagram, sizeof(hdr));
+	uint32_t bytes = size - sizeof(FragmentHeader);
+
+	if ((hdr.magic != FRAGMENT_MAGIC)
+	 || (hdr.fragments == 0)
+	 || (hdr.fragment >= hdr.fragments)
+	 || (hdr.length > MAX_MESSAGE)
+	 || (hdr.offset > hdr.length)
+	 || (bytes > hdr.length - hdr.offset))
+		{
+		_malformed ++;
+		return false;
+		}
+
+	/**************************************************************************\
+	|* Every fragment but the last is a whole payload, and the last runs to the
+	|* end, so each one says what the payload is. It has to put the fragment
+	|* where the sender would have
+	\**************************************************************************/
+	bool last			= (hdr.fragment == hdr.fragments - 1);
+	uint32_t payload	= bytes;
+	if (last && (hdr.fragment > 0))
+		payload = hdr.offset / hdr.fragment;
+
+	if ((payload == 0)
+	 || ((uint64_t)hdr.fragment * payload != hdr.offset)
+	 || (bytes > payload)
+	 || (last && (hdr.offset + bytes != hdr.length))
+	 || (fragmentsFor(hdr.length, payload) != hdr.fragments))
+		{
+		_malformed ++;
+		return false;
+		}
+
+	/**************************************************************************\
+	|* Too late to be any use - unless the sender has restarted, in which case
+	|* start again from wherever it is now
+	\**************************************************************************/
+	if (_haveSequence && !_before(_lastSequence, hdr.sequence))
+		{
+		if ((_lateRun == 0) || (hdr.sequence != _lateSequence))
+			{
+			_lateSequence = hdr.sequence;
+			_lateRun ++;
+			}
+
+		if ((_lastSequence - hdr.sequence < RESYNC_GAP)
+		 && (_lateRun < RESYNC_LATE))
+			{
+			_late ++;
+			return false;
+			}
+
+		LOG << "Sequence went back from" << _lastSequence << "to"
+			<< hdr.sequence << ", resynchronising";
+		_partial.clear();
+		_haveSequence = false;
+		}
+	_lateRun = 0;
+
+	/**************************************************************************\
+	|* Start a new message if need be, making room if there are too many on
+	|* the go. QMap is ordered so the first is the oldest, barring wrap-around
+	\**************************************************************************/
+	if (!_partial.contains(hdr.sequence))
+		{
+		if (_partial.size() >= MAX_PARTIAL)
+			_partial.remove(_partial.firstKey());
+
+		Partial fresh;
+		fresh.data		= QByteArray(hdr.length, Qt::Uninitialized);
+		fresh.seen		= QByteArray(hdr.fragments, 0);
+		fresh.received	= 0;
+		fresh.payload	= payload;
+		_partial.insert(hdr.sequence, fresh);
+		}
+
+	Partial& partial = _partial[hdr.sequence];
+	if ((partial.data.size() != (int)hdr.length)
+	 || (partial.seen.size() != hdr.fragments)
+	 || (partial.payload != payload))
+		{
+		_malformed ++;
+		return false;
+		}
+
+	if (partial.seen[hdr.fragment] == 0)
+		{
+		memcpy(partial.data.data() + hdr.offset,
+			   datagram + sizeof(FragmentHeader),
+			   bytes);
+		partial.seen[hdr.fragment] = 1;
+		partial.received ++;
+		}
+
+	if (partial.received < hdr.fragments)
+		return false;
+
+	/**************************************************************************\
+	|* Complete. Everything between the last one and this is never coming
+	\**************************************************************************/
+	msg = partial.data;
+	_partial.remove(hdr.sequence);
+
+	if (_haveSequence)
+		_lost += hdr.sequence - _lastSequence - 1;
+	_lastSequence	= hdr.sequence;
+	_haveSequence	= true;
+	_completed ++;
+
+	for (uint32_t key : _partial.keys())
+		if (!_before(_lastSequence, key))
+			_partial.remove(key);
+
+	return true;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int FragmentAssembler::numTests(void)
+	{
+	return 3;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * FragmentAssembler::testClassName(void)
+	{
+	return "FragmentAssembler";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult FragmentAssembler::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkReorder();
+		case 1:
+			return _checkLoss();
+		case 2:
+			return _checkHostile();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : a message with recognisable contents
+\******************************************************************************/
+static QByteArray _message(int length, int seed)
+	{
+	QByteArray msg(length, Qt::Uninitialized);
+	for (int i=0; i<length; i++)
+		msg[i] = (char)(i * 7 + seed);
+	return msg;
+	}
+
+/******************************************************************************\
+|* Test interface : 5000 bytes in 1000-byte fragments, delivered backwards
+|* with the middle one twice, should come out intact exactly once
+\******************************************************************************/
+Testable::TestResult FragmentAssembler::_checkReorder(void)
+	{
+	FragmentAssembler assembler;
+	QByteArray msg		= _message(5000, 3);
+	QByteArray datagram;
+	QByteArray out;
+	int delivered		= 0;
+
+	int num = fragmentsFor(msg.size(), 1000);
+	for (int i=num-1; i>=0; i--)
+		for (int copies=0; copies<((i == 2) ? 2 : 1); copies++)
+			{
+			fragment(msg, 41, 1000, i, datagram);
+			if (assembler.add(datagram.constData(), datagram.size(), out))
+				delivered ++;
+			}
+
+	bool ok = (num == 5) && (delivered == 1) && (out == msg);
+	if (!ok)
+		ERR << "Reordered message delivered" << delivered << "times";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : lose the last fragment of the middle of three messages.
+|* The first and last should arrive, the middle counted lost, and the missing
+|* fragment counted late when it finally turns up
+\******************************************************************************/
+Testable::TestResult FragmentAssembler::_checkLoss(void)
+	{
+	FragmentAssembler assembler;
+	QByteArray datagram;
+	QByteArray out;
+	int delivered = 0;
+
+	for (uint32_t seq=100; seq<103; seq++)
+		{
+		QByteArray msg = _message(2500, seq);
+		for (int i=0; i<3; i++)
+			{
+			if ((seq == 101) && (i == 2))
+				continue;
+			fragment(msg, seq, 1000, i, datagram);
+			if (assembler.add(datagram.constData(), datagram.size(), out))
+				{
+				delivered ++;
+				if (out != msg)
+					{
+					ERR << "Message" << seq << "corrupted";
+					return Testable::TEST_FAIL;
+					}
+				}
+			}
+		}
+
+	fragment(_message(2500, 101), 101, 1000, 2, datagram);
+	assembler.add(datagram.constData(), datagram.size(), out);
+
+	bool ok = (delivered == 2)
+		   && (assembler.lost() == 1)
+		   && (assembler.late() == 1)
+		   && (assembler.lastSequence() == 102);
+	if (!ok)
+		ERR << "Loss handling: delivered" << delivered
+			<< "lost" << assembler.lost() << "late" << assembler.late();
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a fragment whose offset wraps past the end of the message,
+|* and one put somewhere other than its index says, are both refused. Then
+|* the sender restarts from 0, and after a few late messages is followed
+\******************************************************************************/
+Testable::TestResult FragmentAssembler::_checkHostile(void)
+	{
+	FragmentAssembler assembler;
+	QByteArray datagram;
+	QByteArray out;
+
+	QByteArray msg = _message(2500, 9);
+	fragment(msg, 7, 1000, 1, datagram);
+	FragmentHeader *hdr	= reinterpret_cast<FragmentHeader *>(datagram.data());
+	hdr->offset			= 0xFFFFFF00;
+	bool ok				= !assembler.add(datagram.constData(), datagram.size(), out);
+
+	fragment(msg, 7, 1000, 1, datagram);
+	hdr					= reinterpret_cast<FragmentHeader *>(datagram.data());
+	hdr->offset			= 500;
+	ok					= ok && !assembler.add(datagram.constData(), datagram.size(), out)
+						&& (assembler.malformed() == 2);
+
+	int delivered = 0;
+	for (uint32_t seq : {1000u, 0u, 1u, 2u, 3u, 4u})
+		{
+		fragment(_message(800, seq), seq, 1000, 0, datagram);
+		if (assembler.add(datagram.constData(), datagram.size(), out))
+			delivered ++;
+		}
+
+	ok = ok && (delivered == 3)
+			&& (assembler.late() == 3)
+			&& (assembler.lastSequence() == 4);
+	if (!ok)
+		ERR << "Hostile datagrams: malformed" << assembler.malformed()
+			<< "delivered" << delivered << "late" << assembler.late();
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
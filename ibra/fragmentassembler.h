@@ -0,0 +1,136 @@
+#ifndef FRAGMENTASSEMBLER_H
+#define FRAGMENTASSEMBLER_H
+
+#include <QByteArray>
+#include <QMap>
+
+#include "properties.h"
+#include "testable.h"
+
+/******************************************************************************\
+|* Spectrum messages are bigger than a datagram, so over UDP each one is split
+|* into fragments, each prefixed with this header. Every message gets the next
+|* sequence number, whatever its type, so a receiver can tell what it missed
+\******************************************************************************/
+#define FRAGMENT_MAGIC		0x4C435352		// "RSCL" on the wire
+
+struct FragmentHeader
+	{
+	uint32_t magic;			// FRAGMENT_MAGIC
+	uint32_t sequence;		// Message sequence number
+	uint32_t length;		// Bytes in the whole message
+	uint32_t offset;		// Where this fragment's bytes go in the message
+	uint16_t fragment;		// Index of this fragment
+	uint16_t fragments;		// Fragments making up the message
+	};
+
+/******************************************************************************\
+|* Splits messages into fragments, and puts them back together at the other
+|* end. Fragments can arrive in any order and more than once. A message that
+|* is missing fragments when a later one completes is given up on - for a
+|* live display the next spectrum is worth more than a late one - as is
+|* anything that turns up for a message older than the last one delivered,
+|* unless it's so much older that the sender must have restarted.
+|*
+|* Datagrams come off the network from anyone, so a fragment has to land
+|* exactly where the sender would have put it, inside the message, or it's
+|* thrown away
+\******************************************************************************/
+class FragmentAssembler : public Testable
+	{
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(uint64_t, completed);			// Messages delivered
+	GET(uint64_t, lost);				// Messages never completed
+	GET(uint64_t, late);				// Fragments for old messages
+	GET(uint64_t, malformed);			// Datagrams that made no sense
+	GET(uint32_t, lastSequence);		// Last message delivered
+	GET(bool, haveSequence);			// Whether lastSequence is valid
+
+	private:
+		/**********************************************************************\
+		|* A message being put back together
+		\**********************************************************************/
+		typedef struct
+			{
+			QByteArray	data;			// The message so far
+			QByteArray	seen;			// 1 per fragment received
+			int			received;		// Distinct fragments received
+			uint32_t	payload;		// Bytes in every fragment but the last
+			} Partial;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QMap<uint32_t, Partial>	_partial;	// By sequence number
+		int						_lateRun;	// Late messages in a row
+		uint32_t				_lateSequence;// ... the last of them
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		FragmentAssembler(void);
+
+		/**********************************************************************\
+		|* Number of fragments needed for a message, given the payload bytes
+		|* that fit in a datagram alongside the header
+		\**********************************************************************/
+		static int fragmentsFor(int length, int payload);
+
+		/**********************************************************************\
+		|* Build fragment {idx} of a message into {datagram}, reusing its
+		|* storage
+		\**********************************************************************/
+		static void fragment(const QByteArray& msg,
+							 uint32_t sequence,
+							 int payload,
+							 int idx,
+							 QByteArray& datagram);
+
+		/**********************************************************************\
+		|* Add a datagram. Returns true, with the message in {msg}, when it
+		|* completes one
+		\**********************************************************************/
+		bool add(const char *datagram, int size, QByteArray& msg);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check out-of-order and duplicate fragments reassemble
+		\**********************************************************************/
+		Testable::TestResult _checkReorder(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check a lost fragment costs one message, and no more
+		\**********************************************************************/
+		Testable::TestResult _checkLoss(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check misplaced fragments are refused, and a sender
+		|* restarting its sequence is followed
+		\**********************************************************************/
+		Testable::TestResult _checkHostile(void);
+	};
+
+#endif // FRAGMENTASSEMBLER_H
@@ -18,16 +18,20 @@ LIBS +=  \
 
 SOURCES += \
     datablock.cc \
-    datamgr.cc
+    datamgr.cc \
+    fragmentassembler.cc \
+    spectrumcodec.cc
 
 HEADERS += \
     constants.h \
     datablock.h \
     datamgr.h \
+    fragmentassembler.h \
     libra.h \
     preamble.h \
     properties.h \
     singleton.h \
+    spectrumcodec.h \
     testable.h
 
 # Default rules for deployment.
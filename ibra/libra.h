@@ -4,9 +4,11 @@
 #include <constants.h>
 #include <datablock.h>
 #include <datamgr.h>
+#include <fragmentassembler.h>
 #include <preamble.h>
 #include <properties.h>
 #include <singleton.h>
+#include <spectrumcodec.h>
 #include <testable.h>
 
 #endif // LIBRA_H
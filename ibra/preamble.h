@@ -10,9 +10,18 @@ typedef enum
 	{
 	TYPE_NONE	= 0,
 	TYPE_UPDATE,
-	TYPE_SAMPLE
+	TYPE_SAMPLE,
+	TYPE_LIVE,
+	TYPE_TEXT,				// UTF-8 reply, only on stream transports
+	TYPE_VIS_UPDATE,		// Visibilities: XX, YY, Re(XY*), Im(XY*) planes,
+							// each {bins} long, so {values} = 4 x {bins}.
+							// {channel} is X's, and Y is the next channel
+	TYPE_VIS_SAMPLE,
+	TYPE_SWEEP				// A spectrum stitched from the hops of a sweep
 	} PreambleType;
 
+#define VIS_PLANES		4	// Planes in a visibility message
+
 struct Preamble
 	{
 	uint16_t order;
@@ -20,17 +29,31 @@ struct Preamble
 	uint32_t extent;
 	uint16_t type;
 	uint16_t flags;
+	uint32_t binLo;			// First spectrum bin in the payload
+	uint32_t bins;			// Bins in the full-resolution spectrum
+	uint16_t decimate;		// Spectrum bins per payload value
+	uint16_t channel;		// Which of a device's streams it came from
+	uint32_t values;		// Spectrum values in the payload
+	float	 scaleBase;		// Quantised encodings: value of code 0
+	float	 scaleStep;		// Quantised encodings: value per code
 
 	/**************************************************************************\
 	|* Constructor just to set common things
 	\**************************************************************************/
 	Preamble(void)
 		{
-		order	= 0xAA55;
-		offset	= sizeof(Preamble);
-		extent	= 0;
-		type	= 0;
-		flags	= 0;
+		order		= 0xAA55;
+		offset		= sizeof(Preamble);
+		extent		= 0;
+		type		= 0;
+		flags		= 0;
+		binLo		= 0;
+		bins		= 0;
+		decimate	= 1;
+		channel		= 0;
+		values		= 0;
+		scaleBase	= 0;
+		scaleStep	= 1;
 		}
 
 	/**************************************************************************\
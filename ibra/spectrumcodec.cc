@@ -0,0 +1,574 @@
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <random>
+
+#include <QFloat16>
+#include <QMap>
+
+#include "constants.h"
+#include "spectrumcodec.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_data) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_data) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Headroom either side of the data when the quantisation scale is reset, as
+|* a fraction of the range of the data
+\******************************************************************************/
+#define SCALE_HEADROOM		(0.125f)
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+SpectrumCodec::SpectrumCodec(int format, bool delta, bool compress, int keyInterval)
+			  :_format(format & ENC_FORMAT)
+			  ,_delta(delta)
+			  ,_compress(compress)
+			  ,_keyInterval(keyInterval)
+			  ,_sinceKey(0)
+			  ,_base(0)
+			  ,_step(0)
+			  ,_previousFormat(-1)
+	{}
+
+/******************************************************************************\
+|* Parse a format name
+\******************************************************************************/
+int SpectrumCodec::formatFor(const QString& name)
+	{
+	QMap<QString, int> map =
+		{
+			{"f32", ENC_F32},
+			{"f16", ENC_F16},
+			{"u16", ENC_U16},
+			{"u8", ENC_U8},
+		};
+
+	QString key = name.toLower();
+	return map.contains(key) ? map[key] : -1;
+	}
+
+/******************************************************************************\
+|* Encode a float32 message
+\******************************************************************************/
+QByteArray SpectrumCodec::encode(const QByteArray& msg, bool keyframe)
+	{
+	if ((_format == ENC_F32) && !_delta && !_compress)
+		return msg;
+
+	const Preamble *in	= reinterpret_cast<const Preamble *>(msg.constData());
+	const float *src	= reinterpret_cast<const float *>
+							(msg.constData() + in->offset);
+	int num				= in->extent / sizeof(float);
+	int bytes			= num * _width(_format);
+
+	/**************************************************************************\
+	|* Turn the values into code words
+	\**************************************************************************/
+	_current.resize(bytes);
+	_quantise(src, num, _current.data());
+
+	/**************************************************************************\
+	|* Difference against the last frame if we can
+	\**************************************************************************/
+	const char *payload	= _current.constData();
+	bool isDelta		= _delta
+						&& !keyframe
+						&& (_previous.size() == bytes)
+						&& (_sinceKey < _keyInterval);
+	if (isDelta)
+		{
+		_scratch.resize(bytes);
+		char *dst		= _scratch.data();
+		const char *a	= _current.constData();
+		const char *b	= _previous.constData();
+
+		switch (_width(_format))
+			{
+			case 1:
+				for (int i=0; i<num; i++)
+					((uint8_t *)dst)[i] = ((const uint8_t *)a)[i]
+										- ((const uint8_t *)b)[i];
+				break;
+			case 2:
+				for (int i=0; i<num; i++)
+					((uint16_t *)dst)[i] = ((const uint16_t *)a)[i]
+										 - ((const uint16_t *)b)[i];
+				break;
+			default:
+				for (int i=0; i<num; i++)
+					((uint32_t *)dst)[i] = ((const uint32_t *)a)[i]
+										 - ((const uint32_t *)b)[i];
+				break;
+			}
+		payload = dst;
+		_sinceKey ++;
+		}
+	else
+		_sinceKey = 0;
+
+	/**************************************************************************\
+	|* Entropy stage. Level 1 is plenty for small deltas, and is fast
+	\**************************************************************************/
+	QByteArray packed;
+	if (_compress)
+		{
+		packed	= qCompress((const uchar *)payload, bytes, 1);
+		payload	= packed.constData();
+		bytes	= packed.size();
+		}
+
+	/**************************************************************************\
+	|* Build the message, keeping the incoming header
+	\**************************************************************************/
+	QByteArray out(sizeof(Preamble) + bytes, Qt::Uninitialized);
+	Preamble *hdr	= new (out.data()) Preamble();
+	*hdr			= *in;
+	hdr->offset		= sizeof(Preamble);
+	hdr->extent		= bytes;
+	hdr->values		= num;
+	hdr->flags		= _format
+					| (isDelta ? ENC_DELTA : 0)
+					| (_compress ? ENC_ZLIB : 0);
+	hdr->scaleBase	= _base;
+	hdr->scaleStep	= _step;
+	memcpy(out.data() + hdr->offset, payload, bytes);
+
+	if (_delta)
+		_previous.swap(_current);
+
+	return out;
+	}
+
+/******************************************************************************\
+|* Decode a message back to float32
+\******************************************************************************/
+QByteArray SpectrumCodec::decode(const QByteArray& msg)
+	{
+	const Preamble *in	= reinterpret_cast<const Preamble *>(msg.constData());
+	if (in->flags == 0)
+		return msg;
+
+	int format			= in->flags & ENC_FORMAT;
+	bool isDelta		= (in->flags & ENC_DELTA) != 0;
+
+	if (format > ENC_U8)
+		{
+		ERR << "Unknown spectrum encoding" << in->flags;
+		return QByteArray();
+		}
+
+	if (in->values > MAX_VALUES)
+		{
+		ERR << "Spectrum claims" << in->values << "values, too many";
+		return QByteArray();
+		}
+
+	int num				= (int)in->values;
+	int bytes			= num * _width(format);
+
+	/**************************************************************************\
+	|* Undo the entropy stage
+	\**************************************************************************/
+	const char *payload	= msg.constData() + in->offset;
+	int length			= in->extent;
+
+	QByteArray unpacked;
+	if (in->flags & ENC_ZLIB)
+		{
+		/**********************************************************************\
+		|* qUncompress() allocates whatever the stream's big-endian size prefix
+		|* says, so check that first
+		\**********************************************************************/
+		const uchar *size	= (const uchar *)payload;
+		if ((length < 4)
+		 || ((((uint32_t)size[0] << 24) | ((uint32_t)size[1] << 16)
+			| ((uint32_t)size[2] << 8)  |  (uint32_t)size[3]) != (uint32_t)bytes))
+			{
+			ERR << "Compressed spectrum isn't" << bytes << "bytes";
+			return QByteArray();
+			}
+
+		unpacked	= qUncompress((const uchar *)payload, length);
+		payload		= unpacked.constData();
+		length		= unpacked.size();
+		}
+
+	if (length != bytes)
+		{
+		ERR << "Spectrum payload is" << length << "bytes, expected" << bytes;
+		return QByteArray();
+		}
+
+	/**************************************************************************\
+	|* Recover the code words
+	\**************************************************************************/
+	if (isDelta)
+		{
+		if ((_previous.size() != bytes) || (_previousFormat != format))
+			{
+			LOG << "Discarding delta frame while waiting for a keyframe";
+			return QByteArray();
+			}
+
+		_current.resize(bytes);
+		char *dst		= _current.data();
+		const char *b	= _previous.constData();
+
+		switch (_width(format))
+			{
+			case 1:
+				for (int i=0; i<num; i++)
+					((uint8_t *)dst)[i] = ((const uint8_t *)b)[i]
+										+ ((const uint8_t *)payload)[i];
+				break;
+			case 2:
+				for (int i=0; i<num; i++)
+					((uint16_t *)dst)[i] = ((const uint16_t *)b)[i]
+										 + ((const uint16_t *)payload)[i];
+				break;
+			default:
+				for (int i=0; i<num; i++)
+					((uint32_t *)dst)[i] = ((const uint32_t *)b)[i]
+										 + ((const uint32_t *)payload)[i];
+				break;
+			}
+		}
+	else
+		_current = QByteArray(payload, bytes);
+
+	/**************************************************************************\
+	|* And back to floats
+	\**************************************************************************/
+	QByteArray out(sizeof(Preamble) + num * sizeof(float), Qt::Uninitialized);
+	Preamble *hdr	= new (out.data()) Preamble();
+	*hdr			= *in;
+	hdr->offset		= sizeof(Preamble);
+	hdr->extent		= num * sizeof(float);
+	hdr->flags		= 0;
+	hdr->scaleBase	= 0;
+	hdr->scaleStep	= 1;
+
+	_dequantise(_current.constData(), num, format,
+				in->scaleBase, in->scaleStep,
+				reinterpret_cast<float *>(out.data() + hdr->offset));
+
+	_previous.swap(_current);
+	_previousFormat = format;
+	return out;
+	}
+
+/******************************************************************************\
+|* Private method: bytes per code word
+\******************************************************************************/
+int SpectrumCodec::_width(int format)
+	{
+	switch (format)
+		{
+		case ENC_F16:
+		case ENC_U16:
+			return 2;
+		case ENC_U8:
+			return 1;
+		default:
+			return 4;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: keep the quantisation scale unless the data has moved
+|* outside it, or now only uses a small part of it
+\******************************************************************************/
+void SpectrumCodec::_rescale(const float *src, int num)
+	{
+	float lo = src[0];
+	float hi = src[0];
+	for (int i=1; i<num; i++)
+		{
+		lo = (src[i] < lo) ? src[i] : lo;
+		hi = (src[i] > hi) ? src[i] : hi;
+		}
+
+	float maxCode	= (_format == ENC_U16) ? 65535.0f : 255.0f;
+	float top		= _base + _step * maxCode;
+	float range		= top - _base;
+
+	if ((_step <= 0) || (lo < _base) || (hi > top) || (hi - lo < range / 4))
+		{
+		float span	= hi - lo;
+		span		= (span > 0) ? span : 1e-3f;
+		float room	= span * SCALE_HEADROOM;
+		_base		= lo - room;
+		_step		= (span + 2 * room) / maxCode;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: values to code words
+\******************************************************************************/
+void SpectrumCodec::_quantise(const float *src, int num, char *dst)
+	{
+	switch (_format)
+		{
+		case ENC_F16:
+			qFloatToFloat16(reinterpret_cast<qfloat16 *>(dst), src, num);
+			break;
+
+		case ENC_U16:
+			{
+			_rescale(src, num);
+			float scale		= 1.0f / _step;
+			uint16_t *codes	= reinterpret_cast<uint16_t *>(dst);
+			for (int i=0; i<num; i++)
+				{
+				float code	= (src[i] - _base) * scale + 0.5f;
+				code		= (code < 0) ? 0 : (code > 65535.0f) ? 65535.0f : code;
+				codes[i]	= (uint16_t)code;
+				}
+			break;
+			}
+
+		case ENC_U8:
+			{
+			_rescale(src, num);
+			float scale		= 1.0f / _step;
+			uint8_t *codes	= reinterpret_cast<uint8_t *>(dst);
+			for (int i=0; i<num; i++)
+				{
+				float code	= (src[i] - _base) * scale + 0.5f;
+				code		= (code < 0) ? 0 : (code > 255.0f) ? 255.0f : code;
+				codes[i]	= (uint8_t)code;
+				}
+			break;
+			}
+
+		default:
+			memcpy(dst, src, num * sizeof(float));
+			break;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: code words to values
+\******************************************************************************/
+void SpectrumCodec::_dequantise(const char *src,
+								int num,
+								int format,
+								float base,
+								float step,
+								float *dst)
+	{
+	switch (format)
+		{
+		case ENC_F16:
+			qFloatFromFloat16(dst, reinterpret_cast<const qfloat16 *>(src), num);
+			break;
+
+		case ENC_U16:
+			{
+			const uint16_t *codes = reinterpret_cast<const uint16_t *>(src);
+			for (int i=0; i<num; i++)
+				dst[i] = base + codes[i] * step;
+			break;
+			}
+
+		case ENC_U8:
+			{
+			const uint8_t *codes = reinterpret_cast<const uint8_t *>(src);
+			for (int i=0; i<num; i++)
+				dst[i] = base + codes[i] * step;
+			break;
+			}
+
+		default:
+			memcpy(dst, src, num * sizeof(float));
+			break;
+		}
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int SpectrumCodec::numTests(void)
+	{
+	return 3;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * SpectrumCodec::testClassName(void)
+	{
+	return "SpectrumCodec";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult SpectrumCodec::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkRoundTrip();
+		case 1:
+			return _checkDeltaFrames();
+		case 2:
+			return _checkHostile();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : a noisy spectrum with a line in it
+\******************************************************************************/
+static QByteArray _spectrum(int num, std::mt19937& rng)
+	{
+	std::normal_distribution<float> noise(0.0f, 0.02f);
+
+	QByteArray msg(sizeof(Preamble) + num * sizeof(float), Qt::Uninitialized);
+	Preamble *hdr	= new (msg.data()) Preamble();
+	hdr->extent		= num * sizeof(float);
+	hdr->type		= TYPE_UPDATE;
+	hdr->bins		= num;
+	hdr->values		= num;
+
+	float *data		= reinterpret_cast<float *>(msg.data() + hdr->offset);
+	for (int i=0; i<num; i++)
+		data[i] = 2.0f + noise(rng) + ((i == num/3) ? 0.5f : 0.0f);
+	return msg;
+	}
+
+/******************************************************************************\
+|* Test helper : largest difference between two float32 messages
+\******************************************************************************/
+static float _maxError(const QByteArray& a, const QByteArray& b)
+	{
+	const Preamble *ha	= reinterpret_cast<const Preamble *>(a.constData());
+	const Preamble *hb	= reinterpret_cast<const Preamble *>(b.constData());
+	if ((b.size() == 0) || (ha->extent != hb->extent))
+		return HUGE_VALF;
+
+	const float *da		= reinterpret_cast<const float *>(a.constData() + ha->offset);
+	const float *db		= reinterpret_cast<const float *>(b.constData() + hb->offset);
+	float worst			= 0;
+	for (uint32_t i=0; i<ha->extent / sizeof(float); i++)
+		worst = fmaxf(worst, fabsf(da[i] - db[i]));
+	return worst;
+	}
+
+/******************************************************************************\
+|* Test interface : each format should come back to within half a step
+\******************************************************************************/
+Testable::TestResult SpectrumCodec::_checkRoundTrip(void)
+	{
+	std::mt19937 rng(1057);
+	QByteArray msg = _spectrum(1024, rng);
+
+	struct { int format; float tolerance; } checks[] =
+		{
+			{ENC_F16, 2.5e-3f},
+			{ENC_U16, 1e-4f},
+			{ENC_U8, 2e-3f},
+		};
+
+	for (auto& check : checks)
+		{
+		SpectrumCodec encoder(check.format, false, true);
+		SpectrumCodec decoder;
+		QByteArray wire		= encoder.encode(msg);
+		float error			= _maxError(msg, decoder.decode(wire));
+
+		if (error > check.tolerance)
+			{
+			ERR << "Format" << check.format << "round-trip error" << error;
+			return Testable::TEST_FAIL;
+			}
+		}
+	return Testable::TEST_PASS;
+	}
+
+/******************************************************************************\
+|* Test interface : with an interval of 8, keyframes should land on frames 0
+|* and 9, plus 12 where one is forced. Every frame should decode, and a
+|* decoder that joins late should refuse deltas until the next keyframe
+\******************************************************************************/
+Testable::TestResult SpectrumCodec::_checkDeltaFrames(void)
+	{
+	std::mt19937 rng(1058);
+	SpectrumCodec encoder(ENC_U8, true, true, 8);
+	SpectrumCodec decoder;
+	SpectrumCodec late;
+
+	for (int frame=0; frame<20; frame++)
+		{
+		QByteArray msg		= _spectrum(512, rng);
+		QByteArray wire		= encoder.encode(msg, frame == 12);
+		const Preamble *hdr	= reinterpret_cast<const Preamble *>(wire.constData());
+		bool isDelta		= (hdr->flags & ENC_DELTA) != 0;
+		bool expectKey		= (frame == 0) || (frame == 9) || (frame == 12);
+
+		if (isDelta == expectKey)
+			{
+			ERR << "Frame" << frame << "keyframe placement wrong";
+			return Testable::TEST_FAIL;
+			}
+
+		if (_maxError(msg, decoder.decode(wire)) > 2e-3f)
+			{
+			ERR << "Frame" << frame << "decoded badly";
+			return Testable::TEST_FAIL;
+			}
+
+		if (frame == 0)
+			continue;
+
+		QByteArray result = late.decode(wire);
+		if ((frame < 9) && (result.size() != 0))
+			{
+			ERR << "Delta frame decoded without a keyframe";
+			return Testable::TEST_FAIL;
+			}
+		if ((frame >= 9) && (_maxError(msg, result) > 2e-3f))
+			{
+			ERR << "Late decoder didn't recover at the keyframe";
+			return Testable::TEST_FAIL;
+			}
+		}
+	return Testable::TEST_PASS;
+	}
+
+/******************************************************************************\
+|* Test interface : a message claiming 2^32-1 values, and a compressed one
+|* whose zlib stream says it unpacks to 1GB, should both be refused
+\******************************************************************************/
+Testable::TestResult SpectrumCodec::_checkHostile(void)
+	{
+	std::mt19937 rng(1059);
+	SpectrumCodec encoder(ENC_U8, false, true);
+	SpectrumCodec decoder;
+
+	QByteArray wire		= encoder.encode(_spectrum(256, rng));
+	bool ok				= decoder.decode(wire).size() != 0;
+
+	QByteArray huge		= wire;
+	Preamble *hdr		= reinterpret_cast<Preamble *>(huge.data());
+	hdr->values			= 0xFFFFFFFF;
+	ok					= ok && (decoder.decode(huge).size() == 0);
+
+	QByteArray bomb		= wire;
+	hdr					= reinterpret_cast<Preamble *>(bomb.data());
+	bomb[hdr->offset]	= 0x40;
+	ok					= ok && (decoder.decode(bomb).size() == 0);
+
+	if (!ok)
+		ERR << "Decoded a message claiming more than it holds";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,143 @@
+#ifndef SPECTRUMCODEC_H
+#define SPECTRUMCODEC_H
+
+#include <QByteArray>
+
+#include "preamble.h"
+#include "properties.h"
+#include "testable.h"
+
+/******************************************************************************\
+|* Encodes spectrum messages (Preamble + float32 values) into more compact
+|* forms for the wire, and decodes them at the other end. The encoding is
+|* described by Preamble.flags:
+|*
+|*	bits 0..3	value format: float32, float16, uint16 or uint8
+|*	bit 4		payload is the difference from the previous message
+|*	bit 5		payload has been through qCompress()
+|*
+|* The spectra are already logarithmic, so the integer formats quantise
+|* linearly, giving a constant dB resolution. Each message carries the base
+|* and step it was quantised with. The encoder holds the scale steady while
+|* the data fits, so that successive frames have similar codes and the
+|* deltas stay small.
+|*
+|* Deltas are taken on the code words (mod 2^n), so they are exact whatever
+|* the scale does. Both ends are stateful: use one codec per stream of
+|* messages, ie: per product and per view
+\******************************************************************************/
+class SpectrumCodec : public Testable
+	{
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			ENC_F32			= 0,
+			ENC_F16			= 1,
+			ENC_U16			= 2,
+			ENC_U8			= 3,
+			ENC_FORMAT		= 0x0F,
+
+			ENC_DELTA		= 0x10,
+			ENC_ZLIB		= 0x20
+			} Encoding;
+
+		static const uint32_t MAX_VALUES = 1 << 24;	// Most a message can hold
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, format);					// One of ENC_F32 ... ENC_U8
+	GET(bool, delta);					// Send deltas between keyframes
+	GET(bool, compress);				// Run the payload through zlib
+	GET(int, keyInterval);				// Max deltas between keyframes
+	GET(int, sinceKey);					// Deltas since the last keyframe
+	GET(float, base);					// Current quantisation base
+	GET(float, step);					// Current quantisation step
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QByteArray		_current;		// Codes for this message
+		QByteArray		_previous;		// Codes for the last message
+		QByteArray		_scratch;		// Delta workspace
+		int				_previousFormat;// Format of the previous codes
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		static int _width(int format);
+		void _rescale(const float *src, int num);
+		void _quantise(const float *src, int num, char *dst);
+		void _dequantise(const char *src, int num, int format,
+						 float base, float step, float *dst);
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		explicit SpectrumCodec(int format = ENC_F32,
+							   bool delta = false,
+							   bool compress = false,
+							   int keyInterval = 32);
+
+		/**********************************************************************\
+		|* Parse a format name ("f32", "f16", "u16", "u8"), -1 if unknown
+		\**********************************************************************/
+		static int formatFor(const QString& name);
+
+		/**********************************************************************\
+		|* Encode a float32 message. Set keyframe to force a non-delta frame,
+		|* eg: because a new client has joined the stream
+		\**********************************************************************/
+		QByteArray encode(const QByteArray& msg, bool keyframe = false);
+
+		/**********************************************************************\
+		|* Decode a message back to float32. Returns an empty array if it
+		|* can't be decoded (corrupt, or a delta with no keyframe yet). The
+		|* header is trusted no further than MAX_VALUES
+		\**********************************************************************/
+		QByteArray decode(const QByteArray& msg);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check each format round-trips within its resolution
+		\**********************************************************************/
+		Testable::TestResult _checkRoundTrip(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check delta frames decode, and are refused without a key
+		\**********************************************************************/
+		Testable::TestResult _checkDeltaFrames(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check a header claiming too much is refused before any
+		|* of it is allocated
+		\**********************************************************************/
+		Testable::TestResult _checkHostile(void);
+	};
+
+#endif // SPECTRUMCODEC_H
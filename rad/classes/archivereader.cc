@@ -0,0 +1,239 @@
+#include <QDir>
+#include <QFile>
+
+#include "archivereader.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+typedef SpectrumArchive::ChunkHeader	ChunkHeader;
+typedef SpectrumArchive::IndexEntry		IndexEntry;
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+ArchiveReader::ArchiveReader(void)
+	{}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+ArchiveReader::~ArchiveReader(void)
+	{
+	close();
+	}
+
+/******************************************************************************\
+|* Map the chunks of one tier. The names sort in time order
+\******************************************************************************/
+bool ArchiveReader::open(const QString& dir, int type)
+	{
+	close();
+
+	QString tier		= SpectrumArchive::tierDir(dir, type);
+	QStringList names	= QDir(tier).entryList(QStringList() << "*.spa",
+											   QDir::Files,
+											   QDir::Name);
+	for (const QString& name : names)
+		_map(tier, name);
+
+	return !_chunks.isEmpty();
+	}
+
+/******************************************************************************\
+|* Unmap everything
+\******************************************************************************/
+void ArchiveReader::close(void)
+	{
+	for (Chunk& chunk : _chunks)
+		{
+		delete chunk.data;
+		delete chunk.index;
+		}
+	_chunks.clear();
+	}
+
+/******************************************************************************\
+|* Number of chunks, the header of one, and the rows in it
+\******************************************************************************/
+int ArchiveReader::chunks(void)
+	{
+	return _chunks.size();
+	}
+
+const ChunkHeader * ArchiveReader::header(int chunk)
+	{
+	return reinterpret_cast<const ChunkHeader *>(_chunks[chunk].base);
+	}
+
+int ArchiveReader::rows(int chunk)
+	{
+	return _chunks[chunk].rows;
+	}
+
+/******************************************************************************\
+|* The time and values of a row
+\******************************************************************************/
+int64_t ArchiveReader::msecs(int chunk, int row)
+	{
+	const Chunk& c = _chunks[chunk];
+	const uchar *at = c.base
+					+ SpectrumArchive::HEADER_BYTES
+					+ (int64_t)row * header(chunk)->rowBytes;
+	return *reinterpret_cast<const int64_t *>(at);
+	}
+
+const float * ArchiveReader::values(int chunk, int row)
+	{
+	const Chunk& c = _chunks[chunk];
+	const uchar *at = c.base
+					+ SpectrumArchive::HEADER_BYTES
+					+ (int64_t)row * header(chunk)->rowBytes
+					+ sizeof(int64_t);
+	return reinterpret_cast<const float *>(at);
+	}
+
+/******************************************************************************\
+|* Find the first row at or after a time. The chunk to look in is the last
+|* one starting before it; if every row there is earlier, the answer
+|* is the first row of the next chunk
+\******************************************************************************/
+bool ArchiveReader::find(int64_t when, int& chunk, int& row)
+	{
+	int lo = 0;
+	int hi = _chunks.size();
+	while (lo < hi)
+		{
+		int mid = (lo + hi) / 2;
+		if (msecs(mid, 0) < when)
+			lo = mid + 1;
+		else
+			hi = mid;
+		}
+
+	chunk = (lo > 0) ? lo - 1 : 0;
+	if (chunk >= _chunks.size())
+		return false;
+
+	row = _findRow(chunk, when);
+	if (row < _chunks[chunk].rows)
+		return true;
+
+	chunk ++;
+	row = 0;
+	return chunk < _chunks.size();
+	}
+
+/******************************************************************************\
+|* Step to the next row, across chunks
+\******************************************************************************/
+bool ArchiveReader::next(int& chunk, int& row)
+	{
+	if (row + 1 < _chunks[chunk].rows)
+		{
+		row ++;
+		return true;
+		}
+
+	if (chunk + 1 < _chunks.size())
+		{
+		chunk ++;
+		row = 0;
+		return true;
+		}
+
+	return false;
+	}
+
+/******************************************************************************\
+|* Private method: map a chunk and its index. A chunk being written may end
+|* part-way through a row, and its index may be ahead of it, so only whole
+|* rows, and entries for them, are used
+\******************************************************************************/
+bool ArchiveReader::_map(const QString& dir, const QString& name)
+	{
+	Chunk chunk;
+	chunk.data			= new QFile(dir + "/" + name);
+	chunk.index			= new QFile(dir + "/" + QString(name).replace(".spa", ".idx"));
+	chunk.base			= nullptr;
+	chunk.entries		= nullptr;
+	chunk.numEntries	= 0;
+	chunk.rows			= 0;
+
+	qint64 size = chunk.data->size();
+	if ((size >= SpectrumArchive::HEADER_BYTES) && chunk.data->open(QIODevice::ReadOnly))
+		chunk.base = chunk.data->map(0, size);
+
+	const ChunkHeader *hdr = reinterpret_cast<const ChunkHeader *>(chunk.base);
+	if ((hdr == nullptr)
+	 || (hdr->magic != SpectrumArchive::CHUNK_MAGIC)
+	 || (hdr->version != SpectrumArchive::CHUNK_VERSION)
+	 || (hdr->rowBytes != (int)(sizeof(int64_t) + hdr->bins * sizeof(float))))
+		{
+		WARN << "Skipping archive chunk" << chunk.data->fileName();
+		delete chunk.data;
+		delete chunk.index;
+		return false;
+		}
+
+	chunk.rows = (size - SpectrumArchive::HEADER_BYTES) / hdr->rowBytes;
+	if (chunk.rows == 0)
+		{
+		delete chunk.data;
+		delete chunk.index;
+		return false;
+		}
+
+	size = chunk.index->size();
+	if ((size >= (qint64)sizeof(IndexEntry)) && chunk.index->open(QIODevice::ReadOnly))
+		{
+		chunk.entries = reinterpret_cast<const IndexEntry *>(chunk.index->map(0, size));
+		if (chunk.entries != nullptr)
+			{
+			chunk.numEntries = size / sizeof(IndexEntry);
+			while ((chunk.numEntries > 0)
+				&& (chunk.entries[chunk.numEntries-1].row >= chunk.rows))
+				chunk.numEntries --;
+			}
+		}
+
+	_chunks.append(chunk);
+	return true;
+	}
+
+/******************************************************************************\
+|* Private method: the first row in a chunk at or after a time, or the
+|* number of rows if there isn't one. The index narrows it down to the rows
+|* between two entries, which are then searched
+\******************************************************************************/
+int ArchiveReader::_findRow(int idx, int64_t when)
+	{
+	const Chunk& chunk = _chunks[idx];
+	int lo = 0;
+	int hi = chunk.numEntries;
+	while (lo < hi)
+		{
+		int mid = (lo + hi) / 2;
+		if (chunk.entries[mid].msecs < when)
+			lo = mid + 1;
+		else
+			hi = mid;
+		}
+
+	int first	= (lo > 0) ? chunk.entries[lo-1].row : 0;
+	int last	= (lo < chunk.numEntries) ? chunk.entries[lo].row : chunk.rows;
+
+	while (first < last)
+		{
+		int mid = (first + last) / 2;
+		if (msecs(idx, mid) < when)
+			first = mid + 1;
+		else
+			last = mid;
+		}
+	return first;
+	}
@@ -0,0 +1,95 @@
+#ifndef ARCHIVEREADER_H
+#define ARCHIVEREADER_H
+
+#include <QList>
+#include <QString>
+
+#include <libra.h>
+
+#include "spectrumarchive.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+/******************************************************************************\
+|* Read access to one tier of a SpectrumArchive. Every chunk and index is
+|* mapped as it stood when the reader was opened; open() again to see rows
+|* written since.
+|*
+|* find() is a binary search over the chunks (by their first time), then
+|* over the chunk's sparse index, then over the rows between two index
+|* entries, so it is O(log n) however much is archived. Rows are then read
+|* in place, from the mapping
+\******************************************************************************/
+class ArchiveReader
+	{
+	NON_COPYABLE_NOR_MOVEABLE(ArchiveReader);
+
+	private:
+		/**********************************************************************\
+		|* A mapped chunk
+		\**********************************************************************/
+		typedef struct
+			{
+			QFile *			data;			// The chunk...
+			QFile *			index;			// ... and its index
+			const uchar *	base;			// Mapping of the chunk
+			const SpectrumArchive::IndexEntry *
+							entries;		// Mapping of the index
+			int				numEntries;		// Entries in the index
+			int				rows;			// Whole rows in the chunk
+			} Chunk;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QList<Chunk>	_chunks;			// Oldest first
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		bool _map(const QString& dir, const QString& name);
+		int _findRow(int chunk, int64_t msecs);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		ArchiveReader(void);
+		~ArchiveReader(void);
+
+		/**********************************************************************\
+		|* Map the chunks of tier {type} in the archive at {dir}
+		\**********************************************************************/
+		bool open(const QString& dir, int type);
+
+		/**********************************************************************\
+		|* Unmap them
+		\**********************************************************************/
+		void close(void);
+
+		/**********************************************************************\
+		|* Number of chunks, the header of one, and the rows in it
+		\**********************************************************************/
+		int chunks(void);
+		const SpectrumArchive::ChunkHeader * header(int chunk);
+		int rows(int chunk);
+
+		/**********************************************************************\
+		|* The time and values of a row
+		\**********************************************************************/
+		int64_t msecs(int chunk, int row);
+		const float * values(int chunk, int row);
+
+		/**********************************************************************\
+		|* Find the first row at or after {msecs}. Returns false if there
+		|* isn't one
+		\**********************************************************************/
+		bool find(int64_t msecs, int& chunk, int& row);
+
+		/**********************************************************************\
+		|* Step to the next row, across chunks. Returns false at the end
+		\**********************************************************************/
+		bool next(int& chunk, int& row);
+	};
+
+#endif // ARCHIVEREADER_H
@@ -0,0 +1,386 @@
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+#include "calibrationcache.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+#define CALIBRATION_DIR		"/calibration"
+#define CALIBRATION_MAGIC	0x4c414352		// "RCAL"
+#define CALIBRATION_VERSION	1
+
+/******************************************************************************\
+|* The file header. 64 bytes, so the spectrum after it stays aligned
+\******************************************************************************/
+typedef struct
+	{
+	uint32_t	magic;					// CALIBRATION_MAGIC
+	uint16_t	version;				// CALIBRATION_VERSION
+	uint16_t	window;					// Config::WindowType
+	int32_t		bins;					// Floats following the header
+	int32_t		reserved;				// Zero
+	int64_t		frequency;				// Centre frequency in Hz
+	double		gain;					// Gain in dB, -1 = automatic
+	char		device[32];				// Driver and device id
+	} CalHeader;
+
+static_assert(sizeof(CalHeader) == 64, "Calibration header should be 64 bytes");
+
+/******************************************************************************\
+|* Key: the file a calibration is kept in
+\******************************************************************************/
+QString CalibrationCache::Key::fileName(void) const
+	{
+	QString level = (gain < 0) ? QString("auto") : QString::number(gain, 'f', 1);
+	return QString("%1_%2Hz_%3dB_%4_%5.cal")
+				.arg(device)
+				.arg(frequency)
+				.arg(level)
+				.arg(fftSize)
+				.arg(Config::windowName(window));
+	}
+
+/******************************************************************************\
+|* Key: compare
+\******************************************************************************/
+bool CalibrationCache::Key::operator==(const Key& other) const
+	{
+	return (device == other.device)
+		&& (frequency == other.frequency)
+		&& (gain == other.gain)
+		&& (fftSize == other.fftSize)
+		&& (window == other.window);
+	}
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+CalibrationCache::CalibrationCache(const QString& dir, int capacity)
+				 :Testable()
+				 ,_dir(dir)
+				 ,_capacity(capacity)
+				 ,_clock(0)
+	{
+	if (_dir.isEmpty())
+		_dir = Config::instance().saveDir() + CALIBRATION_DIR;
+	if (_capacity < 1)
+		_capacity = 1;
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+CalibrationCache::~CalibrationCache(void)
+	{
+	flush();
+	}
+
+/******************************************************************************\
+|* Find a calibration, mapping it if it isn't already
+\******************************************************************************/
+const float * CalibrationCache::lookup(const Key& key)
+	{
+	QString name = key.fileName();
+
+	auto it = _entries.find(name);
+	if (it != _entries.end())
+		{
+		it->used = ++_clock;
+		return it->data;
+		}
+
+	Entry entry;
+	if (!_map(key, entry))
+		return nullptr;
+
+	/**************************************************************************\
+	|* Make room by unmapping whatever's gone longest without a lookup
+	\**************************************************************************/
+	while (_entries.size() >= _capacity)
+		{
+		auto oldest = _entries.begin();
+		for (auto i = _entries.begin(); i != _entries.end(); ++i)
+			if (i->used < oldest->used)
+				oldest = i;
+		_unmap(*oldest);
+		_entries.erase(oldest);
+		}
+
+	entry.used = ++_clock;
+	_entries.insert(name, entry);
+	return entry.data;
+	}
+
+/******************************************************************************\
+|* Write a calibration. It goes to a temporary file first, so a mapping of
+|* the old one (here, or in another process) never sees it half-written
+\******************************************************************************/
+bool CalibrationCache::save(const Key& key, const float *data)
+	{
+	QString name	= key.fileName();
+	QString path	= _dir + "/" + name;
+	QString temp	= path + ".new";
+
+	if (!QDir().mkpath(_dir))
+		{
+		ERR << "Cannot create calibration directory" << _dir;
+		return false;
+		}
+
+	CalHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic		= CALIBRATION_MAGIC;
+	hdr.version		= CALIBRATION_VERSION;
+	hdr.window		= (uint16_t)key.window;
+	hdr.bins		= key.fftSize;
+	hdr.frequency	= key.frequency;
+	hdr.gain		= key.gain;
+	strncpy(hdr.device, qPrintable(key.device), sizeof(hdr.device) - 1);
+
+	QFile file(temp);
+	qint64 extent	= key.fftSize * (qint64)sizeof(float);
+	bool ok			= file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+				   && (file.write((const char *)&hdr, sizeof(hdr)) == sizeof(hdr))
+				   && (file.write((const char *)data, extent) == extent);
+	file.close();
+
+	/**************************************************************************\
+	|* Unmap the old one before it's replaced
+	\**************************************************************************/
+	auto it = _entries.find(name);
+	if (it != _entries.end())
+		{
+		_unmap(*it);
+		_entries.erase(it);
+		}
+
+	if (ok)
+		{
+		QFile::remove(path);
+		ok = QFile::rename(temp, path);
+		}
+
+	if (ok)
+		LOG << "Saved calibration" << name;
+	else
+		{
+		ERR << "Cannot write calibration" << path;
+		QFile::remove(temp);
+		}
+	return ok;
+	}
+
+/******************************************************************************\
+|* Unmap everything
+\******************************************************************************/
+void CalibrationCache::flush(void)
+	{
+	for (Entry& entry : _entries)
+		_unmap(entry);
+	_entries.clear();
+	}
+
+/******************************************************************************\
+|* How many are mapped
+\******************************************************************************/
+int CalibrationCache::resident(void)
+	{
+	return _entries.size();
+	}
+
+/******************************************************************************\
+|* Subtract one spectrum from another. Written so the compiler can vectorise
+|* it: no aliasing, no branches, unit stride
+\******************************************************************************/
+void CalibrationCache::subtract(float *data, const float *cal, int num)
+	{
+	float * __restrict dst			= data;
+	const float * __restrict src	= cal;
+
+	for (int i=0; i<num; i++)
+		dst[i] -= src[i];
+	}
+
+/******************************************************************************\
+|* Private method: map the file for a key, and check it is what it says
+\******************************************************************************/
+bool CalibrationCache::_map(const Key& key, Entry& entry)
+	{
+	QString path	= _dir + "/" + key.fileName();
+	qint64 extent	= sizeof(CalHeader) + key.fftSize * (qint64)sizeof(float);
+
+	if (!QFile::exists(path))
+		return false;
+
+	entry.file = new QFile(path);
+	entry.base = nullptr;
+	if (entry.file->open(QIODevice::ReadOnly) && (entry.file->size() == extent))
+		entry.base = entry.file->map(0, extent);
+
+	const CalHeader *hdr = reinterpret_cast<const CalHeader *>(entry.base);
+	if ((hdr == nullptr)
+	 || (hdr->magic != CALIBRATION_MAGIC)
+	 || (hdr->version != CALIBRATION_VERSION)
+	 || (hdr->bins != key.fftSize)
+	 || (hdr->window != (uint16_t)key.window)
+	 || (hdr->frequency != key.frequency)
+	 || (hdr->gain != key.gain)
+	 || (key.device != QString::fromLatin1(hdr->device)))
+		{
+		ERR << "Calibration" << path << "is not valid for its settings";
+		_unmap(entry);
+		return false;
+		}
+
+	entry.data	= reinterpret_cast<const float *>(entry.base + sizeof(CalHeader));
+	entry.bins	= hdr->bins;
+	LOG << "Mapped calibration" << key.fileName();
+	return true;
+	}
+
+/******************************************************************************\
+|* Private method: unmap an entry and close its file
+\******************************************************************************/
+void CalibrationCache::_unmap(Entry& entry)
+	{
+	if (entry.base != nullptr)
+		entry.file->unmap(entry.base);
+	delete entry.file;
+
+	entry.file	= nullptr;
+	entry.base	= nullptr;
+	entry.data	= nullptr;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int CalibrationCache::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * CalibrationCache::testClassName(void)
+	{
+	return "CalibrationCache";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult CalibrationCache::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkKeyed();
+		case 1:
+			return _checkEviction();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : somewhere to keep test calibrations
+\******************************************************************************/
+static QString _testDir(const char *name)
+	{
+	return QDir::tempPath() + QString("/rad-cal-%1-%2")
+									.arg(name)
+									.arg(QCoreApplication::applicationPid());
+	}
+
+/******************************************************************************\
+|* Test interface : a saved calibration should come back, values intact, for
+|* its own key. One differing only in gain, or in window, shouldn't find it.
+|* Subtracting it from itself should leave zeros
+\******************************************************************************/
+Testable::TestResult CalibrationCache::_checkKeyed(void)
+	{
+	CalibrationCache cache(_testDir("keyed"));
+	Key key = {"test-0", 1420406000, 40.0, 64, Config::W_HAMMING};
+
+	float values[64];
+	for (int i=0; i<64; i++)
+		values[i] = i * 0.25f;
+
+	bool ok				= cache.save(key, values);
+	const float *cal	= cache.lookup(key);
+	ok = ok && (cal != nullptr) && (memcmp(cal, values, sizeof(values)) == 0);
+
+	Key other	= key;
+	other.gain	= 30.0;
+	ok = ok && (cache.lookup(other) == nullptr);
+
+	other			= key;
+	other.window	= Config::W_BLACKMAN;
+	ok = ok && (cache.lookup(other) == nullptr);
+
+	if (ok)
+		{
+		subtract(values, cal, 64);
+		for (int i=0; i<64; i++)
+			ok = ok && (values[i] == 0.0f);
+		}
+
+	cache.flush();
+	QFile::remove(cache.dir() + "/" + key.fileName());
+	QDir().rmdir(cache.dir());
+
+	if (!ok)
+		ERR << "Keyed calibration lookup failed";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : with room for 2, looking up 3 should unmap the one used
+|* least recently, which should still be there to map again
+\******************************************************************************/
+Testable::TestResult CalibrationCache::_checkEviction(void)
+	{
+	CalibrationCache cache(_testDir("evict"), 2);
+	Key keys[3];
+	float values[16];
+
+	bool ok = true;
+	for (int k=0; k<3; k++)
+		{
+		keys[k] = {"test-0", 1420000000 + k * 1000000, -1, 16, Config::W_HANNING};
+		for (int i=0; i<16; i++)
+			values[i] = k;
+		ok = ok && cache.save(keys[k], values);
+		}
+
+	ok = ok && (cache.lookup(keys[0]) != nullptr)
+			&& (cache.lookup(keys[1]) != nullptr)
+			&& (cache.lookup(keys[0]) != nullptr)
+			&& (cache.lookup(keys[2]) != nullptr)
+			&& (cache.resident() == 2)
+			&& (cache._entries.contains(keys[0].fileName()))
+			&& (!cache._entries.contains(keys[1].fileName()));
+
+	const float *cal = cache.lookup(keys[1]);
+	ok = ok && (cal != nullptr) && (cal[15] == 1.0f) && (cache.resident() == 2);
+
+	cache.flush();
+	for (int k=0; k<3; k++)
+		QFile::remove(cache.dir() + "/" + keys[k].fileName());
+	QDir().rmdir(cache.dir());
+
+	if (!ok)
+		ERR << "Calibration cache holds" << cache.resident() << "entries";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,146 @@
+#ifndef CALIBRATIONCACHE_H
+#define CALIBRATIONCACHE_H
+
+#include <QMap>
+#include <QString>
+
+#include <libra.h>
+
+#include "config.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+/******************************************************************************\
+|* Calibration spectra, one per device, frequency, gain, FFT size and window,
+|* since a calibration taken under one set of those says little about any
+|* other. Each lives in a file of its own under {dir}, named for its key, as
+|* a 64-byte header followed by the float spectrum.
+|*
+|* Files are mapped rather than read, and the most recently used few stay
+|* mapped, so switching back to a recent setting costs a map lookup. The
+|* header repeats the key, so a file that's been renamed or truncated is
+|* refused rather than applied to the wrong spectrum.
+|*
+|* Not thread-safe: it belongs to the aggregator, and is only used there
+\******************************************************************************/
+class CalibrationCache : public Testable
+	{
+	NON_COPYABLE_NOR_MOVEABLE(CalibrationCache);
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef struct Key
+			{
+			QString				device;		// Driver and device id
+			int					frequency;	// Centre frequency in Hz
+			double				gain;		// Gain in dB, -1 = automatic
+			int					fftSize;	// Bins in the spectrum
+			Config::WindowType	window;		// FFT window function
+
+			QString fileName(void) const;
+			bool operator==(const Key& other) const;
+			} Key;
+
+		static const int DEFAULT_ENTRIES	= 8;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, dir);					// Where the calibrations are kept
+	GET(int, capacity);					// Most calibrations kept mapped
+
+	private:
+		/**********************************************************************\
+		|* A mapped calibration
+		\**********************************************************************/
+		typedef struct
+			{
+			QFile *			file;			// Open, and mapped
+			uchar *			base;			// Start of the mapping
+			const float *	data;			// The spectrum, after the header
+			int				bins;			// Values in the spectrum
+			uint64_t		used;			// When last looked up
+			} Entry;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QMap<QString, Entry>	_entries;		// Mapped, by file name
+		uint64_t				_clock;			// Orders the lookups
+
+		/**********************************************************************\
+		|* Private methods: map a file, and unmap an entry
+		\**********************************************************************/
+		bool _map(const Key& key, Entry& entry);
+		void _unmap(Entry& entry);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit CalibrationCache(const QString& dir = QString(),
+								  int capacity = DEFAULT_ENTRIES);
+		~CalibrationCache(void);
+
+		/**********************************************************************\
+		|* Return the calibration for {key}, or nullptr if there isn't one.
+		|* The pointer stays good until the entry is evicted or flushed, so
+		|* don't hold it across another lookup
+		\**********************************************************************/
+		const float * lookup(const Key& key);
+
+		/**********************************************************************\
+		|* Write the calibration for {key}, replacing any there was
+		\**********************************************************************/
+		bool save(const Key& key, const float *data);
+
+		/**********************************************************************\
+		|* Unmap everything, so the next lookups go back to the files
+		\**********************************************************************/
+		void flush(void);
+
+		/**********************************************************************\
+		|* Number of calibrations currently mapped
+		\**********************************************************************/
+		int resident(void);
+
+		/**********************************************************************\
+		|* Subtract {cal} from {data}, over {num} values
+		\**********************************************************************/
+		static void subtract(float *data, const float *cal, int num);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check a calibration comes back only for its own key
+		\**********************************************************************/
+		Testable::TestResult _checkKeyed(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check the least recently used entry is the one unmapped
+		\**********************************************************************/
+		Testable::TestResult _checkEviction(void);
+	};
+
+#endif // CALIBRATIONCACHE_H
@@ -0,0 +1,420 @@
+#include <new>
+
+#include <QDateTime>
+
+#include <libra.h>
+
+#include "clientqueue.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+ClientQueue::ClientQueue(Config::QueuePolicy policy,
+						 int maxMessages,
+						 int64_t maxInFlight)
+			:_policy(policy)
+			,_maxMessages((maxMessages < 1) ? 1 : maxMessages)
+			,_maxInFlight(maxInFlight)
+			,_inFlight(0)
+			,_sent(0)
+			,_dropped(0)
+			,_coalesced(0)
+			,_peakDepth(0)
+			,_strikes(0)
+			,_closing(false)
+			,_lastStrike(0)
+	{}
+
+/******************************************************************************\
+|* Queue a message
+\******************************************************************************/
+bool ClientQueue::push(int type, const QByteArray& msg, int channel)
+	{
+	int64_t now = QDateTime::currentMSecsSinceEpoch();
+
+	/**************************************************************************\
+	|* When coalescing, a newer message of the same type, from the same
+	|* channel, takes the place of the waiting one, so it goes out as soon as
+	|* that would have. A delta can't, since the waiting one is what it's a
+	|* delta from, so both go and the stream waits for a keyframe
+	\**************************************************************************/
+	if (_policy == Config::Q_COALESCE)
+		for (int i=0; i<_queue.size(); i++)
+			if ((_queue.at(i).type == type) && (_queue.at(i).channel == channel))
+				{
+				_dropped ++;
+				_strike(now);
+				if (!_isDelta(msg))
+					{
+					_queue[i].msg = msg;
+					_coalesced ++;
+					return true;
+					}
+
+				_queue.removeAt(i);
+				_dropped ++;
+				_discardDeltas(type, channel);
+				return true;
+				}
+
+	if (_queue.size() >= _maxMessages)
+		{
+		if (_policy == Config::Q_DISCONNECT)
+			return false;
+
+		Entry oldest = _queue.takeFirst();
+		_dropped ++;
+		_strike(now);
+		_discardDeltas(oldest.type, oldest.channel);
+		}
+
+	/**************************************************************************\
+	|* Nor is there any point queueing a delta for a lost stream. A keyframe
+	|* finds it again
+	\**************************************************************************/
+	Stream stream(type, channel);
+	if (_lost.contains(stream))
+		{
+		if (_isDelta(msg))
+			{
+			_dropped ++;
+			return true;
+			}
+		_lost.removeAll(stream);
+		}
+
+	_queue.append({type, channel, now, msg});
+	_peakDepth = (_queue.size() > _peakDepth) ? _queue.size() : _peakDepth;
+	return true;
+	}
+
+/******************************************************************************\
+|* Take the next message if the socket has room for it
+\******************************************************************************/
+bool ClientQueue::next(QByteArray& msg)
+	{
+	if (_queue.isEmpty() || (_inFlight >= _maxInFlight))
+		return false;
+
+	msg			= _queue.takeFirst().msg;
+	_inFlight  += msg.size();
+	_sent ++;
+	return true;
+	}
+
+/******************************************************************************\
+|* Return the streams lost since we were last asked
+\******************************************************************************/
+QList<ClientQueue::Stream> ClientQueue::takeLost(void)
+	{
+	QList<Stream> lost = _lost;
+	_lost.clear();
+	return lost;
+	}
+
+/******************************************************************************\
+|* Is a message delta-coded
+\******************************************************************************/
+bool ClientQueue::_isDelta(const QByteArray& msg)
+	{
+	if (msg.size() < (int)sizeof(Preamble))
+		return false;
+
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	return (hdr->flags & SpectrumCodec::ENC_DELTA) != 0;
+	}
+
+/******************************************************************************\
+|* A message of a stream has been discarded. The deltas after it go too, up
+|* to a keyframe, and without one the stream is lost
+\******************************************************************************/
+void ClientQueue::_discardDeltas(int type, int channel)
+	{
+	int i = 0;
+	while (i < _queue.size())
+		{
+		const Entry& entry = _queue.at(i);
+		if ((entry.type != type) || (entry.channel != channel))
+			i ++;
+		else if (!_isDelta(entry.msg))
+			return;
+		else
+			{
+			_queue.removeAt(i);
+			_dropped ++;
+			}
+		}
+
+	Stream stream(type, channel);
+	if (!_lost.contains(stream))
+		_lost.append(stream);
+	}
+
+/******************************************************************************\
+|* Count a strike. If there's been no discard for STRIKE_WINDOW, the client
+|* has been keeping up, so the earlier ones no longer count
+\******************************************************************************/
+void ClientQueue::_strike(int64_t now)
+	{
+	if (now - _lastStrike > STRIKE_WINDOW)
+		_strikes = 0;
+	_strikes ++;
+	_lastStrike = now;
+	}
+
+/******************************************************************************\
+|* Throw away what's waiting of some types. They count as dropped, but it's
+|* not the client's fault, so they aren't strikes
+\******************************************************************************/
+void ClientQueue::discard(uint32_t types)
+	{
+	for (int i=_queue.size()-1; i>=0; i--)
+		if (types & (1U << _queue.at(i).type))
+			{
+			_queue.removeAt(i);
+			_dropped ++;
+			}
+	}
+
+/******************************************************************************\
+|* Account for messages sent around the queue
+\******************************************************************************/
+void ClientQueue::charge(int messages, int64_t bytes)
+	{
+	_inFlight  += bytes;
+	_sent	   += messages;
+	}
+
+/******************************************************************************\
+|* The socket has written some bytes. Every frame was charged as it went, but
+|* the count includes the transport's framing, which wasn't, so don't let
+|* that take us below zero
+\******************************************************************************/
+void ClientQueue::written(int64_t bytes)
+	{
+	_inFlight -= bytes;
+	_inFlight  = (_inFlight < 0) ? 0 : _inFlight;
+	}
+
+/******************************************************************************\
+|* Messages waiting
+\******************************************************************************/
+int ClientQueue::depth(void) const
+	{
+	return _queue.size();
+	}
+
+/******************************************************************************\
+|* Age of the oldest waiting message
+\******************************************************************************/
+int64_t ClientQueue::lag(void) const
+	{
+	if (_queue.isEmpty())
+		return 0;
+	return QDateTime::currentMSecsSinceEpoch() - _queue.first().queuedAt;
+	}
+
+/******************************************************************************\
+|* Forget the strikes
+\******************************************************************************/
+void ClientQueue::clearStrikes(void)
+	{
+	_strikes = 0;
+	}
+
+/******************************************************************************\
+|* Describe the counters as JSON
+\******************************************************************************/
+QJsonObject ClientQueue::toJson(void) const
+	{
+	QJsonObject json;
+	json.insert("sent", (qint64)_sent);
+	json.insert("dropped", (qint64)_dropped);
+	json.insert("coalesced", (qint64)_coalesced);
+	json.insert("depth", depth());
+	json.insert("peakDepth", _peakDepth);
+	json.insert("inFlight", (qint64)_inFlight);
+	json.insert("lagMs", (qint64)lag());
+	return json;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int ClientQueue::numTests(void)
+	{
+	return 3;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * ClientQueue::testClassName(void)
+	{
+	return "ClientQueue";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult ClientQueue::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkDropOldest();
+		case 1:
+			return _checkCoalesceAndDisconnect();
+		case 2:
+			return _checkDeltaLoss();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : a 64-byte message tagged with a number
+\******************************************************************************/
+static QByteArray _tagged(int tag)
+	{
+	return QByteArray(64, (char)tag);
+	}
+
+/******************************************************************************\
+|* Test helper : a message of a type, delta-coded or not
+\******************************************************************************/
+static QByteArray _coded(int type, bool isDelta)
+	{
+	QByteArray msg(sizeof(Preamble), 0);
+	Preamble *hdr	= new (msg.data()) Preamble();
+	hdr->type		= type;
+	hdr->flags		= SpectrumCodec::ENC_U8
+					| (isDelta ? SpectrumCodec::ENC_DELTA : 0);
+	return msg;
+	}
+
+/******************************************************************************\
+|* Test interface : with room for 100 bytes in flight, two 64-byte messages
+|* get to the socket. Of the next 8, only the last 4 should survive, and they
+|* should start flowing again once the socket catches up. The 4 strikes are
+|* forgotten if the next discard comes after a quiet spell
+\******************************************************************************/
+Testable::TestResult ClientQueue::_checkDropOldest(void)
+	{
+	ClientQueue queue(Config::Q_DROP_OLDEST, 4, 100);
+	QByteArray msg;
+	int sent = 0;
+
+	for (int i=0; i<10; i++)
+		{
+		queue.push(TYPE_UPDATE, _tagged(i));
+		while (queue.next(msg))
+			sent ++;
+		}
+
+	if ((sent != 2) || (queue.depth() != 4) || (queue.dropped() != 4))
+		{
+		ERR << "Stalled queue sent" << sent << "holds" << queue.depth()
+			<< "dropped" << queue.dropped();
+		return Testable::TEST_FAIL;
+		}
+
+	queue.written(128);
+	if (!queue.next(msg) || (msg[0] != 6))
+		{
+		ERR << "Queue didn't resume with the oldest survivor";
+		return Testable::TEST_FAIL;
+		}
+
+	bool ok = (queue.strikes() == 4);
+	queue._lastStrike -= STRIKE_WINDOW + 1;
+	queue.push(TYPE_UPDATE, _tagged(10));
+	queue.push(TYPE_UPDATE, _tagged(11));
+	ok = ok && (queue.strikes() == 1);
+	if (!ok)
+		ERR << "Queue has" << queue.strikes() << "strikes after a quiet spell";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : coalescing should leave one of each type, holding the
+|* latest, and a full disconnect-policy queue should refuse more
+\******************************************************************************/
+Testable::TestResult ClientQueue::_checkCoalesceAndDisconnect(void)
+	{
+	ClientQueue queue(Config::Q_COALESCE, 4, 64);
+	QByteArray msg;
+
+	queue.push(TYPE_LIVE, _tagged(0));
+	queue.next(msg);
+
+	queue.push(TYPE_UPDATE, _tagged(1));
+	queue.push(TYPE_SAMPLE, _tagged(2));
+	queue.push(TYPE_UPDATE, _tagged(3));
+
+	if ((queue.depth() != 2) || (queue.coalesced() != 1))
+		{
+		ERR << "Coalescing queue holds" << queue.depth();
+		return Testable::TEST_FAIL;
+		}
+
+	queue.written(64);
+	if (!queue.next(msg) || (msg[0] != 3))
+		{
+		ERR << "Coalescing queue didn't keep the latest update";
+		return Testable::TEST_FAIL;
+		}
+
+	ClientQueue strict(Config::Q_DISCONNECT, 2, 0);
+	bool ok = strict.push(TYPE_UPDATE, _tagged(0))
+		   && strict.push(TYPE_UPDATE, _tagged(1))
+		   && !strict.push(TYPE_UPDATE, _tagged(2));
+	if (!ok)
+		ERR << "Disconnect policy didn't refuse a full queue";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a stalled queue holding an update keyframe, two update
+|* deltas and a live spectrum is full, so the next update drops the keyframe.
+|* Its deltas, and the new one, are no use without it, leaving just the live
+|* one and the updates lost until a keyframe comes. Coalescing a delta should
+|* lose its stream the same way
+\******************************************************************************/
+Testable::TestResult ClientQueue::_checkDeltaLoss(void)
+	{
+	ClientQueue queue(Config::Q_DROP_OLDEST, 4, 0);
+	queue.push(TYPE_UPDATE, _coded(TYPE_UPDATE, false));
+	queue.push(TYPE_UPDATE, _coded(TYPE_UPDATE, true));
+	queue.push(TYPE_UPDATE, _coded(TYPE_UPDATE, true));
+	queue.push(TYPE_LIVE, _coded(TYPE_LIVE, false));
+	queue.push(TYPE_UPDATE, _coded(TYPE_UPDATE, true));
+
+	QList<Stream> lost = queue.takeLost();
+	bool ok = (queue.depth() == 1) && (queue.dropped() == 4)
+		   && (lost.size() == 1) && (lost.at(0) == Stream(TYPE_UPDATE, 0))
+		   && queue.takeLost().isEmpty();
+
+	queue.push(TYPE_UPDATE, _coded(TYPE_UPDATE, false), 0);
+	ok = ok && (queue.depth() == 2);
+
+	ClientQueue coalesce(Config::Q_COALESCE, 4, 0);
+	coalesce.push(TYPE_LIVE, _coded(TYPE_LIVE, true), 3);
+	coalesce.push(TYPE_LIVE, _coded(TYPE_LIVE, true), 3);
+	lost = coalesce.takeLost();
+	ok = ok && (coalesce.depth() == 0)
+			&& (lost.size() == 1) && (lost.at(0) == Stream(TYPE_LIVE, 3));
+
+	if (!ok)
+		ERR << "Delta loss left" << queue.depth() << "queued and"
+			<< coalesce.depth() << "coalesced";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,194 @@
+#ifndef CLIENTQUEUE_H
+#define CLIENTQUEUE_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QPair>
+
+#include <libra.h>
+
+#include "config.h"
+
+/******************************************************************************\
+|* The outbound queue for one client. Messages are only handed to the socket
+|* while it has fewer than {maxInFlight} bytes unwritten - the socket reports
+|* progress via bytesWritten() - and the rest wait here. Once {maxMessages}
+|* are waiting, the policy decides what gives:
+|*
+|*	- drop-oldest:	the oldest waiting message is discarded
+|*	- coalesce:		a new message replaces any waiting one of the same type
+|*					and channel, so the client only ever gets the latest of
+|*					each
+|*	- disconnect:	push() fails, and the caller drops the client
+|*
+|* Messages are the shared QByteArrays that MsgIO renders once per view, so
+|* queueing them costs a reference, not a copy. Every message discarded is a
+|* strike, which MsgIO uses to decide when to demote the client to a cheaper
+|* subscription. Strikes are forgiven after {STRIKE_WINDOW} with no discards,
+|* so only a client that's falling behind now gets demoted, not one that's
+|* had the odd burst over the hours.
+|*
+|* A delta-coded message is no use without the one before it, so discarding
+|* one also discards the deltas queued after it, up to the next keyframe. If
+|* there isn't one, the stream is lost until MsgIO sends it a fresh keyframe
+\******************************************************************************/
+class ClientQueue : public Testable
+	{
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef QPair<int, int> Stream;	// Type and channel
+
+		static const int64_t STRIKE_WINDOW	= 60000;	// msecs to forgive in
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(Config::QueuePolicy, policy);	// What to do when full
+	GET(int, maxMessages);				// Messages we'll hold
+	GET(int64_t, maxInFlight);			// Unwritten bytes in the socket
+	GET(int64_t, inFlight);				// Bytes handed over, not written
+	GET(uint64_t, sent);				// Messages handed to the socket
+	GET(uint64_t, dropped);				// Messages discarded
+	GET(uint64_t, coalesced);			// ... of which replaced by newer
+	GET(int, peakDepth);				// Most messages ever waiting
+	GET(int, strikes);					// Recent discards, see STRIKE_WINDOW
+	GETSET(bool, closing, Closing);		// Client is being disconnected
+
+	private:
+		/**********************************************************************\
+		|* A waiting message
+		\**********************************************************************/
+		typedef struct
+			{
+			int			type;			// PreambleType of the message
+			int			channel;		// ... and the channel it's from
+			int64_t		queuedAt;		// msecs since epoch
+			QByteArray	msg;			// The shared message
+			} Entry;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QList<Entry>	_queue;			// Messages waiting for the socket
+		QList<Stream>	_lost;			// Need a keyframe to carry on
+		int64_t			_lastStrike;	// msecs since epoch
+
+		/**********************************************************************\
+		|* Is a message delta-coded, ie: useless without the previous one
+		\**********************************************************************/
+		static bool _isDelta(const QByteArray& msg);
+
+		/**********************************************************************\
+		|* A message of this stream has gone, so drop the deltas that followed
+		|* it and, failing a keyframe, mark the stream lost
+		\**********************************************************************/
+		void _discardDeltas(int type, int channel);
+
+		/**********************************************************************\
+		|* Count a strike, forgetting the old ones if it's been a while
+		\**********************************************************************/
+		void _strike(int64_t now);
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		explicit ClientQueue(Config::QueuePolicy policy = Config::Q_DROP_OLDEST,
+							 int maxMessages = 8,
+							 int64_t maxInFlight = 1 << 20);
+
+		/**********************************************************************\
+		|* Queue a message of a type, from a channel. Returns false if the
+		|* client should be dropped
+		\**********************************************************************/
+		bool push(int type, const QByteArray& msg, int channel = 0);
+
+		/**********************************************************************\
+		|* Take the next message if the socket has room for it
+		\**********************************************************************/
+		bool next(QByteArray& msg);
+
+		/**********************************************************************\
+		|* Return, and forget, the streams lost since the last call. The next
+		|* message queued for each has to be a keyframe
+		\**********************************************************************/
+		QList<Stream> takeLost(void);
+
+		/**********************************************************************\
+		|* Throw away whatever's waiting of the types in {types}, a bitmask of
+		|* (1 << PreambleType), eg: when a replay is about to replace it
+		\**********************************************************************/
+		void discard(uint32_t types);
+
+		/**********************************************************************\
+		|* Account for messages handed to the socket without going through
+		|* the queue, eg: a history replay or a reply. They hold back what's
+		|* queued until written, like anything else in flight. Everything
+		|* written to the socket has to be charged, here or by next()
+		\**********************************************************************/
+		void charge(int messages, int64_t bytes);
+
+		/**********************************************************************\
+		|* The socket has written some bytes
+		\**********************************************************************/
+		void written(int64_t bytes);
+
+		/**********************************************************************\
+		|* Messages waiting, and the age of the oldest in msecs
+		\**********************************************************************/
+		int depth(void) const;
+		int64_t lag(void) const;
+
+		/**********************************************************************\
+		|* Forget the strikes, once the client has been dealt with
+		\**********************************************************************/
+		void clearStrikes(void);
+
+		/**********************************************************************\
+		|* Describe the counters as JSON
+		\**********************************************************************/
+		QJsonObject toJson(void) const;
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check a stalled socket drops the oldest and resumes, and
+		|* strikes are forgiven after a quiet spell
+		\**********************************************************************/
+		Testable::TestResult _checkDropOldest(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check coalescing keeps the latest, and disconnect trips
+		\**********************************************************************/
+		Testable::TestResult _checkCoalesceAndDisconnect(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check dropping a delta takes its followers with it, and
+		|* the stream is reported lost
+		\**********************************************************************/
+		Testable::TestResult _checkDeltaLoss(void);
+	};
+
+#endif // CLIENTQUEUE_H
@@ -26,22 +26,84 @@
 #define DRIVER_KEY			"filter-driver"
 #define MODEL_KEY			"filter-model"
 #define ID_KEY				"filter-id"
+#define IDS_KEY				"filter-ids"
 #define ANTENNA_KEY			"antenna"
 
 #define BANDWIDTH_KEY		"bandwidth"
 #define FREQUENCY_KEY		"frequency"
+#define FREQUENCY_B_KEY		"frequency-b"
 #define GAIN_KEY			"gain"
 #define SAMPLE_RATE_KEY		"sample-rate"
+#define SYNTH_SIGNALS_KEY	"synth-signals"
+#define SYNTH_FORMAT_KEY	"synth-format"
+#define RTL_LATENCY_KEY		"rtl-latency"
+#define SWEEP_FROM_KEY		"sweep-from"
+#define SWEEP_TO_KEY		"sweep-to"
+#define SWEEP_DWELL_KEY		"sweep-dwell"
+#define SWEEP_SETTLE_KEY	"sweep-settle"
+
+#define DEFAULT_SYNTH_SIGNALS	"noise:-30,tone:250000:-40,chirp:-500000:500000:20:-45,pulse:0.001:2:-20"
+#define DEFAULT_SYNTH_FORMAT	"s8c"
+#define DEFAULT_RTL_LATENCY		"50"
+#define DEFAULT_SWEEP_DWELL		"0.25"
+#define DEFAULT_SWEEP_SETTLE	"10"
 
 #define FFT_WINDOW_TYPE_KEY	"fft-window-type"
 #define FFT_SIZE_KEY		"fft-size"
 #define UPDATE_TIME_KEY		"fft-update-time"
 #define SAMPLE_TIME_KEY		"fft-sample-time"
+#define RFI_SIGMA_KEY		"rfi-sigma"
+#define RFI_FRAMES_KEY		"rfi-frames"
+#define LIVE_MODE_KEY		"live-mode"
+#define LIVE_FRAMES_KEY		"live-frames"
+#define LIVE_RATE_KEY		"live-rate"
+#define CORRELATE_KEY		"correlate"
+#define SWEEP_CROP_KEY		"sweep-crop"
 
 #define DEFAULT_FFT_SIZE	"1024"
+#define DEFAULT_RFI_SIGMA	"4"
+#define DEFAULT_RFI_FRAMES	"128"
+#define DEFAULT_LIVE_MODE	"window"
+#define DEFAULT_LIVE_FRAMES	"2048"
+#define DEFAULT_LIVE_RATE	"10"
+#define DEFAULT_SWEEP_CROP	"0.25"
 
 #define NET_PORT_KEY		"network-port"
+#define STREAM_PORT_KEY		"stream-port"
+#define STREAM_SOCKET_KEY	"stream-socket"
+#define STREAM_NODELAY_KEY	"stream-nodelay"
+#define MCAST_GROUP_KEY		"multicast-group"
+#define MCAST_PORT_KEY		"multicast-port"
+#define MCAST_TTL_KEY		"multicast-ttl"
+#define MCAST_PAYLOAD_KEY	"multicast-payload"
+#define MCAST_ENCODING_KEY	"multicast-encoding"
+#define METRICS_PORT_KEY	"metrics-port"
+#define CLIENT_POLICY_KEY	"client-policy"
+#define CLIENT_QUEUE_KEY	"client-queue"
+#define CLIENT_FLIGHT_KEY	"client-inflight"
+#define REPLAY_UPDATES_KEY	"replay-updates"
+#define REPLAY_SAMPLES_KEY	"replay-samples"
+
+#define DEFAULT_STREAM_PORT	"5418"
+#define DEFAULT_MCAST_PORT	"5419"
+#define DEFAULT_MCAST_TTL	"1"
+#define DEFAULT_MCAST_BYTES	"1400"
+#define DEFAULT_POLICY		"drop-oldest"
+#define DEFAULT_QUEUE		"8"
+#define DEFAULT_FLIGHT		"1048576"
+#define DEFAULT_REPLAY_UPD	"120"
+#define DEFAULT_REPLAY_SMP	"288"
 #define SAVE_DIR_KEY		"save-dir"
+#define ARCHIVE_DIR_KEY		"archive-dir"
+#define IQ_DIR_KEY			"iq-dir"
+#define IQ_RETENTION_KEY	"iq-retention"
+#define IQ_SEGMENTS_KEY		"iq-segments"
+#define PLAY_FILE_KEY		"play-file"
+#define PLAY_SPEED_KEY		"play-speed"
+
+#define DEFAULT_IQ_RETAIN	"60"
+#define DEFAULT_IQ_SEGMENTS	"6"
+#define DEFAULT_PLAY_SPEED	"1"
 
 /******************************************************************************\
 |* These are the commandline args we're managing
@@ -59,6 +121,36 @@ Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_saveDir,
 		({"d", SAVE_DIR_KEY}, "Directory to store data to", "~/.rad"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_archiveDir,
+		(ARCHIVE_DIR_KEY, "Directory to archive updates and samples to (empty = off)", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_iqDir,
+		(IQ_DIR_KEY, "Directory to record raw IQ to (empty = off)", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_iqRetention,
+		(IQ_RETENTION_KEY, "Seconds of raw IQ to keep", DEFAULT_IQ_RETAIN))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_iqSegments,
+		(IQ_SEGMENTS_KEY, "Files the raw IQ ring is split over", DEFAULT_IQ_SEGMENTS))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_playFile,
+		(PLAY_FILE_KEY, "Raw or SigMF IQ recording to use instead of a radio", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_playSpeed,
+		(PLAY_SPEED_KEY, "Times real time to play at (0 = as fast as possible)", DEFAULT_PLAY_SPEED))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_clientInFlight,
+		(CLIENT_FLIGHT_KEY, "Unsent bytes allowed per client socket", DEFAULT_FLIGHT))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_clientPolicy,
+		(CLIENT_POLICY_KEY, "Slow clients: drop-oldest, coalesce or disconnect", DEFAULT_POLICY))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_clientQueue,
+		(CLIENT_QUEUE_KEY, "Messages queued per client before the policy applies", DEFAULT_QUEUE))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_correlate,
+		(CORRELATE_KEY, "Cross-correlate the two streams of a dual-tuner source"))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_driverFilter,
 		(DRIVER_KEY, "Filter for the driver name", "rtlsdr"))
@@ -68,9 +160,15 @@ Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_idFilter,
 		(ID_KEY, "Filter for the device-id", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_idsFilter,
+		(IDS_KEY, "Device-ids to run together, eg: 0,1,2 (overrides filter-id)", ""))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_frequency,
 		({"f", "frequency"}, "Center-frequencty to tune to", "1420406000"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_frequencyB,
+		(FREQUENCY_B_KEY, "Center-frequency for tuner B in RSPduo dual-tuner mode (default: as A)", "0"))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_fftSize,
 		({"n", "fft-num-bins"}, "Size of the FFT in bins", DEFAULT_FFT_SIZE))
@@ -80,12 +178,86 @@ Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_gain,
 		({"g", "gain"}, "Gain to apply"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_liveFrames,
+		(LIVE_FRAMES_KEY, "FFT frames spanned by the live average", DEFAULT_LIVE_FRAMES))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_liveMode,
+		(LIVE_MODE_KEY, "Live average: none, ema or window", DEFAULT_LIVE_MODE))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_liveRate,
+		(LIVE_RATE_KEY, "Live updates to send per second", DEFAULT_LIVE_RATE))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_mcastEncoding,
+		(MCAST_ENCODING_KEY, "Multicast wire format: f32, f16, u16 or u8", "f32"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_mcastGroup,
+		(MCAST_GROUP_KEY, "Multicast group to publish to (empty = off)", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_mcastPayload,
+		(MCAST_PAYLOAD_KEY, "Message bytes per multicast datagram", DEFAULT_MCAST_BYTES))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_mcastPort,
+		(MCAST_PORT_KEY, "Multicast UDP port", DEFAULT_MCAST_PORT))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_mcastTtl,
+		(MCAST_TTL_KEY, "Multicast time-to-live (router hops)", DEFAULT_MCAST_TTL))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_metricsPort,
+		(METRICS_PORT_KEY, "HTTP port serving /metrics (0 = off)", "0"))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_networkPort,
 		({"p", "network-port"}, "Network port to communicate over", "5417"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_replaySamples,
+		(REPLAY_SAMPLES_KEY, "Samples kept to replay to new clients (0 = none)", DEFAULT_REPLAY_SMP))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_replayUpdates,
+		(REPLAY_UPDATES_KEY, "Updates kept to replay to new clients (0 = none)", DEFAULT_REPLAY_UPD))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_rfiSigma,
+		(RFI_SIGMA_KEY, "RFI-excision threshold (std-devs, 0=off)", DEFAULT_RFI_SIGMA))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_rfiFrames,
+		(RFI_FRAMES_KEY, "FFT frames per RFI sub-integration", DEFAULT_RFI_FRAMES))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_rtlLatency,
+		(RTL_LATENCY_KEY, "RTL-SDR milliseconds per USB transfer (0 = driver default)", DEFAULT_RTL_LATENCY))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_sampleRate,
 		({"s", "sample-rate"}, "Baseband Sample rate", "2048000"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_streamDelay,
+		("stream-delay", "Let TCP stream clients batch small writes (no TCP_NODELAY)"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_streamPort,
+		(STREAM_PORT_KEY, "Plain TCP stream port (0 = off)", DEFAULT_STREAM_PORT))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_streamSocket,
+		(STREAM_SOCKET_KEY, "Unix-domain stream socket path (empty = off)", ""))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_sweepCrop,
+		(SWEEP_CROP_KEY, "Fraction of each sweep hop's spectrum trimmed from its edges", DEFAULT_SWEEP_CROP))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_sweepDwell,
+		(SWEEP_DWELL_KEY, "Seconds to integrate at each sweep hop", DEFAULT_SWEEP_DWELL))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_sweepFrom,
+		(SWEEP_FROM_KEY, "Frequency to sweep from (0 = no sweep)", "0"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_sweepSettle,
+		(SWEEP_SETTLE_KEY, "Milliseconds of samples dropped after each sweep hop", DEFAULT_SWEEP_SETTLE))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_sweepTo,
+		(SWEEP_TO_KEY, "Frequency to sweep to", "0"))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_synthFormat,
+		(SYNTH_FORMAT_KEY, "Synthetic source sample format: s8c or s16c", DEFAULT_SYNTH_FORMAT))
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_synthSignals,
+		(SYNTH_SIGNALS_KEY, "Synthetic source signals, eg: noise:dB,tone:Hz:dB,"
+							"chirp:fromHz:toHz:secs:dB,pulse:secs:everySecs:dB",
+		 DEFAULT_SYNTH_SIGNALS))
 Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_timeSample,
 		({"t", "time-between-samples"}, "Time to aggregate data over", "300"))
@@ -132,14 +304,24 @@ Config::Config()
 	{
 	_parser.setApplicationDescription("RASCAL daemon");
 	_parser.addOption(*_antenna);
+	_parser.addOption(*_archiveDir);
 	_parser.addOption(*_bandwidth);
 	_parser.addOption(*_saveDir);
+	_parser.addOption(*_clientInFlight);
+	_parser.addOption(*_clientPolicy);
+	_parser.addOption(*_clientQueue);
+	_parser.addOption(*_correlate);
 	_parser.addOption(*_driverFilter);
 	_parser.addOption(*_idFilter);
+	_parser.addOption(*_idsFilter);
 	_parser.addOption(*_frequency);
+	_parser.addOption(*_frequencyB);
 	_parser.addOption(*_fftSize);
 	_parser.addOption(*_gain);
 	_parser.addOption(*_help);
+	_parser.addOption(*_iqDir);
+	_parser.addOption(*_iqRetention);
+	_parser.addOption(*_iqSegments);
 	_parser.addOption(*_listAllInfo);
 	_parser.addOption(*_listAntennas);
 	_parser.addOption(*_listChannels);
@@ -148,9 +330,35 @@ Config::Config()
 	_parser.addOption(*_listGains);
 	_parser.addOption(*_listNativeFormat);
 	_parser.addOption(*_listSampleRates);
+	_parser.addOption(*_liveFrames);
+	_parser.addOption(*_liveMode);
+	_parser.addOption(*_liveRate);
+	_parser.addOption(*_mcastEncoding);
+	_parser.addOption(*_mcastGroup);
+	_parser.addOption(*_mcastPayload);
+	_parser.addOption(*_mcastPort);
+	_parser.addOption(*_mcastTtl);
+	_parser.addOption(*_metricsPort);
 	_parser.addOption(*_modeFilter);
 	_parser.addOption(*_networkPort);
+	_parser.addOption(*_playFile);
+	_parser.addOption(*_playSpeed);
+	_parser.addOption(*_replaySamples);
+	_parser.addOption(*_replayUpdates);
+	_parser.addOption(*_rfiFrames);
+	_parser.addOption(*_rfiSigma);
+	_parser.addOption(*_rtlLatency);
 	_parser.addOption(*_sampleRate);
+	_parser.addOption(*_streamDelay);
+	_parser.addOption(*_streamPort);
+	_parser.addOption(*_streamSocket);
+	_parser.addOption(*_sweepCrop);
+	_parser.addOption(*_sweepDwell);
+	_parser.addOption(*_sweepFrom);
+	_parser.addOption(*_sweepSettle);
+	_parser.addOption(*_sweepTo);
+	_parser.addOption(*_synthFormat);
+	_parser.addOption(*_synthSignals);
 	_parser.addOption(*_test);
 	_parser.addOption(*_timeSample);
 	_parser.addOption(*_timeUpdate);
@@ -205,6 +413,66 @@ QString Config::saveDir(void)
 	return dir;
 	}
 
+/******************************************************************************\
+|* Get the directory to archive spectra to, empty if we're not archiving
+\******************************************************************************/
+QString Config::archiveDir(void)
+	{
+	if (_parser.isSet(*_archiveDir))
+		return _parser.value(*_archiveDir);
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString dir = s.value(ARCHIVE_DIR_KEY, "").toString();
+	s.endGroup();
+	return dir;
+	}
+
+/******************************************************************************\
+|* Get the directory to record raw IQ to, empty if we're not recording
+\******************************************************************************/
+QString Config::iqDir(void)
+	{
+	if (_parser.isSet(*_iqDir))
+		return _parser.value(*_iqDir);
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString dir = s.value(IQ_DIR_KEY, "").toString();
+	s.endGroup();
+	return dir;
+	}
+
+/******************************************************************************\
+|* Get the number of seconds of raw IQ to keep
+\******************************************************************************/
+double Config::iqRetention(void)
+	{
+	if (_parser.isSet(*_iqRetention))
+		return _parser.value(*_iqRetention).toDouble();
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString secs = s.value(IQ_RETENTION_KEY, DEFAULT_IQ_RETAIN).toString();
+	s.endGroup();
+	return secs.toDouble();
+	}
+
+/******************************************************************************\
+|* Get the number of files to split the raw IQ ring over
+\******************************************************************************/
+int Config::iqSegments(void)
+	{
+	if (_parser.isSet(*_iqSegments))
+		return _parser.value(*_iqSegments).toInt();
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString num = s.value(IQ_SEGMENTS_KEY, DEFAULT_IQ_SEGMENTS).toString();
+	s.endGroup();
+	return num.toInt();
+	}
+
 /******************************************************************************\
 |* Get the antenna to use, as a string so it can be an index or a name-substring
 \******************************************************************************/
@@ -386,6 +654,323 @@ int Config::fftSize(void)
 	return rate.toInt();
 	}
 
+/******************************************************************************\
+|* Get the RFI-excision threshold
+\******************************************************************************/
+double Config::rfiSigma(void)
+	{
+	if (_parser.isSet(*_rfiSigma))
+		return _parser.value(*_rfiSigma).toDouble();
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	QString sigma = s.value(RFI_SIGMA_KEY, DEFAULT_RFI_SIGMA).toString();
+	s.endGroup();
+	return sigma.toDouble();
+	}
+
+/******************************************************************************\
+|* Get the number of frames per RFI sub-integration
+\******************************************************************************/
+int Config::rfiFrames(void)
+	{
+	if (_parser.isSet(*_rfiFrames))
+		return _parser.value(*_rfiFrames).toInt();
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	QString frames = s.value(RFI_FRAMES_KEY, DEFAULT_RFI_FRAMES).toString();
+	s.endGroup();
+	return frames.toInt();
+	}
+
+/******************************************************************************\
+|* Get how the live average is computed
+\******************************************************************************/
+Config::LiveMode Config::liveMode(void)
+	{
+	QString mode = "";
+	if (_parser.isSet(*_liveMode))
+		mode = _parser.value(*_liveMode);
+	else
+		{
+		QSettings s;
+		s.beginGroup(DSP_GROUP);
+		mode = s.value(LIVE_MODE_KEY, DEFAULT_LIVE_MODE).toString();
+		s.endGroup();
+		}
+
+	QMap<QString,Config::LiveMode> map =
+		{
+			{"none", Config::L_NONE},
+			{"ema", Config::L_EMA},
+			{"window", Config::L_WINDOW},
+		};
+
+	QString key = mode.toLower();
+	if (map.contains(key))
+		return map[key];
+
+	qWarning() << "Unknown live mode " << key << " - using window";
+	return Config::L_WINDOW;
+	}
+
+/******************************************************************************\
+|* Get the number of frames spanned by the live average
+\******************************************************************************/
+int Config::liveFrames(void)
+	{
+	if (_parser.isSet(*_liveFrames))
+		return _parser.value(*_liveFrames).toInt();
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	QString frames = s.value(LIVE_FRAMES_KEY, DEFAULT_LIVE_FRAMES).toString();
+	s.endGroup();
+	return frames.toInt();
+	}
+
+/******************************************************************************\
+|* Get the rate at which to push live updates
+\******************************************************************************/
+double Config::liveRate(void)
+	{
+	if (_parser.isSet(*_liveRate))
+		return _parser.value(*_liveRate).toDouble();
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	QString rate = s.value(LIVE_RATE_KEY, DEFAULT_LIVE_RATE).toString();
+	s.endGroup();
+	return rate.toDouble();
+	}
+
+/******************************************************************************\
+|* Get the plain TCP stream port
+\******************************************************************************/
+int Config::streamPort(void)
+	{
+	if (_parser.isSet(*_streamPort))
+		return _parser.value(*_streamPort).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString port = s.value(STREAM_PORT_KEY, DEFAULT_STREAM_PORT).toString();
+	s.endGroup();
+	return port.toInt();
+	}
+
+/******************************************************************************\
+|* Get the Unix-domain stream socket path
+\******************************************************************************/
+QString Config::streamSocket(void)
+	{
+	if (_parser.isSet(*_streamSocket))
+		return _parser.value(*_streamSocket);
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString path = s.value(STREAM_SOCKET_KEY, "").toString();
+	s.endGroup();
+	return path;
+	}
+
+/******************************************************************************\
+|* Get whether stream clients have Nagle turned off
+\******************************************************************************/
+bool Config::streamNoDelay(void)
+	{
+	if (_parser.isSet(*_streamDelay))
+		return false;
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	bool noDelay = s.value(STREAM_NODELAY_KEY, true).toBool();
+	s.endGroup();
+	return noDelay;
+	}
+
+/******************************************************************************\
+|* Get the multicast group
+\******************************************************************************/
+QString Config::multicastGroup(void)
+	{
+	if (_parser.isSet(*_mcastGroup))
+		return _parser.value(*_mcastGroup);
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString group = s.value(MCAST_GROUP_KEY, "").toString();
+	s.endGroup();
+	return group;
+	}
+
+/******************************************************************************\
+|* Get the multicast port
+\******************************************************************************/
+int Config::multicastPort(void)
+	{
+	if (_parser.isSet(*_mcastPort))
+		return _parser.value(*_mcastPort).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString port = s.value(MCAST_PORT_KEY, DEFAULT_MCAST_PORT).toString();
+	s.endGroup();
+	return port.toInt();
+	}
+
+/******************************************************************************\
+|* Get the multicast time-to-live
+\******************************************************************************/
+int Config::multicastTtl(void)
+	{
+	if (_parser.isSet(*_mcastTtl))
+		return _parser.value(*_mcastTtl).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString ttl = s.value(MCAST_TTL_KEY, DEFAULT_MCAST_TTL).toString();
+	s.endGroup();
+	return ttl.toInt();
+	}
+
+/******************************************************************************\
+|* Get the message bytes per multicast datagram
+\******************************************************************************/
+int Config::multicastPayload(void)
+	{
+	if (_parser.isSet(*_mcastPayload))
+		return _parser.value(*_mcastPayload).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString bytes = s.value(MCAST_PAYLOAD_KEY, DEFAULT_MCAST_BYTES).toString();
+	s.endGroup();
+	return bytes.toInt();
+	}
+
+/******************************************************************************\
+|* Get the multicast wire format
+\******************************************************************************/
+QString Config::multicastEncoding(void)
+	{
+	if (_parser.isSet(*_mcastEncoding))
+		return _parser.value(*_mcastEncoding).toLower();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString encoding = s.value(MCAST_ENCODING_KEY, "f32").toString().toLower();
+	s.endGroup();
+	return encoding;
+	}
+
+/******************************************************************************\
+|* Get the HTTP metrics port
+\******************************************************************************/
+int Config::metricsPort(void)
+	{
+	if (_parser.isSet(*_metricsPort))
+		return _parser.value(*_metricsPort).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString port = s.value(METRICS_PORT_KEY, "0").toString();
+	s.endGroup();
+	return port.toInt();
+	}
+
+/******************************************************************************\
+|* Get what to do with a client that can't keep up
+\******************************************************************************/
+Config::QueuePolicy Config::clientPolicy(void)
+	{
+	QString policy = "";
+	if (_parser.isSet(*_clientPolicy))
+		policy = _parser.value(*_clientPolicy);
+	else
+		{
+		QSettings s;
+		s.beginGroup(NETWORK_GROUP);
+		policy = s.value(CLIENT_POLICY_KEY, DEFAULT_POLICY).toString();
+		s.endGroup();
+		}
+
+	QMap<QString,Config::QueuePolicy> map =
+		{
+			{"drop-oldest", Config::Q_DROP_OLDEST},
+			{"coalesce", Config::Q_COALESCE},
+			{"disconnect", Config::Q_DISCONNECT},
+		};
+
+	QString key = policy.toLower();
+	if (map.contains(key))
+		return map[key];
+
+	qWarning() << "Unknown client policy " << key << " - using drop-oldest";
+	return Config::Q_DROP_OLDEST;
+	}
+
+/******************************************************************************\
+|* Get the number of messages a client can have queued
+\******************************************************************************/
+int Config::clientQueue(void)
+	{
+	if (_parser.isSet(*_clientQueue))
+		return _parser.value(*_clientQueue).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString depth = s.value(CLIENT_QUEUE_KEY, DEFAULT_QUEUE).toString();
+	s.endGroup();
+	return depth.toInt();
+	}
+
+/******************************************************************************\
+|* Get the number of bytes a client can have unwritten in its socket
+\******************************************************************************/
+int Config::clientInFlight(void)
+	{
+	if (_parser.isSet(*_clientInFlight))
+		return _parser.value(*_clientInFlight).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString bytes = s.value(CLIENT_FLIGHT_KEY, DEFAULT_FLIGHT).toString();
+	s.endGroup();
+	return bytes.toInt();
+	}
+
+/******************************************************************************\
+|* Get the number of updates to keep for replay
+\******************************************************************************/
+int Config::replayUpdates(void)
+	{
+	if (_parser.isSet(*_replayUpdates))
+		return _parser.value(*_replayUpdates).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString num = s.value(REPLAY_UPDATES_KEY, DEFAULT_REPLAY_UPD).toString();
+	s.endGroup();
+	return num.toInt();
+	}
+
+/******************************************************************************\
+|* Get the number of samples to keep for replay
+\******************************************************************************/
+int Config::replaySamples(void)
+	{
+	if (_parser.isSet(*_replaySamples))
+		return _parser.value(*_replaySamples).toInt();
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString num = s.value(REPLAY_SAMPLES_KEY, DEFAULT_REPLAY_SMP).toString();
+	s.endGroup();
+	return num.toInt();
+	}
+
 /******************************************************************************\
 |* Get the fft-windowing function
 \******************************************************************************/
@@ -402,6 +987,19 @@ Config::WindowType Config::fftWindowType(void)
 		s.endGroup();
 		}
 
+	int type = windowFor(window);
+	if (type >= 0)
+		return (Config::WindowType)type;
+
+	qWarning() << "Cannot find window function for " << window << " - using Hamming";
+	return Config::W_HAMMING;
+	}
+
+/******************************************************************************\
+|* Parse a window-function name or number
+\******************************************************************************/
+int Config::windowFor(const QString& name)
+	{
 	QMap<QString,Config::WindowType> map =
 		{
 			{"0", Config::W_RECTANGLE},
@@ -418,12 +1016,20 @@ Config::WindowType Config::fftWindowType(void)
 			{"parzen", Config::W_PARZEN},
 		};
 
-	QString key = window.toLower();
-	if (map.contains(key))
-		return map[key];
+	QString key = name.toLower();
+	return map.contains(key) ? map[key] : -1;
+	}
 
-	qWarning() << "Cannot find window function for " << key << " - using Hamming";
-	return Config::W_HAMMING;
+/******************************************************************************\
+|* Return the name of a window function
+\******************************************************************************/
+QString Config::windowName(WindowType type)
+	{
+	static const char * names[] =
+		{"rectangle", "hamming", "hanning", "blackman", "welch", "parzen"};
+
+	int idx = (int)type;
+	return ((idx >= 0) && (idx <= W_PARZEN)) ? names[idx] : "hamming";
 	}
 
 /******************************************************************************\
@@ -482,3 +1088,224 @@ bool Config::listChannels(void)
 	return _listAll || _parser.isSet(*_listChannels);
 	}
 
+/******************************************************************************\
+|* Get the IQ recording to play instead of a radio, empty to use a radio
+\******************************************************************************/
+QString Config::playFile(void)
+	{
+	if (_parser.isSet(*_playFile))
+		return _parser.value(*_playFile);
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString file = s.value(PLAY_FILE_KEY, "").toString();
+	s.endGroup();
+	return file;
+	}
+
+/******************************************************************************\
+|* Get how many times real time to play a recording at, 0 for flat out
+\******************************************************************************/
+double Config::playSpeed(void)
+	{
+	if (_parser.isSet(*_playSpeed))
+		return _parser.value(*_playSpeed).toDouble();
+
+	QSettings s;
+	s.beginGroup(FILE_GROUP);
+	QString speed = s.value(PLAY_SPEED_KEY, DEFAULT_PLAY_SPEED).toString();
+	s.endGroup();
+	return speed.toDouble();
+	}
+
+/******************************************************************************\
+|* Get the signals the synthetic source makes
+\******************************************************************************/
+QString Config::synthSignals(void)
+	{
+	if (_parser.isSet(*_synthSignals))
+		return _parser.value(*_synthSignals);
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	QString spec = s.value(SYNTH_SIGNALS_KEY, DEFAULT_SYNTH_SIGNALS).toString();
+	s.endGroup();
+	return spec;
+	}
+
+/******************************************************************************\
+|* Get the sample format the synthetic source makes
+\******************************************************************************/
+QString Config::synthFormat(void)
+	{
+	if (_parser.isSet(*_synthFormat))
+		return _parser.value(*_synthFormat).toLower();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	QString fmt = s.value(SYNTH_FORMAT_KEY, DEFAULT_SYNTH_FORMAT).toString().toLower();
+	s.endGroup();
+	return fmt;
+	}
+
+/******************************************************************************\
+|* Get how many milliseconds of samples each RTL-SDR transfer should hold
+\******************************************************************************/
+int Config::rtlLatency(void)
+	{
+	if (_parser.isSet(*_rtlLatency))
+		return _parser.value(*_rtlLatency).toInt();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	QString msecs = s.value(RTL_LATENCY_KEY, DEFAULT_RTL_LATENCY).toString();
+	s.endGroup();
+	return msecs.toInt();
+	}
+
+/******************************************************************************\
+|* Get the frequency to tune the RSPduo's second tuner to, in dual-tuner mode.
+|* Unless it's been given, it's the same as the first
+\******************************************************************************/
+int Config::centerFrequencyB(void)
+	{
+	int freq = 0;
+	if (_parser.isSet(*_frequencyB))
+		freq = _parser.value(*_frequencyB).toInt();
+	else
+		{
+		QSettings s;
+		s.beginGroup(RADIO_GROUP);
+		freq = s.value(FREQUENCY_B_KEY, "0").toInt();
+		s.endGroup();
+		}
+	return (freq > 0) ? freq : centerFrequency();
+	}
+
+/******************************************************************************\
+|* Get whether the two streams of a dual-tuner source are cross-correlated
+\******************************************************************************/
+bool Config::correlate(void)
+	{
+	if (_parser.isSet(*_correlate))
+		return true;
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	bool correlate = s.value(CORRELATE_KEY, false).toBool();
+	s.endGroup();
+	return correlate;
+	}
+
+/******************************************************************************\
+|* Get the device-ids to open, each one a pipeline of its own. Without a list,
+|* it's the one device the id filter picks
+\******************************************************************************/
+QList<int> Config::radioIds(void)
+	{
+	QString list;
+	if (_parser.isSet(*_idsFilter))
+		list = _parser.value(*_idsFilter);
+	else
+		{
+		QSettings s;
+		s.beginGroup(RADIO_GROUP);
+		list = s.value(IDS_KEY, "").toString();
+		s.endGroup();
+		}
+
+	QList<int> ids;
+	for (const QString& id : list.split(',', Qt::SkipEmptyParts))
+		{
+		bool ok		= false;
+		int value	= id.trimmed().toInt(&ok);
+		if (ok && !ids.contains(value))
+			ids.append(value);
+		}
+
+	if (ids.isEmpty())
+		ids.append(radioIdFilter());
+	return ids;
+	}
+
+/******************************************************************************\
+|* Get the range to sweep over, in Hz. Both are 0 unless sweeping
+\******************************************************************************/
+int Config::sweepFrom(void)
+	{
+	if (_parser.isSet(*_sweepFrom))
+		return _parser.value(*_sweepFrom).toInt();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	int freq = s.value(SWEEP_FROM_KEY, "0").toInt();
+	s.endGroup();
+	return freq;
+	}
+
+int Config::sweepTo(void)
+	{
+	if (_parser.isSet(*_sweepTo))
+		return _parser.value(*_sweepTo).toInt();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	int freq = s.value(SWEEP_TO_KEY, "0").toInt();
+	s.endGroup();
+	return freq;
+	}
+
+/******************************************************************************\
+|* Get whether there's a range to sweep over
+\******************************************************************************/
+bool Config::sweeping(void)
+	{
+	int from = sweepFrom();
+	return (from > 0) && (sweepTo() > from);
+	}
+
+/******************************************************************************\
+|* Get the seconds of samples integrated at each hop of a sweep
+\******************************************************************************/
+double Config::sweepDwell(void)
+	{
+	if (_parser.isSet(*_sweepDwell))
+		return _parser.value(*_sweepDwell).toDouble();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	QString secs = s.value(SWEEP_DWELL_KEY, DEFAULT_SWEEP_DWELL).toString();
+	s.endGroup();
+	return secs.toDouble();
+	}
+
+/******************************************************************************\
+|* Get the milliseconds of samples dropped while the tuner settles after a hop
+\******************************************************************************/
+int Config::sweepSettle(void)
+	{
+	if (_parser.isSet(*_sweepSettle))
+		return _parser.value(*_sweepSettle).toInt();
+
+	QSettings s;
+	s.beginGroup(RADIO_GROUP);
+	QString msecs = s.value(SWEEP_SETTLE_KEY, DEFAULT_SWEEP_SETTLE).toString();
+	s.endGroup();
+	return msecs.toInt();
+	}
+
+/******************************************************************************\
+|* Get the fraction of each hop's spectrum trimmed off, half from each edge,
+|* where the anti-alias filter rolls off
+\******************************************************************************/
+double Config::sweepCrop(void)
+	{
+	if (_parser.isSet(*_sweepCrop))
+		return _parser.value(*_sweepCrop).toDouble();
+
+	QSettings s;
+	s.beginGroup(DSP_GROUP);
+	QString crop = s.value(SWEEP_CROP_KEY, DEFAULT_SWEEP_CROP).toString();
+	s.endGroup();
+	return crop.toDouble();
+	}
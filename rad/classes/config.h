@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <QCommandLineParser>
+#include <QList>
 
 #include "singleton.h"
 
@@ -25,6 +26,20 @@ class Config : public Singleton<Config>
 			W_PARZEN
 			} WindowType;
 
+		typedef enum
+			{
+			L_NONE		= 0,
+			L_EMA,
+			L_WINDOW
+			} LiveMode;
+
+		typedef enum
+			{
+			Q_DROP_OLDEST	= 0,
+			Q_COALESCE,
+			Q_DISCONNECT
+			} QueuePolicy;
+
 		/**********************************************************************\
 		|* Constructor
 		\**********************************************************************/
@@ -35,6 +50,13 @@ class Config : public Singleton<Config>
 		\******************************************************************/
 		WindowType fftWindowType(void);
 
+		/******************************************************************\
+		|* Parse a window-function name (or its number), -1 if unknown, and
+		|* name a window function
+		\******************************************************************/
+		static int windowFor(const QString& name);
+		static QString windowName(WindowType type);
+
 		/******************************************************************\
 		|* Return the baseband sample rate to use
 		\******************************************************************/
@@ -55,6 +77,12 @@ class Config : public Singleton<Config>
 		\******************************************************************/
 		int centerFrequency(void);
 
+		/******************************************************************\
+		|* Return the frequency to tune the RSPduo's tuner B to, when both
+		|* tuners are in use
+		\******************************************************************/
+		int centerFrequencyB(void);
+
 		/******************************************************************\
 		|* Return the gain to apply
 		\******************************************************************/
@@ -65,6 +93,12 @@ class Config : public Singleton<Config>
 		\******************************************************************/
 		int sampleRate(void);
 
+		/******************************************************************\
+		|* Return how many milliseconds of samples each RTL-SDR USB
+		|* transfer should hold, 0 for the driver's default
+		\******************************************************************/
+		int rtlLatency(void);
+
 		/******************************************************************\
 		|* Return the tuner bandwidth to use, -1 = use default for driver
 		\******************************************************************/
@@ -108,11 +142,151 @@ class Config : public Singleton<Config>
 		\******************************************************************/
 		int radioIdFilter(void);
 
+		/******************************************************************\
+		|* Return the device-ids to open together, at least one
+		\******************************************************************/
+		QList<int> radioIds(void);
+
+		/******************************************************************\
+		|* Return the RFI-excision threshold in std-devs, 0 to disable
+		\******************************************************************/
+		double rfiSigma(void);
+
+		/******************************************************************\
+		|* Return the number of FFT frames per RFI sub-integration
+		\******************************************************************/
+		int rfiFrames(void);
+
+		/******************************************************************\
+		|* Return how the live display average is computed
+		\******************************************************************/
+		LiveMode liveMode(void);
+
+		/******************************************************************\
+		|* Return the number of FFT frames the live average spans
+		\******************************************************************/
+		int liveFrames(void);
+
+		/******************************************************************\
+		|* Return the number of live updates to push per second
+		\******************************************************************/
+		double liveRate(void);
+
+		/******************************************************************\
+		|* Return whether to cross-correlate the streams of a dual-tuner
+		|* source
+		\******************************************************************/
+		bool correlate(void);
+
+		/******************************************************************\
+		|* Return the range to sweep the tuner over, whether there is one,
+		|* the seconds to integrate at each hop, the milliseconds to let
+		|* the tuner settle after it, and the fraction of each hop's
+		|* spectrum to trim from its edges
+		\******************************************************************/
+		int sweepFrom(void);
+		int sweepTo(void);
+		bool sweeping(void);
+		double sweepDwell(void);
+		int sweepSettle(void);
+		double sweepCrop(void);
+
+		/******************************************************************\
+		|* Return the plain TCP stream port, 0 to disable
+		\******************************************************************/
+		int streamPort(void);
+
+		/******************************************************************\
+		|* Return the Unix-domain stream socket path, empty to disable
+		\******************************************************************/
+		QString streamSocket(void);
+
+		/******************************************************************\
+		|* Return whether to set TCP_NODELAY on stream clients
+		\******************************************************************/
+		bool streamNoDelay(void);
+
+		/******************************************************************\
+		|* Return the multicast group to publish to, empty to disable
+		\******************************************************************/
+		QString multicastGroup(void);
+
+		/******************************************************************\
+		|* Return the multicast port and time-to-live
+		\******************************************************************/
+		int multicastPort(void);
+		int multicastTtl(void);
+
+		/******************************************************************\
+		|* Return the message bytes to put in each multicast datagram
+		\******************************************************************/
+		int multicastPayload(void);
+
+		/******************************************************************\
+		|* Return the multicast wire format: "f32", "f16", "u16" or "u8"
+		\******************************************************************/
+		QString multicastEncoding(void);
+
+		/******************************************************************\
+		|* Return the HTTP port that serves /metrics, 0 to disable
+		\******************************************************************/
+		int metricsPort(void);
+
+		/******************************************************************\
+		|* Return what to do when a client's send queue is full
+		\******************************************************************/
+		QueuePolicy clientPolicy(void);
+
+		/******************************************************************\
+		|* Return the number of messages a client may have queued
+		\******************************************************************/
+		int clientQueue(void);
+
+		/******************************************************************\
+		|* Return the bytes a client may have unwritten in its socket
+		\******************************************************************/
+		int clientInFlight(void);
+
+		/******************************************************************\
+		|* Return the number of updates and samples kept to send to clients
+		|* as soon as they connect, 0 to keep none
+		\******************************************************************/
+		int replayUpdates(void);
+		int replaySamples(void);
+
 		/******************************************************************\
 		|* Return the directory to save data to
 		\******************************************************************/
 		QString saveDir(void);
 
+		/******************************************************************\
+		|* Return where to archive updates and samples, empty for nowhere
+		\******************************************************************/
+		QString archiveDir(void);
+
+		/******************************************************************\
+		|* Return where to record raw IQ (empty for nowhere), how many
+		|* seconds of it to keep, and how many files to keep it in
+		\******************************************************************/
+		QString iqDir(void);
+		double iqRetention(void);
+		int iqSegments(void);
+
+		/******************************************************************\
+		|* Return the IQ recording to play instead of a radio (empty for
+		|* none), and how many times real time to play it at, 0 for as
+		|* fast as it can be processed
+		\******************************************************************/
+		QString playFile(void);
+		double playSpeed(void);
+
+		/******************************************************************\
+		|* Return what the synthetic source should make, and in what
+		|* format ("s8c" or "s16c")
+		\******************************************************************/
+		QString synthSignals(void);
+		QString synthFormat(void);
+
 	};
 
 #endif // CONFIG_H
@@ -0,0 +1,76 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+/******************************************************************************\
+|* A connected client, whatever transport it arrived on. MsgIO only ever talks
+|* to clients through this, so the WebSocket, TCP and Unix-domain listeners
+|* all get the same subscriptions, queues and commands.
+|*
+|* Binary messages are always Preamble-framed. Text is JSON (or the legacy
+|* CALIBRATION commands) in both directions
+\******************************************************************************/
+class Connection : public QObject
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit Connection(QObject *parent = nullptr) : QObject(parent) {}
+		~Connection(void) override {}
+
+		/**********************************************************************\
+		|* Describe the peer, for logging
+		\**********************************************************************/
+		virtual QString identifier(void) const = 0;
+
+		/**********************************************************************\
+		|* Send a Preamble-framed message, or a text message
+		\**********************************************************************/
+		virtual void sendMessage(const QByteArray& msg) = 0;
+		virtual void sendText(const QString& text) = 0;
+
+		/**********************************************************************\
+		|* Send a run of messages as one write, where the transport allows
+		\**********************************************************************/
+		virtual void sendBatch(const QList<QByteArray>& msgs)
+			{
+			for (const QByteArray& msg : msgs)
+				sendMessage(msg);
+			}
+
+		/**********************************************************************\
+		|* Close the connection, telling the peer why if the transport can
+		\**********************************************************************/
+		virtual void close(const QString& reason) = 0;
+
+		/**********************************************************************\
+		|* Hold back partial packets while a burst of messages is written.
+		|* Only meaningful for TCP
+		\**********************************************************************/
+		virtual void cork(bool on) { Q_UNUSED(on); }
+
+	signals:
+		/**********************************************************************\
+		|* A line of text arrived from the peer
+		\**********************************************************************/
+		void textReceived(const QString& msg);
+
+		/**********************************************************************\
+		|* Bytes we sent have left the process, see ClientQueue
+		\**********************************************************************/
+		void bytesWritten(qint64 bytes);
+
+		/**********************************************************************\
+		|* The peer has gone
+		\**********************************************************************/
+		void disconnected(void);
+	};
+
+#endif // CONNECTION_H
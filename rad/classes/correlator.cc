@@ -0,0 +1,394 @@
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include <QDateTime>
+
+#include <libra.h>
+
+#include "config.h"
+#include "correlator.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+Correlator::Correlator(QObject *parent)
+		   :QObject(parent)
+		   ,_fftSize(0)
+		   ,_haveData(false)
+		   ,_updateSecs(5)
+		   ,_sampleSecs(300)
+		   ,_nextUpdate(0)
+		   ,_nextSample(0)
+		   ,_updateFrames(0)
+		   ,_sampleFrames(0)
+		   ,_matched(0)
+		   ,_unmatched(0)
+		   ,_update(nullptr)
+		   ,_sample(nullptr)
+	{
+	Config &cfg = Config::instance();
+	_fftSize	= cfg.fftSize();
+	_updateSecs	= cfg.secondsBetweenUpdates();
+	_sampleSecs	= cfg.secondsBetweenSamples();
+
+	_allocate();
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+Correlator::~Correlator(void)
+	{
+	_drop();
+	_free();
+	}
+
+/******************************************************************************\
+|* Start again from nothing. Frames waiting for a partner are from before the
+|* change, so they go too
+\******************************************************************************/
+void Correlator::restart(int fftSize, double updateSecs, double sampleSecs)
+	{
+	_drop();
+	_free();
+	_fftSize		= fftSize;
+	_updateSecs		= updateSecs;
+	_sampleSecs		= sampleSecs;
+	_haveData		= false;
+	_allocate();
+
+	LOG << "Correlation restarted:" << _fftSize << "bins, update"
+		<< _updateSecs << "s, sample" << _sampleSecs << "s";
+	}
+
+/******************************************************************************\
+|* A frame has arrived. If its partner is already here, correlate the pair,
+|* otherwise wait for it. A channel that gets too far ahead of the other -
+|* or whose partner was discarded - loses its oldest frames
+\******************************************************************************/
+void Correlator::frameReady(int channel, int64_t frame, int buffer)
+	{
+	DataMgr &dmgr	= DataMgr::instance();
+	if ((channel < 0) || (channel > 1))
+		{
+		dmgr.release(buffer);
+		return;
+		}
+
+	QMap<int64_t, int>& mine	= _pending[channel];
+	QMap<int64_t, int>& other	= _pending[1 - channel];
+
+	if (other.contains(frame))
+		{
+		int partner = other.take(frame);
+		if (channel == 0)
+			_correlate(buffer, partner);
+		else
+			_correlate(partner, buffer);
+		dmgr.release(partner);
+		dmgr.release(buffer);
+		return;
+		}
+
+	mine.insert(frame, buffer);
+	while (mine.size() > MAX_PENDING)
+		{
+		dmgr.release(mine.take(mine.firstKey()));
+		_unmatched ++;
+		}
+	}
+
+/******************************************************************************\
+|* Add one pair of frames into the planes: XX, then YY, then the real and
+|* imaginary parts of X.conj(Y). No branches in the loop, so that the
+|* compiler can vectorise it
+\******************************************************************************/
+void Correlator::accumulate(const fftw_complex *x,
+							const fftw_complex *y,
+							double *planes,
+							int bins)
+	{
+	double *xx	= planes;
+	double *yy	= xx + bins;
+	double *re	= yy + bins;
+	double *im	= re + bins;
+
+	for (int i=0; i<bins; i++)
+		{
+		double a	= x[i][0];
+		double b	= x[i][1];
+		double c	= y[i][0];
+		double d	= y[i][1];
+
+		xx[i]		+= a * a + b * b;
+		yy[i]		+= c * c + d * d;
+		re[i]		+= a * c + b * d;
+		im[i]		+= b * c - a * d;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: correlate a pair, and send whatever is due
+\******************************************************************************/
+void Correlator::_correlate(int bufferX, int bufferY)
+	{
+	DataMgr &dmgr		= DataMgr::instance();
+	fftw_complex *x		= dmgr.asFFT(bufferX);
+	fftw_complex *y		= dmgr.asFFT(bufferY);
+	if ((x == nullptr) || (y == nullptr))
+		return;
+
+	/**************************************************************************\
+	|* Start the clock with the first pair, as the aggregator does
+	\**************************************************************************/
+	if (_haveData == false)
+		{
+		_haveData		= true;
+		_nextUpdate		= _deltaT(_updateSecs);
+		_nextSample		= _deltaT(_sampleSecs);
+		_updateFrames	= 0;
+		_sampleFrames	= 0;
+		}
+
+	accumulate(x, y, _update, _fftSize);
+	accumulate(x, y, _sample, _fftSize);
+	_updateFrames ++;
+	_sampleFrames ++;
+	_matched ++;
+
+	if (QDateTime::currentMSecsSinceEpoch() >= _nextUpdate)
+		{
+		QByteArray msg	= _normalise(TYPE_VIS_UPDATE, _update, _updateFrames);
+		_nextUpdate		= _deltaT(_updateSecs);
+		_updateFrames	= 0;
+
+		emit visibilitiesReady(msg);
+		}
+
+	if (QDateTime::currentMSecsSinceEpoch() >= _nextSample)
+		{
+		QByteArray msg	= _normalise(TYPE_VIS_SAMPLE, _sample, _sampleFrames);
+		_nextSample		= _deltaT(_sampleSecs);
+		_sampleFrames	= 0;
+
+		emit visibilitiesReady(msg);
+		}
+	}
+
+/******************************************************************************\
+|* Private method: make a message of the per-frame averages, and clear the
+|* accumulators
+\******************************************************************************/
+QByteArray Correlator::_normalise(PreambleType type, double *planes, int frames)
+	{
+	int values		= PLANES * _fftSize;
+	uint32_t extent	= values * sizeof(float);
+	QByteArray msg(sizeof(Preamble) + extent, Qt::Uninitialized);
+
+	Preamble *hdr	= new (msg.data()) Preamble();
+	hdr->extent		= extent;
+	hdr->type		= (uint16_t)type;
+	hdr->bins		= _fftSize;
+	hdr->values		= values;
+	hdr->channel	= 0;
+
+	float *results	= reinterpret_cast<float *>(msg.data() + hdr->offset);
+	double scale	= (frames > 0) ? 1.0 / frames : 0.0;
+	for (int i=0; i<values; i++)
+		results[i] = (float)(planes[i] * scale);
+
+	memset(planes, 0, values * sizeof(double));
+	return msg;
+	}
+
+/******************************************************************************\
+|* Private method: allocate and clear the accumulators
+\******************************************************************************/
+void Correlator::_allocate(void)
+	{
+	_update = new double[PLANES * _fftSize]();
+	_sample = new double[PLANES * _fftSize]();
+	_updateFrames = 0;
+	_sampleFrames = 0;
+	}
+
+/******************************************************************************\
+|* Private method: free the accumulators
+\******************************************************************************/
+void Correlator::_free(void)
+	{
+	delete [] _update;
+	delete [] _sample;
+	_update = nullptr;
+	_sample = nullptr;
+	}
+
+/******************************************************************************\
+|* Private method: give back the frames waiting for a partner
+\******************************************************************************/
+void Correlator::_drop(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	for (int channel=0; channel<2; channel++)
+		{
+		for (int buffer : qAsConst(_pending[channel]))
+			dmgr.release(buffer);
+		_unmatched += _pending[channel].size();
+		_pending[channel].clear();
+		}
+	}
+
+/******************************************************************************\
+|* Private method: a time {delta} seconds from now
+\******************************************************************************/
+qint64 Correlator::_deltaT(double delta)
+	{
+	return QDateTime::currentMSecsSinceEpoch() + (qint64)(1000 * delta);
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int Correlator::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * Correlator::testClassName(void)
+	{
+	return "Correlator";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult Correlator::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkAccumulate();
+		case 1:
+			return _checkPairing();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : (1+2i).conj(3-i) = 1+7i, |1+2i|^2 = 5 and |3-i|^2 = 10.
+|* An odd number of bins makes sure any tail the vectoriser leaves is right
+\******************************************************************************/
+Testable::TestResult Correlator::_checkAccumulate(void)
+	{
+	const int bins = 7;
+	fftw_complex x[bins];
+	fftw_complex y[bins];
+	double planes[PLANES * bins];
+	memset(planes, 0, sizeof(planes));
+
+	for (int i=0; i<bins; i++)
+		{
+		x[i][0] = 1 * (i+1);
+		x[i][1] = 2 * (i+1);
+		y[i][0] = 3;
+		y[i][1] = -1;
+		}
+
+	accumulate(x, y, planes, bins);
+	accumulate(x, y, planes, bins);
+
+	for (int i=0; i<bins; i++)
+		{
+		double k	= i + 1;
+		bool ok		= (planes[i]			== 2 * 5 * k * k)
+					&& (planes[bins+i]		== 2 * 10)
+					&& (planes[2*bins+i]	== 2 * 1 * k)
+					&& (planes[3*bins+i]	== 2 * 7 * k);
+		if (!ok)
+			{
+			ERR << "Bin" << i << "gave" << planes[i] << planes[bins+i]
+				<< planes[2*bins+i] << planes[3*bins+i];
+			return Testable::TEST_FAIL;
+			}
+		}
+	return Testable::TEST_PASS;
+	}
+
+/******************************************************************************\
+|* Test interface : Feed two frames per channel, in a different order on each,
+|* with channel 1 lagging channel 0 by a fixed phase. Every update should
+|* show equal auto-spectra and that phase
+\******************************************************************************/
+Testable::TestResult Correlator::_checkPairing(void)
+	{
+	DataMgr &dmgr		= DataMgr::instance();
+	const int bins		= 16;
+	const double phase	= 0.6;
+
+	QList<QByteArray> msgs;
+	QMetaObject::Connection conn =
+		connect(this, &Correlator::visibilitiesReady, this,
+				[&msgs](QByteArray msg) { msgs.append(msg); },
+				Qt::DirectConnection);
+
+	int size		= _fftSize;
+	double update	= _updateSecs;
+	double sample	= _sampleSecs;
+	restart(bins, 0, 3600);
+	int64_t before	= _matched;
+
+	int order[4][2] = {{0, 1}, {1, 0}, {1, 1}, {0, 0}};
+	for (int n=0; n<4; n++)
+		{
+		int channel			= order[n][0];
+		int frame			= order[n][1];
+		int64_t buffer		= dmgr.fftBlockFor(bins);
+		fftw_complex *data	= dmgr.asFFT(buffer);
+
+		for (int i=0; i<bins; i++)
+			{
+			double theta	= 0.3 * i + frame - ((channel == 1) ? phase : 0);
+			data[i][0]		= (1 + frame) * cos(theta);
+			data[i][1]		= (1 + frame) * sin(theta);
+			}
+		frameReady(channel, frame, buffer);
+		}
+
+	disconnect(conn);
+	restart(size, update, sample);
+
+	bool ok = (_matched - before == 2) && (msgs.size() == 2);
+	for (const QByteArray& msg : msgs)
+		{
+		const Preamble *hdr	= reinterpret_cast<const Preamble *>(msg.constData());
+		const float *xx		= reinterpret_cast<const float *>(msg.constData() + hdr->offset);
+		const float *yy		= xx + bins;
+		const float *re		= yy + bins;
+		const float *im		= re + bins;
+
+		ok = ok && (hdr->type == TYPE_VIS_UPDATE) && (hdr->channel == 0)
+				&& (hdr->values == PLANES * bins);
+		for (int i=0; ok && (i<bins); i++)
+			ok = (fabs(xx[i] - yy[i]) < 1e-4)
+			  && (fabs(atan2(im[i], re[i]) - phase) < 1e-4);
+		}
+
+	if (!ok)
+		ERR << "Paired" << _matched - before << "frames into" << msgs.size()
+			<< "updates, or the fringe phase was wrong";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,142 @@
+#ifndef CORRELATOR_H
+#define CORRELATOR_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* An FX correlator for a pair of synchronised channels, such as the two
+|* tuners of an RSPduo feeding one antenna each, to make a two-element
+|* interferometer.
+|*
+|* Each channel's processor numbers its FFT frames, and hands the finished
+|* ones here as well as to its own RFI filter. Frames are paired up by number
+|* - the FFT workers finish out of order, so whichever half of a pair comes
+|* first waits for the other - and for each pair (X, Y) every bin gets
+|*
+|*		XX += |X|^2,  YY += |Y|^2,  XY += X.conj(Y)
+|*
+|* integrated over the same update and sample periods as the spectra. The
+|* accumulators are kept as separate planes so the multiply-accumulate loop
+|* has no branches or shuffles, and vectorises.
+|*
+|* Each message is a Preamble followed by four planes of {bins} floats: the
+|* two auto-spectra, then the real and imaginary parts of the cross-spectrum,
+|* all averaged per frame. The phase of the cross-spectrum is the fringe.
+|* {values} counts all four planes, and the message is tagged with X's
+|* channel, 0: Y is channel 1
+\******************************************************************************/
+class Correlator : public QObject, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		static const int	PLANES		= VIS_PLANES;	// XX, YY, Re XY, Im XY
+		static const int	MAX_PENDING	= 64;	// Frames waiting for a partner
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, fftSize);					// Bins in the FFT
+	GET(bool, haveData);				// Whether any pairs have come in yet
+	GET(double, updateSecs);			// Seconds between updates
+	GET(double, sampleSecs);			// Seconds between samples
+	GET(qint64, nextUpdate);			// Next time to deliver an update
+	GET(qint64, nextSample);			// Next time to deliver a sample
+	GET(int, updateFrames);				// Frame pairs in the update so far
+	GET(int, sampleFrames);				// Frame pairs in the sample so far
+	GET(int64_t, matched);				// Frame pairs correlated
+	GET(int64_t, unmatched);			// Frames dropped without a partner
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		double *			_update;	// Update accumulators, as planes
+		double *			_sample;	// Sample accumulators, as planes
+		QMap<int64_t, int>	_pending[2];// Frame number -> buffer, per channel
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		void _allocate(void);
+		void _free(void);
+		void _drop(void);
+		void _correlate(int bufferX, int bufferY);
+		QByteArray _normalise(PreambleType type, double *planes, int frames);
+		qint64 _deltaT(double delta);
+
+	signals:
+		/**********************************************************************\
+		|* Visibilities are ready: a Preamble followed by the float planes
+		\**********************************************************************/
+		void visibilitiesReady(QByteArray msg);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit Correlator(QObject *parent = nullptr);
+		~Correlator(void);
+
+		/**********************************************************************\
+		|* Add one pair of frames, of {bins} values, into {planes}
+		\**********************************************************************/
+		static void accumulate(const fftw_complex *x,
+							   const fftw_complex *y,
+							   double *planes,
+							   int bins);
+
+	public slots:
+		/**********************************************************************\
+		|* Receive FFT frame {frame} of {channel}. The correlator takes over
+		|* one retain of the buffer
+		\**********************************************************************/
+		void frameReady(int channel, int64_t frame, int bufferId);
+
+		/**********************************************************************\
+		|* Discard what's waiting and what's been accumulated, and start again
+		|* with a new number of bins and integration times
+		\**********************************************************************/
+		void restart(int fftSize, double updateSecs, double sampleSecs);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check the multiply-accumulate against known values
+		\**********************************************************************/
+		Testable::TestResult _checkAccumulate(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check frames arriving out of order are paired, and a
+		|* phase offset between the channels comes out as the fringe phase
+		\**********************************************************************/
+		Testable::TestResult _checkPairing(void);
+	};
+
+#endif // CORRELATOR_H
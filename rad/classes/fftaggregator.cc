@@ -1,9 +1,13 @@
+#include <new>
+
 #include <QDateTime>
 
 #include <libra.h>
 
 #include "config.h"
 #include "fftaggregator.h"
+#include "liveaverage.h"
+#include "metrics.h"
 
 /******************************************************************************\
 |* Categorised logging support
@@ -21,44 +25,203 @@ FFTAggregator::FFTAggregator(QObject *parent)
 			  ,_haveData(false)
 			  ,_updateSecs(5)
 			  ,_sampleSecs(300)
+			  ,_liveSecs(0)
 			  ,_nextUpdate(0)
 			  ,_nextSample(0)
+			  ,_nextLive(0)
 			  ,_updatePasses(0)
 			  ,_samplePasses(0)
+			  ,_isCalibrating(false)
+			  ,_calibrationPasses(0)
+			  ,_channel(0)
 			  ,_updateData(nullptr)
+			  ,_updateWeight(nullptr)
 			  ,_sampleData(nullptr)
-
+			  ,_sampleWeight(nullptr)
+			  ,_live(nullptr)
+			  ,_calValues(nullptr)
+			  ,_calSum(nullptr)
 	{
 	Config &cfg = Config::instance();
 	_fftSize	= cfg.fftSize();
+	_calKey		= {QString(), 0, -1, _fftSize, cfg.fftWindowType()};
 	_updateSecs	= cfg.secondsBetweenUpdates();
 	_sampleSecs	= cfg.secondsBetweenSamples();
 
+	double rate	= cfg.liveRate();
+	_liveSecs	= (rate > 0) ? 1.0 / rate : 1.0;
+
+	_allocate();
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+FFTAggregator::~FFTAggregator(void)
+	{
+	_free();
+	}
+
+/******************************************************************************\
+|* Start the integrations again from nothing, after the radio or the FFT has
+|* been reconfigured. Whatever was accumulated is thrown away, and the clock
+|* starts again with the next sub-integration
+\******************************************************************************/
+void FFTAggregator::restart(int fftSize, double updateSecs, double sampleSecs)
+	{
+	QMutexLocker guard(&_lock);
+
+	_free();
+	_fftSize		= fftSize;
+	_updateSecs		= updateSecs;
+	_sampleSecs		= sampleSecs;
+	_haveData		= false;
+	_updatePasses	= 0;
+	_samplePasses	= 0;
+	_calValues		= nullptr;
+	_allocate();
+
+	if (_isCalibrating)
+		{
+		WARN << "Settings changed, calibration abandoned";
+		_isCalibrating = false;
+		}
+
+	LOG << "Integration restarted:" << _fftSize << "bins, update"
+		<< _updateSecs << "s, sample" << _sampleSecs << "s";
+	}
+
+/******************************************************************************\
+|* Switch calibrations. If this one has been used recently it's still mapped,
+|* so a retune back to somewhere we've been is immediate
+\******************************************************************************/
+void FFTAggregator::setCalibrationKey(CalibrationCache::Key key)
+	{
+	QMutexLocker guard(&_lock);
+
+	if (_isCalibrating)
+		{
+		WARN << "Settings changed, calibration abandoned";
+		_isCalibrating = false;
+		}
+
+	_calKey		= key;
+	_calValues	= _calibrations.lookup(_calKey);
+	if (_calValues == nullptr)
+		LOG << "No calibration for" << _calKey.fileName();
+
+	emit calibrationApplied((_calValues != nullptr) ? _calKey.fileName() : QString());
+	}
+
+/******************************************************************************\
+|* Begin, end or reload a calibration
+\******************************************************************************/
+void FFTAggregator::calibration(int action)
+	{
+	QMutexLocker guard(&_lock);
+
+	switch (action)
+		{
+		case CAL_BEGIN:
+			LOG << "Beginning calibration for" << _calKey.fileName();
+			memset(_calSum, 0, _fftSize * sizeof(double));
+			_calibrationPasses	= 0;
+			_isCalibrating		= true;
+			_calValues			= nullptr;
+			break;
+
+		case CAL_END:
+			if (!_isCalibrating)
+				ERR << "Cannot save non-existent calibration data!";
+			else if (_calibrationPasses == 0)
+				ERR << "Need more data before we can save calibration";
+			else
+				{
+				float *values = new float[_fftSize];
+				for (int i=0; i<_fftSize; i++)
+					values[i] = _calSum[i] / _calibrationPasses;
+				_calibrations.save(_calKey, values);
+				delete [] values;
+
+				_isCalibrating	= false;
+				_calValues		= _calibrations.lookup(_calKey);
+				}
+			break;
+
+		case CAL_LOAD:
+			_calibrations.flush();
+			_calValues = _isCalibrating ? nullptr : _calibrations.lookup(_calKey);
+			LOG << "Calibration for" << _calKey.fileName()
+				<< ((_calValues != nullptr) ? "loaded" : "not found");
+			break;
+
+		default:
+			ERR << "Unknown calibration action" << action;
+			break;
+		}
+
+	emit calibrationApplied((_calValues != nullptr) ? _calKey.fileName() : QString());
+	}
+
+/******************************************************************************\
+|* Private method: allocate and clear the accumulators for {fftSize} bins
+\******************************************************************************/
+void FFTAggregator::_allocate(void)
+	{
+	Config &cfg = Config::instance();
+
 	_updateData	= new double[_fftSize];
 	memset(_updateData, 0, _fftSize * sizeof(double));
 
 	_sampleData	= new double[_fftSize];
 	memset(_sampleData, 0, _fftSize * sizeof(double));
+
+	_updateWeight	= new double[_fftSize];
+	memset(_updateWeight, 0, _fftSize * sizeof(double));
+
+	_sampleWeight	= new double[_fftSize];
+	memset(_sampleWeight, 0, _fftSize * sizeof(double));
+
+	_calSum			= new double[_fftSize];
+	memset(_calSum, 0, _fftSize * sizeof(double));
+
+	/**************************************************************************\
+	|* The live average works in whole sub-integrations, so round the span
+	\**************************************************************************/
+	int subInt		= (cfg.rfiFrames() < 2) ? 2 : cfg.rfiFrames();
+	int span		= (cfg.liveFrames() + subInt/2) / subInt;
+	_live			= new LiveAverage(_fftSize, cfg.liveMode(), span);
 	}
 
 /******************************************************************************\
-|* Destructor
+|* Private method: free the accumulators
 \******************************************************************************/
-FFTAggregator::~FFTAggregator(void)
+void FFTAggregator::_free(void)
 	{
-	if (_updateData != nullptr)
-		delete [] _updateData;
-	if (_sampleData != nullptr)
-		delete [] _sampleData;
+	delete [] _updateData;
+	delete [] _sampleData;
+	delete [] _updateWeight;
+	delete [] _sampleWeight;
+	delete [] _calSum;
+	delete _live;
+
+	_updateData		= nullptr;
+	_sampleData		= nullptr;
+	_updateWeight	= nullptr;
+	_sampleWeight	= nullptr;
+	_calSum			= nullptr;
+	_live			= nullptr;
 	}
 
 /******************************************************************************\
-|* We've been sent an FFT packet. Aggregate it
+|* We've been sent a sub-integration by the RFI filter. Aggregate it. The
+|* buffer holds {fftSize} summed magnitudes followed by {fftSize} weights
 \******************************************************************************/
-void FFTAggregator::fftReady(int buffer)
+void FFTAggregator::subIntegrationReady(int buffer)
 	{
 	QMutexLocker guard(&_lock);
 	DataMgr &dmgr	= DataMgr::instance();
+	int64_t started	= Metrics::now();
 
 	/**************************************************************************\
 	|* Set up the next sample/update point if we haven't got one. That way we
@@ -69,6 +232,7 @@ void FFTAggregator::fftReady(int buffer)
 		_haveData		= true;
 		_nextUpdate		= _deltaT(_updateSecs);
 		_nextSample		= _deltaT(_sampleSecs);
+		_nextLive		= _deltaT(_liveSecs);
 		_updatePasses	= 0;
 		_samplePasses	= 0;
 		}
@@ -76,19 +240,37 @@ void FFTAggregator::fftReady(int buffer)
 	/**************************************************************************\
 	|* aggregate this pass
 	\**************************************************************************/
-	fftw_complex* data  = dmgr.asFFT(buffer);
+	double *sum		= dmgr.asDouble(buffer);
+	double *weight	= sum + _fftSize;
 	for (int i=0; i<_fftSize; i++)
 		{
-		double creal	= data[i][0] * data[i][0];
-		double cimag	= data[i][1] * data[i][1];
-		double power	= creal * creal + cimag * cimag;
-		double mag		= 0.05 * log(power+1);
+		_updateData[i]		+= sum[i];
+		_updateWeight[i]	+= weight[i];
+		_sampleData[i]		+= sum[i];
+		_sampleWeight[i]	+= weight[i];
+		}
+	_updatePasses ++;
+	_samplePasses ++;
+	_live->add(sum, weight);
 
-		_updateData[i] += mag;
-		_updatePasses  ++;
+	Metrics &metrics = Metrics::instance();
+	metrics.add(Metrics::SUB_INTEGRATIONS);
+	metrics.time(Metrics::AGGREGATE, Metrics::now() - started);
 
-		_sampleData[i] += mag;
-		_samplePasses  ++;
+	/**************************************************************************\
+	|* Check whether we're past the time for a live update. These don't reset
+	|* anything, they're just a look at the running average
+	\**************************************************************************/
+	if ((_live->mode() != Config::L_NONE)
+	 && (QDateTime::currentMSecsSinceEpoch() >= _nextLive))
+		{
+		float *results		= nullptr;
+		QByteArray msg		= _message(TYPE_LIVE, &results);
+		_live->snapshot(results);
+		_calibrate(TYPE_LIVE, results);
+		_nextLive			= _deltaT(_liveSecs);
+
+		emit aggregatedDataReady(msg);
 		}
 
 	/**************************************************************************\
@@ -96,18 +278,11 @@ void FFTAggregator::fftReady(int buffer)
 	\**************************************************************************/
 	if (QDateTime::currentMSecsSinceEpoch() >= _nextUpdate)
 		{
-		// Create copy of buffer and send to update thread
-		int64_t resultsId	= dmgr.blockFor(_fftSize, sizeof(float));
-		float *results		= dmgr.asFloat(resultsId);
-
-		for (int i=0; i<_fftSize; i++)
-			results[i] = (float)(_updateData[i] / _updatePasses);
+		QByteArray msg		= _normalise(TYPE_UPDATE, _updateData, _updateWeight);
+		_nextUpdate			= _deltaT(_updateSecs);
+		_updatePasses		= 0;
 
-		memset(_updateData, 0, _fftSize * sizeof(double));
-		_nextUpdate		= _deltaT(_updateSecs);
-		_updatePasses	= 0;
-
-		emit aggregatedDataReady(TYPE_UPDATE, resultsId);
+		emit aggregatedDataReady(msg);
 		}
 
 	/**************************************************************************\
@@ -115,21 +290,74 @@ void FFTAggregator::fftReady(int buffer)
 	\**************************************************************************/
 	if (QDateTime::currentMSecsSinceEpoch() >= _nextSample)
 		{
-		// Create copy of buffer and send to update thread
-		int64_t resultsId	= dmgr.blockFor(_fftSize, sizeof(float));
-		float *results		= dmgr.asFloat(resultsId);
+		QByteArray msg		= _normalise(TYPE_SAMPLE, _sampleData, _sampleWeight);
+		_nextSample			= _deltaT(_sampleSecs);
+		_samplePasses		= 0;
 
-		for (int i=0; i<_fftSize; i++)
-			results[i] = (float)(_sampleData[i] / _samplePasses);
+		emit aggregatedDataReady(msg);
+		}
 
-		memset(_sampleData, 0, _fftSize * sizeof(double));
-		_nextSample		= _deltaT(_sampleSecs);
-		_samplePasses	= 0;
+	dmgr.release(buffer);
+	}
+
+/*****************************************************************************\
+|* Produce a message of the per-bin average, and clear the accumulators.
+|* Bins that were excised for the whole period come out as zero
+\******************************************************************************/
+QByteArray FFTAggregator::_normalise(PreambleType type,
+									 double *data,
+									 double *weight)
+	{
+	float *results	= nullptr;
+	QByteArray msg	= _message(type, &results);
+
+	for (int i=0; i<_fftSize; i++)
+		results[i] = (weight[i] > 0) ? (float)(data[i] / weight[i]) : 0.0f;
+	_calibrate(type, results);
 
-		emit aggregatedDataReady(TYPE_SAMPLE, resultsId);
+	memset(data, 0, _fftSize * sizeof(double));
+	memset(weight, 0, _fftSize * sizeof(double));
+	return msg;
+	}
+
+/*****************************************************************************\
+|* Take an update into the calibration being made, if there is one, and apply
+|* the current calibration, if there is one. The calibration is made from
+|* uncalibrated spectra, since none is applied while one is being made
+\******************************************************************************/
+void FFTAggregator::_calibrate(PreambleType type, float *results)
+	{
+	if (_isCalibrating && (type == TYPE_UPDATE))
+		{
+		for (int i=0; i<_fftSize; i++)
+			_calSum[i] += results[i];
+		_calibrationPasses ++;
 		}
 
-	dmgr.release(buffer);
+	if (_calValues != nullptr)
+		CalibrationCache::subtract(results, _calValues, _fftSize);
+	}
+
+/*****************************************************************************\
+|* Allocate a message for the wire with the preamble already in place, and
+|* point {payload} at the space after it so the results can be written
+|* straight in. Nothing is copied after this - the same buffer goes to every
+|* client
+\******************************************************************************/
+QByteArray FFTAggregator::_message(PreambleType type, float **payload)
+	{
+	uint32_t extent	= _fftSize * sizeof(float);
+	QByteArray msg(sizeof(Preamble) + extent, Qt::Uninitialized);
+
+	Preamble *hdr	= new (msg.data()) Preamble();
+	hdr->extent		= extent;
+	hdr->type		= (uint16_t)type;
+	hdr->bins		= _fftSize;
+	hdr->values		= _fftSize;
+	hdr->channel	= _channel;
+
+	*payload		= reinterpret_cast<float *>(msg.data() + hdr->offset);
+	return msg;
 	}
 
 /*****************************************************************************\
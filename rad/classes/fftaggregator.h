@@ -1,16 +1,30 @@
 #ifndef FFTAGGREGATOR_H
 #define FFTAGGREGATOR_H
 
+#include <QByteArray>
 #include <QMutexLocker>
 #include <QObject>
 
 #include <libra.h>
 
+#include "calibrationcache.h"
+
+class LiveAverage;
+
 class FFTAggregator : public QObject
 	{
 	Q_OBJECT
 
 	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			CAL_BEGIN = 0,				// Start accumulating a calibration
+			CAL_END,					// Save it, and start applying it
+			CAL_LOAD					// Re-read the calibration files
+			} CalibrationAction;
 
 	/**************************************************************************\
 	|* Properties
@@ -19,10 +33,15 @@ class FFTAggregator : public QObject
 	GET(bool, haveData);				// Whether we've received any data yet
 	GET(double, updateSecs);			// Seconds between updates
 	GET(double, sampleSecs);			// Seconds between samples
+	GET(double, liveSecs);				// Seconds between live updates
 	GET(qint64, nextUpdate);			// Next time to deliver an update
 	GET(qint64, nextSample);			// Next time to deliver a sample
-	GET(int, updatePasses);				// Count of update aggregations
-	GET(int, samplePasses);				// Count of sample aggregations
+	GET(qint64, nextLive);				// Next time to deliver a live update
+	GET(int, updatePasses);				// Count of update sub-integrations
+	GET(int, samplePasses);				// Count of sample sub-integrations
+	GET(bool, isCalibrating);			// Accumulating a calibration
+	GET(int, calibrationPasses);		// Updates in the calibration so far
+	GETSET(int, channel, Channel);		// Tagged on every message
 
 
 	private:
@@ -31,18 +50,40 @@ class FFTAggregator : public QObject
 		\**********************************************************************/
 		QMutex			_lock;			// Thread safety
 		double *		_updateData;	// Results of the update aggregation
+		double *		_updateWeight;	// Frames contributing to each bin
 		double *		_sampleData;	// Results of the sample aggregation
+		double *		_sampleWeight;	// Frames contributing to each bin
+		LiveAverage *	_live;			// Continuous average for display
+
+		CalibrationCache		_calibrations;	// Mapped calibration files
+		CalibrationCache::Key	_calKey;		// Settings we're running with
+		const float *			_calValues;		// Applied calibration, or null
+		double *				_calSum;		// Calibration being accumulated
 
 		/**********************************************************************\
 		|* Private methods
 		\**********************************************************************/
+		void _allocate(void);
+		void _free(void);
 		qint64 _deltaT(double delta);
+		QByteArray _normalise(PreambleType type,
+							  double *data,
+							  double *weight);
+		QByteArray _message(PreambleType type, float **payload);
+		void _calibrate(PreambleType type, float *results);
 
 	signals:
 		/**********************************************************************\
-		|* Tell the world we have new data it might want to use
+		|* Tell the world we have new data it might want to use. The message
+		|* is ready for the wire: a Preamble followed by the float spectrum
 		\**********************************************************************/
-		void aggregatedDataReady(PreambleType type, int buffer);
+		void aggregatedDataReady(QByteArray msg);
+
+		/**********************************************************************\
+		|* The calibration being subtracted has changed. {name} is its file,
+		|* or empty if there's none
+		\**********************************************************************/
+		void calibrationApplied(QString name);
 
 	public:
 		/**********************************************************************\
@@ -53,9 +94,26 @@ class FFTAggregator : public QObject
 
 	public slots:
 		/**********************************************************************\
-		|* Receive an FFT buffer from a worker
+		|* Receive a weighted sub-integration from the RFI filter
+		\**********************************************************************/
+		void subIntegrationReady(int bufferId);
+
+		/**********************************************************************\
+		|* Discard what's been accumulated and start again, with a new number
+		|* of bins and integration times
+		\**********************************************************************/
+		void restart(int fftSize, double updateSecs, double sampleSecs);
+
+		/**********************************************************************\
+		|* Switch to the calibration for a new set of radio settings. Any
+		|* calibration in progress is abandoned
+		\**********************************************************************/
+		void setCalibrationKey(CalibrationCache::Key key);
+
+		/**********************************************************************\
+		|* Begin, end or reload a calibration. {action} is a CalibrationAction
 		\**********************************************************************/
-		void fftReady(int bufferId);
+		void calibration(int action);
 
 	};
 
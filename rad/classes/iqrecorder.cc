@@ -0,0 +1,478 @@
+#include <cstring>
+#include <fcntl.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+
+#include "iqrecorder.h"
+#include "metrics.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+#define PAGE_SIZE			4096
+#define MIN_PENDING			(64 * 1024 * 1024)
+#define MAX_CLOCK_SLIP		1000
+
+static_assert(sizeof(IQRecorder::SegmentHeader) == 64,
+			  "Segment header should be 64 bytes");
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+IQRecorder::IQRecorder(const QString& dir,
+					   int segments,
+					   int64_t segmentBytes,
+					   int sampleRate,
+					   int frequency,
+					   QObject *parent)
+		   :QObject(parent)
+		   ,Testable()
+		   ,_dir(dir)
+		   ,_segments((segments < 2) ? 2 : segments)
+		   ,_segmentBytes(segmentBytes)
+		   ,_sampleRate(sampleRate)
+		   ,_frequency(frequency)
+		   ,_sequence(0)
+		   ,_current(-1)
+		   ,_nextIndex(0)
+		   ,_interval(1)
+		   ,_retuned(true)
+		   ,_pending(0)
+		   ,_clockOffset(0)
+		   ,_clocked(false)
+	{
+	int index	= sizeof(SegmentHeader) + INDEX_ENTRIES * sizeof(IndexEntry);
+	_dataOffset	= ((index + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+
+	/**************************************************************************\
+	|* Allow a second of the bulkiest format to queue up
+	\**************************************************************************/
+	_maxPending	= (int64_t)_sampleRate * bytesPerSample(SourceBase::STREAM_CF32);
+	if (_maxPending < MIN_PENDING)
+		_maxPending = MIN_PENDING;
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+IQRecorder::~IQRecorder(void)
+	{
+	close();
+	}
+
+/******************************************************************************\
+|* Bytes per sample
+\******************************************************************************/
+int IQRecorder::bytesPerSample(SourceBase::StreamFormat fmt)
+	{
+	switch (fmt)
+		{
+		case SourceBase::STREAM_S16C:
+			return 4;
+		case SourceBase::STREAM_CF32:
+			return 8;
+		default:
+			return 2;
+		}
+	}
+
+/******************************************************************************\
+|* Size the segments for a retention time, rounded up to whole pages
+\******************************************************************************/
+int64_t IQRecorder::segmentBytesFor(double retention,
+									int segments,
+									int sampleRate,
+									SourceBase::StreamFormat fmt)
+	{
+	if (segments < 2)
+		segments = 2;
+
+	double total	= retention * sampleRate * bytesPerSample(fmt);
+	int64_t bytes	= (int64_t)(total / segments);
+	return ((bytes + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+	}
+
+/******************************************************************************\
+|* Make and map the segment files. Ones left from last time are reused, and
+|* the ring carries on from the newest of them
+\******************************************************************************/
+bool IQRecorder::open(void)
+	{
+	if (!QDir().mkpath(_dir))
+		{
+		ERR << "Cannot create IQ directory" << _dir;
+		return false;
+		}
+
+	qint64 size = _dataOffset + _segmentBytes;
+	for (int i=0; i<_segments; i++)
+		{
+		QString path	= QString("%1/segment-%2.iq").arg(_dir)
+												.arg(i, 2, 10, QChar('0'));
+		QFile *file		= new QFile(path);
+		_files.append(file);
+
+		if (!file->open(QIODevice::ReadWrite))
+			{
+			ERR << "Cannot open IQ segment" << path;
+			close();
+			return false;
+			}
+
+		/**********************************************************************\
+		|* A segment of the wrong size is from other settings: start it again.
+		|* Reserve the blocks now, so a full disk shows up here, not as a
+		|* SIGBUS when the mapping is written to
+		\**********************************************************************/
+		bool fresh = (file->size() != size);
+		if (fresh)
+			{
+			file->resize(0);
+			file->resize(size);
+#if defined(Q_OS_LINUX)
+			if (posix_fallocate(file->handle(), 0, size) != 0)
+				{
+				ERR << "Cannot reserve" << size << "bytes for" << path;
+				close();
+				return false;
+				}
+#endif
+			}
+
+		uchar *map = file->map(0, size);
+		if (map == nullptr)
+			{
+			ERR << "Cannot map IQ segment" << path;
+			close();
+			return false;
+			}
+		_maps.append(map);
+
+		if (fresh)
+			memset(map, 0, sizeof(SegmentHeader));
+		}
+
+	/**************************************************************************\
+	|* Carry on after the newest segment
+	\**************************************************************************/
+	_current	= _segments - 1;
+	_sequence	= 0;
+	for (int i=0; i<_segments; i++)
+		{
+		SegmentHeader *hdr = _header(i);
+		if ((hdr->magic == SEGMENT_MAGIC)
+		 && (hdr->version == SEGMENT_VERSION)
+		 && (hdr->sequence > _sequence))
+			{
+			_sequence	= hdr->sequence;
+			_current	= i;
+			}
+		}
+	_retuned = true;
+
+	LOG << "Recording raw IQ to" << _segments << "segments of"
+		<< _segmentBytes << "bytes in" << _dir;
+	return true;
+	}
+
+/******************************************************************************\
+|* Unmap and close the segments
+\******************************************************************************/
+void IQRecorder::close(void)
+	{
+	for (int i=0; i<_maps.size(); i++)
+		_files.at(i)->unmap(_maps.at(i));
+	qDeleteAll(_files);
+	_maps.clear();
+	_files.clear();
+	}
+
+/******************************************************************************\
+|* Take a buffer from the source, on the source thread. Hold on to it, and
+|* have it written out on ours
+\******************************************************************************/
+void IQRecorder::capture(int64_t bufId,
+						 int samples,
+						 int max,
+						 SourceBase::StreamFormat fmt,
+						 int64_t timeNs)
+	{
+	Q_UNUSED(max);
+
+	int64_t bytes	= (int64_t)samples * bytesPerSample(fmt);
+	int64_t msecs	= QDateTime::currentMSecsSinceEpoch();
+
+	/**************************************************************************\
+	|* The radio's clock starts wherever it likes, so pin it to the wall clock
+	|* with the first buffer it stamps, and again if it's reset or drifts off
+	\**************************************************************************/
+	if (timeNs != 0)
+		{
+		int64_t radio = timeNs / 1000000;
+		if (!_clocked || (qAbs(radio + _clockOffset - msecs) > MAX_CLOCK_SLIP))
+			{
+			_clockOffset	= msecs - radio;
+			_clocked		= true;
+			}
+		msecs = radio + _clockOffset;
+		}
+
+	if (_maps.isEmpty())
+		return;
+
+	if (_pending.fetch_add(bytes) + bytes > _maxPending)
+		{
+		_pending -= bytes;
+		Metrics::instance().add(Metrics::IQ_DROPS);
+		return;
+		}
+
+	DataMgr &dmgr = DataMgr::instance();
+	dmgr.retain(bufId);
+
+	QMetaObject::invokeMethod(this, [this, bufId, bytes, msecs, fmt]()
+		{
+		DataMgr &dmgr = DataMgr::instance();
+		_write(dmgr.asUint8(bufId), bytes, msecs, fmt);
+		dmgr.release(bufId);
+		_pending -= bytes;
+		}, Qt::QueuedConnection);
+	}
+
+/******************************************************************************\
+|* The radio's been retuned. Buffers already queued were captured before
+|* the change, so this is queued behind them
+\******************************************************************************/
+void IQRecorder::retune(int frequency, int sampleRate)
+	{
+	_frequency	= frequency;
+	_sampleRate	= sampleRate;
+	_retuned	= true;
+	}
+
+/******************************************************************************\
+|* Private method: the header of a segment
+\******************************************************************************/
+IQRecorder::SegmentHeader * IQRecorder::_header(int segment)
+	{
+	return reinterpret_cast<SegmentHeader *>(_maps.at(segment));
+	}
+
+/******************************************************************************\
+|* Private method: move on to the next segment, which is the oldest. It's
+|* marked invalid until its header describes what's going into it
+\******************************************************************************/
+void IQRecorder::_startSegment(int64_t msecs, SourceBase::StreamFormat fmt)
+	{
+	_current			= (_current + 1) % _segments;
+	SegmentHeader *hdr	= _header(_current);
+
+	hdr->magic			= 0;
+	hdr->version		= SEGMENT_VERSION;
+	hdr->format			= (uint16_t)fmt;
+	hdr->sampleRate		= _sampleRate;
+	hdr->frequency		= _frequency;
+	hdr->sequence		= ++_sequence;
+	hdr->startMsecs		= msecs;
+	hdr->endMsecs		= msecs;
+	hdr->used			= 0;
+	hdr->entries		= 0;
+	hdr->dataOffset		= _dataOffset;
+	hdr->reserved		= 0;
+	hdr->magic			= SEGMENT_MAGIC;
+
+	/**************************************************************************\
+	|* Spread the index entries over the time the segment will take to fill
+	\**************************************************************************/
+	double rate		= (double)_sampleRate * bytesPerSample(fmt);
+	double span		= (rate > 0) ? 1000.0 * _segmentBytes / rate : 0;
+	_interval		= (int64_t)(span / INDEX_ENTRIES) + 1;
+	_nextIndex		= msecs;
+	_retuned		= false;
+	}
+
+/******************************************************************************\
+|* Private method: copy a buffer into the ring. Samples never straddle two
+|* segments, so each can be read on its own
+\******************************************************************************/
+void IQRecorder::_write(const uint8_t *data,
+						int64_t bytes,
+						int64_t msecs,
+						SourceBase::StreamFormat fmt)
+	{
+	if (_maps.isEmpty())
+		return;
+
+	if (bytes > _segmentBytes)
+		{
+		WARN << "Buffer of" << bytes << "bytes truncated to fit a segment";
+		bytes = _segmentBytes - (_segmentBytes % bytesPerSample(fmt));
+		}
+
+	SegmentHeader *hdr = (_current < 0) ? nullptr : _header(_current);
+	if (_retuned
+	 || (hdr == nullptr)
+	 || (hdr->magic != SEGMENT_MAGIC)
+	 || (hdr->format != (uint16_t)fmt)
+	 || (hdr->used + bytes > _segmentBytes))
+		{
+		_startSegment(msecs, fmt);
+		hdr = _header(_current);
+		}
+
+	uchar *base = _maps.at(_current);
+	if ((msecs >= _nextIndex) && (hdr->entries < INDEX_ENTRIES))
+		{
+		IndexEntry *index	= reinterpret_cast<IndexEntry *>(base + sizeof(SegmentHeader));
+		index[hdr->entries]	= {msecs, hdr->used};
+		hdr->entries ++;
+		_nextIndex			= msecs + _interval;
+		}
+
+	memcpy(base + _dataOffset + hdr->used, data, bytes);
+	hdr->used		+= bytes;
+	hdr->endMsecs	= msecs;
+
+	Metrics::instance().add(Metrics::IQ_BYTES, bytes);
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int IQRecorder::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * IQRecorder::testClassName(void)
+	{
+	return "IQRecorder";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult IQRecorder::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkRing();
+		case 1:
+			return _checkIndex();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : somewhere to keep test segments, and a way to clear it up
+\******************************************************************************/
+static QString _testDir(const char *name)
+	{
+	return QDir::tempPath() + QString("/rad-iq-%1-%2")
+									.arg(name)
+									.arg(QCoreApplication::applicationPid());
+	}
+
+static void _removeDir(IQRecorder& recorder)
+	{
+	recorder.close();
+	for (int i=0; i<recorder.segments(); i++)
+		QFile::remove(QString("%1/segment-%2.iq").arg(recorder.dir())
+												.arg(i, 2, 10, QChar('0')));
+	QDir().rmdir(recorder.dir());
+	}
+
+/******************************************************************************\
+|* Test interface : 5 buffers that each need a segment, into a ring of 3.
+|* The 4th and 5th should replace the 1st and 2nd, and a recorder opened
+|* on the same files afterwards should carry on after the 5th
+\******************************************************************************/
+Testable::TestResult IQRecorder::_checkRing(void)
+	{
+	IQRecorder recorder(_testDir("ring"), 3, PAGE_SIZE);
+	bool ok = recorder.open();
+
+	uint8_t buffer[3000];
+	for (int k=0; ok && k<5; k++)
+		{
+		memset(buffer, k, sizeof(buffer));
+		recorder._write(buffer, sizeof(buffer), 1000 * (k+1), SourceBase::STREAM_S8C);
+		}
+
+	for (int i=0; ok && i<3; i++)
+		{
+		SegmentHeader *hdr	= recorder._header(i);
+		uint8_t *data		= recorder._maps.at(i) + recorder._dataOffset;
+		uint64_t expect		= (i < 2) ? i + 4 : 3;
+		ok = (hdr->magic == SEGMENT_MAGIC)
+		  && (hdr->sequence == expect)
+		  && (hdr->used == sizeof(buffer))
+		  && (hdr->startMsecs == (int64_t)(1000 * expect))
+		  && (data[0] == expect - 1)
+		  && (data[sizeof(buffer)-1] == expect - 1);
+		}
+	recorder.close();
+
+	IQRecorder again(recorder.dir(), 3, PAGE_SIZE);
+	ok = ok && again.open()
+			&& (again.sequence() == 5)
+			&& (again._current == 1);
+
+	if (!ok)
+		ERR << "IQ ring at sequence" << again.sequence()
+			<< "segment" << again._current;
+	_removeDir(again);
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : at 1000 samples/s of S16C a 1MB segment lasts 262s, so
+|* index entries should be 257ms or more apart. Buffers every 100ms should
+|* be indexed at 0, 300, 600 and 900ms. A retune should then start a new
+|* segment with the new frequency
+\******************************************************************************/
+Testable::TestResult IQRecorder::_checkIndex(void)
+	{
+	IQRecorder recorder(_testDir("index"), 2, 1 << 20, 1000, 1420406000);
+	bool ok = recorder.open();
+
+	uint8_t buffer[400];
+	memset(buffer, 0, sizeof(buffer));
+	for (int t=0; ok && t<=1000; t+=100)
+		recorder._write(buffer, sizeof(buffer), t, SourceBase::STREAM_S16C);
+
+	SegmentHeader *hdr	= ok ? recorder._header(recorder._current) : nullptr;
+	IndexEntry *index	= ok ? reinterpret_cast<IndexEntry *>(hdr + 1) : nullptr;
+	ok = ok && (hdr->entries == 4)
+			&& (hdr->used == 11 * 400)
+			&& (hdr->endMsecs == 1000);
+	for (int i=0; ok && i<4; i++)
+		ok = (index[i].msecs == i * 300) && (index[i].offset == i * 1200);
+
+	recorder.retune(1421000000, 1000);
+	recorder._write(buffer, sizeof(buffer), 1100, SourceBase::STREAM_S16C);
+	hdr = ok ? recorder._header(recorder._current) : nullptr;
+	ok = ok && (hdr->frequency == 1421000000)
+			&& (hdr->sequence == 2)
+			&& (hdr->used == 400)
+			&& (hdr->entries == 1);
+
+	if (!ok)
+		ERR << "IQ index check failed";
+	_removeDir(recorder);
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
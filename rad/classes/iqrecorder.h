@@ -0,0 +1,196 @@
+#ifndef IQRECORDER_H
+#define IQRECORDER_H
+
+#include <atomic>
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <libra.h>
+
+#include "sourcebase.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+/******************************************************************************\
+|* Keeps the last few minutes of raw IQ, as it came from the radio, so that
+|* something seen in the spectra can be gone back to.
+|*
+|* The IQ goes into a ring of {segments} files, each made full-size up front
+|* and mapped, so recording is a memcpy and never grows a file. A segment
+|* starts with a 64-byte header, then a time index, then the samples:
+|*
+|*	[SegmentHeader][IndexEntry x INDEX_ENTRIES][pad to a page][samples...]
+|*
+|* The index has an entry every so often, giving the wall-clock time of the
+|* sample at a given offset. Radios that timestamp their samples have their
+|* clock mapped onto the wall clock once, so the times don't jitter with
+|* when the buffers happen to arrive. When a segment is full the oldest is reused,
+|* and its header is cleared first, so a reader never sees a half-rewritten
+|* segment as valid. A segment also ends on a retune, so each holds one
+|* frequency and rate.
+|*
+|* capture() is connected directly to the source, so it runs on the source
+|* thread: it takes a reference on the buffer and queues it for the
+|* recorder's own thread, which does the copying. Nothing the DSP does waits
+|* on it. If the recorder falls more than a second behind, buffers are
+|* dropped (and counted) rather than queued without limit
+\******************************************************************************/
+class IQRecorder : public QObject, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef struct
+			{
+			uint32_t	magic;				// SEGMENT_MAGIC, 0 while rewriting
+			uint16_t	version;			// SEGMENT_VERSION
+			uint16_t	format;				// SourceBase::StreamFormat
+			int32_t		sampleRate;			// Samples per second
+			int32_t		frequency;			// Centre frequency in Hz
+			uint64_t	sequence;			// Increases with each segment
+			int64_t		startMsecs;			// Time of the first sample
+			int64_t		endMsecs;			// Time of the last buffer
+			int64_t		used;				// Bytes of samples written
+			int32_t		entries;			// Index entries in use
+			int32_t		dataOffset;			// Where the samples start
+			int64_t		reserved;			// Zero
+			} SegmentHeader;
+
+		typedef struct
+			{
+			int64_t		msecs;				// Wall-clock time of the sample...
+			int64_t		offset;				// ... at this offset into the data
+			} IndexEntry;
+
+		static const uint32_t	SEGMENT_MAGIC	= 0x51495152;	// "RQIQ"
+		static const uint16_t	SEGMENT_VERSION	= 1;
+		static const int		INDEX_ENTRIES	= 1024;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, dir);					// Where the segments live
+	GET(int, segments);					// Files in the ring
+	GET(int64_t, segmentBytes);			// Sample bytes per file
+	GET(int, sampleRate);				// Current sample rate
+	GET(int, frequency);				// Current centre frequency
+	GET(uint64_t, sequence);			// Sequence of the current segment
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QList<QFile *>			_files;		// One per segment
+		QList<uchar *>			_maps;		// ... and its mapping
+		int						_current;	// Segment being written
+		int						_dataOffset;// Header + index, page aligned
+		int64_t					_nextIndex;	// When to add an index entry
+		int64_t					_interval;	// Milliseconds between entries
+		bool					_retuned;	// Start a segment on next write
+		int64_t					_maxPending;// Bytes allowed in the queue
+		std::atomic<int64_t>	_pending;	// Bytes queued for writing
+		int64_t					_clockOffset;// Radio clock to wall clock, ms
+		bool					_clocked;	// Whether the offset is known
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		SegmentHeader * _header(int segment);
+		void _startSegment(int64_t msecs, SourceBase::StreamFormat fmt);
+		void _write(const uint8_t *data,
+					int64_t bytes,
+					int64_t msecs,
+					SourceBase::StreamFormat fmt);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit IQRecorder(const QString& dir,
+							int segments = 2,
+							int64_t segmentBytes = 1 << 20,
+							int sampleRate = 2048000,
+							int frequency = 1420406000,
+							QObject *parent = nullptr);
+		~IQRecorder(void);
+
+		/**********************************************************************\
+		|* Sample bytes per segment to keep {retention} seconds over
+		|* {segments} files at a given rate and format
+		\**********************************************************************/
+		static int64_t segmentBytesFor(double retention,
+									   int segments,
+									   int sampleRate,
+									   SourceBase::StreamFormat fmt);
+
+		/**********************************************************************\
+		|* Bytes in one IQ sample of a format
+		\**********************************************************************/
+		static int bytesPerSample(SourceBase::StreamFormat fmt);
+
+		/**********************************************************************\
+		|* Make (or reuse) and map the segment files. Returns false if any
+		|* of them can't be
+		\**********************************************************************/
+		bool open(void);
+
+		/**********************************************************************\
+		|* Unmap and close them
+		\**********************************************************************/
+		void close(void);
+
+	public slots:
+		/**********************************************************************\
+		|* A buffer from the source. Connect with Qt::DirectConnection. If the
+		|* radio timestamps its samples, {timeNs} is used for the time rather
+		|* than when the buffer turned up
+		\**********************************************************************/
+		void capture(int64_t bufId,
+					 int samples,
+					 int max,
+					 SourceBase::StreamFormat fmt,
+					 int64_t timeNs = 0);
+
+		/**********************************************************************\
+		|* The radio has been retuned, so start a new segment
+		\**********************************************************************/
+		void retune(int frequency, int sampleRate);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check the ring wraps onto the oldest segment
+		\**********************************************************************/
+		Testable::TestResult _checkRing(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check the index, and that a retune starts a segment
+		\**********************************************************************/
+		Testable::TestResult _checkIndex(void);
+	};
+
+#endif // IQRECORDER_H
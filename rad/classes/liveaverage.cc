@@ -0,0 +1,305 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <libra.h>
+
+#include "liveaverage.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Running totals in the window are add-one-subtract-one, so rounding error
+|* slowly builds up. Re-sum the ring this often to keep them honest
+\******************************************************************************/
+#define RESYNC_PUSHES		4096
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+LiveAverage::LiveAverage(int fftSize, Config::LiveMode mode, int span)
+			:_fftSize(fftSize)
+			,_mode(mode)
+			,_span((span < 1) ? 1 : span)
+			,_alpha(0)
+			,_filled(0)
+			,_head(0)
+			,_pushes(0)
+			,_sum(nullptr)
+			,_weight(nullptr)
+			,_ringSum(nullptr)
+			,_ringWeight(nullptr)
+	{
+	/**************************************************************************\
+	|* Give the EMA the same centre-of-mass as an N-entry window
+	\**************************************************************************/
+	_alpha		= 2.0 / (_span + 1.0);
+
+	_sum		= new double[_fftSize];
+	_weight		= new double[_fftSize];
+
+	if (_mode == Config::L_WINDOW)
+		{
+		_ringSum	= new double[_span * _fftSize];
+		_ringWeight	= new double[_span * _fftSize];
+		}
+
+	reset();
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+LiveAverage::~LiveAverage(void)
+	{
+	delete [] _sum;
+	delete [] _weight;
+	delete [] _ringSum;
+	delete [] _ringWeight;
+	}
+
+/******************************************************************************\
+|* Forget everything we've seen
+\******************************************************************************/
+void LiveAverage::reset(void)
+	{
+	memset(_sum, 0, _fftSize * sizeof(double));
+	memset(_weight, 0, _fftSize * sizeof(double));
+	_filled	= 0;
+	_head	= 0;
+	_pushes	= 0;
+	}
+
+/******************************************************************************\
+|* Fold in a sub-integration
+\******************************************************************************/
+void LiveAverage::add(const double *sum, const double *weight)
+	{
+	switch (_mode)
+		{
+		case Config::L_EMA:
+			_addEMA(sum, weight);
+			break;
+
+		case Config::L_WINDOW:
+			_addWindow(sum, weight);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+/******************************************************************************\
+|* Write out the per-bin mean
+\******************************************************************************/
+void LiveAverage::snapshot(float *results)
+	{
+	for (int i=0; i<_fftSize; i++)
+		results[i] = (_weight[i] > 0) ? (float)(_sum[i] / _weight[i]) : 0.0f;
+	}
+
+/******************************************************************************\
+|* Private method: EMA update. The first sub-integration seeds the average so
+|* that it doesn't have to climb up from zero
+\******************************************************************************/
+void LiveAverage::_addEMA(const double *sum, const double *weight)
+	{
+	double a	= (_filled == 0) ? 1.0 : _alpha;
+	double *s	= _sum;
+	double *w	= _weight;
+
+	for (int i=0; i<_fftSize; i++)
+		{
+		s[i] += a * (sum[i] - s[i]);
+		w[i] += a * (weight[i] - w[i]);
+		}
+
+	_filled = 1;
+	}
+
+/******************************************************************************\
+|* Private method: sliding-window update. Subtract the entry that is about to
+|* be overwritten (zero until the ring has filled), add the new one, and
+|* store it in its place
+\******************************************************************************/
+void LiveAverage::_addWindow(const double *sum, const double *weight)
+	{
+	double *s		= _sum;
+	double *w		= _weight;
+	double *oldSum	= _ringSum + _head * _fftSize;
+	double *oldWt	= _ringWeight + _head * _fftSize;
+
+	if (_filled < _span)
+		{
+		memset(oldSum, 0, _fftSize * sizeof(double));
+		memset(oldWt, 0, _fftSize * sizeof(double));
+		_filled ++;
+		}
+
+	for (int i=0; i<_fftSize; i++)
+		{
+		s[i]		+= sum[i] - oldSum[i];
+		w[i]		+= weight[i] - oldWt[i];
+		oldSum[i]	= sum[i];
+		oldWt[i]	= weight[i];
+		}
+
+	_head = (_head + 1) % _span;
+
+	if (++_pushes >= RESYNC_PUSHES)
+		_resync();
+	}
+
+/******************************************************************************\
+|* Private method: recompute the window totals from the ring
+\******************************************************************************/
+void LiveAverage::_resync(void)
+	{
+	memset(_sum, 0, _fftSize * sizeof(double));
+	memset(_weight, 0, _fftSize * sizeof(double));
+
+	for (int slot=0; slot<_filled; slot++)
+		{
+		double *rs = _ringSum + slot * _fftSize;
+		double *rw = _ringWeight + slot * _fftSize;
+		for (int i=0; i<_fftSize; i++)
+			{
+			_sum[i]		+= rs[i];
+			_weight[i]	+= rw[i];
+			}
+		}
+	_pushes = 0;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int LiveAverage::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * LiveAverage::testClassName(void)
+	{
+	return "LiveAverage";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult LiveAverage::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkWindowMean();
+		case 1:
+			return _checkEMA();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : Push several windows' worth of random sub-integrations,
+|* some with excised bins, and compare against re-summing the last {span}
+\******************************************************************************/
+Testable::TestResult LiveAverage::_checkWindowMean(void)
+	{
+	if (_mode != Config::L_WINDOW)
+		{
+		ERR << "Window test needs a window-mode instance";
+		return Testable::TEST_FAIL;
+		}
+
+	std::mt19937 rng(1051);
+	std::uniform_real_distribution<double> value(0.0, 10.0);
+	std::uniform_int_distribution<int> drop(0, 15);
+
+	int pushes = _span * 3 + _span / 2;
+	std::vector<double> sums(pushes * _fftSize);
+	std::vector<double> weights(pushes * _fftSize);
+
+	reset();
+	for (int p=0; p<pushes; p++)
+		{
+		double *s = sums.data() + p * _fftSize;
+		double *w = weights.data() + p * _fftSize;
+		for (int i=0; i<_fftSize; i++)
+			{
+			bool keep	= drop(rng) != 0;
+			s[i]		= keep ? value(rng) : 0.0;
+			w[i]		= keep ? 128.0 : 0.0;
+			}
+		add(s, w);
+		}
+
+	std::vector<float> live(_fftSize);
+	snapshot(live.data());
+
+	for (int i=0; i<_fftSize; i++)
+		{
+		double s = 0, w = 0;
+		for (int p=pushes-_span; p<pushes; p++)
+			{
+			s += sums[p * _fftSize + i];
+			w += weights[p * _fftSize + i];
+			}
+		float expect = (w > 0) ? (float)(s / w) : 0.0f;
+		if (fabs(live[i] - expect) > 1e-5)
+			{
+			ERR << "Bin" << i << "window mean" << live[i]
+				<< "expected" << expect;
+			return Testable::TEST_FAIL;
+			}
+		}
+
+	reset();
+	return Testable::TEST_PASS;
+	}
+
+/******************************************************************************\
+|* Test interface : The first push should seed the EMA exactly, and a step
+|* should then close (1-alpha) of the remaining gap on each push
+\******************************************************************************/
+Testable::TestResult LiveAverage::_checkEMA(void)
+	{
+	Config::LiveMode oldMode = _mode;
+	_mode = Config::L_EMA;
+	reset();
+
+	std::vector<double> sum(_fftSize, 2.0 * 128);
+	std::vector<double> weight(_fftSize, 128.0);
+	std::vector<float> live(_fftSize);
+
+	add(sum.data(), weight.data());
+	snapshot(live.data());
+	bool ok = (fabs(live[0] - 2.0) < 1e-6);
+
+	for (int i=0; i<_fftSize; i++)
+		sum[i] = 4.0 * 128;
+
+	int steps = 5;
+	for (int p=0; p<steps; p++)
+		add(sum.data(), weight.data());
+	snapshot(live.data());
+
+	double expect = 4.0 - 2.0 * pow(1.0 - _alpha, steps);
+	ok = ok && (fabs(live[_fftSize-1] - expect) < 1e-5);
+	if (!ok)
+		ERR << "EMA gave" << live[_fftSize-1] << "expected" << expect;
+
+	_mode = oldMode;
+	reset();
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,106 @@
+#ifndef LIVEAVERAGE_H
+#define LIVEAVERAGE_H
+
+#include <libra.h>
+
+#include "config.h"
+
+/******************************************************************************\
+|* The live average keeps a continuously-updated spectrum for the display,
+|* independent of the update/sample tiers which reset at every emit. It is
+|* fed the weighted sub-integrations from the RFI filter, and can run as:
+|*
+|*	- an exponential moving average over both the sums and the weights, so
+|*	  excised bins decay out rather than dragging the mean down
+|*	- a true sliding-window mean over the last {span} sub-integrations. A
+|*	  ring holds each sub-integration, and the running totals are updated by
+|*	  adding the new one and subtracting the one falling out of the window
+|*
+|* Either way the cost per sub-integration is O(fftSize), whatever the span
+\******************************************************************************/
+class LiveAverage : public Testable
+	{
+	NON_COPYABLE_NOR_MOVEABLE(LiveAverage);
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, fftSize);					// Bins in the FFT
+	GET(Config::LiveMode, mode);		// EMA, sliding window or off
+	GET(int, span);						// Sub-integrations in the window
+	GET(double, alpha);					// EMA coefficient, from the span
+	GET(int, filled);					// Ring entries in use
+	GET(int, head);						// Next ring entry to overwrite
+	GET(int, pushes);					// Adds since the last resync
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		double *		_sum;			// Running sum (or EMA) per bin
+		double *		_weight;		// Running weight (or EMA) per bin
+		double *		_ringSum;		// {span} x {fftSize} past sums
+		double *		_ringWeight;	// {span} x {fftSize} past weights
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		void _addEMA(const double *sum, const double *weight);
+		void _addWindow(const double *sum, const double *weight);
+		void _resync(void);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit LiveAverage(int fftSize, Config::LiveMode mode, int span);
+		~LiveAverage(void);
+
+		/**********************************************************************\
+		|* Fold in a sub-integration of {fftSize} sums and {fftSize} weights
+		\**********************************************************************/
+		void add(const double *sum, const double *weight);
+
+		/**********************************************************************\
+		|* Write the current per-bin mean into {results}. Excised bins are 0
+		\**********************************************************************/
+		void snapshot(float *results);
+
+		/**********************************************************************\
+		|* Forget everything we've seen
+		\**********************************************************************/
+		void reset(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check the window matches a brute-force mean
+		\**********************************************************************/
+		Testable::TestResult _checkWindowMean(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check the EMA seeds, steps and decays correctly
+		\**********************************************************************/
+		Testable::TestResult _checkEMA(void);
+	};
+
+#endif // LIVEAVERAGE_H
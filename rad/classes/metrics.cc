@@ -0,0 +1,421 @@
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <QSet>
+
+#include "metrics.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* What the counters and timers are called when they're scraped
+\******************************************************************************/
+static const struct
+	{
+	const char *name;
+	const char *help;
+	} _counterInfo[Metrics::NUM_COUNTERS] =
+	{
+	{"rad_samples_total",			"IQ samples received from the source"},
+	{"rad_source_buffers_total",	"Buffers received from the source"},
+	{"rad_source_overruns_total",	"Gaps detected in the source stream"},
+	{"rad_source_discards_total",	"Source buffers dropped while retuning"},
+	{"rad_fft_queued_total",		"FFT frames handed to the thread pool"},
+	{"rad_fft_frames_total",		"FFT frames computed"},
+	{"rad_subintegrations_total",	"RFI sub-integrations aggregated"},
+	{"rad_messages_total",			"Products handed to client queues"},
+	{"rad_iq_bytes_total",			"Raw IQ bytes recorded"},
+	{"rad_iq_drops_total",			"Buffers the IQ recorder fell behind on"},
+	};
+
+static const struct
+	{
+	const char *name;
+	const char *help;
+	} _timerInfo[Metrics::NUM_TIMERS] =
+	{
+	{"rad_fft_task_seconds",		"FFT task time from queued to done"},
+	{"rad_aggregate_seconds",		"Time to merge one sub-integration"},
+	};
+
+static const double _quantiles[] = {0.5, 0.9, 0.99};
+
+/******************************************************************************\
+|* Per-thread state, a source of ids to tell instances apart by, and the ids
+|* still alive, so a thread never hands a shard back to one that's gone
+\******************************************************************************/
+thread_local Metrics::Holder	Metrics::_tls;
+static std::atomic<uint64_t>	_nextId(1);
+static QMutex					_liveLock;
+static QSet<uint64_t>			_live;
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+Metrics::Metrics(void)
+		:_retired()
+		,_id(_nextId++)
+	{
+	QMutexLocker guard(&_liveLock);
+	_live.insert(_id);
+	}
+
+/******************************************************************************\
+|* Destructor. Threads still holding a shard find we've gone, and leave it
+\******************************************************************************/
+Metrics::~Metrics(void)
+	{
+	{
+	QMutexLocker guard(&_liveLock);
+	_live.remove(_id);
+	}
+	qDeleteAll(_shards);
+	qDeleteAll(_free);
+	}
+
+/******************************************************************************\
+|* A thread's hold on its shard
+\******************************************************************************/
+Metrics::Holder::Holder(void)
+		:owner(nullptr)
+		,id(0)
+		,shard(nullptr)
+	{}
+
+Metrics::Holder::~Holder(void)
+	{
+	release();
+	}
+
+/******************************************************************************\
+|* Give the shard back, if its instance is still there to take it
+\******************************************************************************/
+void Metrics::Holder::release(void)
+	{
+	if (shard == nullptr)
+		return;
+
+	QMutexLocker guard(&_liveLock);
+	if (_live.contains(id))
+		owner->_retire(shard);
+
+	owner	= nullptr;
+	id		= 0;
+	shard	= nullptr;
+	}
+
+/******************************************************************************\
+|* Find this thread's shard. The cached one is only used if it belongs to
+|* this instance, which it always will outside of the tests. A new one comes
+|* off the free list if there's one there
+\******************************************************************************/
+Metrics::Shard * Metrics::_shard(void)
+	{
+	if (_tls.id == _id)
+		return _tls.shard;
+
+	_tls.release();
+
+	Shard *shard = nullptr;
+	{
+	QMutexLocker guard(&_lock);
+	shard = _free.isEmpty() ? new Shard() : _free.takeLast();
+	_shards.append(shard);
+	}
+
+	_tls.owner	= this;
+	_tls.id		= _id;
+	_tls.shard	= shard;
+	return shard;
+	}
+
+/******************************************************************************\
+|* Fold a shard into the retired total. Its thread is finishing, so nothing
+|* else writes to it, and it can be zeroed for the next one
+\******************************************************************************/
+void Metrics::_retire(Shard *shard)
+	{
+	QMutexLocker guard(&_lock);
+	for (int i=0; i<NUM_COUNTERS; i++)
+		_retired.counters[i].fetch_add(shard->counters[i].exchange(0),
+									   std::memory_order_relaxed);
+
+	for (int i=0; i<NUM_TIMERS; i++)
+		{
+		for (int j=0; j<NUM_BUCKETS; j++)
+			_retired.buckets[i][j].fetch_add(shard->buckets[i][j].exchange(0),
+											 std::memory_order_relaxed);
+		_retired.nanos[i].fetch_add(shard->nanos[i].exchange(0),
+									std::memory_order_relaxed);
+		}
+
+	_shards.removeAll(shard);
+	_free.append(shard);
+	}
+
+/******************************************************************************\
+|* Count something
+\******************************************************************************/
+void Metrics::add(Counter counter, uint64_t count)
+	{
+	_shard()->counters[counter].fetch_add(count, std::memory_order_relaxed);
+	}
+
+/******************************************************************************\
+|* Record a timing. Bucket b holds [2^(b-1), 2^b) nanoseconds
+\******************************************************************************/
+void Metrics::time(Timer timer, int64_t nanos)
+	{
+	int bucket = 0;
+	if (nanos > 0)
+		bucket = 64 - __builtin_clzll((uint64_t)nanos);
+	if (bucket >= NUM_BUCKETS)
+		bucket = NUM_BUCKETS - 1;
+
+	Shard *shard = _shard();
+	shard->buckets[timer][bucket].fetch_add(1, std::memory_order_relaxed);
+	shard->nanos[timer].fetch_add((nanos > 0) ? nanos : 0,
+								  std::memory_order_relaxed);
+	}
+
+/******************************************************************************\
+|* Monotonic time in nanoseconds
+\******************************************************************************/
+int64_t Metrics::now(void)
+	{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+				.count();
+	}
+
+/******************************************************************************\
+|* Sum a counter over the threads
+\******************************************************************************/
+uint64_t Metrics::total(Counter counter)
+	{
+	QMutexLocker guard(&_lock);
+	uint64_t sum = _retired.counters[counter].load(std::memory_order_relaxed);
+	for (Shard *shard : qAsConst(_shards))
+		sum += shard->counters[counter].load(std::memory_order_relaxed);
+	return sum;
+	}
+
+/******************************************************************************\
+|* Estimate a quantile, interpolating within the bucket it falls in
+\******************************************************************************/
+double Metrics::quantile(Timer timer, double q)
+	{
+	uint64_t buckets[NUM_BUCKETS] = {0};
+	uint64_t num = 0;
+	{
+	QMutexLocker guard(&_lock);
+	for (int i=0; i<NUM_BUCKETS; i++)
+		buckets[i] = _retired.buckets[timer][i].load(std::memory_order_relaxed);
+	for (Shard *shard : qAsConst(_shards))
+		for (int i=0; i<NUM_BUCKETS; i++)
+			buckets[i] += shard->buckets[timer][i].load(std::memory_order_relaxed);
+	}
+
+	for (int i=0; i<NUM_BUCKETS; i++)
+		num += buckets[i];
+	if (num == 0)
+		return 0;
+
+	double target	= q * num;
+	double seen		= 0;
+	for (int i=0; i<NUM_BUCKETS; i++)
+		{
+		if ((buckets[i] > 0) && (seen + buckets[i] >= target))
+			{
+			double lo	= (i == 0) ? 0 : ldexp(1.0, i-1);
+			double hi	= ldexp(1.0, i);
+			double frac	= (target - seen) / buckets[i];
+			return (lo + frac * (hi - lo)) * 1e-9;
+			}
+		seen += buckets[i];
+		}
+	return ldexp(1.0, NUM_BUCKETS - 1) * 1e-9;
+	}
+
+/******************************************************************************\
+|* Number of timings recorded
+\******************************************************************************/
+uint64_t Metrics::count(Timer timer)
+	{
+	QMutexLocker guard(&_lock);
+	uint64_t num = 0;
+	for (int i=0; i<NUM_BUCKETS; i++)
+		num += _retired.buckets[timer][i].load(std::memory_order_relaxed);
+	for (Shard *shard : qAsConst(_shards))
+		for (int i=0; i<NUM_BUCKETS; i++)
+			num += shard->buckets[timer][i].load(std::memory_order_relaxed);
+	return num;
+	}
+
+/******************************************************************************\
+|* Total of the timings recorded, in seconds
+\******************************************************************************/
+double Metrics::seconds(Timer timer)
+	{
+	QMutexLocker guard(&_lock);
+	uint64_t nanos = _retired.nanos[timer].load(std::memory_order_relaxed);
+	for (Shard *shard : qAsConst(_shards))
+		nanos += shard->nanos[timer].load(std::memory_order_relaxed);
+	return nanos * 1e-9;
+	}
+
+/******************************************************************************\
+|* Render in the Prometheus text format
+\******************************************************************************/
+QString Metrics::render(void)
+	{
+	QString text;
+
+	for (int i=0; i<NUM_COUNTERS; i++)
+		{
+		QString name	= _counterInfo[i].name;
+		text		   += "# HELP " + name + " " + _counterInfo[i].help + "\n"
+						+  "# TYPE " + name + " counter\n"
+						+  name + " " + QString::number(total((Counter)i)) + "\n";
+		}
+
+	for (int i=0; i<NUM_TIMERS; i++)
+		{
+		QString name	= _timerInfo[i].name;
+		text		   += "# HELP " + name + " " + _timerInfo[i].help + "\n"
+						+  "# TYPE " + name + " summary\n";
+		for (double q : _quantiles)
+			text += QString("%1{quantile=\"%2\"} %3\n")
+						.arg(name).arg(q).arg(quantile((Timer)i, q));
+		text += QString("%1_sum %2\n").arg(name).arg(seconds((Timer)i))
+			 +  QString("%1_count %2\n").arg(name).arg(count((Timer)i));
+		}
+
+	DataMgr::PoolStats pool = DataMgr::instance().poolStats();
+	text += QString("# HELP rad_pool_blocks Data blocks in the pool\n"
+					"# TYPE rad_pool_blocks gauge\n"
+					"rad_pool_blocks{state=\"active\"} %1\n"
+					"rad_pool_blocks{state=\"idle\"} %2\n")
+				.arg(pool.active).arg(pool.idle);
+	text += QString("# HELP rad_pool_bytes Capacity of the blocks in the pool\n"
+					"# TYPE rad_pool_bytes gauge\n"
+					"rad_pool_bytes{state=\"active\"} %1\n"
+					"rad_pool_bytes{state=\"idle\"} %2\n")
+				.arg(pool.activeBytes).arg(pool.idleBytes);
+	text += QString("# HELP rad_pool_allocations_total Block requests, by outcome\n"
+					"# TYPE rad_pool_allocations_total counter\n"
+					"rad_pool_allocations_total{result=\"created\"} %1\n"
+					"rad_pool_allocations_total{result=\"reused\"} %2\n")
+				.arg(pool.created).arg(pool.reused);
+	return text;
+	}
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int Metrics::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * Metrics::testClassName(void)
+	{
+	return "Metrics";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult Metrics::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkThreads();
+		case 1:
+			return _checkQuantiles();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : four threads counting 100,000 each should total 400,000,
+|* each with a shard of its own, handed back when it finishes. Two more
+|* should reuse two of those shards rather than make new ones
+\******************************************************************************/
+Testable::TestResult Metrics::_checkThreads(void)
+	{
+	Metrics metrics;
+	std::vector<std::thread> threads;
+
+	for (int t=0; t<4; t++)
+		threads.emplace_back([&metrics]()
+			{
+			for (int i=0; i<100000; i++)
+				metrics.add(FFT_FRAMES);
+			metrics.add(SAMPLES_IN, 10);
+			});
+	for (std::thread& thread : threads)
+		thread.join();
+
+	bool ok = (metrics.total(FFT_FRAMES) == 400000)
+		   && (metrics.total(SAMPLES_IN) == 40)
+		   && (metrics.total(MESSAGES_OUT) == 0)
+		   && (metrics._shards.size() == 0)
+		   && (metrics._free.size() == 4);
+
+	threads.clear();
+	for (int t=0; t<2; t++)
+		threads.emplace_back([&metrics]()
+			{
+			metrics.add(FFT_FRAMES, 1000);
+			});
+	for (std::thread& thread : threads)
+		thread.join();
+
+	ok = ok && (metrics.total(FFT_FRAMES) == 402000)
+			&& (metrics._shards.size() == 0)
+			&& (metrics._free.size() == 4);
+	if (!ok)
+		ERR << "Threads counted" << metrics.total(FFT_FRAMES) << "frames,"
+			<< metrics._shards.size() << "shards in use and"
+			<< metrics._free.size() << "free";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : 900 timings of 1us and 100 of 1ms. The median should be
+|* in the 1us bucket, the 99th percentile in the 1ms one, and the sum exact
+\******************************************************************************/
+Testable::TestResult Metrics::_checkQuantiles(void)
+	{
+	Metrics metrics;
+
+	for (int i=0; i<900; i++)
+		metrics.time(FFT_TASK, 1000);
+	for (int i=0; i<100; i++)
+		metrics.time(FFT_TASK, 1000000);
+
+	double p50	= metrics.quantile(FFT_TASK, 0.5);
+	double p99	= metrics.quantile(FFT_TASK, 0.99);
+	bool ok = (p50 >= 512e-9) && (p50 < 1024e-9)
+		   && (p99 >= 524288e-9) && (p99 < 1048576e-9)
+		   && (metrics.count(FFT_TASK) == 1000)
+		   && (fabs(metrics.seconds(FFT_TASK) - 0.1009) < 1e-9)
+		   && (metrics.count(AGGREGATE) == 0);
+	if (!ok)
+		ERR << "Quantiles: p50" << p50 << "p99" << p99
+			<< "count" << metrics.count(FFT_TASK);
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
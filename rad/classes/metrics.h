@@ -0,0 +1,179 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* Counters and timings from around the pipeline, for the /metrics endpoint.
+|*
+|* Every thread that records anything gets a shard of its own, found through
+|* a thread_local pointer, and only that thread ever writes to it. Recording
+|* is then a relaxed atomic add to memory no other thread writes, with no
+|* lock and nothing to contend. A scrape sums the shards; it may see one
+|* thread's counters a moment older than another's, which doesn't matter.
+|*
+|* When a thread finishes, its shard's counts are folded into a retired total
+|* and the shard, zeroed, goes on a free list for the next new thread, so a
+|* pool that keeps replacing its threads doesn't grow the list forever.
+|*
+|* Timings go into power-of-two buckets of nanoseconds, so the percentiles
+|* are estimates, good to within a bucket. They cover the whole run
+\******************************************************************************/
+class Metrics : public Singleton<Metrics>, public Testable
+	{
+	NON_COPYABLE_NOR_MOVEABLE(Metrics);
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			SAMPLES_IN = 0,				// IQ samples from the source
+			SOURCE_BUFFERS,				// Buffers from the source
+			SOURCE_OVERRUNS,			// Gaps in the source's stream
+			SOURCE_DISCARDS,			// Buffers dropped after a retune
+			FFT_QUEUED,					// FFTs handed to the thread pool
+			FFT_FRAMES,					// FFTs computed
+			SUB_INTEGRATIONS,			// RFI sub-integrations aggregated
+			MESSAGES_OUT,				// Products sent to clients
+			IQ_BYTES,					// Raw IQ bytes recorded
+			IQ_DROPS,					// Buffers the recorder couldn't keep
+			NUM_COUNTERS
+			} Counter;
+
+		typedef enum
+			{
+			FFT_TASK = 0,				// Queued to done, per FFT
+			AGGREGATE,					// Merging one sub-integration
+			NUM_TIMERS
+			} Timer;
+
+		static const int NUM_BUCKETS	= 48;	// 1ns -> ~39 hours
+
+	private:
+		/**********************************************************************\
+		|* One thread's share of the metrics
+		\**********************************************************************/
+		typedef struct
+			{
+			std::atomic<uint64_t>	counters[NUM_COUNTERS];
+			std::atomic<uint64_t>	buckets[NUM_TIMERS][NUM_BUCKETS];
+			std::atomic<uint64_t>	nanos[NUM_TIMERS];
+			} Shard;
+
+		/**********************************************************************\
+		|* A thread's hold on its shard, which gives it back when the thread
+		|* finishes, or moves on to another instance
+		\**********************************************************************/
+		struct Holder
+			{
+			Metrics *	owner;				// Instance the shard is from
+			uint64_t	id;					// ... and its id, 0 if none
+			Shard *		shard;				// The shard itself
+
+			Holder(void);
+			~Holder(void);
+
+			void release(void);
+			};
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QMutex				_lock;			// Guards the lists and _retired
+		QList<Shard *>		_shards;		// One per thread that's recording
+		QList<Shard *>		_free;			// Zeroed, ready for a new thread
+		Shard				_retired;		// Folded in from finished threads
+		uint64_t			_id;			// Tells instances apart
+
+		static thread_local Holder		_tls;	// This thread's shard
+
+		/**********************************************************************\
+		|* Private method: the calling thread's shard, made on first use
+		\**********************************************************************/
+		Shard * _shard(void);
+
+		/**********************************************************************\
+		|* Private method: fold a finished thread's shard into the retired
+		|* total, and keep it for another thread
+		\**********************************************************************/
+		void _retire(Shard *shard);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit Metrics(void);
+		~Metrics(void);
+
+		/**********************************************************************\
+		|* Hot path: count something, or record how long something took
+		\**********************************************************************/
+		void add(Counter counter, uint64_t count = 1);
+		void time(Timer timer, int64_t nanos);
+
+		/**********************************************************************\
+		|* Monotonic clock in nanoseconds, to time things with
+		\**********************************************************************/
+		static int64_t now(void);
+
+		/**********************************************************************\
+		|* Sum a counter over all the threads
+		\**********************************************************************/
+		uint64_t total(Counter counter);
+
+		/**********************************************************************\
+		|* Estimate the {q} quantile (0..1) of a timer, in seconds, and return
+		|* the number of timings and their sum in seconds
+		\**********************************************************************/
+		double quantile(Timer timer, double q);
+		uint64_t count(Timer timer);
+		double seconds(Timer timer);
+
+		/**********************************************************************\
+		|* Render everything, plus the DataMgr pool, in the Prometheus text
+		|* exposition format
+		\**********************************************************************/
+		QString render(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check counts from several threads all add up, and their
+		|* shards are reused once they finish
+		\**********************************************************************/
+		Testable::TestResult _checkThreads(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check the percentiles land in the right bucket
+		\**********************************************************************/
+		Testable::TestResult _checkQuantiles(void);
+	};
+
+#endif // METRICS_H
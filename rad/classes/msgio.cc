@@ -1,11 +1,20 @@
-#include <QFileInfo>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
 #include <QtWebSockets>
 #include <QWebSocketServer>
 
 #include <libra.h>
 
 #include "config.h"
+#include "fftaggregator.h"
+#include "metrics.h"
 #include "msgio.h"
+#include "streamconnection.h"
+#include "wsconnection.h"
 
 /******************************************************************************\
 |* Categorised logging support
@@ -15,63 +24,48 @@ Q_LOGGING_CATEGORY(log_net, "rascal.net   ")
 #define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
 #define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
 
-#define CALIBRATION_FILE "/calib.dat"
+/******************************************************************************\
+|* A client that has had this many messages dropped is moved to a subscription
+|* with twice the decimation, up to a limit
+\******************************************************************************/
+#define DEMOTE_STRIKES		16
+#define DEMOTE_MAX_DECIMATE	64
 
 /******************************************************************************\
-|* Helper function: Create an identifier for a connection
+|* A new client is sent the recent history this long after it connects, so
+|* that a subscribe sent straight away gets applied to it. Until then it gets
+|* no live data, which would otherwise arrive ahead of older history
 \******************************************************************************/
-static QString getIdentifier(QWebSocket *peer)
-	{
-	return QStringLiteral("%1:%2").arg(peer->peerAddress().toString(),
-									   QString::number(peer->peerPort()));
-	}
+#define REPLAY_DELAY_MS		250
+
+/******************************************************************************\
+|* A scrape has this long, and this many bytes, to send its request line
+|* before the connection is closed
+\******************************************************************************/
+#define METRICS_TIMEOUT_MS	5000
+#define METRICS_MAX_LINE	4096
 
 /******************************************************************************\
 |* Constructor
 \******************************************************************************/
 MsgIO::MsgIO(QObject *parent)
 	  :QObject(parent)
-	  ,_isCalibrating(false)
-	  ,_calibration(-1)
-	  ,_calibrationPasses(0)
-	  ,_useCalibration(false)
-	  ,_calData(-1)
-	  ,_calNum(0)
+	  ,_server(nullptr)
+	  ,_tcpServer(nullptr)
+	  ,_localServer(nullptr)
+	  ,_metricsServer(nullptr)
+	  ,_multicast(nullptr)
+	  ,_history(Config::instance().replayUpdates(),
+				Config::instance().replaySamples(),
+				1)
+	  ,_reconfiguring(nullptr)
 	{
-	DataMgr &dmgr	= DataMgr::instance();
-	/**************************************************************************\
-	|* Check to see if there is any calibration data, if so, use it
-	\**************************************************************************/
-	QString appDir	= Config::instance().saveDir();
-	QString file	= appDir + CALIBRATION_FILE;
-
-	QFileInfo check(file);
-	if (check.exists())
-		{
-		_calNum			= check.size() / sizeof(float);
-		_calData		= dmgr.blockFor(_calNum, sizeof(float));
-		float * data	= dmgr.asFloat(_calData);
-		if (data != nullptr)
-			{
-			FILE *fp = fopen(qPrintable(file), "rb");
-			if (fp != nullptr)
-				{
-				fread(data, sizeof(float), _calNum, fp);
-				fclose(fp);
-				_useCalibration = true;
-				}
-			else
-				{
-				ERR << "Cannot read calibration data";
-				// Be explicit
-				dmgr.release(_calNum);
-				_calNum			= -1;
-				_useCalibration = false;
-				}
-			}
-		else
-			ERR << "Cannot allocate calibration data space";
-		}
+	Config& cfg		= Config::instance();
+	_radio.load(cfg);
+	_policy			= cfg.clientPolicy();
+	_queueDepth		= cfg.clientQueue();
+	_inFlight		= cfg.clientInFlight();
+	_noDelay		= cfg.streamNoDelay();
 	}
 
 /******************************************************************************\
@@ -80,6 +74,12 @@ MsgIO::MsgIO(QObject *parent)
 MsgIO::~MsgIO(void)
 	{
 	_server->close();
+	if (_tcpServer)
+		_tcpServer->close();
+	if (_localServer)
+		_localServer->close();
+	if (_metricsServer)
+		_metricsServer->close();
 	}
 
 
@@ -99,26 +99,239 @@ void MsgIO::init(int port)
 		}
 	else
 		ERR << "Cannot start network transport on port" << port;
+
+	/**************************************************************************\
+	|* The plain-stream transports are optional
+	\**************************************************************************/
+	Config& cfg		= Config::instance();
+	int streamPort	= cfg.streamPort();
+	QString path	= cfg.streamSocket();
+
+	if (streamPort > 0)
+		{
+		_tcpServer = new QTcpServer(this);
+		if (_tcpServer->listen(QHostAddress::Any, streamPort))
+			{
+			LOG << "Starting TCP stream transport on port" << streamPort;
+			connect(_tcpServer, &QTcpServer::newConnection,
+					this, &MsgIO::onNewTcpConnection);
+			}
+		else
+			ERR << "Cannot start TCP stream transport on port" << streamPort;
+		}
+
+	if (path.length() > 0)
+		{
+		_localServer = new QLocalServer(this);
+		QLocalServer::removeServer(path);
+		if (_localServer->listen(path))
+			{
+			LOG << "Starting Unix stream transport at" << path;
+			connect(_localServer, &QLocalServer::newConnection,
+					this, &MsgIO::onNewLocalConnection);
+			}
+		else
+			ERR << "Cannot start Unix stream transport at" << path;
+		}
+
+	/**************************************************************************\
+	|* As is multicast
+	\**************************************************************************/
+	QString group = cfg.multicastGroup();
+	if (group.length() > 0)
+		{
+		QHostAddress address(group);
+		int format = SpectrumCodec::formatFor(cfg.multicastEncoding());
+		if (!address.isMulticast())
+			ERR << group << "is not a multicast address";
+		else if (format < 0)
+			ERR << "Unknown multicast encoding" << cfg.multicastEncoding();
+		else
+			_multicast = new MulticastPublisher(address,
+												cfg.multicastPort(),
+												cfg.multicastTtl(),
+												cfg.multicastPayload(),
+												format,
+												this);
+		}
+
+	/**************************************************************************\
+	|* And the metrics endpoint
+	\**************************************************************************/
+	int metricsPort = cfg.metricsPort();
+	if (metricsPort > 0)
+		{
+		_metricsServer = new QTcpServer(this);
+		if (_metricsServer->listen(QHostAddress::Any, metricsPort))
+			{
+			LOG << "Serving /metrics on port" << metricsPort;
+			connect(_metricsServer, &QTcpServer::newConnection,
+					this, &MsgIO::onNewMetricsConnection);
+			}
+		else
+			ERR << "Cannot serve /metrics on port" << metricsPort;
+		}
 	}
 
 /******************************************************************************\
-|* Handle a client connecting
+|* Handle a client connecting over WebSocket
 \******************************************************************************/
 void MsgIO::onNewConnection(void)
 	{
-	auto socket = _server->nextPendingConnection();
-	LOG << "New connection: " << getIdentifier(socket);
+	while (_server->hasPendingConnections())
+		_addClient(new WsConnection(_server->nextPendingConnection(), this));
+	}
+
+/******************************************************************************\
+|* Handle a client connecting over TCP
+\******************************************************************************/
+void MsgIO::onNewTcpConnection(void)
+	{
+	while (_tcpServer->hasPendingConnections())
+		_addClient(new StreamConnection(_tcpServer->nextPendingConnection(),
+										_noDelay,
+										this));
+	}
+
+/******************************************************************************\
+|* Handle a client connecting over a Unix-domain socket
+\******************************************************************************/
+void MsgIO::onNewLocalConnection(void)
+	{
+	while (_localServer->hasPendingConnections())
+		_addClient(new StreamConnection(_localServer->nextPendingConnection(),
+										this));
+	}
+
+/******************************************************************************\
+|* Handle a scrape. Only the request line matters: GET /metrics gets the
+|* metrics, anything else a 404, and either way the connection is closed. So
+|* is one that's too slow to send the line, or sends too much without one
+\******************************************************************************/
+void MsgIO::onNewMetricsConnection(void)
+	{
+	while (_metricsServer->hasPendingConnections())
+		{
+		QTcpSocket *socket = _metricsServer->nextPendingConnection();
+		connect(socket, &QTcpSocket::disconnected,
+				socket, &QTcpSocket::deleteLater);
+		QTimer::singleShot(METRICS_TIMEOUT_MS, socket, [socket]()
+			{
+			socket->abort();
+			socket->deleteLater();
+			});
+		connect(socket, &QTcpSocket::readyRead, this, [this, socket]()
+			{
+			if (!socket->canReadLine())
+				{
+				if (socket->bytesAvailable() > METRICS_MAX_LINE)
+					{
+					socket->abort();
+					socket->deleteLater();
+					}
+				return;
+				}
+
+			QList<QByteArray> request = socket->readLine().simplified().split(' ');
+			QByteArray status	= "404 Not Found";
+			QByteArray body		= "Not found\n";
+			if ((request.size() >= 2)
+			 && (request.at(0) == "GET")
+			 && (request.at(1) == "/metrics"))
+				{
+				status	= "200 OK";
+				body	= (Metrics::instance().render() + _clientMetrics()).toUtf8();
+				}
+
+			socket->write("HTTP/1.0 " + status + "\r\n"
+						  "Content-Type: text/plain; version=0.0.4\r\n"
+						  "Content-Length: " + QByteArray::number(body.size())
+						+ "\r\nConnection: close\r\n\r\n" + body);
+			socket->disconnectFromHost();
+			});
+		}
+	}
+
+/******************************************************************************\
+|* The per-client gauges. Clients are named by their identifier, which is
+|* their address and port, or the socket path
+\******************************************************************************/
+QString MsgIO::_clientMetrics(void)
+	{
+	QMutexLocker guard(&_lock);
+	QString depth, sent, dropped, inFlight;
+
+	for (Connection *client : qAsConst(_clients))
+		{
+		ClientQueue& queue	= _queues[client];
+		QString label		= QString("{client=\"%1\"} ")
+								.arg(client->identifier().replace('"', '\''));
+		depth		+= "rad_client_queue_depth" + label
+					+  QString::number(queue.depth()) + "\n";
+		sent		+= "rad_client_sent_total" + label
+					+  QString::number(queue.sent()) + "\n";
+		dropped		+= "rad_client_dropped_total" + label
+					+  QString::number(queue.dropped()) + "\n";
+		inFlight	+= "rad_client_inflight_bytes" + label
+					+  QString::number(queue.inFlight()) + "\n";
+		}
+
+	QString text = QString("# HELP rad_clients Connected clients\n"
+						   "# TYPE rad_clients gauge\n"
+						   "rad_clients %1\n").arg(_clients.size())
+				 + "# HELP rad_client_queue_depth Messages queued for a client\n"
+				   "# TYPE rad_client_queue_depth gauge\n" + depth
+				 + "# HELP rad_client_sent_total Messages sent to a client\n"
+				   "# TYPE rad_client_sent_total counter\n" + sent
+				 + "# HELP rad_client_dropped_total Messages dropped for a client\n"
+				   "# TYPE rad_client_dropped_total counter\n" + dropped
+				 + "# HELP rad_client_inflight_bytes Bytes written but not sent\n"
+				   "# TYPE rad_client_inflight_bytes gauge\n" + inFlight;
+
+	if (_multicast)
+		text += QString("# HELP rad_multicast_datagrams_total Datagrams, by outcome\n"
+						"# TYPE rad_multicast_datagrams_total counter\n"
+						"rad_multicast_datagrams_total{result=\"sent\"} %1\n"
+						"rad_multicast_datagrams_total{result=\"failed\"} %2\n")
+					.arg(_multicast->datagrams()).arg(_multicast->failures());
+	return text;
+	}
 
-	socket->setParent(this);
+/******************************************************************************\
+|* Set up a new client, however it connected
+\******************************************************************************/
+void MsgIO::_addClient(Connection *client)
+	{
+	LOG << "New connection: " << client->identifier();
 
-	connect(socket, &QWebSocket::textMessageReceived,
+	connect(client, &Connection::textReceived,
 			this, &MsgIO::processTextMessage);
-	connect(socket, &QWebSocket::disconnected,
+	connect(client, &Connection::disconnected,
 			this, &MsgIO::socketDisconnected);
-	connect(socket, &QWebSocket::binaryMessageReceived,
-			this, &MsgIO::processBinaryMessage);
 
-	_clients << socket;
+	/**************************************************************************\
+	|* Stream connections report writes as they happen, which can be while
+	|* _pump() holds the lock, so take them via the event loop
+	\**************************************************************************/
+	connect(client, &Connection::bytesWritten,
+			this, &MsgIO::socketBytesWritten, Qt::QueuedConnection);
+
+	QMutexLocker guard(&_lock);
+	_clients << client;
+	_subscriptions.insert(client, Subscription());
+	_keyed.insert(client, QSet<int>());
+	_queues.insert(client, ClientQueue(_policy, _queueDepth, _inFlight));
+	_awaitingReplay.insert(client);
+
+	/**************************************************************************\
+	|* The client is the context, so this never fires if it's gone first
+	\**************************************************************************/
+	QTimer::singleShot(REPLAY_DELAY_MS, client, [this, client]()
+		{
+		QMutexLocker guard(&_lock);
+		if (_awaitingReplay.remove(client))
+			_replay(client, ~0U);
+		});
 	}
 
 
@@ -127,20 +340,14 @@ void MsgIO::onNewConnection(void)
 \******************************************************************************/
 void MsgIO::processTextMessage(const QString& msg)
 	{
-	if (msg == "CALIBRATION BEGIN")
-		_beginCalibration();
+	if (msg.startsWith("{"))
+		_processCommand(qobject_cast<Connection *>(sender()), msg);
+	else if (msg == "CALIBRATION BEGIN")
+		emit calibration(FFTAggregator::CAL_BEGIN);
 	else if (msg == "CALIBRATION END")
-		_stopCalibration();
+		emit calibration(FFTAggregator::CAL_END);
 	else if (msg == "CALIBRATION LOAD")
-		_loadCalibration();
-	}
-
-/******************************************************************************\
-|* Handle a client binary message
-\******************************************************************************/
-void MsgIO::processBinaryMessage(QByteArray msg)
-	{
-	LOG << "WebSocket got binary. Length : " << msg.length();
+		emit calibration(FFTAggregator::CAL_LOAD);
 	}
 
 /******************************************************************************\
@@ -148,24 +355,54 @@ void MsgIO::processBinaryMessage(QByteArray msg)
 \******************************************************************************/
 void MsgIO::socketDisconnected(void)
 	{
-	QWebSocket *client = qobject_cast<QWebSocket *>(sender());
+	Connection *client = qobject_cast<Connection *>(sender());
 
 	if (client)
 		{
-		LOG << "Disconnection: " << getIdentifier(client);
+		QMutexLocker guard(&_lock);
+		ClientQueue& queue = _queues[client];
+		LOG << "Disconnection: " << client->identifier()
+			<< "sent" << queue.sent() << "dropped" << queue.dropped();
 		_clients.removeAll(client);
+		_subscriptions.remove(client);
+		_keyed.remove(client);
+		_queues.remove(client);
+		_awaitingReplay.remove(client);
+		if (_reconfiguring == client)
+			_reconfiguring = nullptr;
 		client->deleteLater();
 		}
 	}
 
+/******************************************************************************\
+|* A client socket has written data, so there may be room for more
+\******************************************************************************/
+void MsgIO::socketBytesWritten(qint64 bytes)
+	{
+	Connection *client = qobject_cast<Connection *>(sender());
+
+	QMutexLocker guard(&_lock);
+	if (client && _queues.contains(client))
+		{
+		_queues[client].written(bytes);
+		_pump(client);
+		}
+	}
+
 
 /******************************************************************************\
 |* Send a text message
 \******************************************************************************/
 void MsgIO::sendTextMessage(const QString &message)
 	{
-	for (QWebSocket *client : qAsConst(_clients))
-		client->sendTextMessage(message);
+	QMutexLocker guard(&_lock);
+	int64_t bytes = message.toUtf8().size();
+	for (Connection *client : qAsConst(_clients))
+		{
+		client->sendText(message);
+		if (_queues.contains(client))
+			_queues[client].charge(1, bytes);
+		}
 	}
 
 /******************************************************************************\
@@ -173,161 +410,434 @@ void MsgIO::sendTextMessage(const QString &message)
 \******************************************************************************/
 void MsgIO::sendBinaryMessage(const QByteArray &data)
 	{
-	for (QWebSocket *client : qAsConst(_clients))
-		client->sendBinaryMessage(data);
+	QMutexLocker guard(&_lock);
+	for (Connection *client : qAsConst(_clients))
+		{
+		client->sendMessage(data);
+		if (_queues.contains(client))
+			_queues[client].charge(1, data.size());
+		}
 	}
 
 /******************************************************************************\
 |* We have new smoothed data, send it off to all the clients. This comes in
-|* as a buffer of floats, _fftSize long
+|* as a complete message - a Preamble followed by _fftSize floats - and the
+|* same buffer is handed to every client, so there's no per-client copy
 \******************************************************************************/
-void MsgIO::newData(PreambleType type, int64_t bufferId)
+void MsgIO::newData(QByteArray msg)
 	{
-	LOG << "data:" << type << "buffer:"<< bufferId;
 	QMutexLocker guard(&_lock);
-	DataMgr &dmgr	= DataMgr::instance();
 
-	if ((type == TYPE_UPDATE) && _isCalibrating)
-		_appendToCalibration(bufferId);
+	if (msg.size() < (int)sizeof(Preamble))
+		{
+		ERR << "Runt message of" << msg.size() << "bytes in send";
+		return;
+		}
+
+	/**************************************************************************\
+	|* The aggregator has already calibrated it, so it goes out as it came
+	\**************************************************************************/
+	const Preamble *hdr	= reinterpret_cast<const Preamble *>(msg.constData());
+	if (hdr->type == TYPE_TEXT)
+		{
+		_configured(msg);
+		return;
+		}
 
-	size_t extent	= dmgr.extent(bufferId);
-	float *src		= dmgr.asFloat(bufferId);
+	LOG << "data:" << hdr->type << "bins:" << hdr->extent / sizeof(float);
 
-	if (_useCalibration)
+	/**************************************************************************\
+	|* Visibilities are four planes rather than one spectrum, so they aren't
+	|* rendered, encoded, multicast or replayed: they go as they are, to the
+	|* clients that asked for them by name. They're from a pair of channels,
+	|* tagged with the first, so a client on either one gets them
+	\**************************************************************************/
+	if ((hdr->type == TYPE_VIS_UPDATE) || (hdr->type == TYPE_VIS_SAMPLE))
 		{
-		int num = extent / sizeof(float);
-		if (num == _calNum)
-			{
-			float *calValues = dmgr.asFloat(_calData);
-			for (int i=0; i<num; i++)
-				src[i] -= calValues[i];
-			}
-		else
-			ERR << "Calibration range" << _calNum << " mismatch to " <<num;
+		for (Connection *client : qAsConst(_clients))
+			if ((_subscriptions[client].wants(hdr->type, hdr->channel)
+			  || _subscriptions[client].wants(hdr->type, hdr->channel + 1))
+			 && !_awaitingReplay.contains(client))
+				_enqueue(client, hdr->type, msg);
+		return;
 		}
 
-	int dstId		= dmgr.blockFor(extent+sizeof(Preamble));
-	char *dst		= reinterpret_cast<char *>(dmgr.asUint8(dstId));
+	/**************************************************************************\
+	|* Multicast listeners all get the same thing, sent once
+	\**************************************************************************/
+	if (_multicast)
+		_multicast->publish(msg);
+
+	/**************************************************************************\
+	|* Keep it for clients yet to join. It's not modified from here on, so
+	|* the ring and the clients all share the one buffer
+	\**************************************************************************/
+	_history.add(msg);
 
-	if ((src == nullptr) || (dst == nullptr))
+	/**************************************************************************\
+	|* A view that is being delta-coded has to send a keyframe if any of its
+	|* clients has just joined it, since they have nothing to add deltas to.
+	|* Each client has the set of streams it's had a keyframe for
+	\**************************************************************************/
+	int stream = Subscription::stream(hdr->type, hdr->channel);
+	QMap<QString, bool> keyframes;
+	for (Connection *client : qAsConst(_clients))
 		{
-		ERR << "Cannot get src(" << src <<":" << bufferId
-			<< ") or dst(" << dst << ":" << dstId << ") in send";
+		const Subscription& sub = _subscriptions[client];
+		if (sub.wants(hdr->type, hdr->channel) && !_keyed[client].contains(stream))
+			keyframes[sub.key()] = true;
 		}
-	else
+
+	/**************************************************************************\
+	|* Each distinct view is only rendered and encoded once, however many
+	|* clients share it. Each channel's products are delta-coded separately
+	\**************************************************************************/
+	QMap<QString, QByteArray> views;
+	QString suffix = QString(":%1:%2").arg(hdr->channel).arg(hdr->type);
+	for (Connection *client : qAsConst(_clients))
 		{
-		Preamble hdr;
-		hdr.extent	= (uint32_t)extent;
-		hdr.type	= (uint16_t)type;
-		::memcpy(dst, &hdr, sizeof(Preamble));
-		::memcpy(dst+sizeof(Preamble), src, extent);
-
-		const char * buffer = const_cast<char *>(dst);
-		QByteArray msg(buffer, extent + sizeof(Preamble));
-		for (QWebSocket *client : qAsConst(_clients))
-			client->sendBinaryMessage(msg);
-
-		dmgr.release(dstId);
+		const Subscription& sub = _subscriptions[client];
+		if (!sub.wants(hdr->type, hdr->channel) || _awaitingReplay.contains(client))
+			continue;
+
+		QString key = sub.key();
+		if (!views.contains(key))
+			{
+			QString name = key + suffix;
+			if (!_encoders.contains(name))
+				_encoders.insert(name, sub.codec());
+
+			views.insert(key, _encoders[name].encode(sub.render(msg),
+													 keyframes.value(key)));
+			}
+		_keyed[client].insert(stream);
+		_enqueue(client, hdr->type, views[key], hdr->channel);
 		}
 
-	dmgr.release(bufferId);
+	/**************************************************************************\
+	|* Drop the encoders for views of this product that nobody wants now
+	\**************************************************************************/
+	for (const QString& name : _encoders.keys())
+		{
+		if (name.endsWith(suffix)
+		 && !views.contains(name.chopped(suffix.length())))
+			_encoders.remove(name);
+		}
 	}
 
 /******************************************************************************\
-|* Set up for starting a calibration run
+|* Handle a JSON command. These look like {"cmd":"name", ...args}
 \******************************************************************************/
-void MsgIO::_beginCalibration(void)
+void MsgIO::_processCommand(Connection *client, const QString& msg)
 	{
-	LOG << "Beginning calibration";
-	QMutexLocker guard(&_lock);
-	if (_calibration >= 0)
+	if (client == nullptr)
+		return;
+
+	QJsonParseError status;
+	QJsonDocument doc = QJsonDocument::fromJson(msg.toUtf8(), &status);
+	if (!doc.isObject())
+		{
+		ERR << "Bad command from" << client->identifier()
+			<< ":" << status.errorString();
+		QMutexLocker guard(&_lock);
+		_reply(client, {{"ok", false}, {"error", status.errorString()}});
+		return;
+		}
+
+	QJsonObject cmd	= doc.object();
+	QString name	= cmd.value("cmd").toString();
+
+	if (name == "subscribe")
+		{
+		QMutexLocker guard(&_lock);
+		Subscription& sub = _subscriptions[client];
+
+		QString error;
+		if (sub.parse(cmd, error))
+			{
+			LOG << "Subscription from" << client->identifier()
+				<< "now" << sub.key();
+			_keyed[client].clear();
+			QJsonObject reply = sub.toJson();
+			reply.insert("reply", name);
+			reply.insert("ok", true);
+			_reply(client, reply);
+			}
+		else
+			_reply(client, {{"reply", name}, {"ok", false}, {"error", error}});
+		}
+	else if (name == "replay")
 		{
-		DataMgr &dmgr = DataMgr::instance();
-		dmgr.release(_calibration);
+		/**********************************************************************\
+		|* Products default to everything subscribed to. A copy of the
+		|* subscription does the parsing, so the names are the same
+		\**********************************************************************/
+		QMutexLocker guard(&_lock);
+		Subscription products = _subscriptions[client];
+		QJsonObject args;
+		if (cmd.contains("products"))
+			args.insert("products", cmd.value("products"));
+
+		QString error;
+		if (products.parse(args, error))
+			{
+			_awaitingReplay.remove(client);
+			int num = _replay(client, products.products());
+			_reply(client, {{"reply", name}, {"ok", true}, {"messages", num}});
+			}
+		else
+			_reply(client, {{"reply", name}, {"ok", false}, {"error", error}});
+		}
+	else if (name == "configure")
+		{
+		/**********************************************************************\
+		|* Check it here so the client hears about mistakes straight away. The
+		|* reply to a real change comes once the processor has made it
+		\**********************************************************************/
+		QMutexLocker guard(&_lock);
+		RadioSettings next = _radio;
+
+		QString error;
+		if (!next.parse(cmd, error))
+			_reply(client, {{"reply", name}, {"ok", false}, {"error", error}});
+		else if (_radio.changes(next) == 0)
+			{
+			QJsonObject reply = _radio.toJson();
+			if (!_sweep.isEmpty())
+				reply.insert("sweep", _sweep);
+			reply.insert("reply", name);
+			reply.insert("ok", true);
+			_reply(client, reply);
+			}
+		else if (_reconfiguring != nullptr)
+			_reply(client, {{"reply", name},
+							{"ok", false},
+							{"error", "Reconfiguration already in progress"}});
+		else
+			{
+			LOG << "Reconfigure requested by" << client->identifier();
+			_reconfiguring = client;
+			emit reconfigure(next.toJson());
+			}
+		}
+	else if (name == "stats")
+		{
+		QMutexLocker guard(&_lock);
+		QJsonObject reply = _queues[client].toJson();
+		reply.insert("reply", name);
+		reply.insert("ok", true);
+		_reply(client, reply);
+		}
+	else
+		{
+		QMutexLocker guard(&_lock);
+		_reply(client, {{"reply", name},
+						{"ok", false},
+						{"error", "Unknown command '" + name + "'"}});
 		}
-	_calibration		= -1;
-	_calibrationPasses	= 0;
-	_isCalibrating		= true;
-	_useCalibration		= false;
-	_calNum				= 0;
 	}
 
 /******************************************************************************\
-|* Add calibration data. Note: does not need the lock, since it's only called
-|* from within newData() which already has the lock
+|* Queue a message for a client. Note: called with the lock held
 \******************************************************************************/
-void MsgIO::_appendToCalibration(int64_t buffer)
+void MsgIO::_enqueue(Connection *client,
+					 int type,
+					 const QByteArray& msg,
+					 int channel)
 	{
-	LOG << "Appending calibration data";
-	DataMgr &dmgr = DataMgr::instance();
-	float * src   = dmgr.asFloat(buffer);
-	int extent	  = dmgr.extent(buffer);
-	int count	  = extent / sizeof(float);
+	ClientQueue& queue = _queues[client];
+	if (queue.closing())
+		return;
 
-	if (_calibration < 0)
+	Metrics::instance().add(Metrics::MESSAGES_OUT);
+	if (!queue.push(type, msg, channel))
 		{
-		LOG << "Creating calibration storage";
-		_calibration = dmgr.blockFor(count, sizeof(double));
-		double *dst  = dmgr.asDouble(_calibration);
-		if (dst == nullptr)
+		/**********************************************************************\
+		|* Close later: the disconnect handler needs the lock we're holding
+		\**********************************************************************/
+		ERR << "Disconnecting" << client->identifier()
+			<< "with" << queue.depth() << "messages queued";
+		queue.setClosing(true);
+		QMetaObject::invokeMethod(client, [client]()
 			{
-			ERR << "Cannot allocate calibration array";
-			_calibration = -1;
-			return;
-			}
-		memset(dst, 0, sizeof(double) * count);
+			client->close("Client too slow");
+			}, Qt::QueuedConnection);
+		return;
 		}
 
-	double *dst  = dmgr.asDouble(_calibration);
-	for (int i=0; i<count; i++)
-		dst[i] += src[i];
-	_calibrationPasses ++;
+	/**************************************************************************\
+	|* Whatever the queue had to throw away, the client's decoder is no longer
+	|* in step with the encoder, so that stream starts again from a keyframe
+	\**************************************************************************/
+	for (const ClientQueue::Stream& lost : queue.takeLost())
+		_keyed[client].remove(Subscription::stream(lost.first, lost.second));
+
+	if (queue.strikes() >= DEMOTE_STRIKES)
+		_demote(client);
+
+	_pump(client);
+	}
+
+/******************************************************************************\
+|* Hand queued messages to the socket. Note: called with the lock held
+\******************************************************************************/
+void MsgIO::_pump(Connection *client)
+	{
+	ClientQueue& queue = _queues[client];
+
+	QByteArray msg;
+	client->cork(true);
+	while (queue.next(msg))
+		client->sendMessage(msg);
+	client->cork(false);
 	}
 
 /******************************************************************************\
-|* Stop calibrating and write the calibration to storage
+|* Double a slow client's decimation, and tell it so. Note: called with the
+|* lock held
 \******************************************************************************/
-void MsgIO::_stopCalibration(void)
+void MsgIO::_demote(Connection *client)
 	{
-	LOG << "Stopping calibration";
-	if (_calibrationPasses == 0)
-		ERR << "Need more data before we can save calibration";
-	else if (_calibration > 0)
+	Subscription& sub	= _subscriptions[client];
+	ClientQueue& queue	= _queues[client];
+	queue.clearStrikes();
+
+	int decimate		= sub.decimate() * 2;
+	if (decimate > DEMOTE_MAX_DECIMATE)
+		return;
+
+	QString error;
+	QJsonObject cmd;
+	cmd.insert("decimate", decimate);
+	if (!sub.parse(cmd, error))
+		return;
+
+	LOG << "Demoting slow client" << client->identifier()
+		<< "to" << sub.key() << "after" << queue.dropped() << "drops";
+
+	_keyed[client].clear();
+
+	QJsonObject reply = sub.toJson();
+	reply.insert("reply", "subscribe");
+	reply.insert("ok", true);
+	reply.insert("demoted", true);
+	_reply(client, reply);
+	}
+
+/******************************************************************************\
+|* Replay the history to a client. Each message is rendered for its view and
+|* encoded as a keyframe, so nothing depends on what the client has already
+|* seen, and the lot goes to the socket in one go - it bypasses the queue,
+|* which would otherwise treat it as a slow client and drop most of it. The
+|* bytes are charged to the queue, so live data waits behind them. Anything
+|* of the same types already queued would go out after the replay, and decode
+|* against the wrong base, so it's thrown away: the history has it anyway.
+|* Note: called with the lock held
+\******************************************************************************/
+int MsgIO::_replay(Connection *client, uint32_t types)
+	{
+	Subscription& sub	= _subscriptions[client];
+	ClientQueue& queue	= _queues[client];
+	if (queue.closing())
+		return 0;
+
+	/**************************************************************************\
+	|* Any delta-coded live stream has to start again from a keyframe. A
+	|* reconfiguration marker isn't history, so it stays
+	\**************************************************************************/
+	queue.discard(types & ~(1U << TYPE_TEXT));
+	_keyed[client].clear();
+
+	QMap<int, SpectrumCodec> codecs;
+	QList<QByteArray> msgs;
+	int64_t bytes = 0;
+
+	for (const QByteArray& msg : _history.history(types))
 		{
-		QMutexLocker guard(&_lock);
-		DataMgr &dmgr	= DataMgr::instance();
-		QString appDir	= Config::instance().saveDir();
-		QString file	= appDir + CALIBRATION_FILE;
+		const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+		if (!sub.wants(hdr->type, hdr->channel))
+			continue;
+
+		int type = hdr->type;
+		if (!codecs.contains(type))
+			codecs.insert(type, SpectrumCodec(sub.encoding(),
+											  false,
+											  sub.compress()));
+
+		QByteArray view = codecs[type].encode(sub.render(msg), true);
+		bytes		   += view.size();
+		msgs.append(view);
+		}
 
-		double * data	= dmgr.asDouble(_calibration);
-		int extent		= dmgr.extent(_calibration);
-		int num			= extent / sizeof(double);
+	if (msgs.size() > 0)
+		{
+		LOG << "Replaying" << msgs.size() << "messages," << bytes
+			<< "bytes to" << client->identifier();
+
+		client->cork(true);
+		client->sendBatch(msgs);
+		client->cork(false);
+		queue.charge(msgs.size(), bytes);
+		}
+	return msgs.size();
+	}
 
-		FILE *fp = fopen(qPrintable(file), "wb");
-		if (fp != nullptr)
+/******************************************************************************\
+|* The processor has finished a reconfiguration. If it worked, nothing from
+|* before can be mixed with what comes after: the history and the delta-coding
+|* state go, and the marker is queued behind the last of the old spectra so
+|* every client sees exactly where the change happened. Note: called with the
+|* lock held
+\******************************************************************************/
+void MsgIO::_configured(const QByteArray& msg)
+	{
+	const Preamble *hdr	= reinterpret_cast<const Preamble *>(msg.constData());
+	QJsonObject result	= QJsonDocument::fromJson(msg.mid(hdr->offset,
+															hdr->extent))
+							.object();
+	bool ok				= result.value("ok").toBool();
+
+	if (ok)
+		{
+		QString error;
+		_radio.parse(result, error);
+		_history.clear();
+		_encoders.clear();
+		for (Connection *client : qAsConst(_clients))
 			{
-			float vals[num];
-			for (int i=0; i<num; i++)
-				vals[i] = data[i] / _calibrationPasses;
-			fwrite(vals, sizeof(float), num, fp);
-			fclose(fp);
+			_keyed[client].clear();
+			_enqueue(client, TYPE_TEXT, msg);
 			}
-		else
-			ERR << "Cannot open" << file << "for output";
+		}
 
-		_useCalibration = true;
-		_isCalibrating	= false;
-		_calNum			= num;
+	if (_reconfiguring != nullptr)
+		{
+		result.remove("event");
+		result.insert("reply", "configure");
+		_reply(_reconfiguring, result);
+		_reconfiguring = nullptr;
 		}
-	else
-		ERR << "Cannot save non-existent calibration data!";
 	}
 
 /******************************************************************************\
-|* Stop calibrating and write the calibration to storage
+|* Describe the sweep
 \******************************************************************************/
-void MsgIO::_loadCalibration(void)
+void MsgIO::setSweep(const QJsonObject& sweep)
 	{
 	QMutexLocker guard(&_lock);
+	_sweep = sweep;
+	}
 
+/******************************************************************************\
+|* Send a JSON reply. It goes around the queue, so that it isn't dropped, but
+|* it's charged like everything else the socket writes. Note: called with the
+|* lock held
+\******************************************************************************/
+void MsgIO::_reply(Connection *client, const QJsonObject& reply)
+	{
+	QJsonDocument doc(reply);
+	QByteArray text = doc.toJson(QJsonDocument::Compact);
+	client->sendText(QString::fromUtf8(text));
+	if (_queues.contains(client))
+		_queues[client].charge(1, text.size());
 	}
@@ -2,29 +2,30 @@
 #define MSGIO_H
 
 #include <QList>
+#include <QMap>
 #include <QObject>
+#include <QSet>
 #include <QString>
 #include <QMutexLocker>
 
+QT_FORWARD_DECLARE_CLASS(QLocalServer)
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
 QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
-QT_FORWARD_DECLARE_CLASS(QWebSocket)
 
 #include <libra.h>
 
+#include "clientqueue.h"
+#include "config.h"
+#include "connection.h"
+#include "multicastpublisher.h"
+#include "radiosettings.h"
+#include "replayring.h"
+#include "subscription.h"
+
 class MsgIO: public QObject
 	{
 	Q_OBJECT
 
-	/**************************************************************************\
-	|* Properties
-	\**************************************************************************/
-	GET(bool, isCalibrating);			// Configuration object
-	GET(int, calibration);				// Calibration data
-	GET(int, calibrationPasses);		// Number of passes for calibration
-	GET(bool, useCalibration);			// Are we using calibration ?
-	GET(int, calData);					// Calibration data
-	GET(int, calNum);					// Entries in calibration data
-
 	public:
 		/**********************************************************************\
 		|* Typedefs and enums
@@ -32,31 +33,83 @@ class MsgIO: public QObject
 
 	private:
 		/**********************************************************************\
-		|* Begin storing data for calibration
+		|* Set up a newly-connected client
+		\**********************************************************************/
+		void _addClient(Connection *client);
+
+		/**********************************************************************\
+		|* Handle a JSON command from a client
+		\**********************************************************************/
+		void _processCommand(Connection *client, const QString& msg);
+
+		/**********************************************************************\
+		|* Send a JSON reply to a client, charged to its queue. Note: called
+		|* with the lock held
+		\**********************************************************************/
+		void _reply(Connection *client, const QJsonObject& reply);
+
+		/**********************************************************************\
+		|* Queue a message for a client, applying the slow-client policy
+		\**********************************************************************/
+		void _enqueue(Connection *client,
+					  int type,
+					  const QByteArray& msg,
+					  int channel = 0);
+
+		/**********************************************************************\
+		|* Hand a client's queued messages to its socket, while it has room
+		\**********************************************************************/
+		void _pump(Connection *client);
+
+		/**********************************************************************\
+		|* Move a client that keeps dropping data to a cheaper subscription
 		\**********************************************************************/
-		void _beginCalibration(void);
+		void _demote(Connection *client);
 
 		/**********************************************************************\
-		|* Append to the calibration store
+		|* Send a client the recent history of the products in {types}, as
+		|* its subscription would have seen them, in one batch
 		\**********************************************************************/
-		void _appendToCalibration(int64_t buffer);
+		int _replay(Connection *client, uint32_t types);
 
 		/**********************************************************************\
-		|* Stop calibration
+		|* The processor has (or hasn't) applied new settings. Start everyone
+		|* afresh, pass the marker on, and answer whoever asked
 		\**********************************************************************/
-		void _stopCalibration(void);
+		void _configured(const QByteArray& msg);
 
 		/**********************************************************************\
-		|* Load the calibration
+		|* Render the per-client gauges for /metrics
 		\**********************************************************************/
-		void _loadCalibration(void);
+		QString _clientMetrics(void);
 
 
 		/**********************************************************************\
 		|* Private variables
 		\**********************************************************************/
-		QWebSocketServer *		_server;		// Handle the connection
-		QList<QWebSocket *>		_clients;		// List of connected clients
+		QWebSocketServer *		_server;		// WebSocket listener
+		QTcpServer *			_tcpServer;		// Plain TCP listener
+		QLocalServer *			_localServer;	// Unix-domain listener
+		QTcpServer *			_metricsServer;	// HTTP listener for /metrics
+		MulticastPublisher *	_multicast;		// Sends to everyone at once
+		QList<Connection *>		_clients;		// List of connected clients
+		QMap<Connection *, Subscription>
+								_subscriptions;	// What each client wants
+		QMap<QString, SpectrumCodec>
+								_encoders;		// Per view and product
+		QMap<Connection *, QSet<int> >
+								_keyed;			// Streams sent a keyframe
+		QMap<Connection *, ClientQueue>
+								_queues;		// Outbound per client
+		ReplayRing				_history;		// Recent messages, for replay
+		QSet<Connection *>		_awaitingReplay;// Not sent live data yet
+		RadioSettings			_radio;			// What's currently applied
+		Connection *			_reconfiguring;	// Waiting on a configure
+		QJsonObject				_sweep;			// The sweep, if there is one
+		Config::QueuePolicy		_policy;		// What to do with slow clients
+		int						_queueDepth;	// Messages queued per client
+		int						_inFlight;		// Unwritten bytes per client
+		bool					_noDelay;		// TCP_NODELAY on TCP clients
 		QMutex					_lock;			// Thread safety
 
 
@@ -65,9 +118,12 @@ class MsgIO: public QObject
 		|* Private slots - generally for WebSocket operation
 		\**********************************************************************/
 		void onNewConnection(void);
+		void onNewTcpConnection(void);
+		void onNewLocalConnection(void);
+		void onNewMetricsConnection(void);
 		void socketDisconnected();
 		void processTextMessage(const QString &message);
-		void processBinaryMessage(QByteArray message);
+		void socketBytesWritten(qint64 bytes);
 
 	public:
 		/**********************************************************************\
@@ -81,17 +137,36 @@ class MsgIO: public QObject
 		\**********************************************************************/
 		void init(int port);
 
+		/**********************************************************************\
+		|* Describe the sweep, so clients asking for the settings can place
+		|* the stitched spectrum
+		\**********************************************************************/
+		void setSweep(const QJsonObject& sweep);
+
 		/**********************************************************************\
 		|* Send appropriate message types
 		\**********************************************************************/
 		void sendTextMessage(const QString &message);
 		void sendBinaryMessage(const QByteArray &data);
 
+	signals:
+		/**********************************************************************\
+		|* A client wants the settings changed
+		\**********************************************************************/
+		void reconfigure(QJsonObject settings);
+
+		/**********************************************************************\
+		|* A client wants a calibration begun, ended or reloaded. {action} is
+		|* an FFTAggregator::CalibrationAction
+		\**********************************************************************/
+		void calibration(int action);
+
 	public slots:
 		/**********************************************************************\
-		|* Receive data ready to send out, from the aggregator
+		|* Receive a message ready to send out, from the aggregator, or a
+		|* TYPE_TEXT marker from the processor
 		\**********************************************************************/
-		void newData(PreambleType type, int64_t bufferId);
+		void newData(QByteArray msg);
 
 	};
 
@@ -0,0 +1,61 @@
+#include <QUdpSocket>
+
+#include "multicastpublisher.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+MulticastPublisher::MulticastPublisher(const QHostAddress& group,
+									   int port,
+									   int ttl,
+									   int payload,
+									   int format,
+									   QObject *parent)
+				   :QObject(parent)
+				   ,_group(group)
+				   ,_port(port)
+				   ,_payload(payload)
+				   ,_sequence(0)
+				   ,_datagrams(0)
+				   ,_failures(0)
+				   ,_format(format)
+	{
+	int smallest	= (int)sizeof(Preamble);
+	_payload		= (_payload < smallest) ? smallest : _payload;
+
+	_socket = new QUdpSocket(this);
+	_socket->setSocketOption(QAbstractSocket::MulticastTtlOption, ttl);
+
+	LOG << "Publishing to multicast group" << _group.toString()
+		<< "port" << _port << "ttl" << ttl;
+	}
+
+/******************************************************************************\
+|* Send a message to the group
+\******************************************************************************/
+void MulticastPublisher::publish(const QByteArray& msg)
+	{
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	int stream			= (hdr->channel << 8) | hdr->type;
+
+	if (!_encoders.contains(stream))
+		_encoders.insert(stream, SpectrumCodec(_format));
+	QByteArray wire	= _encoders[stream].encode(msg);
+
+	uint32_t sequence	= _sequence ++;
+	int num				= FragmentAssembler::fragmentsFor(wire.size(), _payload);
+	for (int i=0; i<num; i++)
+		{
+		FragmentAssembler::fragment(wire, sequence, _payload, i, _datagram);
+		if (_socket->writeDatagram(_datagram, _group, _port) < 0)
+			_failures ++;
+		else
+			_datagrams ++;
+		}
+	}
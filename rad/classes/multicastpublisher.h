@@ -0,0 +1,63 @@
+#ifndef MULTICASTPUBLISHER_H
+#define MULTICASTPUBLISHER_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QMap>
+#include <QObject>
+
+#include <libra.h>
+
+QT_FORWARD_DECLARE_CLASS(QUdpSocket)
+
+/******************************************************************************\
+|* Publishes every product once to a UDP multicast group, so the cost is the
+|* same however many displays are listening. Each message is split into
+|* sequence-numbered fragments (see FragmentAssembler) small enough to avoid
+|* IP fragmentation.
+|*
+|* There's no back-channel, so there are no subscriptions: listeners get the
+|* full-resolution spectrum in the configured encoding. Delta coding is never
+|* used, since one lost datagram would spoil every frame up to the next key
+\******************************************************************************/
+class MulticastPublisher : public QObject
+	{
+	Q_OBJECT
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QHostAddress, group);			// Multicast group to send to
+	GET(int, port);						// UDP port to send to
+	GET(int, payload);					// Message bytes per datagram
+	GET(uint32_t, sequence);			// Next message sequence number
+	GET(uint64_t, datagrams);			// Datagrams sent
+	GET(uint64_t, failures);			// Datagrams the socket refused
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QUdpSocket *				_socket;	// Where datagrams go
+		int							_format;	// SpectrumCodec format
+		QMap<int, SpectrumCodec>	_encoders;	// One per channel and product
+		QByteArray					_datagram;	// Reused for each fragment
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		explicit MulticastPublisher(const QHostAddress& group,
+									int port,
+									int ttl,
+									int payload,
+									int format,
+									QObject *parent = nullptr);
+
+		/**********************************************************************\
+		|* Send a full-resolution message to the group
+		\**********************************************************************/
+		void publish(const QByteArray& msg);
+	};
+
+#endif // MULTICASTPUBLISHER_H
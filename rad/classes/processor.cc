@@ -1,14 +1,21 @@
 #include <complex>
+#include <cstring>
 
+#include <QJsonDocument>
 #include <QThreadPool>
 
 #include <libra.h>
 
 #include "config.h"
+#include "correlator.h"
 #include "fftaggregator.h"
+#include "metrics.h"
 #include "msgio.h"
 #include "processor.h"
-#include "soapyio.h"
+#include "rfifilter.h"
+#include "sourcemgr.h"
+#include "spectrumarchive.h"
+#include "sweeper.h"
 #include "taskfft.h"
 
 /******************************************************************************\
@@ -17,17 +24,39 @@
 #define LOG qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
 #define ERR qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
 
+/******************************************************************************\
+|* After the radio has been retuned, this many buffers are dropped, since they
+|* can hold samples from before or during the change
+\******************************************************************************/
+#define SETTLE_BUFFERS		2
+
 /******************************************************************************\
 |* Constructor
 \******************************************************************************/
-Processor::Processor(Config& cfg, QObject *parent)
+Processor::Processor(Config& cfg, int channel, QObject *parent)
 		  : QObject(parent)
+		  ,_channel(channel)
 		  ,_cfg(cfg)
+		  ,_mio(nullptr)
+		  ,_srcmgr(nullptr)
 		  ,_fftSize(0)
+		  ,_discard(0)
+		  ,_epoch(0)
+		  ,_frames(0)
+		  ,_correlator(nullptr)
+		  ,_sweeper(nullptr)
+		  ,_hop(0)
+		  ,_hopFrames(0)
+		  ,_dwellFrames(1)
+		  ,_hopSettle(0)
+		  ,_settle(0)
 		  ,_work(-1)
 		  ,_fftIn(-1)
 		  ,_fftOut(-1)
 		  ,_window(-1)
+		  ,_rfiFilter(nullptr)
+		  ,_aggregator(nullptr)
+		  ,_archive(nullptr)
 	{}
 
 /******************************************************************************\
@@ -38,6 +67,13 @@ Processor::~Processor(void)
 	DataMgr &dmgr	= DataMgr::instance();
 	ERR << "Destroying processor";
 
+	if (_archive)
+		{
+		_archiveThread.quit();
+		_archiveThread.wait();
+		delete _archive;
+		}
+
 	if (_fftIn >= 0)
 		dmgr.release(_fftIn);
 	if (_fftOut >= 0)
@@ -56,7 +92,45 @@ void Processor::dataReceived(int64_t buffer,
 							 int max,
 							 SourceBase::StreamFormat fmt)
 	{
-	DataMgr &dmgr	= DataMgr::instance();
+	DataMgr &dmgr		= DataMgr::instance();
+	Metrics &metrics	= Metrics::instance();
+
+	metrics.add(Metrics::SOURCE_BUFFERS);
+	metrics.add(Metrics::SAMPLES_IN, samples);
+
+	/**************************************************************************\
+	|* Drop anything from before, or just after, a change to the radio
+	\**************************************************************************/
+	if (_discard != 0)
+		{
+		if (_discard > 0)
+			_discard --;
+		metrics.add(Metrics::SOURCE_DISCARDS);
+		dmgr.release(buffer);
+		return;
+		}
+
+	/**************************************************************************\
+	|* After a sweep hop, the first samples are from while the tuner settled
+	\**************************************************************************/
+	int skip	= qMin(_settle, samples);
+	_settle		-= skip;
+	samples		-= skip;
+	if (samples == 0)
+		{
+		dmgr.release(buffer);
+		return;
+		}
+
+	/**************************************************************************\
+	|* A change of sample rate can mean bigger buffers from the source
+	\**************************************************************************/
+	if (dmgr.extent(_work) < samples * 2 * sizeof(double))
+		{
+		dmgr.release(_work);
+		_work = dmgr.blockFor(samples * 2, sizeof(double));
+		}
+
 	double *work	= dmgr.asDouble(_work);
 	double scale	= 1.0 / (double)max;
 
@@ -81,7 +155,7 @@ void Processor::dataReceived(int64_t buffer,
 		case SourceBase::STREAM_S8C:
 			{
 			extent *= 2;
-			int8_t * src8 = dmgr.asInt8(buffer);
+			int8_t * src8 = dmgr.asInt8(buffer) + skip * 2;
 			for (int i=0; i<extent; i++)
 				*work++ = ((*src8++) - shift) * scale;
 			break;
@@ -90,12 +164,21 @@ void Processor::dataReceived(int64_t buffer,
 		case SourceBase::STREAM_S16C:
 			{
 			extent *= 2;
-			int16_t * src16 = dmgr.asInt16(buffer);
+			int16_t * src16 = dmgr.asInt16(buffer) + skip * 2;
 			for (int i=0; i<extent; i++)
 				*work++ = ((*src16++) - shift) * scale;
 			break;
 			}
 
+		case SourceBase::STREAM_CF32:
+			{
+			extent *= 2;
+			float * srcF = dmgr.asFloat(buffer) + skip * 2;
+			for (int i=0; i<extent; i++)
+				*work++ = ((*srcF++) - shift) * scale;
+			break;
+			}
+
 		}
 
 	/**************************************************************************\
@@ -148,12 +231,64 @@ void Processor::dataReceived(int64_t buffer,
 				extent -= _fftSize*2;
 				}
 
-			connect(task, &TaskFFT::fftDone,
-					_aggregator, &FFTAggregator::fftReady);
+			/******************************************************************\
+			|* A sweep's frames are stitched rather than aggregated, tagged
+			|* with the hop they're from
+			\******************************************************************/
+			if (_sweeper)
+				{
+				Sweeper *sweeper	= _sweeper;
+				int64_t hop			= _hop;
+				connect(task, &TaskFFT::fftDone, sweeper,
+						[sweeper, hop](int bufferId)
+					{
+					sweeper->frameReady(hop, bufferId);
+					});
+				}
+			else
+				connect(task, &TaskFFT::fftDone,
+						_rfiFilter, &RFIFilter::fftReady);
+
+			if (_correlator)
+				{
+				Correlator *correlator	= _correlator;
+				int channel				= _channel;
+				task->setFrame(_frames);
+				connect(task, &TaskFFT::frameDone, correlator,
+						[correlator, channel](int64_t frame, int bufferId)
+					{
+					correlator->frameReady(channel, frame, bufferId);
+					});
+				}
+			_frames ++;
 
+			/******************************************************************\
+			|* Every chain shares the one pool. A task's priority goes down
+			|* with the number its chain already has in the queue, so the
+			|* chains take turns rather than one big buffer holding up the
+			|* rest
+			\******************************************************************/
+			connect(task, &TaskFFT::fftDone, this, [this]()
+				{
+				_inFlight.deref();
+				}, Qt::DirectConnection);
+
+			int queued = _inFlight.fetchAndAddRelaxed(1);
 			task->setPlan(_fftPlan);
 			task->setWindow(_window);
-			QThreadPool::globalInstance()->start(task);
+			QThreadPool::globalInstance()->start(task, -queued);
+			metrics.add(Metrics::FFT_QUEUED);
+
+			/******************************************************************\
+			|* Once a hop has had its dwell, whatever's left of the buffer is
+			|* surplus
+			\******************************************************************/
+			if (_sweeper && (++_hopFrames >= _dwellFrames))
+				{
+				_nextHop();
+				extent = 0;
+				break;
+				}
 			}
 
 		/**********************************************************************\
@@ -173,14 +308,30 @@ void Processor::dataReceived(int64_t buffer,
 /******************************************************************************\
 |* Initialise
 \******************************************************************************/
-void Processor::init(MsgIO *mio)
+void Processor::init(MsgIO *mio, SourceMgr *srcmgr)
 	{
 	_mio		= mio;
+	_srcmgr		= srcmgr;
+	_settings.load(_cfg);
+
+	/**************************************************************************\
+	|* Only the first chain is reconfigured by clients. The others start out
+	|* as their stream is tuned, and stay there
+	\**************************************************************************/
+	if (_channel > 0)
+		{
+		QString error;
+		QJsonObject tuning;
+		tuning.insert("frequency", srcmgr->streamFrequency(_channel));
+		if (!_settings.parse(tuning, error))
+			ERR << "Channel" << _channel << ":" << error;
+		}
 
 	/**************************************************************************\
 	|* Use a background thread for data-aggregation
 	\**************************************************************************/
 	_aggregator = new FFTAggregator();
+	_aggregator->setChannel(_channel);
 	_aggregator->moveToThread(&_bgThread);
 
 	/**************************************************************************\
@@ -189,12 +340,88 @@ void Processor::init(MsgIO *mio)
 	connect(_aggregator, &FFTAggregator::aggregatedDataReady,
 			mio, &MsgIO::newData);
 
+	/**************************************************************************\
+	|* Clients ask for changes through MsgIO, and the marker saying they've
+	|* been made goes back the same way as the data, so it arrives in order
+	\**************************************************************************/
+	if (_channel == 0)
+		{
+		connect(mio, &MsgIO::reconfigure,
+				this, &Processor::reconfigure);
+		connect(this, &Processor::configured,
+				mio, &MsgIO::newData);
+		}
+
+	/**************************************************************************\
+	|* Calibrations are made and applied by the aggregator, before the data
+	|* fans out to the clients
+	\**************************************************************************/
+	connect(mio, &MsgIO::calibration,
+			_aggregator, &FFTAggregator::calibration);
+
+	/**************************************************************************\
+	|* Updates and samples are archived, if there's somewhere to put them,
+	|* on a thread of their own so the disk never holds up the clients
+	\**************************************************************************/
+	QString archiveDir = _cfg.archiveDir();
+	if (!archiveDir.isEmpty() && (_channel > 0))
+		archiveDir += QString("/channel-%1").arg(_channel);
+	if (!archiveDir.isEmpty())
+		{
+		_archive = new SpectrumArchive(archiveDir);
+		_archive->describe(_settings);
+		_archive->moveToThread(&_archiveThread);
+
+		connect(_aggregator, &FFTAggregator::aggregatedDataReady,
+				_archive, &SpectrumArchive::append);
+		connect(_aggregator, &FFTAggregator::calibrationApplied,
+				_archive, &SpectrumArchive::setCalibration);
+		_archiveThread.start();
+		LOG << "Archiving to" << archiveDir;
+		}
+
+	_aggregator->setCalibrationKey(_calibrationKey(_settings));
+
+	_fftSize	= _cfg.fftSize();
+
+	/**************************************************************************\
+	|* The RFI filter shares the aggregation thread, so sub-integrations are
+	|* handed over with a direct call rather than a queued one
+	\**************************************************************************/
+	_rfiFilter	= new RFIFilter(_fftSize, _cfg.rfiFrames(), _cfg.rfiSigma());
+	_rfiFilter->moveToThread(&_bgThread);
+
+	connect(_rfiFilter, &RFIFilter::subIntegrationReady,
+			_aggregator, &FFTAggregator::subIntegrationReady);
+
+	/**************************************************************************\
+	|* A sweep steps the first tuner across a range, and is stitched on the
+	|* aggregation thread. It starts at the first hop
+	\**************************************************************************/
+	if ((_channel == 0) && _cfg.sweeping())
+		{
+		int rate		= _settings.sampleRate();
+		_sweeper		= new Sweeper(_cfg.sweepFrom(),
+									  _cfg.sweepTo(),
+									  rate,
+									  _fftSize,
+									  _cfg.sweepCrop());
+		_sweeper->moveToThread(&_bgThread);
+		connect(_sweeper, &Sweeper::sweepReady,
+				mio, &MsgIO::newData);
+
+		_dwellFrames	= qMax(1, (int)ceil(_cfg.sweepDwell() * rate / _fftSize));
+		_hopSettle		= (int)((int64_t)_cfg.sweepSettle() * rate / 1000);
+		_settle			= _hopSettle;
+		_srcmgr->retune(_sweeper->frequency(0), rate);
+		mio->setSweep(_describeSweep());
+		}
+
 	/**************************************************************************\
 	|* Start the background thread
 	\**************************************************************************/
 	_bgThread.start();
 
-	_fftSize	= _cfg.fftSize();
 	_allocate();
 
 	/**************************************************************************\
@@ -202,19 +429,276 @@ void Processor::init(MsgIO *mio)
 	|* substitute others as long as they are compatible, so allocate these
 	|* in exactly the same way as the ones we will use.
 	\**************************************************************************/
-	DataMgr &dmgr		= DataMgr::instance();
-	fftw_complex *in	= dmgr.asFFT(_fftIn);
-	fftw_complex *out	= dmgr.asFFT(_fftOut);
-	_fftPlan			= fftw_plan_dft_1d(_fftSize,
-										   in,
-										   out,
-										   FFTW_FORWARD,
-										   FFTW_PATIENT);
+	_fftPlan = _makePlan(_fftIn, _fftOut, _fftSize, FFTW_PATIENT);
 	LOG << "FFT plan created";
 
 	_populateWindowData();
 	}
 
+/******************************************************************************\
+|* Hand numbered frames to a correlator
+\******************************************************************************/
+void Processor::setCorrelator(Correlator *correlator)
+	{
+	_correlator = correlator;
+	}
+
+/******************************************************************************\
+|* Private method: the calibration key for some settings
+\******************************************************************************/
+CalibrationCache::Key Processor::_calibrationKey(RadioSettings settings)
+	{
+	CalibrationCache::Key key;
+	key.device		= _srcmgr->deviceName(_channel);
+	key.frequency	= settings.frequency();
+	key.gain		= settings.gain();
+	key.fftSize		= settings.fftSize();
+	key.window		= settings.window();
+	return key;
+	}
+
+/******************************************************************************\
+|* Apply new settings. This runs on the main thread, as does dataReceived(),
+|* so no new FFTs start while it works. Anything that can fail is done before
+|* anything is changed, so a failure leaves things as they were
+\******************************************************************************/
+void Processor::reconfigure(QJsonObject settings)
+	{
+	DataMgr &dmgr			= DataMgr::instance();
+	RadioSettings next		= _settings;
+	QString error;
+
+	if (!next.parse(settings, error))
+		{
+		_announce(false, error);
+		return;
+		}
+
+	uint32_t changes	= _settings.changes(next);
+	int size			= next.fftSize();
+
+	/**************************************************************************\
+	|* Only this channel is reconfigured, so while the two are being
+	|* correlated, anything that would put them out of step is refused
+	\**************************************************************************/
+	if (_correlator && (changes & (RadioSettings::CH_SOURCE | RadioSettings::CH_FFT)))
+		{
+		_announce(false, "Cannot retune or change the FFT while correlating");
+		return;
+		}
+
+	/**************************************************************************\
+	|* A sweep owns the tuner, and its plan is made for one FFT size
+	\**************************************************************************/
+	if (_sweeper && (changes & (RadioSettings::CH_SOURCE | RadioSettings::CH_FFT)))
+		{
+		_announce(false, "Cannot retune or change the FFT while sweeping");
+		return;
+		}
+
+	LOG << "Reconfiguring:" << QJsonDocument(next.toJson())
+									.toJson(QJsonDocument::Compact);
+
+	/**************************************************************************\
+	|* A new size needs a new plan, made on buffers of its own. FFTW_MEASURE,
+	|* not FFTW_PATIENT, since the data is waiting
+	\**************************************************************************/
+	fftw_plan plan	= nullptr;
+	int64_t fftIn	= -1;
+	int64_t fftOut	= -1;
+	if (size != _fftSize)
+		{
+		fftIn	= dmgr.fftBlockFor(size);
+		fftOut	= dmgr.fftBlockFor(size);
+		plan	= _makePlan(fftIn, fftOut, size, FFTW_MEASURE);
+		if (plan == nullptr)
+			{
+			dmgr.release(fftIn);
+			dmgr.release(fftOut);
+			_announce(false, QString("Cannot plan an FFT of %1").arg(size));
+			return;
+			}
+		}
+
+	/**************************************************************************\
+	|* Then the radio, which puts itself back if it can't make the change
+	\**************************************************************************/
+	if ((changes & RadioSettings::CH_SOURCE)
+	 && !_srcmgr->reconfigure(_settings, next, error))
+		{
+		if (plan != nullptr)
+			{
+			fftw_destroy_plan(plan);
+			dmgr.release(fftIn);
+			dmgr.release(fftOut);
+			}
+		_announce(false, error);
+		return;
+		}
+
+	/**************************************************************************\
+	|* Let the FFTs in flight finish with the old plan and window, then have
+	|* the aggregation thread drain what they sent before it starts again
+	\**************************************************************************/
+	QThreadPool::globalInstance()->waitForDone();
+
+	RFIFilter *filter			= _rfiFilter;
+	FFTAggregator *aggregator	= _aggregator;
+	SpectrumArchive *archive	= _archive;
+	CalibrationCache::Key key	= _calibrationKey(next);
+	QMetaObject::invokeMethod(_aggregator, [filter, aggregator, archive, next, key]() mutable
+		{
+		filter->restart(next.fftSize());
+		aggregator->restart(next.fftSize(),
+							next.updateSecs(),
+							next.sampleSecs());
+
+		/**********************************************************************\
+		|* Queued from here, the archive hears of the change after the last
+		|* of the data from before it, and before the first from after
+		\**********************************************************************/
+		if (archive)
+			QMetaObject::invokeMethod(archive, [archive, next]()
+				{
+				archive->describe(next);
+				});
+		aggregator->setCalibrationKey(key);
+		}, Qt::BlockingQueuedConnection);
+
+	if (_correlator)
+		{
+		Correlator *correlator = _correlator;
+		QMetaObject::invokeMethod(correlator, [correlator, next]() mutable
+			{
+			correlator->restart(next.fftSize(),
+								next.updateSecs(),
+								next.sampleSecs());
+			});
+		}
+
+	if (plan != nullptr)
+		{
+		fftw_destroy_plan(_fftPlan);
+		dmgr.release(_fftIn);
+		dmgr.release(_fftOut);
+		_fftPlan	= plan;
+		_fftIn		= fftIn;
+		_fftOut		= fftOut;
+		_fftSize	= size;
+
+		dmgr.release(_window);
+		_window		= dmgr.blockFor(_fftSize, sizeof(double));
+		}
+
+	_settings = next;
+	_populateWindowData();
+	_previous.clear();
+
+	/**************************************************************************\
+	|* Buffers already queued for us were read before the change, so drop all
+	|* of them, then a few more while the radio settles
+	\**************************************************************************/
+	if (changes & RadioSettings::CH_SOURCE)
+		{
+		_discard = -1;
+		QMetaObject::invokeMethod(this, [this]()
+			{
+			_discard = SETTLE_BUFFERS;
+			}, Qt::QueuedConnection);
+		}
+
+	_epoch ++;
+	_announce(true, "");
+	}
+
+/******************************************************************************\
+|* Make the marker for the clients: the settings in force, and how it went
+\******************************************************************************/
+void Processor::_announce(bool ok, const QString& error)
+	{
+	QJsonObject json = _settings.toJson();
+	json.insert("event", "configured");
+	json.insert("ok", ok);
+	json.insert("epoch", _epoch);
+	if (_sweeper)
+		json.insert("sweep", _describeSweep());
+	if (!ok)
+		{
+		ERR << "Reconfigure failed:" << error;
+		json.insert("error", error);
+		}
+
+	QByteArray text	= QJsonDocument(json).toJson(QJsonDocument::Compact);
+
+	Preamble hdr;
+	hdr.type		= TYPE_TEXT;
+	hdr.extent		= text.size();
+
+	QByteArray msg(sizeof(Preamble), Qt::Uninitialized);
+	memcpy(msg.data(), &hdr, sizeof(hdr));
+	msg.append(text);
+
+	emit configured(msg);
+	}
+
+/******************************************************************************\
+|* Describe the sweep: the range the stitched spectrum covers, and how
+\******************************************************************************/
+QJsonObject Processor::_describeSweep(void)
+	{
+	QJsonObject sweep;
+	sweep.insert("from", _sweeper->from());
+	sweep.insert("to", _sweeper->to());
+	sweep.insert("bins", _sweeper->bins());
+	sweep.insert("hops", _sweeper->hops());
+	sweep.insert("dwell", _dwellFrames * _fftSize / (double)_settings.sampleRate());
+	return sweep;
+	}
+
+/******************************************************************************\
+|* Move the sweep on. The stitcher is told how many frames the hop had, then
+|* the tuner is moved straight away: the hop's FFTs are still in the pool, so
+|* they're worked on while the tuner retunes and settles, and the only time
+|* lost is the settling. As after a reconfigure, buffers already queued for
+|* us were read before the change, so all of them go, then the settling
+|* samples of the next
+\******************************************************************************/
+void Processor::_nextHop(void)
+	{
+	Sweeper *sweeper	= _sweeper;
+	int64_t hop			= _hop;
+	int frames			= _hopFrames;
+	QMetaObject::invokeMethod(sweeper, [sweeper, hop, frames]()
+		{
+		sweeper->hopDone(hop, frames);
+		});
+
+	_hop ++;
+	_hopFrames	= 0;
+	_previous.clear();
+	_srcmgr->retune(_sweeper->frequency(_hop), _settings.sampleRate());
+
+	_discard = -1;
+	QMetaObject::invokeMethod(this, [this]()
+		{
+		_discard	= 0;
+		_settle		= _hopSettle;
+		}, Qt::QueuedConnection);
+	}
+
+/******************************************************************************\
+|* Plan an FFT between two blocks of {size} complex values
+\******************************************************************************/
+fftw_plan Processor::_makePlan(int64_t in, int64_t out, int size, unsigned flags)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	return fftw_plan_dft_1d(size,
+							dmgr.asFFT(in),
+							dmgr.asFFT(out),
+							FFTW_FORWARD,
+							flags);
+	}
+
 /******************************************************************************\
 |* Set up the buffers
 \******************************************************************************/
@@ -224,7 +708,7 @@ void Processor::_allocate(void)
 
 	if (_work >= 0)
 		dmgr.release(_work);
-	_work	= dmgr.blockFor(Config::instance().sampleRate()*2, sizeof(double));
+	_work	= dmgr.blockFor(_settings.sampleRate()*2, sizeof(double));
 
 	if (_fftIn >= 0)
 		dmgr.release(_fftIn);
@@ -248,7 +732,7 @@ void Processor::_populateWindowData(void)
 	DataMgr &dmgr		= DataMgr::instance();
 	double *win			= dmgr.asDouble(_window);
 
-	switch (Config::instance().fftWindowType())
+	switch (_settings.window())
 		{
 		case Config::W_RECTANGLE:
 			for (int i=0; i<_fftSize; i++)
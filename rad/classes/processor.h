@@ -1,29 +1,56 @@
 #ifndef PROCESSOR_H
 #define PROCESSOR_H
 
+#include <QAtomicInt>
+#include <QJsonObject>
 #include <QObject>
 #include <QThread>
+#include <QThreadPool>
 #include <QQueue>
 #include <fftw3.h>
 #include "properties.h"
 
+#include "calibrationcache.h"
+#include "radiosettings.h"
 #include "sourcebase.h"
 
 QT_FORWARD_DECLARE_CLASS(Config)
+QT_FORWARD_DECLARE_CLASS(Correlator)
 QT_FORWARD_DECLARE_CLASS(FFTAggregator)
 QT_FORWARD_DECLARE_CLASS(MsgIO)
+QT_FORWARD_DECLARE_CLASS(RFIFilter)
+QT_FORWARD_DECLARE_CLASS(SourceMgr)
+QT_FORWARD_DECLARE_CLASS(SpectrumArchive)
+QT_FORWARD_DECLARE_CLASS(Sweeper)
 
 class Processor : public QObject
 	{
 	Q_OBJECT
 
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, channel);					// Which of the source's streams
+
 	private:
 		/**********************************************************************\
 		|* Private variables
 		\**********************************************************************/
 		Config&			_cfg;			// Configuration
 		MsgIO *			_mio;			// Websocket interface
+		SourceMgr *		_srcmgr;		// Radio, for live changes
+		RadioSettings	_settings;		// What we're currently running with
 		int				_fftSize;		// Size of the FFT
+		int				_discard;		// Buffers to drop, -1 = all for now
+		int				_epoch;			// Number of reconfigurations
+		int64_t			_frames;		// FFT frames made, for pairing
+		Correlator *	_correlator;	// Cross-correlation, or null
+		Sweeper *		_sweeper;		// Sweep stitching, or null
+		int64_t			_hop;			// Sweep hop being integrated
+		int				_hopFrames;		// FFT frames made for it so far
+		int				_dwellFrames;	// FFT frames to make at each hop
+		int				_hopSettle;		// Samples to drop after each hop
+		int				_settle;		// Samples left to drop
 
 		int64_t			_work;			// Working buffer
 		QQueue<double>	_previous;		// Data left over from last pass
@@ -33,8 +60,12 @@ class Processor : public QObject
 		int64_t			_fftOut;		// FFTW buffer used during planning
 		int64_t			_window;		// Buffer holding the windowing data
 
+		QAtomicInt		_inFlight;		// FFTs queued or running
 		QThread			_bgThread;		// Background aggregation thread
+		RFIFilter *		_rfiFilter;		// Excise RFI before aggregation
 		FFTAggregator *	_aggregator;	// Collect data and send it off
+		QThread			_archiveThread;	// Archive writing thread
+		SpectrumArchive *	_archive;	// Long-term store, or null
 
 		/**********************************************************************\
 		|* Private method: allocate the RAM buffers we need
@@ -46,17 +77,60 @@ class Processor : public QObject
 		\**********************************************************************/
 		void _populateWindowData(void);
 
+		/**********************************************************************\
+		|* Private method: plan an FFT of {size} bins between two FFT blocks
+		\**********************************************************************/
+		fftw_plan _makePlan(int64_t in, int64_t out, int size, unsigned flags);
+
+		/**********************************************************************\
+		|* Private method: tell everyone how a reconfiguration went
+		\**********************************************************************/
+		void _announce(bool ok, const QString& error);
+
+		/**********************************************************************\
+		|* Private method: which calibration goes with some settings
+		\**********************************************************************/
+		CalibrationCache::Key _calibrationKey(RadioSettings settings);
+
+		/**********************************************************************\
+		|* Private method: describe the sweep, for the clients
+		\**********************************************************************/
+		QJsonObject _describeSweep(void);
+
+		/**********************************************************************\
+		|* Private method: the dwell at this hop is done, so move to the next
+		\**********************************************************************/
+		void _nextHop(void);
+
 	public:
 		/**********************************************************************\
-		|* Constructor
+		|* Constructor. Each stream the sources deliver - both tuners of an
+		|* RSPduo, or each of several devices - has a processor of its own,
+		|* and {channel} is the number of the stream
 		\**********************************************************************/
-		explicit Processor(Config& cfg, QObject *parent = nullptr);
+		explicit Processor(Config& cfg,
+						   int channel = 0,
+						   QObject *parent = nullptr);
 		~Processor(void);
 
 		/**********************************************************************\
 		|* Initialise with the data-stream params
 		\**********************************************************************/
-		void init(MsgIO *mio);
+		void init(MsgIO *mio, SourceMgr *srcmgr);
+
+		/**********************************************************************\
+		|* Send numbered FFT frames to a correlator as well. Both channels'
+		|* processors count frames from the first buffer they're given, so
+		|* frame n of each covers the same samples
+		\**********************************************************************/
+		void setCorrelator(Correlator *correlator);
+
+	signals:
+		/**********************************************************************\
+		|* A reconfiguration has been applied (or not). The message is a
+		|* TYPE_TEXT marker for the clients, holding JSON
+		\**********************************************************************/
+		void configured(QByteArray msg);
 
 	public slots:
 		void dataReceived(int64_t handle,
@@ -64,6 +138,12 @@ class Processor : public QObject
 						  int max,
 						  SourceBase::StreamFormat fmt);
 
+		/**********************************************************************\
+		|* Apply new settings while running: retune the radio, swap in a new
+		|* FFT plan and buffers if need be, and restart the integrations
+		\**********************************************************************/
+		void reconfigure(QJsonObject settings);
+
 	};
 
 #endif // PROCESSOR_H
@@ -0,0 +1,244 @@
+#include <climits>
+
+#include <libra.h>
+
+#include "radiosettings.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+RadioSettings::RadioSettings(void)
+			  :_frequency(1420406000)
+			  ,_gain(-1)
+			  ,_sampleRate(2048000)
+			  ,_fftSize(1024)
+			  ,_window(Config::W_HAMMING)
+			  ,_updateSecs(5)
+			  ,_sampleSecs(300)
+	{}
+
+/******************************************************************************\
+|* Take the settings from the configuration
+\******************************************************************************/
+void RadioSettings::load(Config& cfg)
+	{
+	_frequency	= cfg.centerFrequency();
+	_gain		= cfg.gain();
+	_sampleRate	= cfg.sampleRate();
+	_fftSize	= cfg.fftSize();
+	_window		= cfg.fftWindowType();
+	_updateSecs	= cfg.secondsBetweenUpdates();
+	_sampleSecs	= cfg.secondsBetweenSamples();
+	}
+
+/******************************************************************************\
+|* Update from a JSON command
+\******************************************************************************/
+bool RadioSettings::parse(const QJsonObject& cmd, QString& error)
+	{
+	double frequency			= cmd.value("frequency").toDouble(_frequency);
+	double gain					= cmd.value("gain").toDouble(_gain);
+	double sampleRate			= cmd.value("sampleRate").toDouble(_sampleRate);
+	int fftSize					= cmd.value("fftSize").toInt(_fftSize);
+	Config::WindowType window	= _window;
+	double updateSecs			= cmd.value("updateSecs").toDouble(_updateSecs);
+	double sampleSecs			= cmd.value("sampleSecs").toDouble(_sampleSecs);
+
+	if (cmd.contains("window"))
+		{
+		QString name	= cmd.value("window").toString();
+		int type		= Config::windowFor(name);
+		if (type < 0)
+			{
+			error = "Unknown window '" + name + "'";
+			return false;
+			}
+		window = (Config::WindowType)type;
+		}
+
+	/**************************************************************************\
+	|* These are held as ints, so check they'll fit before they're converted
+	\**************************************************************************/
+	if (!(frequency > 0) || (frequency > INT_MAX))
+		{
+		error = QString("Bad frequency %1").arg(frequency);
+		return false;
+		}
+
+	if (!(sampleRate > 0) || (sampleRate > INT_MAX))
+		{
+		error = QString("Bad sample rate %1").arg(sampleRate);
+		return false;
+		}
+
+	if ((fftSize < MIN_FFT_SIZE) || (fftSize > MAX_FFT_SIZE))
+		{
+		error = QString("FFT size %1 is outside %2 -> %3").arg(fftSize)
+														  .arg(MIN_FFT_SIZE)
+														  .arg(MAX_FFT_SIZE);
+		return false;
+		}
+
+	if ((updateSecs <= 0) || (sampleSecs < updateSecs))
+		{
+		error = QString("Bad integration times: update %1s, sample %2s")
+					.arg(updateSecs).arg(sampleSecs);
+		return false;
+		}
+
+	_frequency	= (int)frequency;
+	_gain		= gain;
+	_sampleRate	= (int)sampleRate;
+	_fftSize	= fftSize;
+	_window		= window;
+	_updateSecs	= updateSecs;
+	_sampleSecs	= sampleSecs;
+	return true;
+	}
+
+/******************************************************************************\
+|* Describe the settings as JSON
+\******************************************************************************/
+QJsonObject RadioSettings::toJson(void) const
+	{
+	QJsonObject json;
+	json.insert("frequency", _frequency);
+	json.insert("gain", _gain);
+	json.insert("sampleRate", _sampleRate);
+	json.insert("fftSize", _fftSize);
+	json.insert("window", Config::windowName(_window));
+	json.insert("updateSecs", _updateSecs);
+	json.insert("sampleSecs", _sampleSecs);
+	return json;
+	}
+
+/******************************************************************************\
+|* What differs between these settings and another set
+\******************************************************************************/
+uint32_t RadioSettings::changes(const RadioSettings& other) const
+	{
+	uint32_t changes = 0;
+	if (_frequency != other._frequency)
+		changes |= CH_FREQUENCY;
+	if (_gain != other._gain)
+		changes |= CH_GAIN;
+	if (_sampleRate != other._sampleRate)
+		changes |= CH_SAMPLE_RATE;
+	if ((_fftSize != other._fftSize) || (_window != other._window))
+		changes |= CH_FFT;
+	if ((_updateSecs != other._updateSecs) || (_sampleSecs != other._sampleSecs))
+		changes |= CH_TIMING;
+	return changes;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int RadioSettings::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * RadioSettings::testClassName(void)
+	{
+	return "RadioSettings";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult RadioSettings::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkParse();
+		case 1:
+			return _checkChanges();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a retune and a new window should apply and leave the rest
+|* alone. A bad FFT size, an unknown window, or a frequency too big to hold,
+|* should change nothing at all
+\******************************************************************************/
+Testable::TestResult RadioSettings::_checkParse(void)
+	{
+	RadioSettings settings;
+	QString error;
+
+	QJsonObject cmd;
+	cmd.insert("frequency", 1420000000);
+	cmd.insert("window", "blackman");
+	bool ok = settings.parse(cmd, error)
+		   && (settings.frequency() == 1420000000)
+		   && (settings.window() == Config::W_BLACKMAN)
+		   && (settings.fftSize() == 1024);
+
+	cmd = QJsonObject();
+	cmd.insert("frequency", 100000000);
+	cmd.insert("fftSize", 8);
+	ok = ok && !settings.parse(cmd, error)
+			&& (settings.frequency() == 1420000000);
+
+	cmd = QJsonObject();
+	cmd.insert("gain", 20);
+	cmd.insert("window", "triangle");
+	ok = ok && !settings.parse(cmd, error)
+			&& (settings.gain() == -1);
+
+	cmd = QJsonObject();
+	cmd.insert("frequency", 5.8e9);
+	ok = ok && !settings.parse(cmd, error)
+			&& (settings.frequency() == 1420000000);
+
+	if (!ok)
+		ERR << "Settings parse gave" << settings.frequency()
+			<< settings.fftSize() << (int)settings.window() << ":" << error;
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a retune is a source change only, a window change needs a
+|* new plan, and the same settings are no change at all
+\******************************************************************************/
+Testable::TestResult RadioSettings::_checkChanges(void)
+	{
+	RadioSettings before;
+	RadioSettings after = before;
+	QString error;
+
+	bool ok = (before.changes(after) == 0);
+
+	QJsonObject cmd;
+	cmd.insert("frequency", 1419000000);
+	cmd.insert("gain", 30);
+	after.parse(cmd, error);
+	ok = ok && (before.changes(after) == (CH_FREQUENCY | CH_GAIN));
+
+	after	= before;
+	cmd		= QJsonObject();
+	cmd.insert("window", "welch");
+	cmd.insert("sampleSecs", 600);
+	after.parse(cmd, error);
+	ok = ok && (before.changes(after) == (CH_FFT | CH_TIMING))
+			&& ((before.changes(after) & CH_SOURCE) == 0);
+
+	if (!ok)
+		ERR << "Changes classified as" << before.changes(after);
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,118 @@
+#ifndef RADIOSETTINGS_H
+#define RADIOSETTINGS_H
+
+#include <QJsonObject>
+#include <QString>
+
+#include <libra.h>
+
+#include "config.h"
+
+/******************************************************************************\
+|* The settings that can be changed while rad is running, without restarting
+|* it. They start out from the Config, and clients change them with a JSON
+|* text message:
+|*
+|*	{"cmd":"configure", "frequency":1420405752, "gain":40,
+|*	 "sampleRate":2048000, "fftSize":4096, "window":"blackman",
+|*	 "updateSecs":5, "sampleSecs":300}
+|*
+|* Any field can be left out to keep its current value, so {"cmd":"configure"}
+|* on its own just reports the settings. A gain of -1 means automatic.
+|*
+|* What has to happen to apply a change depends on what changed: the radio
+|* for frequency, gain and sample rate, a new FFT plan for size and window,
+|* and always a fresh start to the integrations, since spectra either side
+|* of a change can't be averaged together
+\******************************************************************************/
+class RadioSettings : public Testable
+	{
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		enum
+			{
+			CH_FREQUENCY	= 1 << 0,
+			CH_GAIN			= 1 << 1,
+			CH_SAMPLE_RATE	= 1 << 2,
+			CH_FFT			= 1 << 3,	// Size or window: needs a new plan
+			CH_TIMING		= 1 << 4,	// Update or sample interval
+
+			CH_SOURCE		= CH_FREQUENCY | CH_GAIN | CH_SAMPLE_RATE
+			};
+
+		static const int MIN_FFT_SIZE	= 16;
+		static const int MAX_FFT_SIZE	= 1 << 20;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, frequency);				// Centre frequency in Hz
+	GET(double, gain);					// Gain in dB, -1 = automatic
+	GET(int, sampleRate);				// Baseband sample rate
+	GET(int, fftSize);					// Bins in the FFT
+	GET(Config::WindowType, window);	// FFT window function
+	GET(double, updateSecs);			// Seconds between updates
+	GET(double, sampleSecs);			// Seconds between samples
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		RadioSettings(void);
+
+		/**********************************************************************\
+		|* Take the settings from the configuration
+		\**********************************************************************/
+		void load(Config& cfg);
+
+		/**********************************************************************\
+		|* Update from a JSON command, returns false and sets error if the
+		|* command doesn't make sense, in which case nothing is changed
+		\**********************************************************************/
+		bool parse(const QJsonObject& cmd, QString& error);
+
+		/**********************************************************************\
+		|* Describe the settings as JSON
+		\**********************************************************************/
+		QJsonObject toJson(void) const;
+
+		/**********************************************************************\
+		|* Return the CH_* bits for what differs between these and {other}
+		\**********************************************************************/
+		uint32_t changes(const RadioSettings& other) const;
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check a partial update applies, and a bad one doesn't
+		\**********************************************************************/
+		Testable::TestResult _checkParse(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check the changes are classified correctly
+		\**********************************************************************/
+		Testable::TestResult _checkChanges(void);
+	};
+
+#endif // RADIOSETTINGS_H
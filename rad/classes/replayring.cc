@@ -0,0 +1,211 @@
+#include <cstring>
+
+#include "replayring.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+ReplayRing::ReplayRing(int updates, int samples, int lives)
+		   :_bytes(0)
+	{
+	_limits.insert(TYPE_UPDATE, updates);
+	_limits.insert(TYPE_SAMPLE, samples);
+	_limits.insert(TYPE_LIVE, lives);
+	}
+
+/******************************************************************************\
+|* Keep a message
+\******************************************************************************/
+void ReplayRing::add(const QByteArray& msg)
+	{
+	if (msg.size() < (int)sizeof(Preamble))
+		return;
+
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	int type			= hdr->type;
+	int channel			= hdr->channel;
+	int stream			= (channel << 8) | type;
+	int limit			= _limits.value(type, 0);
+	if (limit <= 0)
+		return;
+
+	_ring.append({type, channel, msg});
+	_bytes += msg.size();
+	_counts[stream] ++;
+
+	/**************************************************************************\
+	|* Only one message arrives at a time, so at most one has to go
+	\**************************************************************************/
+	if (_counts[stream] > limit)
+		for (int i=0; i<_ring.size(); i++)
+			if ((_ring.at(i).type == type) && (_ring.at(i).channel == channel))
+				{
+				_bytes -= _ring.at(i).msg.size();
+				_ring.removeAt(i);
+				_counts[stream] --;
+				break;
+				}
+	}
+
+/******************************************************************************\
+|* Return the history of some products, oldest first
+\******************************************************************************/
+QList<QByteArray> ReplayRing::history(uint32_t types) const
+	{
+	QList<QByteArray> msgs;
+	for (const Entry& entry : _ring)
+		if (types & (1U << entry.type))
+			msgs.append(entry.msg);
+	return msgs;
+	}
+
+/******************************************************************************\
+|* Number held of a type, from a channel
+\******************************************************************************/
+int ReplayRing::count(int type, int channel) const
+	{
+	return _counts.value((channel << 8) | type, 0);
+	}
+
+/******************************************************************************\
+|* Forget everything
+\******************************************************************************/
+void ReplayRing::clear(void)
+	{
+	_ring.clear();
+	_counts.clear();
+	_bytes = 0;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int ReplayRing::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * ReplayRing::testClassName(void)
+	{
+	return "ReplayRing";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult ReplayRing::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkLimits();
+		case 1:
+			return _checkOrder();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : a message of a given type, carrying a serial number
+\******************************************************************************/
+static QByteArray _message(int type, float serial)
+	{
+	Preamble hdr;
+	hdr.type	= type;
+	hdr.extent	= sizeof(float);
+
+	QByteArray msg(sizeof(Preamble) + sizeof(float), Qt::Uninitialized);
+	memcpy(msg.data(), &hdr, sizeof(hdr));
+	memcpy(msg.data() + sizeof(hdr), &serial, sizeof(serial));
+	return msg;
+	}
+
+/******************************************************************************\
+|* Test helper : the serial number of a message
+\******************************************************************************/
+static float _serial(const QByteArray& msg)
+	{
+	float serial;
+	memcpy(&serial, msg.constData() + sizeof(Preamble), sizeof(serial));
+	return serial;
+	}
+
+/******************************************************************************\
+|* Test interface : keep 3 updates and 1 live. After 10 of each, the last 3
+|* updates and the last live should be all that's left, and samples (with a
+|* limit of 0) never stored
+\******************************************************************************/
+Testable::TestResult ReplayRing::_checkLimits(void)
+	{
+	ReplayRing ring(3, 0, 1);
+
+	for (int i=0; i<10; i++)
+		{
+		ring.add(_message(TYPE_UPDATE, i));
+		ring.add(_message(TYPE_LIVE, 100 + i));
+		ring.add(_message(TYPE_SAMPLE, 200 + i));
+		}
+
+	QList<QByteArray> updates	= ring.history(1U << TYPE_UPDATE);
+	QList<QByteArray> lives		= ring.history(1U << TYPE_LIVE);
+
+	bool ok = (ring.count(TYPE_UPDATE) == 3)
+		   && (ring.count(TYPE_LIVE) == 1)
+		   && (ring.count(TYPE_SAMPLE) == 0)
+		   && (updates.size() == 3)
+		   && (_serial(updates.at(0)) == 7)
+		   && (_serial(updates.at(2)) == 9)
+		   && (lives.size() == 1)
+		   && (_serial(lives.at(0)) == 109)
+		   && (ring.bytes() == 4 * (int64_t)(sizeof(Preamble) + sizeof(float)));
+	if (!ok)
+		ERR << "Ring holds" << ring.count(TYPE_UPDATE) << "updates,"
+			<< ring.count(TYPE_LIVE) << "live," << ring.count(TYPE_SAMPLE)
+			<< "samples";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : samples and updates interleaved should come back in the
+|* order they went in, with the types not asked for left out
+\******************************************************************************/
+Testable::TestResult ReplayRing::_checkOrder(void)
+	{
+	ReplayRing ring(4, 4, 1);
+
+	float serial = 0;
+	for (int i=0; i<4; i++)
+		{
+		ring.add(_message(TYPE_UPDATE, serial++));
+		ring.add(_message(TYPE_UPDATE, serial++));
+		ring.add(_message(TYPE_SAMPLE, serial++));
+		ring.add(_message(TYPE_LIVE, serial++));
+		}
+
+	QList<QByteArray> msgs = ring.history((1U << TYPE_UPDATE)
+										 | (1U << TYPE_SAMPLE));
+
+	bool ok = (msgs.size() == 8);
+	for (int i=1; ok && i<msgs.size(); i++)
+		ok = (_serial(msgs.at(i-1)) < _serial(msgs.at(i)));
+
+	for (const QByteArray& msg : msgs)
+		if (reinterpret_cast<const Preamble *>(msg.constData())->type == TYPE_LIVE)
+			ok = false;
+
+	if (!ok)
+		ERR << "History of" << msgs.size() << "messages out of order";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
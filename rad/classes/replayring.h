@@ -0,0 +1,107 @@
+#ifndef REPLAYRING_H
+#define REPLAYRING_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* The most recent messages of each product, kept so a client that has just
+|* connected can be sent enough history to fill its display straight away,
+|* rather than waiting hours for the samples to trickle in.
+|*
+|* Messages are held as the shared, full-resolution QByteArrays MsgIO gets
+|* from the aggregator, after calibration, so keeping them costs a reference.
+|* They're never modified once stored. Each product has its own limit, which
+|* applies to each channel separately, and when it's reached the oldest of
+|* that product from that channel goes. Order of arrival is kept across
+|* products and channels, so a replay interleaves them as they happened
+\******************************************************************************/
+class ReplayRing : public Testable
+	{
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int64_t, bytes);				// Total size of what's held
+
+	private:
+		/**********************************************************************\
+		|* A stored message
+		\**********************************************************************/
+		typedef struct
+			{
+			int			type;			// PreambleType of the message
+			int			channel;		// Stream it came from
+			QByteArray	msg;			// The shared message
+			} Entry;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QList<Entry>		_ring;		// Oldest first
+		QMap<int, int>		_limits;	// Most to keep, by type
+		QMap<int, int>		_counts;	// Currently held, by channel and type
+
+	public:
+		/**********************************************************************\
+		|* Constructor. A limit of 0 means that product isn't kept
+		\**********************************************************************/
+		explicit ReplayRing(int updates = 60, int samples = 288, int lives = 1);
+
+		/**********************************************************************\
+		|* Keep a message, dropping the oldest of its type and channel if
+		|* need be
+		\**********************************************************************/
+		void add(const QByteArray& msg);
+
+		/**********************************************************************\
+		|* Return what's held of the products in the {types} bitmask (bit n set
+		|* for PreambleType n), oldest first
+		\**********************************************************************/
+		QList<QByteArray> history(uint32_t types) const;
+
+		/**********************************************************************\
+		|* Number of messages held of a given type, from a given channel
+		\**********************************************************************/
+		int count(int type, int channel = 0) const;
+
+		/**********************************************************************\
+		|* Forget everything, eg: when the spectra stop being comparable
+		\**********************************************************************/
+		void clear(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check each product is bounded, keeping the newest
+		\**********************************************************************/
+		Testable::TestResult _checkLimits(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check history is in arrival order and filtered by type
+		\**********************************************************************/
+		Testable::TestResult _checkOrder(void);
+	};
+
+#endif // REPLAYRING_H
@@ -0,0 +1,287 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <libra.h>
+
+#include "rfifilter.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+RFIFilter::RFIFilter(int fftSize, int frames, double sigma, QObject *parent)
+		  :QObject(parent)
+		  ,_fftSize(fftSize)
+		  ,_frames((frames < 2) ? 2 : frames)
+		  ,_sigma(sigma)
+		  ,_skLo(0)
+		  ,_skHi(0)
+		  ,_passes(0)
+		  ,_excised(0)
+		  ,_s1(nullptr)
+		  ,_s2(nullptr)
+		  ,_mag(nullptr)
+	{
+	/**************************************************************************\
+	|* Variance of the SK estimator for N=d=1 is
+	|*		2.M^2.N.d.(1+N.d) / ((M-1).(M.N.d+2).(M.N.d+3))
+	|* which reduces to the below. The distribution is slightly skewed for small
+	|* M, but symmetric thresholds are good enough for M >= 64 or so.
+	\**************************************************************************/
+	double M	= _frames;
+	double var	= 4.0 * M * M / ((M - 1) * (M + 2) * (M + 3));
+	_skLo		= 1.0 - _sigma * sqrt(var);
+	_skHi		= 1.0 + _sigma * sqrt(var);
+
+	_s1			= new double[_fftSize];
+	_s2			= new double[_fftSize];
+	_mag		= new double[_fftSize];
+	_reset();
+
+	if (_sigma > 0)
+		LOG << "RFI excision: SK over" << _frames << "frames, accept"
+			<< _skLo << "->" << _skHi;
+	else
+		LOG << "RFI excision disabled";
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+RFIFilter::~RFIFilter(void)
+	{
+	delete [] _s1;
+	delete [] _s2;
+	delete [] _mag;
+	}
+
+/******************************************************************************\
+|* Start again with a (possibly) different number of bins, dropping whatever
+|* was part-way through being accumulated
+\******************************************************************************/
+void RFIFilter::restart(int fftSize)
+	{
+	if (fftSize != _fftSize)
+		{
+		delete [] _s1;
+		delete [] _s2;
+		delete [] _mag;
+
+		_fftSize	= fftSize;
+		_s1			= new double[_fftSize];
+		_s2			= new double[_fftSize];
+		_mag		= new double[_fftSize];
+		}
+	_reset();
+	}
+
+/******************************************************************************\
+|* We've been sent an FFT packet. Fold it into the current sub-integration
+\******************************************************************************/
+void RFIFilter::fftReady(int buffer)
+	{
+	DataMgr &dmgr		= DataMgr::instance();
+	fftw_complex *data	= dmgr.asFFT(buffer);
+
+	if (data != nullptr)
+		_accumulate(data);
+	dmgr.release(buffer);
+
+	if (_passes >= _frames)
+		emit subIntegrationReady(_flush());
+	}
+
+/******************************************************************************\
+|* Private method: clear the sub-integration accumulators
+\******************************************************************************/
+void RFIFilter::_reset(void)
+	{
+	memset(_s1, 0, _fftSize * sizeof(double));
+	memset(_s2, 0, _fftSize * sizeof(double));
+	memset(_mag, 0, _fftSize * sizeof(double));
+	_passes = 0;
+	}
+
+/******************************************************************************\
+|* Private method: add one frame. No branches in the loop, so that the
+|* compiler can vectorise it
+\******************************************************************************/
+void RFIFilter::_accumulate(fftw_complex *data)
+	{
+	double *s1	= _s1;
+	double *s2	= _s2;
+	double *mag	= _mag;
+
+	for (int i=0; i<_fftSize; i++)
+		{
+		double re		= data[i][0];
+		double im		= data[i][1];
+		double power	= re * re + im * im;
+
+		s1[i]			+= power;
+		s2[i]			+= power * power;
+		mag[i]			+= magnitude(re, im);
+		}
+
+	_passes ++;
+	}
+
+/******************************************************************************\
+|* Private method: compute SK per bin, write out the weighted sums and reset.
+|* Returns the handle of the {sum, weight} block
+\******************************************************************************/
+int64_t RFIFilter::_flush(void)
+	{
+	DataMgr &dmgr	= DataMgr::instance();
+	int64_t blockId	= dmgr.blockFor(_fftSize * 2, sizeof(double));
+	double *sum		= dmgr.asDouble(blockId);
+	double *weight	= sum + _fftSize;
+
+	double M		= _passes;
+	double scale	= (M + 1) / (M - 1);
+	double lo		= (_sigma > 0) ? _skLo : -HUGE_VAL;
+	double hi		= (_sigma > 0) ? _skHi :  HUGE_VAL;
+
+	double rejected	= 0;
+	for (int i=0; i<_fftSize; i++)
+		{
+		double s1	= _s1[i];
+		double sk	= (s1 > 0) ? scale * (M * _s2[i] / (s1 * s1) - 1) : 1.0;
+		double keep	= ((sk >= lo) && (sk <= hi)) ? 1.0 : 0.0;
+
+		sum[i]		= _mag[i] * keep;
+		weight[i]	= M * keep;
+		rejected	+= 1.0 - keep;
+		}
+
+	_excised += (int64_t)rejected;
+	_reset();
+	return blockId;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int RFIFilter::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * RFIFilter::testClassName(void)
+	{
+	return "RFIFilter";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult RFIFilter::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkNoisePasses();
+		case 1:
+			return _checkPulseExcised();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : Gaussian noise should (almost) never be excised
+\******************************************************************************/
+Testable::TestResult RFIFilter::_checkNoisePasses(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	std::mt19937 rng(1420);
+	std::normal_distribution<double> noise(0.0, sqrt(0.5));
+
+	_reset();
+	_excised			= 0;
+	int64_t frame		= dmgr.fftBlockFor(_fftSize);
+	fftw_complex *data	= dmgr.asFFT(frame);
+
+	for (int f=0; f<_frames; f++)
+		{
+		for (int i=0; i<_fftSize; i++)
+			{
+			data[i][0] = noise(rng);
+			data[i][1] = noise(rng);
+			}
+		_accumulate(data);
+		}
+	dmgr.release(frame);
+
+	int64_t result	= _flush();
+	double *weight	= dmgr.asDouble(result) + _fftSize;
+
+	int dropped = 0;
+	for (int i=0; i<_fftSize; i++)
+		if (weight[i] == 0)
+			dropped ++;
+	dmgr.release(result);
+
+	if (dropped > _fftSize / 32)
+		{
+		ERR << "Noise-only data had" << dropped << "of" << _fftSize
+			<< "bins excised";
+		return Testable::TEST_FAIL;
+		}
+	return Testable::TEST_PASS;
+	}
+
+/******************************************************************************\
+|* Test interface : A carrier present in 1 frame of 8 should be excised, and
+|* its neighbours should not
+\******************************************************************************/
+Testable::TestResult RFIFilter::_checkPulseExcised(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	std::mt19937 rng(1665);
+	std::normal_distribution<double> noise(0.0, sqrt(0.5));
+
+	int bin				= _fftSize / 3;
+
+	_reset();
+	int64_t frame		= dmgr.fftBlockFor(_fftSize);
+	fftw_complex *data	= dmgr.asFFT(frame);
+
+	for (int f=0; f<_frames; f++)
+		{
+		for (int i=0; i<_fftSize; i++)
+			{
+			data[i][0] = noise(rng);
+			data[i][1] = noise(rng);
+			}
+		if (f % 8 == 0)
+			data[bin][0] += 10.0;
+		_accumulate(data);
+		}
+	dmgr.release(frame);
+
+	int64_t result	= _flush();
+	double *sum		= dmgr.asDouble(result);
+	double *weight	= sum + _fftSize;
+
+	bool ok = (weight[bin] == 0) && (sum[bin] == 0)
+			&& (weight[bin-1] == _frames) && (weight[bin+1] == _frames);
+	if (!ok)
+		ERR << "Pulsed carrier not excised: weights"
+			<< weight[bin-1] << weight[bin] << weight[bin+1];
+	dmgr.release(result);
+
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
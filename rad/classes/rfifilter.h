@@ -0,0 +1,127 @@
+#ifndef RFIFILTER_H
+#define RFIFILTER_H
+
+#include <cmath>
+
+#include <QObject>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* The RFI filter sits between the FFT workers and the aggregator. It gathers
+|* short sub-integrations of {frames} FFTs, and for each bin computes the
+|* generalised spectral-kurtosis estimator (Nita & Gary, 2010):
+|*
+|*		SK = (M.N.d + 1) / (M - 1) * (M.S2 / S1^2 - 1)
+|*
+|* where S1 = sum(P), S2 = sum(P^2) over the M frames, N = 1 (each frame is a
+|* single spectrum) and d = 1 (power from a complex FFT). Gaussian noise gives
+|* SK ~= 1; intermittent or CW interference pushes it away. Bins outside
+|* 1 +/- sigma.stddev(SK) are given zero weight for that sub-integration.
+|*
+|* The output block is 2 x fftSize doubles: the first half is the summed
+|* magnitude for each bin (zero if excised), the second half is the number of
+|* frames that contributed to each bin, so the aggregator can normalise per bin
+\******************************************************************************/
+class RFIFilter : public QObject, public Testable
+	{
+	Q_OBJECT
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, fftSize);					// Bins in the FFT
+	GET(int, frames);					// Frames per sub-integration (M)
+	GET(double, sigma);					// Threshold in std-devs, 0 = off
+	GET(double, skLo);					// Lower SK acceptance threshold
+	GET(double, skHi);					// Upper SK acceptance threshold
+	GET(int, passes);					// Frames in the current sub-int
+	GET(int64_t, excised);				// Count of bins excised so far
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		double *		_s1;			// Sum of power per bin
+		double *		_s2;			// Sum of power-squared per bin
+		double *		_mag;			// Sum of magnitude per bin
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		void _reset(void);
+		void _accumulate(fftw_complex *data);
+		int64_t _flush(void);
+
+	signals:
+		/**********************************************************************\
+		|* A sub-integration is ready for the aggregator
+		\**********************************************************************/
+		void subIntegrationReady(int bufferId);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit RFIFilter(int fftSize,
+						   int frames,
+						   double sigma,
+						   QObject *parent = nullptr);
+		~RFIFilter(void);
+
+		/**********************************************************************\
+		|* Discard the current sub-integration and resize for {fftSize} bins
+		\**********************************************************************/
+		void restart(int fftSize);
+
+		/**********************************************************************\
+		|* The display magnitude of one FFT bin, as the aggregator has always
+		|* shown it. Anything else showing spectra uses this too, so that they
+		|* all share a scale
+		\**********************************************************************/
+		static inline double magnitude(double re, double im)
+			{
+			double creal	= re * re;
+			double cimag	= im * im;
+			return 0.05 * log(creal * creal + cimag * cimag + 1);
+			}
+
+	public slots:
+		/**********************************************************************\
+		|* Receive an FFT buffer from a worker
+		\**********************************************************************/
+		void fftReady(int bufferId);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check that gaussian noise passes through untouched
+		\**********************************************************************/
+		Testable::TestResult _checkNoisePasses(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check that a pulsed carrier in one bin is excised
+		\**********************************************************************/
+		Testable::TestResult _checkPulseExcised(void);
+	};
+
+#endif // RFIFILTER_H
@@ -15,7 +15,8 @@ class SourceBase : public QObject
 		typedef enum
 			{
 			STREAM_S8C		= 0,		// Signed, 8-bit data
-			STREAM_S16C					// Signed, 16-bit data
+			STREAM_S16C,				// Signed, 16-bit data
+			STREAM_CF32					// 32-bit float data, full scale 1.0
 			} StreamFormat;
 
 		struct StreamInfo
@@ -118,6 +119,16 @@ class SourceBase : public QObject
 			return info.name;
 			};
 
+		/**********************************************************************\
+		|* Number of independent streams the source delivers at once. The
+		|* first comes through dataAvailable(), a second (the RSPduo's other
+		|* tuner, in dual-tuner mode) through secondaryDataAvailable()
+		\**********************************************************************/
+		virtual int streamCount(void)
+			{
+			return 1;
+			};
+
 		/**********************************************************************\
 		|* Convenience method to return the mode
 		\**********************************************************************/
@@ -152,6 +163,10 @@ class SourceBase : public QObject
 					return "16-bit, signed, complex";
 					break;
 
+				case STREAM_CF32:
+					return "32-bit, float, complex";
+					break;
+
 				default:
 					return "undefined";
 					break;
@@ -172,12 +187,23 @@ class SourceBase : public QObject
 
 	signals:
 		/**********************************************************************\
-		|* We have new data
+		|* We have new data. {timeNs} is when the radio says the first sample
+		|* was taken, on its own clock, or 0 if it doesn't say
 		\**********************************************************************/
 		void dataAvailable(int64_t bufId,
 						   int samples,
 						   int max,
-						   StreamFormat fmt);
+						   StreamFormat fmt,
+						   int64_t timeNs = 0);
+
+		/**********************************************************************\
+		|* We have new data from the second stream, if there is one
+		\**********************************************************************/
+		void secondaryDataAvailable(int64_t bufId,
+									int samples,
+									int max,
+									StreamFormat fmt,
+									int64_t timeNs = 0);
 
 	};
 
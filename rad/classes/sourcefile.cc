@@ -0,0 +1,615 @@
+#include <cmath>
+#include <cstring>
+#if defined(Q_OS_LINUX)
+#  include <sys/mman.h>
+#endif
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <QVector>
+
+#include "datamgr.h"
+#include "metrics.h"
+#include "sourcefile.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+SourceFile::SourceFile(const QString& path, double speed, QObject *parent)
+		   :SourceBase(parent)
+		   ,Testable()
+		   ,_path(path)
+		   ,_speed((speed < 0) ? 0 : speed)
+		   ,_fileFormat(FILE_CU8)
+		   ,_recordedRate(0)
+		   ,_recordedFrequency(0)
+		   ,_position(0)
+		   ,_numSamples(0)
+		   ,_isActive(false)
+		   ,_file(nullptr)
+		   ,_data(nullptr)
+		   ,_sampleRate(0)
+		   ,_started(0)
+		   ,_startedAt(0)
+	{
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+SourceFile::~SourceFile(void)
+	{
+	_releaseInFlight();
+	delete _file;
+	}
+
+/******************************************************************************\
+|* The samples of a SigMF recording are in the .sigmf-data file
+\******************************************************************************/
+QString SourceFile::dataFileFor(const QString& path)
+	{
+	if (path.endsWith(".sigmf-meta"))
+		return path.left(path.length() - 5) + "data";
+	return path;
+	}
+
+/******************************************************************************\
+|* ... and its metadata in the .sigmf-meta. A raw recording has none
+\******************************************************************************/
+QString SourceFile::metaFileFor(const QString& path)
+	{
+	if (path.endsWith(".sigmf-data"))
+		return path.left(path.length() - 4) + "meta";
+	if (path.endsWith(".sigmf-meta"))
+		return path;
+	return "";
+	}
+
+/******************************************************************************\
+|* The format of a raw recording, from its extension
+\******************************************************************************/
+SourceFile::FileFormat SourceFile::formatFor(const QString& path)
+	{
+	QString ext = QFileInfo(path).suffix().toLower();
+	if ((ext == "cs8") || (ext == "ci8") || (ext == "s8"))
+		return FILE_CS8;
+	if ((ext == "cs16") || (ext == "ci16") || (ext == "s16"))
+		return FILE_CS16;
+	return FILE_CU8;
+	}
+
+/******************************************************************************\
+|* Bytes in one IQ pair
+\******************************************************************************/
+int SourceFile::bytesPerSample(FileFormat fmt)
+	{
+	return (fmt == FILE_CS16) ? 4 : 2;
+	}
+
+/******************************************************************************\
+|* Return the information on how this source reports data. The maximum is
+|* what the radio that makes this format reports
+\******************************************************************************/
+SourceBase::StreamInfo SourceFile::streamInfo(void)
+	{
+	StreamInfo info;
+	info.format = (_fileFormat == FILE_CS16) ? STREAM_S16C : STREAM_S8C;
+	info.max	= (_fileFormat == FILE_CS16) ? 16384 : 128;
+	info.name	= "file";
+	info.mode	= QFileInfo(_path).fileName();
+	return info;
+	}
+
+/******************************************************************************\
+|* Open and map the recording
+\******************************************************************************/
+bool SourceFile::open(int deviceId)
+	{
+	Q_UNUSED(deviceId);
+
+	if (_path.isEmpty())
+		return false;
+
+	QString data	= dataFileFor(_path);
+	QString meta	= metaFileFor(_path);
+	_fileFormat		= formatFor(data);
+	if (!meta.isEmpty() && !_readMeta(meta))
+		return false;
+
+	delete _file;
+	_data		= nullptr;
+	_file		= new QFile(data);
+	qint64 size	= _file->size();
+	if ((size < bytesPerSample(_fileFormat)) || !_file->open(QIODevice::ReadOnly))
+		{
+		ERR << "Cannot open IQ recording" << data;
+		return false;
+		}
+
+	_data = _file->map(0, size);
+	if (_data == nullptr)
+		{
+		ERR << "Cannot map IQ recording" << data;
+		return false;
+		}
+
+#if defined(Q_OS_LINUX)
+	madvise((void *)_data, size, MADV_SEQUENTIAL);
+#endif
+
+	_numSamples = size / bytesPerSample(_fileFormat);
+	_position	= 0;
+	LOG << "Playing" << data << ":" << _numSamples << "samples"
+		<< ((_speed > 0) ? QString("at %1x real time").arg(_speed)
+						 : QString("as fast as possible"));
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the sample rate
+\******************************************************************************/
+bool SourceFile::setSampleRate(int sampleRate)
+	{
+	if ((_recordedRate > 0) && (sampleRate != _recordedRate))
+		{
+		ERR << "Recording was made at" << _recordedRate
+			<< "samples/sec, not" << sampleRate;
+		return false;
+		}
+
+	_sampleRate	= sampleRate;
+	_started	= 0;
+	LOG << name() << "sample rate is now" << sampleRate;
+	return (sampleRate > 0);
+	}
+
+/******************************************************************************\
+|* Set the frequency
+\******************************************************************************/
+bool SourceFile::setFrequency(int frequency)
+	{
+	if ((_recordedFrequency > 0) && (frequency != _recordedFrequency))
+		{
+		ERR << "Recording was made at" << _recordedFrequency
+			<< "Hz, not" << frequency;
+		return false;
+		}
+
+	LOG << name() << "now tuned to" << frequency << "Hz";
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the gain, antenna and bandwidth - all NOPs on a recording
+\******************************************************************************/
+bool SourceFile::setGain(double gain)
+	{
+	Q_UNUSED(gain);
+	return true;
+	}
+
+bool SourceFile::setAntenna(QString antenna)
+	{
+	Q_UNUSED(antenna);
+	return true;
+	}
+
+bool SourceFile::setBandwidth(int bandwidth)
+	{
+	Q_UNUSED(bandwidth);
+	return true;
+	}
+
+/******************************************************************************\
+|* Start playing, from the start
+\******************************************************************************/
+void SourceFile::startSampling(void)
+	{
+	if (_data == nullptr)
+		{
+		ERR << "No recording to play";
+		return;
+		}
+
+	_isActive	= true;
+	_position	= 0;
+	_started	= 0;
+	_next();
+	}
+
+/******************************************************************************\
+|* Stop playing
+\******************************************************************************/
+void SourceFile::stopSampling(void)
+	{
+	_isActive = false;
+	}
+
+/******************************************************************************\
+|* Send the next block if it's due, otherwise come back when it will be
+\******************************************************************************/
+void SourceFile::_next(void)
+	{
+	if (!_isActive)
+		return;
+
+	if (_speed > 0)
+		{
+		int64_t now = Metrics::now();
+		if ((_started == 0) || (_sampleRate <= 0))
+			{
+			_started	= now;
+			_startedAt	= _position;
+			}
+
+		double rate	= ((_sampleRate > 0) ? _sampleRate : 1) * _speed;
+		int64_t due	= _started + (int64_t)((_position - _startedAt) * 1e9 / rate);
+		if (due > now)
+			{
+			QTimer::singleShot((int)ceil((due - now) / 1e6), this, &SourceFile::_next);
+			return;
+			}
+		}
+	else if (_backlogged())
+		{
+		QTimer::singleShot(1, this, &SourceFile::_next);
+		return;
+		}
+
+	if (!sendBlock())
+		{
+		LOG << "Finished playing" << _path << "after" << _position << "samples";
+		_isActive = false;
+		_releaseInFlight();
+		return;
+		}
+
+	QTimer::singleShot(0, this, &SourceFile::_next);
+	}
+
+/******************************************************************************\
+|* Copy the next block out of the mapping and send it. Signed 8-bit samples
+|* are offset to look like the RTL-SDR's unsigned ones
+\******************************************************************************/
+bool SourceFile::sendBlock(void)
+	{
+	if ((_data == nullptr) || (_position >= _numSamples))
+		return false;
+
+	DataMgr &dmgr		= DataMgr::instance();
+	int64_t samples		= qMin((int64_t)BLOCK_SAMPLES, _numSamples - _position);
+	int bps				= bytesPerSample(_fileFormat);
+	int64_t bytes		= samples * bps;
+	const uchar *src	= _data + _position * bps;
+	int64_t bufId		= dmgr.blockFor(bytes);
+	uint8_t *dst		= dmgr.asUint8(bufId);
+
+	if (_fileFormat == FILE_CS8)
+		{
+		for (int64_t i=0; i<bytes; i++)
+			dst[i] = src[i] ^ 0x80;
+		}
+	else
+		memcpy(dst, src, bytes);
+
+	/**************************************************************************\
+	|* Flat out, keep a reference so we can tell when it's been consumed
+	\**************************************************************************/
+	if (_speed <= 0)
+		{
+		dmgr.retain(bufId);
+		_inFlight.append(bufId);
+		}
+
+	_position += samples;
+
+	if (_fileFormat == FILE_CS16)
+		emit dataAvailable(bufId, samples, 8192, STREAM_S16C);
+	else
+		emit dataAvailable(bufId, samples, 128, STREAM_S8C);
+	return true;
+	}
+
+/******************************************************************************\
+|* Private method: is the pipeline behind? Blocks the processor has finished
+|* with are dropped from the in-flight list, then it's behind if too many
+|* are still there, or if too many FFTs are waiting for the thread pool
+\******************************************************************************/
+bool SourceFile::_backlogged(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	while (!_inFlight.isEmpty() && (dmgr.retainCount(_inFlight.first()) <= 1))
+		dmgr.release(_inFlight.takeFirst());
+
+	if (_inFlight.size() >= MAX_IN_FLIGHT)
+		return true;
+
+	Metrics &metrics	= Metrics::instance();
+	int64_t backlog		= metrics.total(Metrics::FFT_QUEUED)
+						- metrics.total(Metrics::FFT_FRAMES);
+	return (backlog > MAX_FFT_BACKLOG);
+	}
+
+/******************************************************************************\
+|* Private method: let go of the blocks we're tracking
+\******************************************************************************/
+void SourceFile::_releaseInFlight(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	for (int64_t bufId : _inFlight)
+		dmgr.release(bufId);
+	_inFlight.clear();
+	}
+
+/******************************************************************************\
+|* Private method: read the format, rate and frequency from SigMF metadata
+\******************************************************************************/
+bool SourceFile::_readMeta(const QString& meta)
+	{
+	QFile file(meta);
+	if (!file.open(QIODevice::ReadOnly))
+		{
+		ERR << "Cannot read SigMF metadata" << meta;
+		return false;
+		}
+
+	QJsonParseError status;
+	QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &status);
+	if (!doc.isObject())
+		{
+		ERR << "Bad SigMF metadata in" << meta << ":" << status.errorString();
+		return false;
+		}
+
+	QJsonObject global	= doc.object().value("global").toObject();
+	QString datatype	= global.value("core:datatype").toString();
+	if (datatype == "cu8")
+		_fileFormat = FILE_CU8;
+	else if (datatype == "ci8")
+		_fileFormat = FILE_CS8;
+	else if (datatype == "ci16_le")
+		_fileFormat = FILE_CS16;
+	else
+		{
+		ERR << "Cannot play SigMF datatype" << datatype;
+		return false;
+		}
+
+	_recordedRate = (int)global.value("core:sample_rate").toDouble();
+
+	QJsonArray captures = doc.object().value("captures").toArray();
+	if (!captures.isEmpty())
+		_recordedFrequency = (int)captures.at(0).toObject()
+										.value("core:frequency").toDouble();
+	return true;
+	}
+
+/******************************************************************************\
+|* Get a list of antennas - a recording has one
+\******************************************************************************/
+QList<QString> SourceFile::listAntennas(void)
+	{
+	QList<QString> list;
+	list.append("RX");
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of available bandwidth settings - none to choose from
+\******************************************************************************/
+QList<QString> SourceFile::listBandwidths(void)
+	{
+	return QList<QString>();
+	}
+
+/******************************************************************************\
+|* Get the number of channels in each direction - 1 RX
+\******************************************************************************/
+SourceBase::ChannelInfo SourceFile::numberOfChannels(void)
+	{
+	SourceBase::ChannelInfo info;
+	info.rx = 1;
+	info.tx = 0;
+	return info;
+	}
+
+/******************************************************************************\
+|* Get a list of frequency ranges, in MHz - whatever it was recorded at
+\******************************************************************************/
+QList<SourceBase::Range> SourceFile::listFrequencyRanges(void)
+	{
+	QList<SourceBase::Range> list;
+	if (_recordedFrequency > 0)
+		list.append({.from=_recordedFrequency/1e6, .to=_recordedFrequency/1e6});
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of sample rates, in MHz - likewise
+\******************************************************************************/
+QList<SourceBase::Range> SourceFile::listSampleRateRanges(void)
+	{
+	QList<SourceBase::Range> list;
+	if (_recordedRate > 0)
+		list.append({.from=_recordedRate/1e6, .to=_recordedRate/1e6});
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of available gains - none
+\******************************************************************************/
+QList<double> SourceFile::listGains(void)
+	{
+	return QList<double>();
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int SourceFile::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * SourceFile::testClassName(void)
+	{
+	return "SourceFile";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult SourceFile::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkSigmf();
+		case 1:
+			return _checkBlocks();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : somewhere to keep a test recording
+\******************************************************************************/
+static QString _testFile(const char *name)
+	{
+	return QDir::tempPath() + QString("/rad-play-%1-%2")
+									.arg(QCoreApplication::applicationPid())
+									.arg(name);
+	}
+
+/******************************************************************************\
+|* Test interface : a ci8 SigMF recording should take its rate and frequency
+|* from the metadata, refuse any other, and be sent as offset 8-bit samples
+\******************************************************************************/
+Testable::TestResult SourceFile::_checkSigmf(void)
+	{
+	QString meta	= _testFile("test.sigmf-meta");
+	QString data	= _testFile("test.sigmf-data");
+	int8_t iq[16]	= {0, 1, -1, 127, -128, 64, -64, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+	QFile m(meta);
+	m.open(QIODevice::WriteOnly);
+	m.write("{\"global\":{\"core:datatype\":\"ci8\",\"core:sample_rate\":1000000,"
+			"\"core:version\":\"1.0.0\"},"
+			"\"captures\":[{\"core:sample_index\":0,\"core:frequency\":1420000000}],"
+			"\"annotations\":[]}");
+	m.close();
+
+	QFile d(data);
+	d.open(QIODevice::WriteOnly);
+	d.write((const char *)iq, sizeof(iq));
+	d.close();
+
+	bool ok = false;
+	{
+	SourceFile src(meta, 0);
+	ok = src.open(0)
+	  && (src.fileFormat() == FILE_CS8)
+	  && (src.recordedRate() == 1000000)
+	  && (src.recordedFrequency() == 1420000000)
+	  && (src.numSamples() == 8)
+	  && (src.streamInfo().format == STREAM_S8C)
+	  && !src.setSampleRate(2048000)
+	  && src.setSampleRate(1000000)
+	  && !src.setFrequency(1420406000)
+	  && src.setFrequency(1420000000);
+
+	int blocks = 0;
+	connect(&src, &SourceBase::dataAvailable,
+			[&](int64_t bufId, int samples, int max, SourceBase::StreamFormat fmt)
+		{
+		DataMgr &dmgr	= DataMgr::instance();
+		uint8_t *got	= dmgr.asUint8(bufId);
+		ok = ok && (samples == 8) && (max == 128) && (fmt == STREAM_S8C);
+		for (int i=0; ok && i<16; i++)
+			ok = (got[i] == (uint8_t)(iq[i] ^ 0x80));
+		dmgr.release(bufId);
+		blocks ++;
+		});
+
+	ok = ok && src.sendBlock() && !src.sendBlock() && (blocks == 1);
+	}
+
+	QFile::remove(meta);
+	QFile::remove(data);
+
+	if (!ok)
+		ERR << "SigMF recording not played as expected";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a raw 16-bit recording of 2 blocks and a bit should go
+|* out as 3 blocks, with every sample in order
+\******************************************************************************/
+Testable::TestResult SourceFile::_checkBlocks(void)
+	{
+	QString path	= _testFile("test.cs16");
+	int64_t total	= 2 * BLOCK_SAMPLES + 100;
+
+	QVector<int16_t> iq(total * 2);
+	for (int i=0; i<iq.size(); i++)
+		iq[i] = (int16_t)(i & 0x3FFF);
+
+	QFile f(path);
+	f.open(QIODevice::WriteOnly);
+	f.write((const char *)iq.constData(), iq.size() * sizeof(int16_t));
+	f.close();
+
+	bool ok = false;
+	{
+	SourceFile src(path, 1.0);
+	ok = src.open(0)
+	  && src.setSampleRate(2048000)
+	  && (src.fileFormat() == FILE_CS16)
+	  && (src.numSamples() == total)
+	  && (src.streamInfo().format == STREAM_S16C);
+
+	int blocks		= 0;
+	int64_t seen	= 0;
+	connect(&src, &SourceBase::dataAvailable,
+			[&](int64_t bufId, int samples, int max, SourceBase::StreamFormat fmt)
+		{
+		DataMgr &dmgr	= DataMgr::instance();
+		int16_t *got	= dmgr.asInt16(bufId);
+		ok = ok && (max == 8192) && (fmt == STREAM_S16C)
+				&& (memcmp(got, iq.constData() + seen * 2, samples * 4) == 0);
+		dmgr.release(bufId);
+		seen += samples;
+		blocks ++;
+		});
+
+	while (src.sendBlock())
+		;
+	ok = ok && (blocks == 3) && (seen == total) && (src.position() == total);
+	}
+
+	QFile::remove(path);
+
+	if (!ok)
+		ERR << "Raw recording not played as expected";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
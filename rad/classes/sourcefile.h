@@ -0,0 +1,222 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <libra.h>
+
+#include "properties.h"
+#include "sourcebase.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+/******************************************************************************\
+|* Plays an IQ recording through the pipeline as if it were a radio, to
+|* benchmark it or reprocess what was recorded.
+|*
+|* The recording is either raw interleaved IQ, with the format taken from
+|* the extension (.cu8, as written by rtl_sdr, is the default; .cs8 and
+|* .cs16 are signed), or a SigMF pair, where the .sigmf-meta gives the
+|* format, sample rate and frequency. 8-bit data is sent on as the RTL-SDR
+|* sends it, and 16-bit as the SDRplay does, so it's processed exactly as
+|* the live stream would have been.
+|*
+|* The data file is mapped, and each block is copied out of the mapping into
+|* a DataMgr buffer. Blocks go out from the event loop, so stopSampling()
+|* still works while playing. At {speed} times real time they're paced by
+|* the clock; at speed 0 they go as fast as the pipeline takes them, held
+|* back while the FFTs or the buffers in flight pass a limit
+\******************************************************************************/
+class SourceFile : public SourceBase, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			FILE_CU8 = 0,				// Unsigned 8-bit, as from rtl_sdr
+			FILE_CS8,					// Signed 8-bit
+			FILE_CS16					// Signed 16-bit, little-endian
+			} FileFormat;
+
+		static const int	BLOCK_SAMPLES	= 256 * 1024;	// IQ pairs per block
+		static const int	MAX_IN_FLIGHT	= 4;			// Blocks unconsumed
+		static const int	MAX_FFT_BACKLOG	= 256;			// FFTs not yet done
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, path);						// Recording to play
+	GET(double, speed);						// Times real time, 0 = flat out
+	GET(FileFormat, fileFormat);			// How the samples are stored
+	GET(int, recordedRate);					// From the metadata, or 0
+	GET(int, recordedFrequency);			// From the metadata, or 0
+	GET(int64_t, position);					// Next sample to send
+	GET(int64_t, numSamples);				// Samples in the recording
+	GETSET(bool, isActive, IsActive);		// Playing
+
+	private:
+		/**********************************************************************\
+		|* Private instance variables
+		\**********************************************************************/
+		QFile *				_file;			// The IQ data
+		const uchar *		_data;			// ... mapped
+		int					_sampleRate;	// Rate to pace at
+		int64_t				_started;		// When playing started, ns
+		int64_t				_startedAt;		// ... from which sample
+		QList<int64_t>		_inFlight;		// Blocks sent, oldest first
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		bool _readMeta(const QString& meta);
+		bool _backlogged(void);
+		void _releaseInFlight(void);
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		explicit SourceFile(const QString& path,
+							double speed = 1.0,
+							QObject *parent = nullptr);
+		virtual ~SourceFile(void);
+
+		/**********************************************************************\
+		|* Work out the data file, metadata file and format for a path
+		\**********************************************************************/
+		static QString dataFileFor(const QString& path);
+		static QString metaFileFor(const QString& path);
+		static FileFormat formatFor(const QString& path);
+
+		/**********************************************************************\
+		|* Bytes in one IQ pair of a format
+		\**********************************************************************/
+		static int bytesPerSample(FileFormat fmt);
+
+		/**********************************************************************\
+		|* Return the information on how this source reports data
+		\**********************************************************************/
+		virtual StreamInfo streamInfo(void);
+
+		/**********************************************************************\
+		|* Open the recording. The device id is ignored
+		\**********************************************************************/
+		virtual bool open(int deviceId);
+
+		/**********************************************************************\
+		|* Set the sample-rate. A SigMF recording has to be played at the
+		|* rate it was made at; a raw one is taken to be at this rate
+		\**********************************************************************/
+		virtual bool setSampleRate(int sampleRate);
+
+		/**********************************************************************\
+		|* Set the center-frequency. Likewise
+		\**********************************************************************/
+		virtual bool setFrequency(int frequency);
+
+		/**********************************************************************\
+		|* Set the gain in dB: a NOP
+		\**********************************************************************/
+		virtual bool setGain(double gain);
+
+		/**********************************************************************\
+		|* Set the antenna to use: a NOP
+		\**********************************************************************/
+		virtual bool setAntenna(QString antenna);
+
+		/**********************************************************************\
+		|* Set the tuner bandwidth to use: a NOP
+		\**********************************************************************/
+		virtual bool setBandwidth(int bandwidth);
+
+		/**********************************************************************\
+		|* Get a list of available antennas
+		\**********************************************************************/
+		virtual QList<QString> listAntennas(void);
+
+		/**********************************************************************\
+		|* Get a list of available bandwidth settings
+		\**********************************************************************/
+		virtual QList<QString> listBandwidths(void);
+
+		/**********************************************************************\
+		|* Get the number of available channels for RX and TX
+		\**********************************************************************/
+		virtual ChannelInfo numberOfChannels(void);
+
+		/**********************************************************************\
+		|* Get a list of frequency ranges, in MHz
+		\**********************************************************************/
+		virtual QList<Range> listFrequencyRanges(void);
+
+		/**********************************************************************\
+		|* Get a list of gains in dB
+		\**********************************************************************/
+		virtual QList<double> listGains(void);
+
+		/**********************************************************************\
+		|* Get the ranges within which you can sample
+		\**********************************************************************/
+		virtual QList<SourceBase::Range> listSampleRateRanges(void);
+
+		/**********************************************************************\
+		|* Send the next block. Returns false at the end of the recording
+		\**********************************************************************/
+		bool sendBlock(void);
+
+	public slots:
+		/**********************************************************************\
+		|* Start playing from the start of the recording
+		\**********************************************************************/
+		 virtual void startSampling(void);
+
+		/**********************************************************************\
+		|* Stop playing
+		\**********************************************************************/
+		 virtual void stopSampling(void);
+
+	private slots:
+		/**********************************************************************\
+		|* Send the next block when it's due, or wait for it to be
+		\**********************************************************************/
+		void _next(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check a SigMF recording's metadata is used
+		\**********************************************************************/
+		Testable::TestResult _checkSigmf(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check a raw recording is sent whole, in blocks
+		\**********************************************************************/
+		Testable::TestResult _checkBlocks(void);
+	};
+
+#endif // SOURCEFILE_H
@@ -2,11 +2,15 @@
 
 #include "config.h"
 #include "constants.h"
+#include "iqrecorder.h"
 #include "processor.h"
 #include "sourcebase.h"
+#include "sourcefile.h"
 #include "sourcemgr.h"
 #include "sourcertlsdr.h"
 #include "sourcesdrplay.h"
+#include "sourcesoapy.h"
+#include "sourcesynthetic.h"
 
 /******************************************************************************\
 |* Categorised logging support
@@ -24,8 +28,23 @@ Q_LOGGING_CATEGORY(log_src, "rascal.src   ")
 SourceMgr::SourceMgr(QObject *parent)
 		  :QObject(parent)
 		  ,_src(nullptr)
+		  ,_recorder(nullptr)
+		  ,_recThread(nullptr)
 	{
-	_findMatchingSource();
+	/**************************************************************************\
+	|* Open a source for each device-id asked for. One that can't be found is
+	|* left out, and the rest carry on without it
+	\**************************************************************************/
+	for (int id : Config::instance().radioIds())
+		{
+		SourceBase *src = _findMatchingSource(id);
+		if (src != nullptr)
+			{
+			_srcs.append(src);
+			_ids.append(id);
+			}
+		}
+	_src = _srcs.isEmpty() ? nullptr : _srcs.first();
 
 	/**************************************************************************\
 	|* Handle commandline options to list out stats etc.
@@ -106,8 +125,15 @@ SourceMgr::SourceMgr(QObject *parent)
 \******************************************************************************/
 SourceMgr::~SourceMgr(void)
 	{
-	if (_src)
-		delete _src;
+	if (_recThread)
+		{
+		_recThread->quit();
+		_recThread->wait();
+		}
+	delete _recorder;
+
+	for (SourceBase *src : qAsConst(_srcs))
+		delete src;
 	}
 
 
@@ -120,22 +146,41 @@ bool SourceMgr::foundSource(void)
 	}
 
 /******************************************************************************\
-|* Initialise the parameters for the source
+|* Name the device a stream comes from
+\******************************************************************************/
+QString SourceMgr::deviceName(int stream)
+	{
+	int index = 0;
+	int which = _sourceFor(stream, index);
+	if (which < 0)
+		return "none";
+
+	int id			= _ids.at(which);
+	QString name	= QString("%1-%2").arg(_srcs.at(which)->name())
+									  .arg((id < 0) ? 0 : id);
+	if (index > 0)
+		name += QString(":%1").arg(index);
+	return name;
+	}
+
+/******************************************************************************\
+|* Initialise the parameters for the sources. They all start out the same
 \******************************************************************************/
 bool SourceMgr::initialiseSource(void)
 	{
-	bool ok = false;
-	if (_src != nullptr)
+	bool ok = !_srcs.isEmpty();
+	for (SourceBase *src : qAsConst(_srcs))
 		{
-		ok = _src->setSampleRate(Config::instance().sampleRate());
 		if (ok)
-			ok = _src->setFrequency(Config::instance().centerFrequency());
+			ok = src->setSampleRate(Config::instance().sampleRate());
 		if (ok)
-			ok = _src->setGain(Config::instance().gain());
+			ok = src->setFrequency(Config::instance().centerFrequency());
 		if (ok)
-			ok = _src->setAntenna(Config::instance().antenna());
+			ok = src->setGain(Config::instance().gain());
 		if (ok)
-			ok = _src->setBandwidth(Config::instance().bandwidth());
+			ok = src->setAntenna(Config::instance().antenna());
+		if (ok)
+			ok = src->setBandwidth(Config::instance().bandwidth());
 		}
 
 	return ok;
@@ -144,23 +189,46 @@ bool SourceMgr::initialiseSource(void)
 /******************************************************************************\
 |* Determine the radio to use by probing and filtering the results
 \******************************************************************************/
-void SourceMgr::_findMatchingSource(void)
+SourceBase * SourceMgr::_findMatchingSource(int idFilter)
 	{
 	QString devFilter	= Config::instance().radioDriverFilter();
 	QString modeFilter	= Config::instance().radioModeFilter();
-	int idFilter		= Config::instance().radioIdFilter();
 
 	/**************************************************************************\
-	|* Create instances of all the sources we know about
+	|* Create instances of all the sources we know about. A recording to play
+	|* stands in for the radio, whatever the filters say
 	\**************************************************************************/
 	QList<SourceBase *> srcs;
-	srcs.append(new SourceRtlSdr());
-	srcs.append(new SourceSdrPlay());
+	QString playFile	= Config::instance().playFile();
+	if (playFile.length() > 0)
+		{
+		devFilter	= "";
+		modeFilter	= "";
+		srcs.append(new SourceFile(playFile, Config::instance().playSpeed()));
+		}
+	else
+		{
+		srcs.append(new SourceRtlSdr());
+		srcs.append(new SourceSdrPlay());
+		srcs.append(new SourceSoapy());
+
+		/**********************************************************************\
+		|* The synthetic source is only ever wanted by name, never as a
+		|* fallback for a radio that isn't plugged in
+		\**********************************************************************/
+		if (devFilter.contains("synthetic"))
+			{
+			QString fmt = Config::instance().synthFormat();
+			srcs.append(new SourceSynthetic(Config::instance().synthSignals(),
+											(fmt == "s16c") ? SourceBase::STREAM_S16C
+															: SourceBase::STREAM_S8C));
+			}
+		}
 
 	/**************************************************************************\
 	|* Find the first entry in the list that matches the criteria
 	\**************************************************************************/
-	_src = nullptr;
+	SourceBase *match = nullptr;
 	for (SourceBase *src : srcs)
 		{
 		bool driverFound			= true;
@@ -179,7 +247,7 @@ void SourceMgr::_findMatchingSource(void)
 		bool found = driverFound & modeFound;
 		if (found && src->open(idFilter))
 			{
-			_src = src;
+			match = src;
 			break;
 			}
 		}
@@ -188,46 +256,233 @@ void SourceMgr::_findMatchingSource(void)
 	|* Delete all the instances that we didn't match
 	\**************************************************************************/
 	for (SourceBase *src : srcs)
-		if (src != _src)
+		if (src != match)
 			delete src;
 
 	/**************************************************************************\
 	|* If we're still null, then show an error
 	\**************************************************************************/
-	if (_src == nullptr)
+	if (match == nullptr)
 		{
-		QString msg = QString("Cannot match device using {driver:%1, mode:%2}").
-				arg(devFilter,modeFilter);
+		QString msg = QString("Cannot match device using {driver:%1, mode:%2, id:%3}").
+				arg(devFilter,modeFilter).arg(idFilter);
 		ERR << msg;
 		}
+	return match;
+	}
+
+/******************************************************************************\
+|* Return the number of streams the sources deliver
+\******************************************************************************/
+int SourceMgr::streamCount(void)
+	{
+	int streams = 0;
+	for (SourceBase *src : qAsConst(_srcs))
+		streams += src->streamCount();
+	return (streams == 0) ? 1 : streams;
 	}
 
 /******************************************************************************\
-|* Start the source sampling
+|* Return the frequency a stream starts out tuned to. Only a source's second
+|* stream - the RSPduo's tuner B - can be tuned elsewhere
 \******************************************************************************/
-bool SourceMgr::start(Processor *processor)
+int SourceMgr::streamFrequency(int stream)
 	{
-	bool ok = false;
-	if (_src != nullptr)
+	int index = 0;
+	_sourceFor(stream, index);
+	return (index > 0) ? Config::instance().centerFrequencyB()
+					   : Config::instance().centerFrequency();
+	}
+
+/******************************************************************************\
+|* Private method: find the source delivering a stream. Returns its place in
+|* the list, or -1, and sets {index} to which of its streams it is
+\******************************************************************************/
+int SourceMgr::_sourceFor(int stream, int& index)
+	{
+	index = 0;
+	for (int i=0; i<_srcs.size(); i++)
 		{
-		_thread = new QThread(this);
-		_src->moveToThread(_thread);
+		int streams = _srcs.at(i)->streamCount();
+		if (stream < streams)
+			{
+			index = stream;
+			return i;
+			}
+		stream -= streams;
+		}
+	return -1;
+	}
+
+/******************************************************************************\
+|* Start the sources sampling, each on its own thread. Only the primary's
+|* first stream is recorded as raw IQ
+\******************************************************************************/
+bool SourceMgr::start(const QList<Processor *>& processors)
+	{
+	if (_srcs.isEmpty())
+		return false;
+
+	int stream = 0;
+	for (SourceBase *src : qAsConst(_srcs))
+		{
+		QThread *thread = new QThread(this);
+		src->moveToThread(thread);
+		_threads.append(thread);
 
 		connect(this, &SourceMgr::startSourceSampling,
-				_src, &SourceBase::startSampling);
+				src, &SourceBase::startSampling);
 		connect(this, &SourceMgr::stopSourceSampling,
-				_src, &SourceBase::stopSampling);
-		connect(_src, &SourceBase::dataAvailable,
-				processor, &Processor::dataReceived);
-		_thread->start();
+				src, &SourceBase::stopSampling);
+
+		if (stream < processors.size())
+			connect(src, &SourceBase::dataAvailable,
+					processors.at(stream), &Processor::dataReceived);
+		if ((src->streamCount() > 1) && (stream + 1 < processors.size()))
+			connect(src, &SourceBase::secondaryDataAvailable,
+					processors.at(stream + 1), &Processor::dataReceived);
+		stream += src->streamCount();
+		}
+
+	_startRecorder();
+	for (QThread *thread : qAsConst(_threads))
+		thread->start();
 
-		emit startSourceSampling();
-		ok = true;
+	emit startSourceSampling();
+	return true;
+	}
+
+/******************************************************************************\
+|* Record the raw IQ, if there's somewhere to put it. The ring is sized for
+|* the configured rate, so a faster one set later keeps proportionately less
+\******************************************************************************/
+void SourceMgr::_startRecorder(void)
+	{
+	Config &cfg	= Config::instance();
+	QString dir	= cfg.iqDir();
+	if (dir.length() == 0)
+		return;
+
+	SourceBase::StreamFormat fmt	= _src->streamInfo().format;
+	int segments					= cfg.iqSegments();
+	int64_t bytes					= IQRecorder::segmentBytesFor(cfg.iqRetention(),
+																  segments,
+																  cfg.sampleRate(),
+																  fmt);
+
+	_recorder = new IQRecorder(dir,
+							   segments,
+							   bytes,
+							   cfg.sampleRate(),
+							   cfg.centerFrequency());
+	if (!_recorder->open())
+		{
+		ERR << "Not recording raw IQ";
+		delete _recorder;
+		_recorder = nullptr;
+		return;
+		}
+
+	/**************************************************************************\
+	|* capture() runs on the source thread, to take its reference on each
+	|* buffer before the processor can release it
+	\**************************************************************************/
+	_recThread = new QThread(this);
+	_recorder->moveToThread(_recThread);
+	connect(_src, &SourceBase::dataAvailable,
+			_recorder, &IQRecorder::capture, Qt::DirectConnection);
+	_recThread->start();
+	}
+
+/******************************************************************************\
+|* Change the radio settings on the fly. The source thread is blocked inside
+|* the driver's streaming loop, so this calls straight into the source: both
+|* drivers allow their tuning calls while streaming
+\******************************************************************************/
+bool SourceMgr::reconfigure(RadioSettings from, RadioSettings to, QString& error)
+	{
+	if (_src == nullptr)
+		{
+		error = "No source";
+		return false;
+		}
+
+	uint32_t changes	= from.changes(to);
+	bool ok				= true;
+
+	if (ok && (changes & RadioSettings::CH_SAMPLE_RATE))
+		{
+		ok = _src->setSampleRate(to.sampleRate());
+		if (ok && !_src->setBandwidth(Config::instance().bandwidth()))
+			WARN << "Tuner bandwidth unchanged at new sample rate";
+		if (!ok)
+			error = QString("Cannot set sample rate %1").arg(to.sampleRate());
+		}
+
+	if (ok && (changes & RadioSettings::CH_FREQUENCY))
+		{
+		ok = _src->setFrequency(to.frequency());
+		if (!ok)
+			error = QString("Cannot tune to %1").arg(to.frequency());
+		}
+
+	if (ok && (changes & RadioSettings::CH_GAIN))
+		{
+		ok = _src->setGain(to.gain());
+		if (!ok)
+			error = QString("Cannot set gain %1").arg(to.gain());
+		}
+
+	/**************************************************************************\
+	|* Put back whatever we can, so the radio matches what clients think it is
+	\**************************************************************************/
+	if (!ok)
+		{
+		ERR << "Reconfigure failed:" << error;
+		if (changes & RadioSettings::CH_SAMPLE_RATE)
+			_src->setSampleRate(from.sampleRate());
+		if (changes & RadioSettings::CH_FREQUENCY)
+			_src->setFrequency(from.frequency());
+		if (changes & RadioSettings::CH_GAIN)
+			_src->setGain(from.gain());
+		}
+	else if (_recorder && (changes & (RadioSettings::CH_FREQUENCY
+									| RadioSettings::CH_SAMPLE_RATE)))
+		{
+		IQRecorder *recorder	= _recorder;
+		int frequency			= to.frequency();
+		int sampleRate			= to.sampleRate();
+		QMetaObject::invokeMethod(recorder, [recorder, frequency, sampleRate]()
+			{
+			recorder->retune(frequency, sampleRate);
+			}, Qt::QueuedConnection);
 		}
 
 	return ok;
 	}
 
+/******************************************************************************\
+|* Retune the primary source between the hops of a sweep
+\******************************************************************************/
+bool SourceMgr::retune(int frequency, int sampleRate)
+	{
+	if ((_src == nullptr) || !_src->setFrequency(frequency))
+		{
+		ERR << "Cannot tune to" << frequency;
+		return false;
+		}
+
+	if (_recorder)
+		{
+		IQRecorder *recorder = _recorder;
+		QMetaObject::invokeMethod(recorder, [recorder, frequency, sampleRate]()
+			{
+			recorder->retune(frequency, sampleRate);
+			}, Qt::QueuedConnection);
+		}
+	return true;
+	}
+
 /******************************************************************************\
 |* Private method - show a list with a title
 \******************************************************************************/
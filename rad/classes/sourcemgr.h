@@ -1,11 +1,27 @@
 #ifndef SOURCEMGR_H
 #define SOURCEMGR_H
 
+#include <QList>
 #include <QObject>
+
+#include "radiosettings.h"
+
+QT_FORWARD_DECLARE_CLASS(IQRecorder)
 QT_FORWARD_DECLARE_CLASS(SourceBase)
 QT_FORWARD_DECLARE_CLASS(Processor)
 QT_FORWARD_DECLARE_CLASS(QThread)
 
+/******************************************************************************\
+|* The source manager finds, sets up and starts the radios. There's usually
+|* one, but a list of device-ids opens one source per id, each on a thread of
+|* its own. Every stream of every source feeds a processor of its own, and
+|* the streams are numbered in order across the sources: a dual-tuner RSPduo
+|* followed by two dongles is streams 0 and 1, then 2, then 3. The stream
+|* number is the channel its products are tagged with.
+|*
+|* The first source is the primary: it's the one listed, recorded and
+|* reconfigured by clients
+\******************************************************************************/
 class SourceMgr : public QObject
 	{
 	Q_OBJECT
@@ -23,13 +39,28 @@ class SourceMgr : public QObject
 		/**********************************************************************\
 		|* Private variables
 		\**********************************************************************/
-		SourceBase *	_src;					// The actual source we got
-		QThread *		_thread;				// The background thread
+		SourceBase *	_src;					// The primary source
+		QList<SourceBase *>	_srcs;				// Every source, primary first
+		QList<int>		_ids;					// ... the device-id of each
+		QList<QThread *>	_threads;			// ... and its thread
+		IQRecorder *	_recorder;				// Raw IQ recorder, if any
+		QThread *		_recThread;				// ... and its thread
 
 		/**********************************************************************\
 		|* Private method - use the filters to select a radio source
 		\**********************************************************************/
-		void _findMatchingSource(void);
+		SourceBase * _findMatchingSource(int idFilter);
+
+		/**********************************************************************\
+		|* Private method - find the source delivering a stream, and which of
+		|* its own streams it is
+		\**********************************************************************/
+		int _sourceFor(int stream, int& index);
+
+		/**********************************************************************\
+		|* Private method - start recording raw IQ, if configured to
+		\**********************************************************************/
+		void _startRecorder(void);
 
 		/******************************************************************************\
 		|* Private method - show a list with a title
@@ -52,14 +83,42 @@ class SourceMgr : public QObject
 		bool foundSource(void);
 
 		/**********************************************************************\
-		|* Initialise the source
+		|* Name the device a stream comes from, as driver-id, e.g. "rtlsdr-0".
+		|* A source's second stream has ":1" added
+		\**********************************************************************/
+		QString deviceName(int stream = 0);
+
+		/**********************************************************************\
+		|* Initialise the sources
 		\**********************************************************************/
 		bool initialiseSource(void);
 
 		/**********************************************************************\
-		|* Initialise the source
+		|* Number of streams the sources deliver, each needing a processor
+		\**********************************************************************/
+		int streamCount(void);
+
+		/**********************************************************************\
+		|* The frequency a stream is tuned to at the start
+		\**********************************************************************/
+		int streamFrequency(int stream);
+
+		/**********************************************************************\
+		|* Start the sources, feeding stream n to processors[n]
+		\**********************************************************************/
+		bool start(const QList<Processor *>& processors);
+
+		/**********************************************************************\
+		|* Change the radio side of the settings while it's streaming. If any
+		|* part fails, try to put back what was there and return false
+		\**********************************************************************/
+		bool reconfigure(RadioSettings from, RadioSettings to, QString& error);
+
+		/**********************************************************************\
+		|* Just retune the primary source, as a sweep does between hops. The
+		|* recorder is told, so the IQ it keeps is labelled with each hop
 		\**********************************************************************/
-		bool start(Processor *processor);
+		bool retune(int frequency, int sampleRate);
 
 	signals:
 		/**********************************************************************\
@@ -2,8 +2,10 @@
 
 #include <QCoreApplication>
 
+#include "config.h"
 #include "constants.h"
 #include "datamgr.h"
+#include "metrics.h"
 #include "sourcemgr.h"
 #include "sourcertlsdr.h"
 
@@ -19,7 +21,10 @@
 \******************************************************************************/
 static void _sighandler(int signum);
 static void rtlsdr_callback(uint8_t *buf, uint32_t len, void *ctx);
-static SourceRtlSdr * _self;
+static uint8_t * rtlsdr_alloc(uint32_t len, void *ctx);
+static void rtlsdr_free(uint8_t *buf, void *ctx);
+
+QList<SourceRtlSdr *> SourceRtlSdr::_sources;
 
 /******************************************************************************\
 |* Constructor
@@ -29,8 +34,10 @@ SourceRtlSdr::SourceRtlSdr(QObject *parent)
 			 ,_isActive(false)
 			 ,_dev(nullptr)
 			 ,_sampleRate(0)
+			 ,_streamStart(0)
+			 ,_streamSamples(0)
 	{
-	_self = this;
+	_sources.append(this);
 	}
 
 /******************************************************************************\
@@ -38,6 +45,7 @@ SourceRtlSdr::SourceRtlSdr(QObject *parent)
 \******************************************************************************/
 SourceRtlSdr::~SourceRtlSdr(void)
 	{
+	_sources.removeAll(this);
 	}
 
 /******************************************************************************\
@@ -74,7 +82,17 @@ bool SourceRtlSdr::open(int deviceId)
 			ok = false;
 			}
 		else
+			{
 			ok = true;
+
+			/******************************************************************\
+			|* A sweep retunes at every hop, so use the tuner's short cut if
+			|* it has one
+			\******************************************************************/
+			if (Config::instance().sweeping()
+			 && (rtlsdr_set_fast_retune(_dev, 1) == 0))
+				LOG << name() << "using fast retunes";
+			}
 		}
 
 	return ok;
@@ -92,7 +110,8 @@ bool SourceRtlSdr::setSampleRate(int sampleRate)
 		{
 		sampleRate = rtlsdr_get_sample_rate(_dev);
 		LOG << name() << "sample rate is now" << sampleRate;
-		_sampleRate = sampleRate;
+		_sampleRate		= sampleRate;
+		_streamStart	= 0;
 		}
 	return (ok >= 0);
 	}
@@ -255,10 +274,16 @@ void SourceRtlSdr::startSampling(void)
 	sigaction(SIGPIPE, &sigact, NULL);
 
 	/**************************************************************************\
-	|* Allocate a data buffer
+	|* Size the transfers for the latency asked for, and have librtlsdr read
+	|* straight into DataMgr blocks, so each one can be passed down the
+	|* pipeline as it is, rather than copied out of a buffer the library keeps
 	\**************************************************************************/
-	DataMgr &dmgr = DataMgr::instance();
-	_bufId = dmgr.blockFor(_sampleRate * 2);
+	uint32_t num	= 0;
+	uint32_t len	= 0;
+	_transferLayout(Config::instance().rtlLatency(), num, len);
+
+	if (rtlsdr_set_buffer_allocator(_dev, rtlsdr_alloc, rtlsdr_free, this) < 0)
+		WARN << "Cannot set buffer allocator, samples will be copied";
 
 	/**************************************************************************\
 	|* Reset the buffers
@@ -276,10 +301,7 @@ void SourceRtlSdr::startSampling(void)
 	|* Start capturing
 	\**************************************************************************/
 	if (_isActive)
-		{
-		int extent = dmgr.extent(_bufId);
-		rtlsdr_read_async(_dev, rtlsdr_callback, this, 0, extent);
-		}
+		rtlsdr_read_async(_dev, rtlsdr_callback, this, num, len);
 	}
 
 /******************************************************************************\
@@ -388,18 +410,130 @@ QList<double> SourceRtlSdr::listGains(void)
 \******************************************************************************/
 static void rtlsdr_callback(uint8_t *buf, uint32_t len, void *ctx)
 	{
-	(void)ctx;
-	_self->_dataIncoming(buf, len);
+	static_cast<SourceRtlSdr *>(ctx)->_dataIncoming(buf, len);
 	}
 
 void SourceRtlSdr::_dataIncoming(uint8_t *srcData, uint32_t len)
+	{
+	/**************************************************************************\
+	|* If the buffer is one of ours, it's now ours to send on as it is. If
+	|* not, the allocator wasn't taken, and it has to be copied
+	\**************************************************************************/
+	DataMgr &dmgr	= DataMgr::instance();
+	int64_t bufId	= _lent.value(srcData, -1);
+	if (bufId < 0)
+		{
+		bufId = dmgr.blockFor(len);
+		memcpy(dmgr.asUint8(bufId), srcData, len);
+		}
+	else
+		_lent.remove(srcData);
+
+	/**************************************************************************\
+	|* librtlsdr doesn't report overruns, so infer them: if we've had more than
+	|* half a second fewer samples than the clock says we should have, some
+	|* were lost. Count it, and start counting afresh from here
+	\**************************************************************************/
+	int64_t now = Metrics::now();
+	if (_streamStart == 0)
+		{
+		_streamStart	= now;
+		_streamSamples	= 0;
+		}
+	else
+		{
+		_streamSamples += len/2;
+		int64_t expected = (now - _streamStart) * (double)_sampleRate / 1e9;
+		if (expected - _streamSamples > _sampleRate / 2)
+			{
+			Metrics::instance().add(Metrics::SOURCE_OVERRUNS);
+			_streamStart	= now;
+			_streamSamples	= 0;
+			}
+		}
+
+	emit dataAvailable(bufId, len/2, 128, STREAM_S8C);
+	}
+
+
+/******************************************************************************\
+|* Private method : work out the USB transfers for a latency. Each transfer
+|* holds about {msecs} of samples, rounded to whole URBs, so blocks reach the
+|* pipeline steadily and soon. There are enough to keep QUEUE_MSECS of
+|* samples queued with the device, within the usbfs allowance. 0 leaves it
+|* to librtlsdr
+\******************************************************************************/
+void SourceRtlSdr::_transferLayout(int msecs, uint32_t& num, uint32_t& len)
+	{
+	num = len = 0;
+	if ((msecs <= 0) || (_sampleRate <= 0))
+		{
+		LOG << "Using librtlsdr's default USB transfers";
+		return;
+		}
+
+	int64_t usbfs	= USBFS_BYTES / qMax(1, _openDevices());
+	int64_t bytes	= (int64_t)_sampleRate * 2 * msecs / 1000;
+	int64_t urbs	= (bytes + URB_BYTES/2) / URB_BYTES;
+	int64_t maxUrbs	= qMax((int64_t)1, usbfs / URB_BYTES / MIN_TRANSFERS);
+	urbs			= qBound((int64_t)1, urbs, maxUrbs);
+	len				= (uint32_t)(urbs * URB_BYTES);
+
+	int64_t perSec	= (int64_t)_sampleRate * 2;
+	int64_t wanted	= (perSec * QUEUE_MSECS / 1000 + len - 1) / len;
+	num				= (uint32_t)qBound((int64_t)MIN_TRANSFERS,
+									   wanted,
+									   (int64_t)MAX_TRANSFERS);
+	while ((num > MIN_TRANSFERS) && ((int64_t)num * len > usbfs))
+		num --;
+
+	LOG << "USB transfers:" << num << "x" << len << "bytes,"
+		<< QString::number(len * 1000.0 / perSec, 'f', 1) << "ms each";
+	}
+
+/******************************************************************************\
+|* Private method : the number of dongles open, which share the usbfs memory
+\******************************************************************************/
+int SourceRtlSdr::_openDevices(void)
+	{
+	int open = 0;
+	for (SourceRtlSdr *src : qAsConst(_sources))
+		if (src->_dev != nullptr)
+			open ++;
+	return open;
+	}
+
+/******************************************************************************\
+|* Private method : buffer handling. librtlsdr asks for a buffer for each
+|* transfer, and for another to replace it each time one fills. A buffer
+|* comes back here only if it was never filled, when reading stops
+\******************************************************************************/
+static uint8_t * rtlsdr_alloc(uint32_t len, void *ctx)
+	{
+	return static_cast<SourceRtlSdr *>(ctx)->_lendBuffer(len);
+	}
+
+static void rtlsdr_free(uint8_t *buf, void *ctx)
+	{
+	static_cast<SourceRtlSdr *>(ctx)->_returnBuffer(buf);
+	}
+
+uint8_t * SourceRtlSdr::_lendBuffer(uint32_t len)
 	{
 	DataMgr &dmgr	= DataMgr::instance();
 	int64_t bufId	= dmgr.blockFor(len);
+	if (bufId < 0)
+		return nullptr;
+
 	uint8_t *data	= dmgr.asUint8(bufId);
+	_lent[data]		= bufId;
+	return data;
+	}
 
-	memcpy(data, srcData, len);
-	emit dataAvailable(bufId, len/2, 128, STREAM_S8C);
+void SourceRtlSdr::_returnBuffer(uint8_t *data)
+	{
+	if (_lent.contains(data))
+		DataMgr::instance().release(_lent.take(data));
 	}
 
 
@@ -408,17 +542,28 @@ void SourceRtlSdr::_dataIncoming(uint8_t *srcData, uint32_t len)
 \******************************************************************************/
 static void _sighandler(int signum)
 	{
-	_self->_handleSignal(signum);
+	SourceRtlSdr::_signalAll(signum);
 	}
 
-void SourceRtlSdr::_handleSignal(int signum)
+void SourceRtlSdr::_signalAll(int signum)
 	{
 	fprintf(stderr, "Signal %d caught, exiting!\n", signum);
-	if (_isActive)
-		{
-		rtlsdr_cancel_async(_dev);
+
+	bool streaming = false;
+	for (SourceRtlSdr *src : qAsConst(_sources))
+		if (src->_handleSignal(signum))
+			streaming = true;
+
+	if (streaming)
 		qApp->quit();
-		}
 	else
 		exit(0);
 	}
+
+bool SourceRtlSdr::_handleSignal(int signum)
+	{
+	Q_UNUSED(signum);
+	if (_isActive)
+		rtlsdr_cancel_async(_dev);
+	return _isActive;
+	}
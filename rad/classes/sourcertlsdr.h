@@ -1,6 +1,8 @@
 #ifndef SOURCERTLSDR_H
 #define SOURCERTLSDR_H
 
+#include <QHash>
+#include <QList>
 #include <QObject>
 
 #include "properties.h"
@@ -11,6 +13,19 @@ class SourceRtlSdr : public SourceBase
 	{
 	Q_OBJECT
 
+	public:
+		/**********************************************************************\
+		|* Limits on the USB transfers. Each is a whole number of URBs, there
+		|* are enough of them to hold QUEUE_MSECS of samples, and together
+		|* they fit in each open dongle's share of the kernel's default usbfs
+		|* allowance
+		\**********************************************************************/
+		static const uint32_t	URB_BYTES		= 16384;
+		static const uint32_t	MIN_TRANSFERS	= 4;
+		static const uint32_t	MAX_TRANSFERS	= 64;
+		static const int		QUEUE_MSECS		= 500;
+		static const uint32_t	USBFS_BYTES		= 16 * 1024 * 1024;
+
 	/**************************************************************************\
 	|* Properties
 	\**************************************************************************/
@@ -21,8 +36,18 @@ class SourceRtlSdr : public SourceBase
 		|* Private instance variables
 		\**********************************************************************/
 		rtlsdr_dev_t *		_dev;			// Device structure
-		int64_t				_bufId;			// Buffer Id for IQ data
+		QHash<uint8_t*, int64_t> _lent;		// Buffers with librtlsdr
 		int					_sampleRate;	// Sampling frequency in Hz
+		int64_t				_streamStart;	// When we started counting, ns
+		int64_t				_streamSamples;	// Samples seen since then
+
+		static QList<SourceRtlSdr *> _sources;	// Every instance, for signals
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		void _transferLayout(int msecs, uint32_t& num, uint32_t& len);
+		static int _openDevices(void);
 
 	public:
 		/**********************************************************************\
@@ -100,15 +125,24 @@ class SourceRtlSdr : public SourceBase
 
 
 		/**********************************************************************\
-		|* Signal handler, has to be public to be invokable from 'C'
+		|* Signal handler, has to be public to be invokable from 'C'. Every
+		|* instance is told, and each returns whether it was streaming
 		\**********************************************************************/
-		void _handleSignal(int signum);
+		static void _signalAll(int signum);
+		bool _handleSignal(int signum);
 
 		/**********************************************************************\
 		|* Callback handler, has to be public to be invokable from 'C'
 		\**********************************************************************/
 		void _dataIncoming(uint8_t *data, uint32_t len);
 
+		/**********************************************************************\
+		|* Buffer handlers, public for the same reason. librtlsdr fills
+		|* DataMgr blocks directly, and hands each one over when it's full
+		\**********************************************************************/
+		uint8_t * _lendBuffer(uint32_t len);
+		void _returnBuffer(uint8_t *data);
+
 	public slots:
 		/**********************************************************************\
 		|* Start sampling from the source
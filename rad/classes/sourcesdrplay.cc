@@ -1,9 +1,17 @@
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
 #include <QCoreApplication>
 
+#include "config.h"
 #include "constants.h"
 #include "datamgr.h"
+#include "metrics.h"
 #include "sourcemgr.h"
 #include "sourcesdrplay.h"
 
@@ -18,19 +26,21 @@
 /******************************************************************************\
 |* Tuner options
 \******************************************************************************/
-#define MAX_TUNERS 4
+#define MAX_TUNERS 5
 static const char * _tuners[MAX_TUNERS] =
 	{
 	"TunerA",
 	"TunerB",
 	"Master/Slave",
-	"Slave"
+	"Slave",
+	"Dual"
 	};
 
 #define TUNER_A_IDX			(0)
 #define TUNER_B_IDX			(1)
 #define MASTER_SLAVE		(2)
 #define SLAVE				(3)
+#define DUAL_TUNER			(4)
 
 /******************************************************************************\
 |* Bandwidth options
@@ -51,9 +61,45 @@ static int _bandwidths[MAX_BANDWIDTHS] =
 #define DEFAULT_FREQUENCY		(1420406000)
 
 /******************************************************************************\
-|* Static declarations
+|* The API hands over I and Q as separate arrays, and the pipeline wants them
+|* interleaved. This runs on the API's callback thread at up to 10 MS/s, so
+|* it's done 8 pairs at a time where the CPU allows: SSE2 unpacks each half of
+|* an I and a Q vector into two of I,Q pairs, and NEON stores them as pairs
+|* directly. Whatever's left over is done one by one
 \******************************************************************************/
-static SourceSdrPlay * _self;
+static void _interleave(const short *xi,
+						const short *xq,
+						int16_t *out,
+						unsigned int numSamples)
+	{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= numSamples; i += 8)
+		{
+		__m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xi + i));
+		__m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xq + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2*i),
+						 _mm_unpacklo_epi16(vi, vq));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2*i + 8),
+						 _mm_unpackhi_epi16(vi, vq));
+		}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= numSamples; i += 8)
+		{
+		int16x8x2_t iq;
+		iq.val[0] = vld1q_s16(xi + i);
+		iq.val[1] = vld1q_s16(xq + i);
+		vst2q_s16(out + 2*i, iq);
+		}
+#endif
+
+	for (; i < numSamples; i++)
+		{
+		out[2*i]	= xi[i];
+		out[2*i+1]	= xq[i];
+		}
+	}
 
 
 /******************************************************************************\
@@ -66,9 +112,9 @@ void StreamACallback(short *xi,
 					 unsigned int reset,
 					 void *cbContext)
 	{
-	Q_UNUSED(cbContext);
-	if (_self)
-		_self->streamA(xi, xq, params, numSamples, reset);
+	SourceSdrPlay *self = static_cast<SourceSdrPlay *>(cbContext);
+	if (self)
+		self->streamA(xi, xq, params, numSamples, reset);
 	else
 		ERR << "Got Stream A callback with no handler!";
 	}
@@ -83,9 +129,9 @@ void StreamBCallback(short *xi,
 					 unsigned int reset,
 					 void *cbContext)
 	{
-	Q_UNUSED(cbContext);
-	if (_self)
-		_self->streamB(xi, xq, params, numSamples, reset);
+	SourceSdrPlay *self = static_cast<SourceSdrPlay *>(cbContext);
+	if (self)
+		self->streamB(xi, xq, params, numSamples, reset);
 	else
 		ERR << "Got Stream B callback with no handler!";
 	}
@@ -98,11 +144,11 @@ void EventCallback(sdrplay_api_EventT eventId,
 				   sdrplay_api_EventParamsT *params,
 				   void *cbContext)
 	{
-	Q_UNUSED(cbContext);
-	if (_self)
-		_self->eventCb(eventId, tuner, params);
+	SourceSdrPlay *self = static_cast<SourceSdrPlay *>(cbContext);
+	if (self)
+		self->eventCb(eventId, tuner, params);
 	else
-		ERR << "Got Stream B callback with no handler!";
+		ERR << "Got event callback with no handler!";
 	}
 
 /******************************************************************************\
@@ -113,14 +159,19 @@ SourceSdrPlay::SourceSdrPlay(QObject *parent)
 			  ,_isActive(false)
 			  ,_dev(nullptr)
 			  ,_params(nullptr)
+			  ,_rxParams(nullptr)
+			  ,_rxParamsB(nullptr)
 			  ,_bufId(-1)
 			  ,_antenna(_tuners[0])
 			  ,_sampleRate(8000000)
 			  ,_frequency(DEFAULT_FREQUENCY)
+			  ,_frequencyB(DEFAULT_FREQUENCY)
+			  ,_dual(false)
 			  ,_bandwidth(_bandwidths[4])
 			  ,_gain(40)
 	{
-	_self = this;
+	_nextSample[0]	= _nextSample[1]	= 0;
+	_tracking[0]	= _tracking[1]		= false;
 	}
 
 /******************************************************************************\
@@ -154,6 +205,13 @@ bool SourceSdrPlay::open(int deviceId)
 	if (deviceId < 0)
 		deviceId = 0;
 
+	/**************************************************************************\
+	|* The tuner mode is fixed when the device is selected, which is before
+	|* initialiseSource() gets to setAntenna(), so take it from the config
+	\**************************************************************************/
+	setAntenna(Config::instance().antenna());
+	_frequencyB = Config::instance().centerFrequencyB();
+
 	/**************************************************************************\
 	|* Check that we can open the API
 	\**************************************************************************/
@@ -248,6 +306,18 @@ bool SourceSdrPlay::open(int deviceId)
 				_dev->tuner = sdrplay_api_Tuner_B;
 				_dev->rspDuoMode = sdrplay_api_RspDuoMode_Single_Tuner;
 				}
+			else if (_antenna == _tuners[DUAL_TUNER])
+				{
+				/**************************************************************\
+				|* Both tuners at once: the ADC runs at 6MHz with a 1.620MHz
+				|* IF, and the API delivers each tuner at 2MHz on its own
+				|* stream
+				\**************************************************************/
+				_dev->tuner = sdrplay_api_Tuner_Both;
+				_dev->rspDuoMode = sdrplay_api_RspDuoMode_Dual_Tuner;
+				_dev->rspDuoSampleFreq = 6000000.0;
+				_dual = true;
+				}
 			else
 				{
 				_dev->rspDuoMode = sdrplay_api_RspDuoMode_Master;
@@ -319,6 +389,8 @@ bool SourceSdrPlay::open(int deviceId)
 			  ? _params->rxChannelB
 			  : _params->rxChannelA;
 
+	_rxParamsB = _dual ? _params->rxChannelB : nullptr;
+
 	if (_rxParams != nullptr)
 		{
 		_rxParams->tunerParams.rfFreq.rfHz = _frequency;
@@ -335,6 +407,24 @@ bool SourceSdrPlay::open(int deviceId)
 		_rxParams->ctrlParams.agc.enable = sdrplay_api_AGC_DISABLE;
 		}
 
+	/**************************************************************************\
+	|* In dual-tuner mode both tuners have to use the low IF, and tuner B is
+	|* set up the same as A, but for its frequency
+	\**************************************************************************/
+	if (_dual && (_rxParams != nullptr) && (_rxParamsB != nullptr))
+		{
+		_rxParams->tunerParams.ifType	= sdrplay_api_IF_1_620;
+		_rxParams->tunerParams.bwType	= sdrplay_api_BW_1_536;
+		_rxParamsB->tunerParams			= _rxParams->tunerParams;
+		_rxParamsB->ctrlParams			= _rxParams->ctrlParams;
+		_rxParamsB->tunerParams.rfFreq.rfHz = _frequencyB;
+
+		if (_sampleRate != DUAL_SAMPLE_RATE)
+			WARN << "Dual-tuner mode delivers" << DUAL_SAMPLE_RATE
+				 << "samples/sec per tuner, not" << _sampleRate;
+		LOG << "Dual-tuner mode: A at" << _frequency << "B at" << _frequencyB;
+		}
+
 	/**************************************************************************\
 	|* Configure the callback functions
 	\**************************************************************************/
@@ -346,12 +436,20 @@ bool SourceSdrPlay::open(int deviceId)
 
 
 /******************************************************************************\
-|* Set the sample rate
+|* Set the sample rate. Only the master (or a single tuner) owns the ADC, so a
+|* slave can't change it while streaming
 \******************************************************************************/
 bool SourceSdrPlay::setSampleRate(int freqInHz)
 	{
 	_sampleRate = freqInHz;
-	return _isActive ? false : true;
+	if (!_isActive)
+		return true;
+
+	if ((_params == nullptr) || (_params->devParams == nullptr))
+		return false;
+
+	_params->devParams->fsFreq.fsHz = _sampleRate;
+	return _update(sdrplay_api_Update_Dev_Fs);
 	}
 
 /******************************************************************************\
@@ -360,16 +458,82 @@ bool SourceSdrPlay::setSampleRate(int freqInHz)
 bool SourceSdrPlay::setFrequency(int freqInHz)
 	{
 	_frequency = freqInHz;
-	return _isActive ? false : true;
+	if (!_isActive)
+		return true;
+
+	if (_rxParams == nullptr)
+		return false;
+
+	_rxParams->tunerParams.rfFreq.rfHz = _frequency;
+	return _update(sdrplay_api_Update_Tuner_Frf);
+	}
+
+/******************************************************************************\
+|* Set tuner B's center-frequency, in dual-tuner mode
+\******************************************************************************/
+bool SourceSdrPlay::setFrequencyB(int freqInHz)
+	{
+	_frequencyB = freqInHz;
+	if (!_isActive)
+		return true;
+
+	if (_rxParamsB == nullptr)
+		return false;
+
+	_rxParamsB->tunerParams.rfFreq.rfHz = _frequencyB;
+	return _update(sdrplay_api_Update_Tuner_Frf, sdrplay_api_Tuner_B);
 	}
 
 /******************************************************************************\
-|* Set the gain in dB
+|* Set the gain in dB. Both tuners share it in dual-tuner mode
 \******************************************************************************/
 bool SourceSdrPlay::setGain(double gain)
 	{
 	_gain = gain;
-	return _isActive ? false : true;
+	if (!_isActive)
+		return true;
+
+	if (_rxParams == nullptr)
+		return false;
+
+	_rxParams->tunerParams.gain.gRdB = _gain;
+	bool ok = _update(sdrplay_api_Update_Tuner_Gr);
+	if (ok && (_rxParamsB != nullptr))
+		{
+		_rxParamsB->tunerParams.gain.gRdB = _gain;
+		ok = _update(sdrplay_api_Update_Tuner_Gr, sdrplay_api_Tuner_B);
+		}
+	return ok;
+	}
+
+/******************************************************************************\
+|* Two streams when both tuners are running
+\******************************************************************************/
+int SourceSdrPlay::streamCount(void)
+	{
+	return _dual ? 2 : 1;
+	}
+
+/******************************************************************************\
+|* Private method: push a changed parameter to the device while it streams.
+|* With both tuners running, a tuner has to be named, and it's A by default
+\******************************************************************************/
+bool SourceSdrPlay::_update(sdrplay_api_ReasonForUpdateT reason,
+							sdrplay_api_TunerSelectT tuner)
+	{
+	if (tuner == sdrplay_api_Tuner_Neither)
+		tuner = _dual ? sdrplay_api_Tuner_A : _dev->tuner;
+
+	sdrplay_api_ErrT err = sdrplay_api_Update(_dev->dev,
+											  tuner,
+											  reason,
+											  sdrplay_api_Update_Ext1_None);
+	if (err != sdrplay_api_Success)
+		{
+		ERR << "sdrplay_api_Update failed:" << sdrplay_api_GetErrorString(err);
+		return false;
+		}
+	return true;
 	}
 
 /******************************************************************************\
@@ -484,7 +648,7 @@ void SourceSdrPlay::startSampling(void)
 	{
 	LOG << "Start sampling";
 
-	sdrplay_api_ErrT err = sdrplay_api_Init(_dev->dev, &_cbfns, nullptr);
+	sdrplay_api_ErrT err = sdrplay_api_Init(_dev->dev, &_cbfns, this);
 	if (err != sdrplay_api_Success)
 		{
 		ERR << "api_init() failed. Should only happen to slave!";
@@ -531,18 +695,11 @@ void SourceSdrPlay::streamA(short *xi,
 							unsigned int numSamples,
 							unsigned int reset)
 	{
-	Q_UNUSED(params);
-	Q_UNUSED(reset);
+	_checkContinuity(0, params, numSamples, reset);
 
 	DataMgr &dmgr	= DataMgr::instance();
 	int64_t bufId	= dmgr.blockFor(numSamples*4);
-	int16_t *data	= dmgr.asInt16(bufId);
-
-	for (unsigned int i=0; i<numSamples; i++)
-		{
-		*data ++ = *xi++;
-		*data ++ = *xq++;
-		}
+	_interleave(xi, xq, dmgr.asInt16(bufId), numSamples);
 
 	emit dataAvailable(bufId, numSamples, 8192, STREAM_S16C);
 	}
@@ -556,20 +713,36 @@ void SourceSdrPlay::streamB(short *xi,
 							unsigned int numSamples,
 							unsigned int reset)
 	{
-	Q_UNUSED(params);
-	Q_UNUSED(reset);
+	_checkContinuity(1, params, numSamples, reset);
 
 	DataMgr &dmgr	= DataMgr::instance();
 	int64_t bufId	= dmgr.blockFor(numSamples*4);
-	int16_t *data	= dmgr.asInt16(bufId);
+	_interleave(xi, xq, dmgr.asInt16(bufId), numSamples);
 
-	for (unsigned int i=0; i<numSamples; i++)
-		{
-		*data ++ = *xi++;
-		*data ++ = *xq++;
-		}
+	if (_dual)
+		emit secondaryDataAvailable(bufId, numSamples, 8192, STREAM_S16C);
+	else
+		emit dataAvailable(bufId, numSamples, 8192, STREAM_S16C);
+	}
 
-	emit dataAvailable(bufId, numSamples, 8192, STREAM_S16C);
+/******************************************************************************\
+|* Each callback carries the number of its first sample, so a jump means the
+|* API dropped some. A reset (after a change of rate, say) restarts the count
+\******************************************************************************/
+void SourceSdrPlay::_checkContinuity(int stream,
+									 sdrplay_api_StreamCbParamsT *params,
+									 unsigned int numSamples,
+									 unsigned int reset)
+	{
+	if (params == nullptr)
+		return;
+
+	if (_tracking[stream] && !reset
+	 && (params->firstSampleNum != _nextSample[stream]))
+		Metrics::instance().add(Metrics::SOURCE_OVERRUNS);
+
+	_nextSample[stream]	= params->firstSampleNum + numSamples;
+	_tracking[stream]	= true;
 	}
 
 /******************************************************************************\
@@ -15,7 +15,8 @@ class SourceSdrPlay : public SourceBase
 		/**********************************************************************\
 		|* Constants, enums and typedefs
 		\**********************************************************************/
-		static const int MAX_DEV = 6;
+		static const int MAX_DEV			= 6;
+		static const int DUAL_SAMPLE_RATE	= 2000000;	// Per tuner, dual mode
 
 	/**************************************************************************\
 	|* Properties
@@ -30,13 +31,32 @@ class SourceSdrPlay : public SourceBase
 		sdrplay_api_DeviceT *			_dev;			// Device structure
 		sdrplay_api_DeviceParamsT *		_params;		// Device parameters
 		sdrplay_api_RxChannelParamsT *	_rxParams;		// Receive params
+		sdrplay_api_RxChannelParamsT *	_rxParamsB;		// ... tuner B, if dual
 		sdrplay_api_CallbackFnsT		_cbfns;			// Callbacks
 		int64_t							_bufId;			// buf-Id for IQ data
 		QString							_antenna;		// Which antenna to use
 		int								_sampleRate;	// Sampling Freq in Hz
 		int								_frequency;		// Center Freq in Hz
+		int								_frequencyB;	// ... tuner B, if dual
+		bool							_dual;			// Both tuners at once
 		int								_bandwidth;		// IF bandwidth
 		int								_gain;			// IF gain
+		unsigned int					_nextSample[2];	// Expected, per stream
+		bool							_tracking[2];	// ... once we've a start
+
+		/**********************************************************************\
+		|* Private method: apply a parameter change while streaming
+		\**********************************************************************/
+		bool _update(sdrplay_api_ReasonForUpdateT reason,
+					 sdrplay_api_TunerSelectT tuner = sdrplay_api_Tuner_Neither);
+
+		/**********************************************************************\
+		|* Private method: count a gap in a stream's sample numbers as an overrun
+		\**********************************************************************/
+		void _checkContinuity(int stream,
+							  sdrplay_api_StreamCbParamsT *params,
+							  unsigned int numSamples,
+							  unsigned int reset);
 
 	public:
 		/**********************************************************************\
@@ -56,14 +76,21 @@ class SourceSdrPlay : public SourceBase
 		virtual bool open(int deviceId = 0);
 
 		/**********************************************************************\
-		|* Set the sample-rate
+		|* Two streams in dual-tuner mode, one otherwise
+		\**********************************************************************/
+		virtual int streamCount(void);
+
+		/**********************************************************************\
+		|* Set the sample-rate. These three also apply while streaming
 		\**********************************************************************/
 		virtual bool setSampleRate(int sampleRate);
 
 		/**********************************************************************\
-		|* Set the center-frequency
+		|* Set the center-frequency. In dual-tuner mode this is tuner A's, and
+		|* tuner B is tuned with setFrequencyB()
 		\**********************************************************************/
 		virtual bool setFrequency(int frequency);
+		bool setFrequencyB(int frequency);
 
 		/**********************************************************************\
 		|* Set the gain in dB
@@ -0,0 +1,656 @@
+#include <QStringList>
+
+#include <SoapySDR/Errors.hpp>
+#include <SoapySDR/Formats.hpp>
+
+#include "config.h"
+#include "datamgr.h"
+#include "metrics.h"
+#include "sourcemgr.h"
+#include "sourcesoapy.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+#define DRIVER_KEY			"driver"
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+SourceSoapy::SourceSoapy(QObject *parent)
+			:SourceBase(parent)
+			,Testable()
+			,_driver("")
+			,_soapyFormat(SOAPY_SDR_CS16)
+			,_streamFormat(STREAM_S16C)
+			,_fullScale(32768)
+			,_channel(0)
+			,_sampleRate(0)
+			,_replaced(0)
+			,_dev(nullptr)
+			,_rx(nullptr)
+			,_next(0)
+			,_isActive(false)
+			,_mtu(0)
+	{
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+SourceSoapy::~SourceSoapy(void)
+	{
+	stopSampling();
+	if (_rx)
+		{
+		_dev->deactivateStream(_rx, 0, 0);
+		_dev->closeStream(_rx);
+		}
+	if (_dev)
+		SoapySDR::Device::unmake(_dev);
+	_freeRing();
+	}
+
+/******************************************************************************\
+|* Pick the format to stream in. The native one means the driver passes the
+|* samples straight through, so that's best if we can take it. If not, the
+|* smallest one that we can take, since the driver converts either way
+\******************************************************************************/
+QString SourceSoapy::negotiate(const QStringList& offered, const QString& native)
+	{
+	QStringList usable = {SOAPY_SDR_CS8, SOAPY_SDR_CS16, SOAPY_SDR_CF32};
+
+	if (usable.contains(native))
+		return native;
+
+	for (const QString& fmt : usable)
+		if (offered.contains(fmt))
+			return fmt;
+
+	return "";
+	}
+
+/******************************************************************************\
+|* Return the information on how this source reports data. The mode is the
+|* SoapySDR driver, once there is one
+\******************************************************************************/
+SourceBase::StreamInfo SourceSoapy::streamInfo(void)
+	{
+	StreamInfo info;
+	info.format = _streamFormat;
+	info.max	= _fullScale;
+	info.name	= "soapy";
+	info.mode	= _driver;
+	return info;
+	}
+
+/******************************************************************************\
+|* Attempt to open the given device id, counting only the devices whose
+|* driver matches the mode filter, if there is one
+\******************************************************************************/
+bool SourceSoapy::open(int deviceId)
+	{
+	QString modeFilter = Config::instance().radioModeFilter();
+
+	// Default is to choose the first device
+	if (deviceId < 0)
+		deviceId = 0;
+
+	SoapySDR::KwargsList results = SoapySDR::Device::enumerate();
+	int count = 0;
+	for (SoapySDR::Kwargs& args : results)
+		{
+		QString driver = "";
+		if (args.count(DRIVER_KEY))
+			driver = QString(args[DRIVER_KEY].c_str()).toLower();
+
+		if ((modeFilter.length() > 0) && !driver.contains(modeFilter))
+			continue;
+
+		if (count++ < deviceId)
+			continue;
+
+		try
+			{
+			_dev = SoapySDR::Device::make(args);
+			}
+		catch (const std::exception& e)
+			{
+			ERR << "Failed to open device" << name() << ":" << deviceId
+				<< ":" << e.what();
+			return false;
+			}
+		_driver = driver;
+		break;
+		}
+
+	if (_dev == nullptr)
+		return false;
+
+	/**************************************************************************\
+	|* Settle on the format to stream in, and what full scale is in it. CS8
+	|* goes out as offset binary, as the RTL-SDR sends it
+	\**************************************************************************/
+	QStringList offered;
+	for (const std::string& fmt : _dev->getStreamFormats(SOAPY_SDR_RX, _channel))
+		offered.append(fmt.c_str());
+
+	double fullScale	= 0;
+	QString native		= _dev->getNativeStreamFormat(SOAPY_SDR_RX,
+													  _channel,
+													  fullScale).c_str();
+	_soapyFormat		= negotiate(offered, native);
+
+	if (_soapyFormat == SOAPY_SDR_CS8)
+		{
+		_streamFormat	= STREAM_S8C;
+		_fullScale		= 128;
+		}
+	else if (_soapyFormat == SOAPY_SDR_CS16)
+		{
+		_streamFormat	= STREAM_S16C;
+		_fullScale		= ((native == _soapyFormat) && (fullScale > 0))
+						? fullScale : 32768;
+		}
+	else if (_soapyFormat == SOAPY_SDR_CF32)
+		{
+		_streamFormat	= STREAM_CF32;
+		_fullScale		= 1;
+		}
+	else
+		{
+		ERR << name() << _driver << "offers no format we can use, native is"
+			<< native;
+		SoapySDR::Device::unmake(_dev);
+		_dev = nullptr;
+		return false;
+		}
+
+	LOG << name() << "opened" << _driver << "streaming" << _soapyFormat
+		<< "( native" << native << ")";
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the sample rate
+\******************************************************************************/
+bool SourceSoapy::setSampleRate(int sampleRate)
+	{
+	try
+		{
+		_dev->setSampleRate(SOAPY_SDR_RX, _channel, sampleRate);
+		}
+	catch (const std::exception& e)
+		{
+		ERR << "Failed to set sample rate of" << sampleRate << ":" << e.what();
+		return false;
+		}
+
+	_sampleRate = (int)_dev->getSampleRate(SOAPY_SDR_RX, _channel);
+	LOG << name() << "sample rate is now" << _sampleRate;
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the frequency
+\******************************************************************************/
+bool SourceSoapy::setFrequency(int frequency)
+	{
+	try
+		{
+		_dev->setFrequency(SOAPY_SDR_RX, _channel, frequency);
+		}
+	catch (const std::exception& e)
+		{
+		ERR << "Failed to tune to" << frequency << ":" << e.what();
+		return false;
+		}
+
+	LOG << name() << "now tuned to" << frequency << "Hz";
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the gain, within the range the device allows, or hand it to the AGC
+\******************************************************************************/
+bool SourceSoapy::setGain(double gain)
+	{
+	bool hasAgc = _dev->hasGainMode(SOAPY_SDR_RX, _channel);
+	if (gain == SourceMgr::AUTOMATIC_GAIN)
+		{
+		if (!hasAgc)
+			{
+			ERR << "Failed to set automatic gain";
+			return false;
+			}
+		_dev->setGainMode(SOAPY_SDR_RX, _channel, true);
+		LOG << name() << "now set to automatic gain";
+		return true;
+		}
+
+	if (hasAgc)
+		_dev->setGainMode(SOAPY_SDR_RX, _channel, false);
+
+	SoapySDR::Range range	= _dev->getGainRange(SOAPY_SDR_RX, _channel);
+	double nearest			= qBound(range.minimum(), gain, range.maximum());
+	if (nearest != gain)
+		LOG << name() << "setting gain to nearest value ["
+			<< nearest << "] to " << gain;
+
+	_dev->setGain(SOAPY_SDR_RX, _channel, nearest);
+	LOG << name() << "gain now set to "
+		<< _dev->getGain(SOAPY_SDR_RX, _channel);
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the bandwidth for the tuner, in kHz, or to the sample rate if < 0
+\******************************************************************************/
+bool SourceSoapy::setBandwidth(int requestedBw)
+	{
+	if (requestedBw < 0)
+		requestedBw = _sampleRate;
+	else
+		requestedBw *= 1000;
+	if ((_sampleRate > 0) && (requestedBw > _sampleRate))
+		requestedBw = _sampleRate;
+
+	try
+		{
+		_dev->setBandwidth(SOAPY_SDR_RX, _channel, requestedBw);
+		}
+	catch (const std::exception& e)
+		{
+		ERR << "Failed to set bandwidth to" << requestedBw << ":" << e.what();
+		return false;
+		}
+
+	LOG << name() << "bandwidth now set to "
+		<< (int)_dev->getBandwidth(SOAPY_SDR_RX, _channel);
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the antenna, by index or by (part of) its name
+\******************************************************************************/
+bool SourceSoapy::setAntenna(QString antenna)
+	{
+	QList<QString> list = listAntennas();
+	if (list.isEmpty() || (antenna.length() == 0))
+		return true;
+
+	bool isNumeric	= false;
+	int index		= antenna.toInt(&isNumeric);
+	QString match	= "";
+
+	if (isNumeric)
+		{
+		if ((index < 0) || (index >= list.size()))
+			{
+			ERR << "Antenna index out of range, max=" << list.size()-1;
+			return false;
+			}
+		match = list.at(index);
+		}
+	else
+		{
+		for (const QString& name : list)
+			if (name.contains(antenna, Qt::CaseInsensitive))
+				{
+				match = name;
+				break;
+				}
+		if (match.length() == 0)
+			{
+			ERR << "No antenna matches" << antenna;
+			return false;
+			}
+		}
+
+	_dev->setAntenna(SOAPY_SDR_RX, _channel, match.toStdString());
+	LOG << name() << "antenna now set to" << match;
+	return true;
+	}
+
+/******************************************************************************\
+|* Start sampling. The stream is set up here, so any trouble is reported
+|* straight away, and then read by a thread of its own
+\******************************************************************************/
+void SourceSoapy::startSampling(void)
+	{
+	if (_isActive)
+		{
+		ERR << name() << "is already sampling";
+		return;
+		}
+	if (_reader.joinable())
+		_reader.join();
+
+	std::vector<size_t> channels = {(size_t)_channel};
+	try
+		{
+		_rx = _dev->setupStream(SOAPY_SDR_RX,
+								_soapyFormat.toStdString(),
+								channels);
+		}
+	catch (const std::exception& e)
+		{
+		ERR << "Cannot set up" << _soapyFormat << "stream:" << e.what();
+		_rx = nullptr;
+		}
+	if (_rx == nullptr)
+		return;
+
+	int error = _dev->activateStream(_rx);
+	if (error != 0)
+		{
+		ERR << "Cannot start stream:" << SoapySDR::errToStr(error);
+		_dev->closeStream(_rx);
+		_rx = nullptr;
+		return;
+		}
+
+	_mtu		= _dev->getStreamMTU(_rx);
+	_ring.fill(-1, RING_SLOTS);
+	_next		= 0;
+	_isActive	= true;
+	_reader		= std::thread(&SourceSoapy::_read, this);
+	}
+
+/******************************************************************************\
+|* The reading thread. readStream() reads into the next block of the ring,
+|* which is sent on as soon as it's filled. This loops until stopSampling(),
+|* which it sees within READ_TIMEOUT, or the stream fails
+\******************************************************************************/
+void SourceSoapy::_read(void)
+	{
+	/**************************************************************************\
+	|* Every block holds a whole MTU, so no read is ever split
+	\**************************************************************************/
+	size_t mtu		= _mtu;
+	size_t bytes	= mtu * SoapySDR::formatToSize(_soapyFormat.toStdString());
+
+	DataMgr &dmgr		= DataMgr::instance();
+	Metrics &metrics	= Metrics::instance();
+	int max				= (int)_fullScale;
+
+	while (_isActive)
+		{
+		int64_t bufId = _nextSlot(bytes);
+		if (bufId < 0)
+			{
+			ERR << "Cannot get a" << (int)bytes << "byte block to read into";
+			break;
+			}
+
+		void *buffs[]		= {dmgr.asUint8(bufId)};
+		int flags			= 0;
+		long long timeNs	= 0;
+		int samples			= _dev->readStream(_rx, buffs, mtu, flags,
+											   timeNs, READ_TIMEOUT);
+
+		/**********************************************************************\
+		|* The block that wasn't filled stays in the ring for next time round
+		\**********************************************************************/
+		if (samples == SOAPY_SDR_TIMEOUT)
+			continue;
+		if (samples == SOAPY_SDR_OVERFLOW)
+			{
+			metrics.add(Metrics::SOURCE_OVERRUNS);
+			continue;
+			}
+		if (samples < 0)
+			{
+			ERR << "Stream failed:" << SoapySDR::errToStr(samples);
+			break;
+			}
+
+		if (_streamFormat == STREAM_S8C)
+			{
+			uint8_t *data = dmgr.asUint8(bufId);
+			for (int i=0; i<samples*2; i++)
+				data[i] ^= 0x80;
+			}
+
+		/**********************************************************************\
+		|* The ring keeps its reference, and this one is for the consumer
+		\**********************************************************************/
+		dmgr.retain(bufId);
+		emit dataAvailable(bufId,
+						   samples,
+						   max,
+						   _streamFormat,
+						   (flags & SOAPY_SDR_HAS_TIME) ? (int64_t)timeNs : 0);
+		}
+
+	_isActive = false;
+	_dev->deactivateStream(_rx);
+	_dev->closeStream(_rx);
+	_rx = nullptr;
+	_freeRing();
+	}
+
+/******************************************************************************\
+|* Stop sampling. The reading thread sees this within READ_TIMEOUT, and has
+|* closed the stream by the time it's finished
+\******************************************************************************/
+void SourceSoapy::stopSampling(void)
+	{
+	_isActive = false;
+	if (_reader.joinable() && (_reader.get_id() != std::this_thread::get_id()))
+		_reader.join();
+	}
+
+
+/******************************************************************************\
+|* Get a list of antennas
+\******************************************************************************/
+QList<QString> SourceSoapy::listAntennas(void)
+	{
+	QList<QString> list;
+	for (const std::string& name : _dev->listAntennas(SOAPY_SDR_RX, _channel))
+		list.append(name.c_str());
+	return list;
+	}
+
+/******************************************************************************\
+|* Get the number of channels in each direction
+\******************************************************************************/
+SourceBase::ChannelInfo SourceSoapy::numberOfChannels(void)
+	{
+	SourceBase::ChannelInfo info;
+	info.rx = (int)_dev->getNumChannels(SOAPY_SDR_RX);
+	info.tx = (int)_dev->getNumChannels(SOAPY_SDR_TX);
+	return info;
+	}
+
+/******************************************************************************\
+|* Get a list of available bandwidth settings, in kHz. A continuous range is
+|* given by its ends
+\******************************************************************************/
+QList<QString> SourceSoapy::listBandwidths(void)
+	{
+	QList<QString> list;
+	for (const SoapySDR::Range& range : _dev->getBandwidthRange(SOAPY_SDR_RX, _channel))
+		{
+		list.append(QString::number((int)(range.minimum() / 1000)));
+		if (range.maximum() > range.minimum())
+			list.append(QString::number((int)(range.maximum() / 1000)));
+		}
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of frequency ranges, in MHz
+\******************************************************************************/
+QList<SourceBase::Range> SourceSoapy::listFrequencyRanges(void)
+	{
+	return _ranges(_dev->getFrequencyRange(SOAPY_SDR_RX, _channel), 1e-6);
+	}
+
+/******************************************************************************\
+|* Get a list of sample rates, in MHz
+\******************************************************************************/
+QList<SourceBase::Range> SourceSoapy::listSampleRateRanges(void)
+	{
+	return _ranges(_dev->getSampleRateRange(SOAPY_SDR_RX, _channel), 1e-6);
+	}
+
+/******************************************************************************\
+|* Get a list of available gains, in dB, stepping through the overall range
+\******************************************************************************/
+QList<double> SourceSoapy::listGains(void)
+	{
+	QList<double> list;
+	SoapySDR::Range range	= _dev->getGainRange(SOAPY_SDR_RX, _channel);
+	double step				= (range.step() > 0) ? range.step() : 1;
+
+	for (double gain = range.minimum(); gain <= range.maximum(); gain += step)
+		list.append(gain);
+	return list;
+	}
+
+/******************************************************************************\
+|* Private method : the next block of the ring to read into. One that's still
+|* held downstream - or is too small, after a change of rate - is left to
+|* whoever has it, and a fresh one takes its place
+\******************************************************************************/
+int64_t SourceSoapy::_nextSlot(size_t bytes)
+	{
+	DataMgr &dmgr	= DataMgr::instance();
+	int64_t& slot	= _ring[_next];
+	_next			= (_next + 1) % _ring.size();
+
+	if (slot >= 0)
+		{
+		bool held = (dmgr.retainCount(slot) > 1);
+		if (held || (dmgr.extent(slot) < bytes))
+			{
+			if (held)
+				_replaced ++;
+			dmgr.release(slot);
+			slot = -1;
+			}
+		}
+
+	if (slot < 0)
+		slot = dmgr.blockFor(bytes);
+	return slot;
+	}
+
+/******************************************************************************\
+|* Private method : give back the ring's references
+\******************************************************************************/
+void SourceSoapy::_freeRing(void)
+	{
+	DataMgr &dmgr = DataMgr::instance();
+	for (int64_t& slot : _ring)
+		{
+		if (slot >= 0)
+			dmgr.release(slot);
+		slot = -1;
+		}
+	}
+
+/******************************************************************************\
+|* Private method : convert SoapySDR ranges, scaling them
+\******************************************************************************/
+QList<SourceBase::Range> SourceSoapy::_ranges(const SoapySDR::RangeList& list,
+											  double scale)
+	{
+	QList<SourceBase::Range> ranges;
+	for (const SoapySDR::Range& range : list)
+		ranges.append({.from=range.minimum() * scale,
+					   .to=range.maximum() * scale});
+	return ranges;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int SourceSoapy::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * SourceSoapy::testClassName(void)
+	{
+	return "SourceSoapy";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult SourceSoapy::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkNegotiate();
+		case 1:
+			return _checkRing();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a native CS16 is kept even though CS8 is offered, an
+|* unusable native one gives way to the cheapest offered, and with nothing
+|* usable there's nothing to pick
+\******************************************************************************/
+Testable::TestResult SourceSoapy::_checkNegotiate(void)
+	{
+	bool ok = (negotiate({"CS8", "CS16", "CF32"}, "CS16") == "CS16")
+		   && (negotiate({"CS8", "CF32"}, "CF32") == "CF32")
+		   && (negotiate({"CF32", "CS16", "CS12"}, "CS12") == "CS16")
+		   && (negotiate({"CU8", "CF32"}, "CU8") == "CF32")
+		   && (negotiate({"CU8"}, "CU8") == "");
+
+	if (!ok)
+		ERR << "Negotiated the wrong stream format";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a ring of three. The second block is still held when the
+|* ring comes back round, so it's replaced, and the first, which isn't, is
+|* reused. Asking for more than the third holds replaces that too
+\******************************************************************************/
+Testable::TestResult SourceSoapy::_checkRing(void)
+	{
+	DataMgr &dmgr	= DataMgr::instance();
+	int64_t before	= _replaced;
+	_ring.fill(-1, 3);
+	_next			= 0;
+
+	int64_t a		= _nextSlot(64);
+	int64_t b		= _nextSlot(64);
+	int64_t c		= _nextSlot(64);
+	dmgr.retain(b);
+
+	bool ok			= (a >= 0) && (b >= 0) && (c >= 0)
+					&& (_nextSlot(64) == a)
+					&& (_nextSlot(64) != b)
+					&& (dmgr.retainCount(b) == 1)
+					&& (_replaced - before == 1)
+					&& (_nextSlot(128) != c)
+					&& (_replaced - before == 1);
+
+	dmgr.release(b);
+	_freeRing();
+	_ring.clear();
+
+	if (!ok)
+		ERR << "Ring reused a block still in use, or didn't reuse a free one";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,209 @@
+#ifndef SOURCESOAPY_H
+#define SOURCESOAPY_H
+
+#include <atomic>
+#include <thread>
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <SoapySDR/Device.hpp>
+
+#include <libra.h>
+
+#include "properties.h"
+#include "sourcebase.h"
+
+/******************************************************************************\
+|* Any radio with a SoapySDR driver - Airspy, HackRF, LimeSDR, PlutoSDR, and
+|* the ones with their own sources here, if wanted that way.
+|*
+|* The stream is set up in whichever of CS8, CS16 and CF32 costs least: the
+|* radio's native format if it's one of them, so the driver doesn't convert,
+|* otherwise the smallest the driver offers.
+|*
+|* readStream() writes straight into a ring of DataMgr blocks, each an MTU
+|* long, and a block goes down the pipeline as it is. The ring holds a
+|* reference on each of its blocks, and each one sent gets another for
+|* whoever consumes it. Coming round to a block that's still held downstream
+|* means it hasn't been consumed, so the ring gives up its reference and takes
+|* a fresh block in its place rather than write over it; once the pipeline
+|* keeps up, the same few blocks go round and round.
+|*
+|* When the driver timestamps its samples, the time goes along with them.
+|*
+|* readStream() blocks, so the reading has a thread of its own. That leaves
+|* the source's thread free to take the stopSampling() that ends it
+\******************************************************************************/
+class SourceSoapy : public SourceBase, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		static const int	RING_SLOTS		= 8;		// Blocks in the ring
+		static const long	READ_TIMEOUT	= 100000;	// readStream wait, us
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, driver);					// SoapySDR driver key
+	GET(QString, soapyFormat);				// Stream format, as SoapySDR has it
+	GET(StreamFormat, streamFormat);		// ... and as we do
+	GET(double, fullScale);					// Largest sample value
+	GET(int, channel);						// RX channel in use
+	GET(int, sampleRate);					// Sampling frequency in Hz
+	GET(int64_t, replaced);					// Ring blocks still in use
+
+	private:
+		/**********************************************************************\
+		|* Private instance variables
+		\**********************************************************************/
+		SoapySDR::Device *	_dev;			// Device, once open
+		SoapySDR::Stream *	_rx;			// Receiving stream, while sampling
+		QVector<int64_t>	_ring;			// DataMgr blocks to read into
+		int					_next;			// Next block in the ring
+		std::atomic<bool>	_isActive;		// Reading
+		std::thread			_reader;		// Doing the reading
+		size_t				_mtu;			// Samples per read
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		int64_t _nextSlot(size_t bytes);
+		void _read(void);
+		void _freeRing(void);
+		QList<SourceBase::Range> _ranges(const SoapySDR::RangeList& list,
+										 double scale);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit SourceSoapy(QObject *parent = nullptr);
+		virtual ~SourceSoapy(void);
+
+		/**********************************************************************\
+		|* Pick the format to stream in from those the driver offers and the
+		|* one it calls native. Empty if none will do
+		\**********************************************************************/
+		static QString negotiate(const QStringList& offered,
+								 const QString& native);
+
+		/**********************************************************************\
+		|* Return the information on how this source reports data
+		\**********************************************************************/
+		virtual StreamInfo streamInfo(void);
+
+		/**********************************************************************\
+		|* Return whether we managed to open a given instance
+		\**********************************************************************/
+		virtual bool open(int deviceId);
+
+		/**********************************************************************\
+		|* Set the sample-rate
+		\**********************************************************************/
+		virtual bool setSampleRate(int sampleRate);
+
+		/**********************************************************************\
+		|* Set the center-frequency
+		\**********************************************************************/
+		virtual bool setFrequency(int frequency);
+
+		/**********************************************************************\
+		|* Set the gain in dB
+		\**********************************************************************/
+		virtual bool setGain(double gain);
+
+		/**********************************************************************\
+		|* Set the antenna to use
+		\**********************************************************************/
+		virtual bool setAntenna(QString antenna);
+
+		/**********************************************************************\
+		|* Set the tuner bandwidth to use
+		\**********************************************************************/
+		virtual bool setBandwidth(int bandwidth);
+
+		/**********************************************************************\
+		|* Get a list of available antennas
+		\**********************************************************************/
+		virtual QList<QString> listAntennas(void);
+
+		/**********************************************************************\
+		|* Get a list of available bandwidth settings
+		\**********************************************************************/
+		virtual QList<QString> listBandwidths(void);
+
+		/**********************************************************************\
+		|* Get the number of available channels for RX and TX
+		\**********************************************************************/
+		virtual ChannelInfo numberOfChannels(void);
+
+		/**********************************************************************\
+		|* Get a list of frequency ranges, in MHz
+		\**********************************************************************/
+		virtual QList<Range> listFrequencyRanges(void);
+
+		/**********************************************************************\
+		|* Get a list of gains in dB
+		\**********************************************************************/
+		virtual QList<double> listGains(void);
+
+		/**********************************************************************\
+		|* Get the ranges within which you can sample via the ADC
+		\**********************************************************************/
+		virtual QList<SourceBase::Range> listSampleRateRanges(void);
+
+	public slots:
+		/**********************************************************************\
+		|* Start sampling from the source. The reading goes on in a thread of
+		|* its own, so this returns once it's begun
+		\**********************************************************************/
+		 virtual void startSampling(void);
+
+		/**********************************************************************\
+		|* Stop sampling from the source, and wait for the reading to finish
+		\**********************************************************************/
+		 virtual void stopSampling(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check the native format is kept when it'll do, and the
+		|* cheapest one offered is picked when it won't
+		\**********************************************************************/
+		Testable::TestResult _checkNegotiate(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check ring blocks are reused once consumed, and replaced
+		|* while they're still held downstream
+		\**********************************************************************/
+		Testable::TestResult _checkRing(void);
+	};
+
+#endif // SOURCESOAPY_H
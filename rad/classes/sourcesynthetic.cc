@@ -0,0 +1,641 @@
+#include <cmath>
+#include <complex>
+#include <cstring>
+
+#include <QStringList>
+#include <QTimer>
+
+#include "datamgr.h"
+#include "metrics.h"
+#include "sourcesynthetic.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_src) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+#define NOISE_SEED			0x2545F491u
+#define CHECK_RATE			2048000
+
+/******************************************************************************\
+|* Helper: xorshift, for numbers that are the same every run
+\******************************************************************************/
+static inline uint32_t _xorshift(uint32_t& state)
+	{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+	}
+
+/******************************************************************************\
+|* Helper: the oscillator phase step for a frequency, as a fraction of a
+|* turn in 32 bits. Negative frequencies wrap round, as they should
+\******************************************************************************/
+static inline uint32_t _stepFor(double hz, int sampleRate)
+	{
+	return (uint32_t)(int64_t)llround(hz / sampleRate * 4294967296.0);
+	}
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+SourceSynthetic::SourceSynthetic(const QString& spec,
+								 StreamFormat format,
+								 QObject *parent)
+				:SourceBase(parent)
+				,Testable()
+				,_spec(spec)
+				,_streamFormat(format)
+				,_sampleRate(0)
+				,_generated(0)
+				,_isActive(false)
+				,_noise(0)
+				,_seed(NOISE_SEED)
+				,_started(0)
+				,_startedAt(0)
+	{
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+SourceSynthetic::~SourceSynthetic(void)
+	{
+	}
+
+/******************************************************************************\
+|* Check a spec
+\******************************************************************************/
+QString SourceSynthetic::checkSpec(const QString& spec)
+	{
+	QList<Signal> sigs;
+	float noise;
+	return _parse(spec, CHECK_RATE, sigs, noise);
+	}
+
+/******************************************************************************\
+|* Private method: turn a spec into signals at a sample rate
+\******************************************************************************/
+QString SourceSynthetic::_parse(const QString& spec,
+								int sampleRate,
+								QList<Signal>& sigs,
+								float& noise)
+	{
+	sigs.clear();
+	noise = 0;
+
+	for (const QString& item : spec.split(","))
+		{
+		if (item.trimmed().isEmpty())
+			continue;
+
+		QStringList parts	= item.trimmed().split(":");
+		QString kind		= parts.takeFirst().toLower();
+
+		QList<double> args;
+		for (const QString& part : parts)
+			{
+			bool ok;
+			args.append(part.toDouble(&ok));
+			if (!ok)
+				return QString("'%1' isn't a number in '%2'").arg(part, item);
+			}
+
+		Signal sig;
+		memset(&sig, 0, sizeof(sig));
+		double nyquist = sampleRate / 2.0;
+
+		if ((kind == "noise") && (args.size() == 1))
+			{
+			noise = pow(10.0, args[0] / 20.0);
+			continue;
+			}
+		else if ((kind == "tone") && (args.size() == 2))
+			{
+			if (fabs(args[0]) > nyquist)
+				return QString("Tone at %1 Hz is outside the band").arg(args[0]);
+			sig.type		= SIG_TONE;
+			sig.step		= _stepFor(args[0], sampleRate);
+			sig.amplitude	= pow(10.0, args[1] / 20.0);
+			}
+		else if ((kind == "chirp") && (args.size() == 4))
+			{
+			if ((fabs(args[0]) > nyquist) || (fabs(args[1]) > nyquist))
+				return QString("Chirp '%1' goes outside the band").arg(item);
+			sig.type		= SIG_CHIRP;
+			sig.period		= llround(args[2] * sampleRate);
+			if (sig.period < 1)
+				return QString("Chirp '%1' needs a period").arg(item);
+			sig.startStep	= _stepFor(args[0], sampleRate);
+			sig.step		= sig.startStep;
+			sig.sweep		= (int32_t)llround((args[1] - args[0]) / sampleRate
+											   * 4294967296.0 / sig.period);
+			sig.amplitude	= pow(10.0, args[3] / 20.0);
+			}
+		else if ((kind == "pulse") && (args.size() == 3))
+			{
+			sig.type		= SIG_PULSE;
+			sig.width		= llround(args[0] * sampleRate);
+			sig.period		= llround(args[1] * sampleRate);
+			if ((sig.period < 1) || (sig.width < 0) || (sig.width > sig.period))
+				return QString("Pulse '%1' doesn't fit its period").arg(item);
+			sig.amplitude	= pow(10.0, args[2] / 20.0);
+			}
+		else
+			return QString("Can't make '%1'").arg(item);
+
+		sigs.append(sig);
+		}
+
+	return "";
+	}
+
+/******************************************************************************\
+|* Return the information on how this source reports data
+\******************************************************************************/
+SourceBase::StreamInfo SourceSynthetic::streamInfo(void)
+	{
+	StreamInfo info;
+	info.format = _streamFormat;
+	info.max	= (_streamFormat == STREAM_S16C) ? 16384 : 128;
+	info.name	= "synthetic";
+	info.mode	= (_streamFormat == STREAM_S16C) ? "s16c" : "s8c";
+	return info;
+	}
+
+/******************************************************************************\
+|* Make the tables, and check the spec
+\******************************************************************************/
+bool SourceSynthetic::open(int deviceId)
+	{
+	Q_UNUSED(deviceId);
+
+	QString error = checkSpec(_spec);
+	if (!error.isEmpty())
+		{
+		ERR << "Bad synthetic signal spec:" << error;
+		return false;
+		}
+
+	int size = 1 << TABLE_BITS;
+	_sine.resize(size * 2);
+	for (int i=0; i<size; i++)
+		{
+		_sine[2*i]		= cos(2.0 * M_PI * i / size);
+		_sine[2*i+1]	= sin(2.0 * M_PI * i / size);
+		}
+
+	/**************************************************************************\
+	|* Box-Muller, from a fixed seed
+	\**************************************************************************/
+	uint32_t state = NOISE_SEED;
+	_gauss.resize(NOISE_SAMPLES * 2);
+	for (int i=0; i<NOISE_SAMPLES*2; i+=2)
+		{
+		double u1 = (_xorshift(state) + 1.0) / 4294967297.0;
+		double u2 = _xorshift(state) / 4294967296.0;
+		double r  = sqrt(-2.0 * log(u1));
+		_gauss[i]	= r * cos(2.0 * M_PI * u2);
+		_gauss[i+1]	= r * sin(2.0 * M_PI * u2);
+		}
+
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the sample rate. Everything starts again, so the output only depends
+|* on the spec and the rate
+\******************************************************************************/
+bool SourceSynthetic::setSampleRate(int sampleRate)
+	{
+	if (sampleRate <= 0)
+		return false;
+
+	QString error = _parse(_spec, sampleRate, _signals, _noise);
+	if (!error.isEmpty())
+		{
+		ERR << "Cannot make" << _spec << "at" << sampleRate << ":" << error;
+		return false;
+		}
+
+	_sampleRate	= sampleRate;
+	_seed		= NOISE_SEED;
+	_generated	= 0;
+	_started	= 0;
+	LOG << name() << "sample rate is now" << sampleRate;
+	return true;
+	}
+
+/******************************************************************************\
+|* Set the frequency, gain, antenna and bandwidth - all NOPs
+\******************************************************************************/
+bool SourceSynthetic::setFrequency(int frequency)
+	{
+	LOG << name() << "now tuned to" << frequency << "Hz";
+	return true;
+	}
+
+bool SourceSynthetic::setGain(double gain)
+	{
+	Q_UNUSED(gain);
+	return true;
+	}
+
+bool SourceSynthetic::setAntenna(QString antenna)
+	{
+	Q_UNUSED(antenna);
+	return true;
+	}
+
+bool SourceSynthetic::setBandwidth(int bandwidth)
+	{
+	Q_UNUSED(bandwidth);
+	return true;
+	}
+
+/******************************************************************************\
+|* Make the next lot of samples
+\******************************************************************************/
+void SourceSynthetic::generate(uint8_t *out, int samples, StreamFormat fmt)
+	{
+	if (_work.size() < samples * 2)
+		_work.resize(samples * 2);
+
+	float *work = _work.data();
+	memset(work, 0, samples * 2 * sizeof(float));
+
+	if (_noise > 0)
+		_addNoise(work, samples, _noise);
+
+	for (Signal& sig : _signals)
+		{
+		if (sig.type == SIG_PULSE)
+			_addPulse(work, samples, sig);
+		else
+			_addOscillator(work, samples, sig);
+		}
+
+	/**************************************************************************\
+	|* Scale as the radios do: 8-bit samples are offset, like the RTL-SDR's,
+	|* and 16-bit ones are signed with full scale at 8192, like the SDRplay's
+	\**************************************************************************/
+	int values = samples * 2;
+	if (fmt == STREAM_S16C)
+		{
+		int16_t *dst = reinterpret_cast<int16_t *>(out);
+		for (int i=0; i<values; i++)
+			{
+			float v = work[i] * 8192.0f;
+			v = (v > 32767.0f) ? 32767.0f : (v < -32768.0f) ? -32768.0f : v;
+			dst[i] = (int16_t)v;
+			}
+		}
+	else
+		{
+		for (int i=0; i<values; i++)
+			{
+			float v = work[i] * 127.5f + 128.0f;
+			v = (v > 255.0f) ? 255.0f : (v < 0.0f) ? 0.0f : v;
+			out[i] = (uint8_t)v;
+			}
+		}
+
+	_generated += samples;
+	}
+
+/******************************************************************************\
+|* Private method: add noise, read from the table starting somewhere new
+\******************************************************************************/
+void SourceSynthetic::_addNoise(float *out, int samples, float level)
+	{
+	const float *gauss	= _gauss.constData();
+	float scale			= level / (float)M_SQRT2;
+	int pos				= _xorshift(_seed) % NOISE_SAMPLES;
+
+	while (samples > 0)
+		{
+		int n = qMin(samples, NOISE_SAMPLES - pos);
+		const float *src = gauss + pos * 2;
+		for (int i=0; i<n*2; i++)
+			out[i] += scale * src[i];
+
+		out		+= n * 2;
+		samples	-= n;
+		pos		= 0;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: add a tone or chirp. The phase of sample i is
+|*
+|*	phase + i.step + i(i-1)/2.sweep
+|*
+|* (modulo a turn), so no sample depends on the one before. A chirp starts
+|* its sweep again at the end of each period
+\******************************************************************************/
+void SourceSynthetic::_addOscillator(float *out, int samples, Signal& sig)
+	{
+	const float *sine	= _sine.constData();
+	const int shift		= 32 - TABLE_BITS;
+	float amplitude		= sig.amplitude;
+
+	while (samples > 0)
+		{
+		int n = samples;
+		if ((sig.type == SIG_CHIRP) && (sig.period - sig.count < n))
+			n = sig.period - sig.count;
+
+		uint32_t phase	= sig.phase;
+		uint32_t step	= sig.step;
+		uint32_t sweep	= (uint32_t)sig.sweep;
+		for (int i=0; i<n; i++)
+			{
+			uint32_t tri	= (uint32_t)(((uint64_t)i * (i - 1)) >> 1);
+			uint32_t at		= (phase + (uint32_t)i * step + tri * sweep) >> shift;
+			out[2*i]		+= amplitude * sine[2*at];
+			out[2*i+1]		+= amplitude * sine[2*at+1];
+			}
+
+		uint32_t tri	= (uint32_t)(((uint64_t)n * (n - 1)) >> 1);
+		sig.phase		= phase + (uint32_t)n * step + tri * sweep;
+		sig.step		= step + (uint32_t)n * sweep;
+		sig.count		+= n;
+		if ((sig.type == SIG_CHIRP) && (sig.count >= sig.period))
+			{
+			sig.count	= 0;
+			sig.step	= sig.startStep;
+			}
+
+		out		+= n * 2;
+		samples	-= n;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: add a pulse of RFI, broadband noise while it's on
+\******************************************************************************/
+void SourceSynthetic::_addPulse(float *out, int samples, Signal& sig)
+	{
+	while (samples > 0)
+		{
+		int n;
+		if (sig.count < sig.width)
+			{
+			n = (int)qMin((int64_t)samples, sig.width - sig.count);
+			_addNoise(out, n, sig.amplitude);
+			}
+		else
+			n = (int)qMin((int64_t)samples, sig.period - sig.count);
+
+		sig.count += n;
+		if (sig.count >= sig.period)
+			sig.count = 0;
+
+		out		+= n * 2;
+		samples	-= n;
+		}
+	}
+
+/******************************************************************************\
+|* Private method: samples per block, about 1/20th of a second
+\******************************************************************************/
+int SourceSynthetic::_blockSamples(void)
+	{
+	int samples = qMax(MIN_BLOCK, _sampleRate / 20);
+	return (samples + 1023) & ~1023;
+	}
+
+/******************************************************************************\
+|* Start making samples
+\******************************************************************************/
+void SourceSynthetic::startSampling(void)
+	{
+	if ((_sampleRate <= 0) || _sine.isEmpty())
+		{
+		ERR << "Synthetic source isn't set up";
+		return;
+		}
+
+	_isActive	= true;
+	_started	= 0;
+	_next();
+	}
+
+/******************************************************************************\
+|* Stop making them
+\******************************************************************************/
+void SourceSynthetic::stopSampling(void)
+	{
+	_isActive = false;
+	}
+
+/******************************************************************************\
+|* Send the next block if it's due, otherwise come back when it will be. If
+|* we've fallen more than half a second behind the clock, the generator is
+|* the bottleneck: count an overrun, as a radio would, and carry on from now
+\******************************************************************************/
+void SourceSynthetic::_next(void)
+	{
+	if (!_isActive)
+		return;
+
+	int64_t now = Metrics::now();
+	if (_started == 0)
+		{
+		_started	= now;
+		_startedAt	= _generated;
+		}
+
+	int64_t due = _started + (int64_t)((_generated - _startedAt) * 1e9 / _sampleRate);
+	if (due > now)
+		{
+		QTimer::singleShot((int)ceil((due - now) / 1e6), this, &SourceSynthetic::_next);
+		return;
+		}
+
+	if (now - due > 500000000)
+		{
+		Metrics::instance().add(Metrics::SOURCE_OVERRUNS);
+		_started = 0;
+		}
+
+	DataMgr &dmgr	= DataMgr::instance();
+	int samples		= _blockSamples();
+	int bytes		= samples * 2 * ((_streamFormat == STREAM_S16C) ? 2 : 1);
+	int64_t bufId	= dmgr.blockFor(bytes);
+	generate(dmgr.asUint8(bufId), samples, _streamFormat);
+
+	emit dataAvailable(bufId,
+					   samples,
+					   (_streamFormat == STREAM_S16C) ? 8192 : 128,
+					   _streamFormat);
+
+	QTimer::singleShot(0, this, &SourceSynthetic::_next);
+	}
+
+/******************************************************************************\
+|* Get a list of antennas - just the one
+\******************************************************************************/
+QList<QString> SourceSynthetic::listAntennas(void)
+	{
+	QList<QString> list;
+	list.append("RX");
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of available bandwidth settings - none to choose from
+\******************************************************************************/
+QList<QString> SourceSynthetic::listBandwidths(void)
+	{
+	return QList<QString>();
+	}
+
+/******************************************************************************\
+|* Get the number of channels in each direction - 1 RX
+\******************************************************************************/
+SourceBase::ChannelInfo SourceSynthetic::numberOfChannels(void)
+	{
+	SourceBase::ChannelInfo info;
+	info.rx = 1;
+	info.tx = 0;
+	return info;
+	}
+
+/******************************************************************************\
+|* Get a list of frequency ranges, in MHz - anywhere
+\******************************************************************************/
+QList<SourceBase::Range> SourceSynthetic::listFrequencyRanges(void)
+	{
+	QList<SourceBase::Range> list;
+	list.append({.from=0, .to=6000});
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of sample rates, in MHz - anything
+\******************************************************************************/
+QList<SourceBase::Range> SourceSynthetic::listSampleRateRanges(void)
+	{
+	QList<SourceBase::Range> list;
+	list.append({.from=0, .to=100});
+	return list;
+	}
+
+/******************************************************************************\
+|* Get a list of available gains - none
+\******************************************************************************/
+QList<double> SourceSynthetic::listGains(void)
+	{
+	return QList<double>();
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int SourceSynthetic::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * SourceSynthetic::testClassName(void)
+	{
+	return "SourceSynthetic";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult SourceSynthetic::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkSpec();
+		case 1:
+			return _checkTone();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : good specs should parse and bad ones shouldn't, and two
+|* generators with the same spec should make the same samples
+\******************************************************************************/
+Testable::TestResult SourceSynthetic::_checkSpec(void)
+	{
+	QString spec = "noise:-20,tone:250000:-30,chirp:-500000:500000:0.01:-30,"
+				   "pulse:0.001:0.004:-10";
+
+	bool ok = checkSpec(spec).isEmpty()
+		   && !checkSpec("tone:2000000:-10").isEmpty()
+		   && !checkSpec("chirp:1:2:-3").isEmpty()
+		   && !checkSpec("pulse:2:1:-3").isEmpty()
+		   && !checkSpec("wobble:1").isEmpty()
+		   && !checkSpec("tone:x:-3").isEmpty();
+
+	SourceSynthetic a(spec, STREAM_S8C);
+	SourceSynthetic b(spec, STREAM_S8C);
+	ok = ok && a.open(0) && a.setSampleRate(CHECK_RATE)
+			&& b.open(0) && b.setSampleRate(CHECK_RATE);
+
+	int samples = 30000;
+	QVector<uint8_t> outA(samples * 2);
+	QVector<uint8_t> outB(samples * 2);
+	for (int i=0; ok && i<3; i++)
+		{
+		a.generate(outA.data(), samples, STREAM_S8C);
+		b.generate(outB.data(), samples, STREAM_S8C);
+		ok = (memcmp(outA.constData(), outB.constData(), outA.size()) == 0);
+		}
+
+	int distinct = 0;
+	for (int i=1; i<outA.size(); i++)
+		if (outA[i] != outA[0])
+			distinct ++;
+	ok = ok && (distinct > samples) && (a.generated() == 3 * samples);
+
+	if (!ok)
+		ERR << "Synthetic specs or repeatability failed";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : a -6 dBFS tone at 256 kHz should be there at about half
+|* full scale, and there shouldn't be anything at 512 kHz
+\******************************************************************************/
+Testable::TestResult SourceSynthetic::_checkTone(void)
+	{
+	SourceSynthetic src("tone:256000:-6", STREAM_S16C);
+	bool ok = src.open(0) && src.setSampleRate(CHECK_RATE);
+
+	int samples = 8192;
+	QVector<int16_t> iq(samples * 2);
+	src.generate(reinterpret_cast<uint8_t *>(iq.data()), samples, STREAM_S16C);
+
+	std::complex<double> at256(0, 0);
+	std::complex<double> at512(0, 0);
+	for (int i=0; i<samples; i++)
+		{
+		std::complex<double> x(iq[2*i], iq[2*i+1]);
+		at256 += x * std::polar(1.0, -2.0 * M_PI * 256000.0 * i / CHECK_RATE);
+		at512 += x * std::polar(1.0, -2.0 * M_PI * 512000.0 * i / CHECK_RATE);
+		}
+
+	double level	= std::abs(at256) / samples / 8192.0;
+	double leak		= std::abs(at512) / samples / 8192.0;
+	ok = ok && (fabs(level - pow(10.0, -6.0 / 20.0)) < 0.01) && (leak < 0.001);
+
+	if (!ok)
+		ERR << "Synthetic tone at level" << level << "with" << leak << "leakage";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,235 @@
+#ifndef SOURCESYNTHETIC_H
+#define SOURCESYNTHETIC_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include <libra.h>
+
+#include "properties.h"
+#include "sourcebase.h"
+
+/******************************************************************************\
+|* A radio that isn't there, for measuring the pipeline on machines without
+|* one. It makes noise plus any number of tones, chirps and pulses of RFI,
+|* described by a spec like:
+|*
+|*	noise:-30,tone:250000:-40,chirp:-500000:500000:20:-45,pulse:0.001:2:-20
+|*
+|* where levels are dB relative to full scale, frequencies are offsets from
+|* the centre in Hz, a chirp sweeps from one to the other every so many
+|* seconds, and a pulse is a burst of broadband noise lasting some seconds,
+|* every so many seconds.
+|*
+|* Everything is deterministic, so two runs get the same samples. Nothing
+|* costly is done per sample: tones and chirps are numerically-controlled
+|* oscillators indexing a precomputed sine table, with the phase of each
+|* sample worked out directly rather than from the one before, so the loops
+|* vectorise; noise is read from a precomputed table of gaussian samples at
+|* a pseudo-random place each block.
+|*
+|* Blocks go out paced by the clock, from the event loop, in the format
+|* either of the real radios sends
+\******************************************************************************/
+class SourceSynthetic : public SourceBase, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			SIG_TONE = 0,				// Fixed frequency
+			SIG_CHIRP,					// Sweeps, then starts again
+			SIG_PULSE					// Bursts of broadband noise
+			} SignalType;
+
+		typedef struct
+			{
+			SignalType	type;			// What it is
+			float		amplitude;		// Linear, full scale = 1
+			uint32_t	step;			// Phase step per sample, now
+			uint32_t	startStep;		// ... at the start of a sweep
+			int32_t		sweep;			// Change in step per sample
+			int64_t		period;			// Samples per sweep or pulse cycle
+			int64_t		width;			// Samples a pulse lasts
+			int64_t		count;			// Samples into the period
+			uint32_t	phase;			// Oscillator phase
+			} Signal;
+
+		static const int	TABLE_BITS		= 12;			// Sine table size
+		static const int	NOISE_SAMPLES	= 1 << 18;		// Noise table size
+		static const int	MIN_BLOCK		= 16384;		// IQ pairs per block
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, spec);						// What to make
+	GET(StreamFormat, streamFormat);		// ... in what format
+	GET(int, sampleRate);					// ... at what rate
+	GET(int64_t, generated);				// Samples made so far
+	GETSET(bool, isActive, IsActive);		// Running
+
+	private:
+		/**********************************************************************\
+		|* Private instance variables
+		\**********************************************************************/
+		QList<Signal>		_signals;		// Tones, chirps and pulses
+		float				_noise;			// Noise level, linear
+		QVector<float>		_sine;			// cos,sin pairs around a circle
+		QVector<float>		_gauss;			// Unit-variance I,Q pairs
+		QVector<float>		_work;			// One block, as floats
+		uint32_t			_seed;			// Where to read noise from next
+		int64_t				_started;		// When the clock started, ns
+		int64_t				_startedAt;		// ... at which sample
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		static QString _parse(const QString& spec,
+							  int sampleRate,
+							  QList<Signal>& sigs,
+							  float& noise);
+		void _addNoise(float *out, int samples, float level);
+		void _addOscillator(float *out, int samples, Signal& sig);
+		void _addPulse(float *out, int samples, Signal& sig);
+		int _blockSamples(void);
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		explicit SourceSynthetic(const QString& spec,
+								 StreamFormat format = STREAM_S8C,
+								 QObject *parent = nullptr);
+		virtual ~SourceSynthetic(void);
+
+		/**********************************************************************\
+		|* Check a spec. Returns an empty string if it's good, else the problem
+		\**********************************************************************/
+		static QString checkSpec(const QString& spec);
+
+		/**********************************************************************\
+		|* Make the next {samples} IQ pairs into {out}, in {fmt}
+		\**********************************************************************/
+		void generate(uint8_t *out, int samples, StreamFormat fmt);
+
+		/**********************************************************************\
+		|* Return the information on how this source reports data
+		\**********************************************************************/
+		virtual StreamInfo streamInfo(void);
+
+		/**********************************************************************\
+		|* Set up the generator. The device id is ignored
+		\**********************************************************************/
+		virtual bool open(int deviceId);
+
+		/**********************************************************************\
+		|* Set the sample-rate: anything goes
+		\**********************************************************************/
+		virtual bool setSampleRate(int sampleRate);
+
+		/**********************************************************************\
+		|* Set the center-frequency: the signals are offsets from it, so a NOP
+		\**********************************************************************/
+		virtual bool setFrequency(int frequency);
+
+		/**********************************************************************\
+		|* Set the gain in dB: a NOP
+		\**********************************************************************/
+		virtual bool setGain(double gain);
+
+		/**********************************************************************\
+		|* Set the antenna to use: a NOP
+		\**********************************************************************/
+		virtual bool setAntenna(QString antenna);
+
+		/**********************************************************************\
+		|* Set the tuner bandwidth to use: a NOP
+		\**********************************************************************/
+		virtual bool setBandwidth(int bandwidth);
+
+		/**********************************************************************\
+		|* Get a list of available antennas
+		\**********************************************************************/
+		virtual QList<QString> listAntennas(void);
+
+		/**********************************************************************\
+		|* Get a list of available bandwidth settings
+		\**********************************************************************/
+		virtual QList<QString> listBandwidths(void);
+
+		/**********************************************************************\
+		|* Get the number of available channels for RX and TX
+		\**********************************************************************/
+		virtual ChannelInfo numberOfChannels(void);
+
+		/**********************************************************************\
+		|* Get a list of frequency ranges, in MHz
+		\**********************************************************************/
+		virtual QList<Range> listFrequencyRanges(void);
+
+		/**********************************************************************\
+		|* Get a list of gains in dB
+		\**********************************************************************/
+		virtual QList<double> listGains(void);
+
+		/**********************************************************************\
+		|* Get the ranges within which you can sample
+		\**********************************************************************/
+		virtual QList<SourceBase::Range> listSampleRateRanges(void);
+
+	public slots:
+		/**********************************************************************\
+		|* Start making samples
+		\**********************************************************************/
+		 virtual void startSampling(void);
+
+		/**********************************************************************\
+		|* Stop making them
+		\**********************************************************************/
+		 virtual void stopSampling(void);
+
+	private slots:
+		/**********************************************************************\
+		|* Send the next block when it's due, or wait for it to be
+		\**********************************************************************/
+		void _next(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check specs are parsed, and the output is repeatable
+		\**********************************************************************/
+		Testable::TestResult _checkSpec(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check a tone comes out at the right frequency and level
+		\**********************************************************************/
+		Testable::TestResult _checkTone(void);
+	};
+
+#endif // SOURCESYNTHETIC_H
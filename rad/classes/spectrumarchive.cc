@@ -0,0 +1,417 @@
+#include <cstring>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#include "archivereader.h"
+#include "spectrumarchive.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+static_assert(sizeof(SpectrumArchive::ChunkHeader) <= SpectrumArchive::HEADER_BYTES,
+			  "Chunk header doesn't fit in its space");
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+SpectrumArchive::SpectrumArchive(const QString& dir, int chunkRows, QObject *parent)
+				:QObject(parent)
+				,Testable()
+				,_dir(dir)
+				,_chunkRows((chunkRows < 1) ? 1 : chunkRows)
+				,_described(false)
+	{
+	_syncTimer = new QTimer(this);
+	_syncTimer->setInterval(SYNC_MS);
+	connect(_syncTimer, &QTimer::timeout, this, &SpectrumArchive::sync);
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+SpectrumArchive::~SpectrumArchive(void)
+	{
+	sync();
+	_endChunks();
+	}
+
+/******************************************************************************\
+|* Where a tier lives
+\******************************************************************************/
+QString SpectrumArchive::tierDir(const QString& dir, int type)
+	{
+	return dir + ((type == TYPE_UPDATE) ? "/update" : "/sample");
+	}
+
+/******************************************************************************\
+|* Chunk file names sort in time order
+\******************************************************************************/
+QString SpectrumArchive::chunkName(int64_t msecs)
+	{
+	return QString("%1.spa").arg(msecs, 13, 10, QChar('0'));
+	}
+
+QString SpectrumArchive::indexName(int64_t msecs)
+	{
+	return QString("%1.idx").arg(msecs, 13, 10, QChar('0'));
+	}
+
+/******************************************************************************\
+|* Take a message from the aggregator, stamped with when it arrived
+\******************************************************************************/
+void SpectrumArchive::append(QByteArray msg)
+	{
+	if (msg.size() < (int)sizeof(Preamble))
+		return;
+
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	if (((hdr->type != TYPE_UPDATE) && (hdr->type != TYPE_SAMPLE))
+	 || (hdr->flags != 0))
+		return;
+
+	int bins = hdr->extent / sizeof(float);
+	if ((bins != (int)hdr->values) || (hdr->offset + hdr->extent > (uint32_t)msg.size()))
+		{
+		ERR << "Not archiving a malformed spectrum";
+		return;
+		}
+
+	appendRow(hdr->type,
+			  reinterpret_cast<const float *>(msg.constData() + hdr->offset),
+			  bins,
+			  QDateTime::currentMSecsSinceEpoch());
+	}
+
+/******************************************************************************\
+|* Add a row, starting a chunk if there isn't one, or if it's full
+\******************************************************************************/
+void SpectrumArchive::appendRow(int type, const float *values, int bins, int64_t msecs)
+	{
+	if (!_described)
+		return;
+
+	Tier& tier = _tiers[type];
+	if ((tier.data != nullptr)
+	 && ((tier.rows >= _chunkRows) || (tier.bins != bins)))
+		_endChunk(tier);
+
+	if ((tier.data == nullptr) && !_startChunk(type, tier, bins, msecs))
+		return;
+
+	if ((tier.rows % INDEX_STRIDE) == 0)
+		{
+		IndexEntry entry = {msecs, tier.rows};
+		tier.index->write((const char *)&entry, sizeof(entry));
+		}
+
+	tier.data->write((const char *)&msecs, sizeof(msecs));
+	tier.data->write((const char *)values, bins * sizeof(float));
+	tier.rows ++;
+	tier.dirty = true;
+
+	if (!_syncTimer->isActive())
+		_syncTimer->start();
+	}
+
+/******************************************************************************\
+|* New settings. Rows either side of a change go in different chunks
+\******************************************************************************/
+void SpectrumArchive::describe(RadioSettings settings)
+	{
+	if (_described && (_settings.changes(settings) == 0))
+		return;
+
+	_endChunks();
+	_settings	= settings;
+	_described	= true;
+	}
+
+/******************************************************************************\
+|* New calibration, likewise
+\******************************************************************************/
+void SpectrumArchive::setCalibration(QString name)
+	{
+	if (name == _calibration)
+		return;
+
+	_endChunks();
+	_calibration = name;
+	}
+
+/******************************************************************************\
+|* Push what's been written out to the disk. This is the only place the
+|* writer waits on the disk, and it's every few seconds, not every row
+\******************************************************************************/
+void SpectrumArchive::sync(void)
+	{
+	for (Tier& tier : _tiers)
+		if (tier.dirty && (tier.data != nullptr))
+			{
+			tier.data->flush();
+			tier.index->flush();
+			fsync(tier.data->handle());
+			fsync(tier.index->handle());
+			tier.dirty = false;
+			}
+	}
+
+/******************************************************************************\
+|* Private method: start a chunk, and write its header
+\******************************************************************************/
+bool SpectrumArchive::_startChunk(int type, Tier& tier, int bins, int64_t msecs)
+	{
+	QString dir = tierDir(_dir, type);
+	if (!QDir().mkpath(dir))
+		{
+		ERR << "Cannot create archive directory" << dir;
+		return false;
+		}
+
+	ChunkHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic		= CHUNK_MAGIC;
+	hdr.version		= CHUNK_VERSION;
+	hdr.tier		= (uint16_t)type;
+	hdr.bins		= bins;
+	hdr.rowBytes	= sizeof(int64_t) + bins * sizeof(float);
+	hdr.created		= msecs;
+	hdr.centreHz	= _settings.frequency();
+	hdr.binHz		= (double)_settings.sampleRate() / bins;
+	hdr.firstHz		= hdr.centreHz - _settings.sampleRate() / 2.0;
+	hdr.integration	= (type == TYPE_UPDATE) ? _settings.updateSecs()
+											: _settings.sampleSecs();
+	hdr.sampleRate	= _settings.sampleRate();
+	hdr.window		= (uint16_t)_settings.window();
+	strncpy(hdr.calibration, qPrintable(_calibration), sizeof(hdr.calibration) - 1);
+
+	QByteArray header(HEADER_BYTES, '\0');
+	memcpy(header.data(), &hdr, sizeof(hdr));
+
+	tier.data	= new QFile(dir + "/" + chunkName(msecs));
+	tier.index	= new QFile(dir + "/" + indexName(msecs));
+	tier.rows	= 0;
+	tier.bins	= bins;
+	tier.dirty	= true;
+
+	if (!tier.data->open(QIODevice::WriteOnly | QIODevice::Truncate)
+	 || !tier.index->open(QIODevice::WriteOnly | QIODevice::Truncate)
+	 || (tier.data->write(header) != HEADER_BYTES))
+		{
+		ERR << "Cannot start archive chunk" << tier.data->fileName();
+		_endChunk(tier);
+		return false;
+		}
+
+	LOG << "Archiving to" << tier.data->fileName();
+	return true;
+	}
+
+/******************************************************************************\
+|* Private method: finish with a chunk. It's synced first, so a reader that
+|* sees the next chunk can rely on this one being complete
+\******************************************************************************/
+void SpectrumArchive::_endChunk(Tier& tier)
+	{
+	if (tier.data != nullptr)
+		{
+		tier.data->flush();
+		tier.index->flush();
+		fsync(tier.data->handle());
+		fsync(tier.index->handle());
+		}
+
+	delete tier.data;
+	delete tier.index;
+	tier.data	= nullptr;
+	tier.index	= nullptr;
+	tier.rows	= 0;
+	tier.dirty	= false;
+	}
+
+/******************************************************************************\
+|* Private method: finish with every tier's chunk
+\******************************************************************************/
+void SpectrumArchive::_endChunks(void)
+	{
+	for (Tier& tier : _tiers)
+		_endChunk(tier);
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int SpectrumArchive::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * SpectrumArchive::testClassName(void)
+	{
+	return "SpectrumArchive";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult SpectrumArchive::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkChunks();
+		case 1:
+			return _checkFind();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : somewhere to keep a test archive, and a way to clear it up
+\******************************************************************************/
+static QString _testDir(const char *name)
+	{
+	return QDir::tempPath() + QString("/rad-archive-%1-%2")
+									.arg(name)
+									.arg(QCoreApplication::applicationPid());
+	}
+
+static void _removeDir(const QString& dir)
+	{
+	QDir(dir).removeRecursively();
+	}
+
+/******************************************************************************\
+|* Test interface : 25 updates at 10 rows a chunk should make chunks of 10,
+|* 10 and 5. A change of calibration should then start a 4th. Samples go in
+|* a tier of their own, and the header should describe the rows
+\******************************************************************************/
+Testable::TestResult SpectrumArchive::_checkChunks(void)
+	{
+	QString dir = _testDir("chunks");
+	float values[16];
+	bool ok		= true;
+
+	{
+	SpectrumArchive archive(dir, 10);
+	RadioSettings settings;
+	archive.describe(settings);
+
+	for (int i=0; i<25; i++)
+		{
+		for (int j=0; j<16; j++)
+			values[j] = i;
+		archive.appendRow(TYPE_UPDATE, values, 16, 1000 * i);
+		}
+	archive.setCalibration("rtlsdr-0_1420406000Hz_autodB_16_hamming.cal");
+	archive.appendRow(TYPE_UPDATE, values, 16, 25000);
+
+	for (int i=0; i<3; i++)
+		archive.appendRow(TYPE_SAMPLE, values, 16, 300000 * i);
+	archive.sync();
+	}
+
+	ArchiveReader updates;
+	ok = updates.open(dir, TYPE_UPDATE)
+	  && (updates.chunks() == 4)
+	  && (updates.rows(0) == 10)
+	  && (updates.rows(1) == 10)
+	  && (updates.rows(2) == 5)
+	  && (updates.rows(3) == 1)
+	  && (updates.msecs(1, 0) == 10000)
+	  && (updates.values(2, 4)[15] == 24.0f);
+
+	if (ok)
+		{
+		const ChunkHeader *hdr = updates.header(0);
+		RadioSettings settings;
+		ok = (hdr->bins == 16)
+		  && (hdr->tier == TYPE_UPDATE)
+		  && (hdr->binHz == settings.sampleRate() / 16.0)
+		  && (hdr->centreHz == settings.frequency())
+		  && (hdr->integration == settings.updateSecs())
+		  && (hdr->calibration[0] == '\0')
+		  && (strncmp(updates.header(3)->calibration, "rtlsdr-0_", 9) == 0);
+		}
+
+	ArchiveReader samples;
+	ok = ok && samples.open(dir, TYPE_SAMPLE)
+			&& (samples.chunks() == 1)
+			&& (samples.rows(0) == 3)
+			&& (samples.header(0)->integration == RadioSettings().sampleSecs());
+
+	updates.close();
+	samples.close();
+	_removeDir(dir);
+
+	if (!ok)
+		ERR << "Archive chunks not as expected";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : 1000 rows at 5, 15, 25 ... ms, over 10 chunks. Any time
+|* should find the row at or after it, whichever chunk and whichever side of
+|* an index entry it falls
+\******************************************************************************/
+Testable::TestResult SpectrumArchive::_checkFind(void)
+	{
+	QString dir = _testDir("find");
+	float values[4];
+
+	{
+	SpectrumArchive archive(dir, 100);
+	archive.describe(RadioSettings());
+	for (int i=0; i<1000; i++)
+		{
+		values[0] = i;
+		archive.appendRow(TYPE_SAMPLE, values, 4, 10 * i + 5);
+		}
+	}
+
+	ArchiveReader reader;
+	bool ok = reader.open(dir, TYPE_SAMPLE) && (reader.chunks() == 10);
+
+	for (int t=0; ok && t<10000; t+=7)
+		{
+		int chunk	= -1;
+		int row		= -1;
+		int expect	= (t <= 5) ? 0 : (t - 5 + 9) / 10;
+		ok = reader.find(t, chunk, row)
+		  && (chunk * 100 + row == expect)
+		  && (reader.values(chunk, row)[0] == expect)
+		  && (reader.msecs(chunk, row) >= t);
+		if (!ok)
+			ERR << "Time" << t << "found chunk" << chunk << "row" << row;
+		}
+
+	int chunk, row;
+	ok = ok && reader.find(9995, chunk, row)
+			&& (chunk == 9) && (row == 99)
+			&& !reader.next(chunk, row)
+			&& !reader.find(9996, chunk, row)
+			&& reader.find(995, chunk, row)
+			&& reader.next(chunk, row)
+			&& (chunk == 1) && (row == 0);
+
+	reader.close();
+	_removeDir(dir);
+
+	if (!ok)
+		ERR << "Archive find failed";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
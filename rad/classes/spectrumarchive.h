@@ -0,0 +1,189 @@
+#ifndef SPECTRUMARCHIVE_H
+#define SPECTRUMARCHIVE_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QString>
+
+#include <libra.h>
+
+#include "radiosettings.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+/******************************************************************************\
+|* The long-term store for updates and samples. Each tier has a directory of
+|* chunk files, named for the time of their first row, and each chunk is:
+|*
+|*	[ChunkHeader, padded to HEADER_BYTES][row][row]...
+|*
+|* where a row is an int64 time in ms followed by {bins} floats, so every
+|* row is the same width and row n is at a fixed offset. The header says
+|* what the rows mean: the frequency of each bin, the FFT size and window,
+|* the integration time and the calibration applied. A change to any of
+|* those starts a new chunk, as does a chunk reaching CHUNK_ROWS.
+|*
+|* Next to each chunk is a sparse index, an IndexEntry for every
+|* INDEX_STRIDE'th row, so a reader can find a time by binary search over
+|* the chunk names, then the index, then at most INDEX_STRIDE rows, without
+|* touching the rest of the data. See ArchiveReader.
+|*
+|* Files are only ever appended to. Writing happens on a thread of its own,
+|* and the files are synced every SYNC_MS rather than per row
+\******************************************************************************/
+class SpectrumArchive : public QObject, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef struct
+			{
+			uint32_t	magic;				// CHUNK_MAGIC
+			uint16_t	version;			// CHUNK_VERSION
+			uint16_t	tier;				// TYPE_UPDATE or TYPE_SAMPLE
+			int32_t		bins;				// Floats per row
+			int32_t		rowBytes;			// Bytes per row, with the time
+			int64_t		created;			// When the chunk was started, ms
+			double		centreHz;			// Centre frequency
+			double		firstHz;			// Frequency of bin 0
+			double		binHz;				// Width of a bin
+			double		integration;		// Seconds per row
+			int32_t		sampleRate;			// Baseband sample rate
+			uint16_t	window;				// Config::WindowType
+			uint16_t	reserved;			// Zero
+			char		calibration[128];	// Calibration applied, or empty
+			} ChunkHeader;
+
+		typedef struct
+			{
+			int64_t		msecs;				// Time of the row...
+			int64_t		row;				// ... with this number
+			} IndexEntry;
+
+		static const uint32_t	CHUNK_MAGIC		= 0x41505352;	// "RSPA"
+		static const uint16_t	CHUNK_VERSION	= 1;
+		static const int		HEADER_BYTES	= 4096;
+		static const int		INDEX_STRIDE	= 64;
+		static const int		CHUNK_ROWS		= 8640;
+		static const int		SYNC_MS			= 5000;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(QString, dir);					// Tiers are directories under here
+	GET(int, chunkRows);				// Rows before a new chunk
+
+	private:
+		/**********************************************************************\
+		|* What's being written for one tier
+		\**********************************************************************/
+		typedef struct
+			{
+			QFile *		data;			// Current chunk, or null
+			QFile *		index;			// ... and its index
+			int			rows;			// Rows in the chunk
+			int			bins;			// Floats in each of them
+			bool		dirty;			// Written to since the last sync
+			} Tier;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QMap<int, Tier>		_tiers;			// By PreambleType
+		RadioSettings		_settings;		// What the rows are of
+		QString				_calibration;	// ... and how they're calibrated
+		bool				_described;		// Have settings to write with
+		QTimer *			_syncTimer;		// Batches up the syncs
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		bool _startChunk(int type, Tier& tier, int bins, int64_t msecs);
+		void _endChunk(Tier& tier);
+		void _endChunks(void);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor
+		\**********************************************************************/
+		explicit SpectrumArchive(const QString& dir,
+								 int chunkRows = CHUNK_ROWS,
+								 QObject *parent = nullptr);
+		~SpectrumArchive(void);
+
+		/**********************************************************************\
+		|* The directory a tier is kept in, under {dir}
+		\**********************************************************************/
+		static QString tierDir(const QString& dir, int type);
+
+		/**********************************************************************\
+		|* The name of a chunk or its index starting at {msecs}
+		\**********************************************************************/
+		static QString chunkName(int64_t msecs);
+		static QString indexName(int64_t msecs);
+
+	public slots:
+		/**********************************************************************\
+		|* A message from the aggregator: updates and samples are archived,
+		|* anything else is ignored
+		\**********************************************************************/
+		void append(QByteArray msg);
+
+		/**********************************************************************\
+		|* Append one row, at a given time
+		\**********************************************************************/
+		void appendRow(int type, const float *values, int bins, int64_t msecs);
+
+		/**********************************************************************\
+		|* The settings have changed, so start new chunks
+		\**********************************************************************/
+		void describe(RadioSettings settings);
+
+		/**********************************************************************\
+		|* The calibration has changed (empty for none), so start new chunks
+		\**********************************************************************/
+		void setCalibration(QString name);
+
+		/**********************************************************************\
+		|* Flush and sync anything written since the last time
+		\**********************************************************************/
+		void sync(void);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check chunks start when they should, with the right header
+		\**********************************************************************/
+		Testable::TestResult _checkChunks(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check a reader finds any time across several chunks
+		\**********************************************************************/
+		Testable::TestResult _checkFind(void);
+	};
+
+#endif // SPECTRUMARCHIVE_H
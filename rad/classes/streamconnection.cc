@@ -0,0 +1,273 @@
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <QLocalSocket>
+#include <QSocketNotifier>
+#include <QTcpSocket>
+
+#include <libra.h>
+
+#include "streamconnection.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Most iovecs handed to a single sendmsg()
+\******************************************************************************/
+#define MAX_IOVECS			64
+
+/******************************************************************************\
+|* Linux reports a closed peer with SIGPIPE unless told not to per-call, the
+|* BSDs (and macOS) do it per-socket with SO_NOSIGPIPE
+\******************************************************************************/
+#ifdef MSG_NOSIGNAL
+#  define SEND_FLAGS		MSG_NOSIGNAL
+#else
+#  define SEND_FLAGS		0
+#endif
+
+/******************************************************************************\
+|* Constructor : TCP
+\******************************************************************************/
+StreamConnection::StreamConnection(QTcpSocket *socket,
+								   bool noDelay,
+								   QObject *parent)
+				 :Connection(parent)
+				 ,_tcp(socket)
+				 ,_local(nullptr)
+				 ,_device(socket)
+				 ,_fd((int)socket->socketDescriptor())
+				 ,_writable(nullptr)
+	{
+	int on = noDelay ? 1 : 0;
+	setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	connect(_tcp, &QTcpSocket::disconnected,
+			this, &Connection::disconnected);
+	_init();
+	}
+
+/******************************************************************************\
+|* Constructor : Unix-domain
+\******************************************************************************/
+StreamConnection::StreamConnection(QLocalSocket *socket, QObject *parent)
+				 :Connection(parent)
+				 ,_tcp(nullptr)
+				 ,_local(socket)
+				 ,_device(socket)
+				 ,_fd((int)socket->socketDescriptor())
+				 ,_writable(nullptr)
+	{
+	connect(_local, &QLocalSocket::disconnected,
+			this, &Connection::disconnected);
+	_init();
+	}
+
+/******************************************************************************\
+|* Common setup
+\******************************************************************************/
+void StreamConnection::_init(void)
+	{
+	_device->setParent(this);
+
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt(_fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	_writable = new QSocketNotifier(_fd, QSocketNotifier::Write, this);
+	_writable->setEnabled(false);
+	connect(_writable, &QSocketNotifier::activated,
+			this, &StreamConnection::_flush);
+
+	connect(_device, &QIODevice::readyRead,
+			this, &StreamConnection::_readCommands);
+	}
+
+/******************************************************************************\
+|* Describe the peer
+\******************************************************************************/
+QString StreamConnection::identifier(void) const
+	{
+	if (_tcp)
+		return QStringLiteral("tcp:%1:%2").arg(_tcp->peerAddress().toString(),
+											   QString::number(_tcp->peerPort()));
+	return QStringLiteral("unix:%1").arg(_fd);
+	}
+
+/******************************************************************************\
+|* Send a message: header and payload go as separate ranges of the same
+|* shared buffer
+\******************************************************************************/
+void StreamConnection::sendMessage(const QByteArray& msg)
+	{
+	if (_append(msg))
+		_flush();
+	}
+
+/******************************************************************************\
+|* Send a run of messages. They're all queued before anything is written, so
+|* the kernel gets them in as few sendmsg() calls as the iovec limit allows
+\******************************************************************************/
+void StreamConnection::sendBatch(const QList<QByteArray>& msgs)
+	{
+	bool any = false;
+	for (const QByteArray& msg : msgs)
+		any = _append(msg) || any;
+
+	if (any)
+		_flush();
+	}
+
+/******************************************************************************\
+|* Send text, wrapped in a TYPE_TEXT message
+\******************************************************************************/
+void StreamConnection::sendText(const QString& text)
+	{
+	QByteArray payload	= text.toUtf8();
+
+	Preamble hdr;
+	hdr.type			= TYPE_TEXT;
+	hdr.extent			= payload.size();
+	QByteArray header(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+
+	_pending.append({header, 0, header.size()});
+	_pending.append({payload, 0, payload.size()});
+	_flush();
+	}
+
+/******************************************************************************\
+|* Close the connection. There's no close reason on a plain stream
+\******************************************************************************/
+void StreamConnection::close(const QString& reason)
+	{
+	LOG << "Closing" << identifier() << ":" << reason;
+	_pending.clear();
+	_writable->setEnabled(false);
+
+	if (_tcp)
+		_tcp->disconnectFromHost();
+	else
+		_local->disconnectFromServer();
+	}
+
+/******************************************************************************\
+|* Cork/uncork a TCP connection
+\******************************************************************************/
+void StreamConnection::cork(bool on)
+	{
+	if (_tcp == nullptr)
+		return;
+
+	int value = on ? 1 : 0;
+#if defined(TCP_CORK)
+	setsockopt(_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#elif defined(TCP_NOPUSH)
+	setsockopt(_fd, IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value));
+#else
+	Q_UNUSED(value);
+#endif
+	}
+
+/******************************************************************************\
+|* Private method: queue the header and payload of a message for writing
+\******************************************************************************/
+bool StreamConnection::_append(const QByteArray& msg)
+	{
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	int end				= hdr->offset + hdr->extent;
+
+	if (end > msg.size())
+		{
+		ERR << "Message claims" << end << "bytes but has" << msg.size();
+		return false;
+		}
+
+	_pending.append({msg, 0, hdr->offset});
+	_pending.append({msg, hdr->offset, end});
+	return true;
+	}
+
+/******************************************************************************\
+|* Private method: write as much of the pending data as the kernel will take
+\******************************************************************************/
+void StreamConnection::_flush(void)
+	{
+	while (!_pending.isEmpty())
+		{
+		struct iovec iov[MAX_IOVECS];
+		int num = 0;
+		for (const Chunk& chunk : qAsConst(_pending))
+			{
+			if (num == MAX_IOVECS)
+				break;
+			iov[num].iov_base	= const_cast<char *>(chunk.data.constData())
+								+ chunk.from;
+			iov[num].iov_len	= chunk.to - chunk.from;
+			num ++;
+			}
+
+		struct msghdr mh;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov		= iov;
+		mh.msg_iovlen	= num;
+
+		ssize_t done = sendmsg(_fd, &mh, SEND_FLAGS);
+		if (done < 0)
+			{
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				{
+				ERR << "Write to" << identifier() << "failed:" << strerror(errno);
+				_pending.clear();
+				}
+			break;
+			}
+
+		emit bytesWritten(done);
+
+		/**********************************************************************\
+		|* Retire whatever was written
+		\**********************************************************************/
+		while ((done > 0) && !_pending.isEmpty())
+			{
+			Chunk& chunk	= _pending.first();
+			int left		= chunk.to - chunk.from;
+			if (done >= left)
+				{
+				done -= left;
+				_pending.removeFirst();
+				}
+			else
+				{
+				chunk.from += done;
+				done		= 0;
+				}
+			}
+		}
+
+	_writable->setEnabled(!_pending.isEmpty());
+	}
+
+/******************************************************************************\
+|* Read command lines from the client
+\******************************************************************************/
+void StreamConnection::_readCommands(void)
+	{
+	while (_device->canReadLine())
+		{
+		QString line = QString::fromUtf8(_device->readLine()).trimmed();
+		if (line.length() > 0)
+			emit textReceived(line);
+		}
+	}
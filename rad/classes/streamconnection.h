@@ -0,0 +1,85 @@
+#ifndef STREAMCONNECTION_H
+#define STREAMCONNECTION_H
+
+#include <QByteArray>
+#include <QList>
+
+#include "connection.h"
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+QT_FORWARD_DECLARE_CLASS(QLocalSocket)
+QT_FORWARD_DECLARE_CLASS(QSocketNotifier)
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+
+/******************************************************************************\
+|* A client connected over plain TCP or a Unix-domain socket. There's no
+|* framing beyond the Preamble: the stream is just one message after another,
+|* each being {offset} bytes of header then {extent} bytes of payload. Replies
+|* to commands go the same way, as TYPE_TEXT messages holding UTF-8 JSON.
+|* Commands from the client are newline-terminated lines of text.
+|*
+|* Writes bypass Qt's socket buffer and go straight to the descriptor with
+|* sendmsg(), with the header and payload as separate iovecs so nothing is
+|* concatenated. Anything the kernel won't take yet is kept (by reference, the
+|* messages are shared) and flushed when the socket becomes writable
+\******************************************************************************/
+class StreamConnection : public Connection
+	{
+	Q_OBJECT
+
+	private:
+		/**********************************************************************\
+		|* A range of a shared buffer still to be written
+		\**********************************************************************/
+		typedef struct
+			{
+			QByteArray	data;			// Keeps the buffer alive
+			int			from;			// First byte still to go
+			int			to;				// One past the last byte
+			} Chunk;
+
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QTcpSocket *		_tcp;		// Set if this is a TCP connection
+		QLocalSocket *		_local;		// Set if this is a Unix connection
+		QIODevice *			_device;	// Whichever of the above it is
+		int					_fd;		// The descriptor we write to
+		QSocketNotifier *	_writable;	// Fires when we can write more
+		QList<Chunk>		_pending;	// Waiting for the kernel
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		void _init(void);
+		bool _append(const QByteArray& msg);
+		void _flush(void);
+
+	private slots:
+		/**********************************************************************\
+		|* Read command lines from the client
+		\**********************************************************************/
+		void _readCommands(void);
+
+	public:
+		/**********************************************************************\
+		|* Constructors. We take ownership of the socket
+		\**********************************************************************/
+		explicit StreamConnection(QTcpSocket *socket,
+								  bool noDelay,
+								  QObject *parent = nullptr);
+		explicit StreamConnection(QLocalSocket *socket,
+								  QObject *parent = nullptr);
+
+		/**********************************************************************\
+		|* Connection interface
+		\**********************************************************************/
+		QString identifier(void) const override;
+		void sendMessage(const QByteArray& msg) override;
+		void sendText(const QString& text) override;
+		void sendBatch(const QList<QByteArray>& msgs) override;
+		void close(const QString& reason) override;
+		void cork(bool on) override;
+	};
+
+#endif // STREAMCONNECTION_H
@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include <QJsonArray>
+#include <QMap>
+
+#include <libra.h>
+
+#include "subscription.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG qDebug(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR qCritical(log_net) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Names used on the wire for the products
+\******************************************************************************/
+static QMap<QString, PreambleType> _productNames(void)
+	{
+	return	{
+			{"update", TYPE_UPDATE},
+			{"sample", TYPE_SAMPLE},
+			{"live", TYPE_LIVE},
+			{"vis-update", TYPE_VIS_UPDATE},
+			{"vis-sample", TYPE_VIS_SAMPLE},
+			{"sweep", TYPE_SWEEP},
+			};
+	}
+
+static const char * _encodingNames[] = {"f32", "f16", "u16", "u8"};
+
+#define ALL_PRODUCTS	((1U << TYPE_UPDATE)|(1U << TYPE_SAMPLE)|(1U << TYPE_LIVE)\
+						|(1U << TYPE_SWEEP))
+#define MAX_CHANNEL		65535
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+Subscription::Subscription(void)
+			 :_products(ALL_PRODUCTS)
+			 ,_channels()
+			 ,_binLo(0)
+			 ,_binHi(-1)
+			 ,_decimate(1)
+			 ,_reduce(REDUCE_MEAN)
+			 ,_encoding(SpectrumCodec::ENC_F32)
+			 ,_delta(false)
+			 ,_compress(false)
+	{}
+
+/******************************************************************************\
+|* Update from a JSON command
+\******************************************************************************/
+bool Subscription::parse(const QJsonObject& cmd, QString& error)
+	{
+	uint32_t products	= _products;
+	QSet<int> channels	= _channels;
+	int binLo			= cmd.value("binLo").toInt(_binLo);
+	int binHi			= cmd.value("binHi").toInt(_binHi);
+	int decimate		= cmd.value("decimate").toInt(_decimate);
+	Reduction reduce	= _reduce;
+	int encoding		= _encoding;
+	bool delta			= cmd.value("delta").toBool(_delta);
+	bool compress		= cmd.value("compress").toBool(_compress);
+
+	if (cmd.contains("products"))
+		{
+		QMap<QString, PreambleType> names = _productNames();
+		products = 0;
+		for (const QJsonValue& product : cmd.value("products").toArray())
+			{
+			QString name = product.toString().toLower();
+			if (!names.contains(name))
+				{
+				error = "Unknown product '" + name + "'";
+				return false;
+				}
+			products |= 1U << names[name];
+			}
+		}
+
+	if (cmd.contains("channels"))
+		{
+		channels.clear();
+		for (const QJsonValue& channel : cmd.value("channels").toArray())
+			{
+			int num = channel.toInt(-1);
+			if ((num < 0) || (num > MAX_CHANNEL))
+				{
+				error = QString("Bad channel %1").arg(num);
+				return false;
+				}
+			channels.insert(num);
+			}
+		}
+
+	if (cmd.contains("reduce"))
+		{
+		QString name = cmd.value("reduce").toString().toLower();
+		if (name == "mean")
+			reduce = REDUCE_MEAN;
+		else if (name == "max")
+			reduce = REDUCE_MAX;
+		else
+			{
+			error = "Unknown reduction '" + name + "'";
+			return false;
+			}
+		}
+
+	if (cmd.contains("encoding"))
+		{
+		QString name	= cmd.value("encoding").toString();
+		encoding		= SpectrumCodec::formatFor(name);
+		if (encoding < 0)
+			{
+			error = "Unknown encoding '" + name + "'";
+			return false;
+			}
+		}
+
+	if ((binLo < 0) || ((binHi >= 0) && (binHi < binLo)))
+		{
+		error = QString("Bad bin range %1 -> %2").arg(binLo).arg(binHi);
+		return false;
+		}
+
+	if ((decimate < 1) || (decimate > 65535))
+		{
+		error = QString("Bad decimation %1").arg(decimate);
+		return false;
+		}
+
+	_products	= products;
+	_channels	= channels;
+	_binLo		= binLo;
+	_binHi		= binHi;
+	_decimate	= decimate;
+	_reduce		= reduce;
+	_encoding	= encoding;
+	_delta		= delta;
+	_compress	= compress;
+	return true;
+	}
+
+/******************************************************************************\
+|* Describe the subscription as JSON
+\******************************************************************************/
+QJsonObject Subscription::toJson(void) const
+	{
+	QJsonArray products;
+	QMap<QString, PreambleType> names = _productNames();
+	for (const QString& name : names.keys())
+		if (wants(names[name]))
+			products.append(name);
+
+	QList<int> numbers = _channels.values();
+	std::sort(numbers.begin(), numbers.end());
+
+	QJsonArray channels;
+	for (int channel : numbers)
+		channels.append(channel);
+
+	QJsonObject json;
+	json.insert("products", products);
+	json.insert("channels", channels);
+	json.insert("binLo", _binLo);
+	json.insert("binHi", _binHi);
+	json.insert("decimate", _decimate);
+	json.insert("reduce", (_reduce == REDUCE_MAX) ? "max" : "mean");
+	json.insert("encoding", _encodingNames[_encoding]);
+	json.insert("delta", _delta);
+	json.insert("compress", _compress);
+	return json;
+	}
+
+/******************************************************************************\
+|* Does the client want this type of message, and from this channel
+\******************************************************************************/
+bool Subscription::wants(int type) const
+	{
+	return (_products & (1U << type)) != 0;
+	}
+
+bool Subscription::wants(int type, int channel) const
+	{
+	return wants(type)
+		&& (_channels.isEmpty() || _channels.contains(channel));
+	}
+
+/******************************************************************************\
+|* Identify one product of one channel. Types fit in a byte, channels in 16
+|* bits, so every stream has its own number
+\******************************************************************************/
+int Subscription::stream(int type, int channel)
+	{
+	return (channel << 8) | (type & 0xFF);
+	}
+
+/******************************************************************************\
+|* Identify the view
+\******************************************************************************/
+QString Subscription::key(void) const
+	{
+	return QString("%1:%2:%3:%4:%5:%6:%7").arg(_binLo)
+										  .arg(_binHi)
+										  .arg(_decimate)
+										  .arg((int)_reduce)
+										  .arg(_encoding)
+										  .arg((int)_delta)
+										  .arg((int)_compress);
+	}
+
+/******************************************************************************\
+|* Make a codec for one product of this view
+\******************************************************************************/
+SpectrumCodec Subscription::codec(void) const
+	{
+	return SpectrumCodec(_encoding, _delta, _compress);
+	}
+
+/******************************************************************************\
+|* Produce the view of a full-resolution message
+\******************************************************************************/
+QByteArray Subscription::render(const QByteArray& msg) const
+	{
+	const Preamble *in	= reinterpret_cast<const Preamble *>(msg.constData());
+	const float *src	= reinterpret_cast<const float *>
+							(msg.constData() + in->offset);
+	int num				= in->extent / sizeof(float);
+
+	/**************************************************************************\
+	|* Work out the range we're actually going to send
+	\**************************************************************************/
+	int lo				= (_binLo < num) ? _binLo : num - 1;
+	int hi				= ((_binHi < 0) || (_binHi >= num)) ? num - 1 : _binHi;
+	int dec				= _decimate;
+
+	if (num == 0)
+		return msg;
+
+	if ((lo == 0) && (hi == num - 1) && (dec == 1))
+		return msg;
+
+	int count			= (hi - lo + dec) / dec;
+	uint32_t extent		= count * sizeof(float);
+
+	/**************************************************************************\
+	|* Start with the incoming header so anything we don't know about is kept
+	\**************************************************************************/
+	QByteArray out(sizeof(Preamble) + extent, Qt::Uninitialized);
+	Preamble *hdr		= new (out.data()) Preamble();
+	*hdr				= *in;
+	hdr->offset			= sizeof(Preamble);
+	hdr->extent			= extent;
+	hdr->values			= count;
+	hdr->binLo			= in->binLo + lo * in->decimate;
+	hdr->decimate		= in->decimate * dec;
+
+	float *dst			= reinterpret_cast<float *>(out.data() + hdr->offset);
+
+	/**************************************************************************\
+	|* Fold each group of bins. The last group may be short
+	\**************************************************************************/
+	for (int i=0; i<count; i++)
+		{
+		const float *group	= src + lo + i * dec;
+		int n				= hi + 1 - (lo + i * dec);
+		n					= (n < dec) ? n : dec;
+
+		float value			= group[0];
+		if (_reduce == REDUCE_MAX)
+			{
+			for (int j=1; j<n; j++)
+				value = (group[j] > value) ? group[j] : value;
+			}
+		else
+			{
+			for (int j=1; j<n; j++)
+				value += group[j];
+			value /= n;
+			}
+		dst[i] = value;
+		}
+
+	return out;
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int Subscription::numTests(void)
+	{
+	return 3;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * Subscription::testClassName(void)
+	{
+	return "Subscription";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult Subscription::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkMeanRange();
+		case 1:
+			return _checkMaxAndPassThrough();
+		case 2:
+			return _checkChannels();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test helper : make a message where bin i holds the value i
+\******************************************************************************/
+static QByteArray _ramp(int num)
+	{
+	QByteArray msg(sizeof(Preamble) + num * sizeof(float), Qt::Uninitialized);
+	Preamble *hdr	= new (msg.data()) Preamble();
+	hdr->extent		= num * sizeof(float);
+	hdr->type		= TYPE_UPDATE;
+	hdr->bins		= num;
+	hdr->values		= num;
+
+	float *data		= reinterpret_cast<float *>(msg.data() + hdr->offset);
+	for (int i=0; i<num; i++)
+		data[i] = i;
+	return msg;
+	}
+
+/******************************************************************************\
+|* Test interface : bins 10..20 by 4 should give means of {10-13}, {14-17},
+|* {18-20}
+\******************************************************************************/
+Testable::TestResult Subscription::_checkMeanRange(void)
+	{
+	Subscription sub;
+	QString error;
+	QJsonObject cmd;
+	cmd.insert("binLo", 10);
+	cmd.insert("binHi", 20);
+	cmd.insert("decimate", 4);
+
+	if (!sub.parse(cmd, error))
+		{
+		ERR << "Parse failed:" << error;
+		return Testable::TEST_FAIL;
+		}
+
+	QByteArray out		= sub.render(_ramp(64));
+	const Preamble *hdr	= reinterpret_cast<const Preamble *>(out.constData());
+	const float *data	= reinterpret_cast<const float *>
+							(out.constData() + hdr->offset);
+
+	bool ok = (hdr->extent == 3 * sizeof(float))
+		   && (hdr->binLo == 10) && (hdr->decimate == 4) && (hdr->bins == 64)
+		   && (fabs(data[0] - 11.5) < 1e-6)
+		   && (fabs(data[1] - 15.5) < 1e-6)
+		   && (fabs(data[2] - 19.0) < 1e-6);
+
+	if (!ok)
+		ERR << "Mean range gave" << hdr->extent / sizeof(float) << "values:"
+			<< data[0] << data[1] << data[2];
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : max by 8 over everything, and the default subscription
+|* should hand back the very same buffer
+\******************************************************************************/
+Testable::TestResult Subscription::_checkMaxAndPassThrough(void)
+	{
+	QByteArray in		= _ramp(64);
+
+	Subscription full;
+	if (full.render(in).constData() != in.constData())
+		{
+		ERR << "Full-resolution subscription copied the message";
+		return Testable::TEST_FAIL;
+		}
+
+	Subscription sub;
+	QString error;
+	QJsonObject cmd;
+	cmd.insert("decimate", 8);
+	cmd.insert("reduce", "max");
+	sub.parse(cmd, error);
+
+	QByteArray out		= sub.render(in);
+	const Preamble *hdr	= reinterpret_cast<const Preamble *>(out.constData());
+	const float *data	= reinterpret_cast<const float *>
+							(out.constData() + hdr->offset);
+
+	bool ok = (hdr->extent == 8 * sizeof(float));
+	for (int i=0; ok && i<8; i++)
+		ok = (data[i] == i * 8 + 7);
+
+	if (!ok)
+		ERR << "Max reduction failed";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : Check a client gets all channels until it picks some,
+|* that channels past 31 are told apart, and a bad channel leaves the
+|* subscription as it was
+\******************************************************************************/
+Testable::TestResult Subscription::_checkChannels(void)
+	{
+	Subscription sub;
+	QString error;
+	bool ok = sub.wants(TYPE_UPDATE, 0) && sub.wants(TYPE_UPDATE, 40);
+
+	QJsonObject cmd;
+	cmd.insert("channels", QJsonArray({0, 2, 40}));
+	ok = ok && sub.parse(cmd, error)
+			&& sub.wants(TYPE_UPDATE, 0)
+			&& !sub.wants(TYPE_UPDATE, 1)
+			&& sub.wants(TYPE_UPDATE, 2)
+			&& sub.wants(TYPE_UPDATE, 40)
+			&& !sub.wants(TYPE_UPDATE, 32)
+			&& !sub.wants(TYPE_UPDATE, 8);
+
+	cmd.insert("channels", QJsonArray({1, 70000}));
+	ok = ok && !sub.parse(cmd, error)
+			&& sub.wants(TYPE_UPDATE, 2)
+			&& !sub.wants(TYPE_UPDATE, 1);
+
+	ok = ok && (stream(TYPE_UPDATE, 8) != stream(TYPE_UPDATE, 0))
+			&& (stream(TYPE_LIVE, 40) != stream(TYPE_LIVE, 32));
+
+	if (!ok)
+		ERR << "Channel selection failed";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
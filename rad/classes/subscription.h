@@ -0,0 +1,140 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QSet>
+#include <QString>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* A subscription is what one client wants to see: which products, from which
+|* channels, which range of bins, and how many bins to fold into each value it
+|* receives. Clients send it as a JSON text message:
+|*
+|*	{"cmd":"subscribe", "products":["update","live"], "channels":[0,2],
+|*	 "binLo":200, "binHi":800, "decimate":4, "reduce":"max",
+|*	 "encoding":"u8", "delta":true, "compress":true}
+|*
+|* Any field can be left out to keep its default, which is everything at full
+|* resolution - the same as a client that never subscribes. binHi is
+|* inclusive, and -1 means the last bin.
+|*
+|* The encoding fields select a SpectrumCodec for the wire: "f32", "f16",
+|* "u16" or "u8", optionally delta-coded between keyframes and compressed.
+|*
+|* Channels are the streams of the radios, numbered from 0 to 65535 as the
+|* Preamble carries them; an empty list means all of them.
+|*
+|* Two subscriptions that differ only in products or channels render the same
+|* view, so the view key deliberately leaves them out
+\******************************************************************************/
+class Subscription : public Testable
+	{
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		typedef enum
+			{
+			REDUCE_MEAN	= 0,
+			REDUCE_MAX
+			} Reduction;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(uint32_t, products);			// Bitmask of (1 << PreambleType)
+	GET(QSet<int>, channels);			// Channels wanted, empty = all
+	GET(int, binLo);					// First bin to send
+	GET(int, binHi);					// Last bin to send, -1 = all
+	GET(int, decimate);					// Bins per value sent
+	GET(Reduction, reduce);				// How to fold bins together
+	GET(int, encoding);					// SpectrumCodec format
+	GET(bool, delta);					// Delta-code between keyframes
+	GET(bool, compress);				// Compress the payload
+
+	public:
+		/**********************************************************************\
+		|* Constructor
+		\**********************************************************************/
+		Subscription(void);
+
+		/**********************************************************************\
+		|* Update from a JSON command, returns false and sets error if the
+		|* command doesn't make sense, in which case nothing is changed
+		\**********************************************************************/
+		bool parse(const QJsonObject& cmd, QString& error);
+
+		/**********************************************************************\
+		|* Describe the subscription as JSON, to confirm it to the client
+		\**********************************************************************/
+		QJsonObject toJson(void) const;
+
+		/**********************************************************************\
+		|* Does the client want this type of message, from this channel
+		\**********************************************************************/
+		bool wants(int type) const;
+		bool wants(int type, int channel) const;
+
+		/**********************************************************************\
+		|* Identify one product of one channel, eg: to track which of them a
+		|* client has been sent a keyframe for
+		\**********************************************************************/
+		static int stream(int type, int channel);
+
+		/**********************************************************************\
+		|* Identify the view, so identical ones can be rendered once
+		\**********************************************************************/
+		QString key(void) const;
+
+		/**********************************************************************\
+		|* Return the message for this view from a full-resolution message. If
+		|* nothing needs to change, the original (shared) message is returned
+		\**********************************************************************/
+		QByteArray render(const QByteArray& msg) const;
+
+		/**********************************************************************\
+		|* Make a codec for one product of this view
+		\**********************************************************************/
+		SpectrumCodec codec(void) const;
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check a range with a partial last group, reduced by mean
+		\**********************************************************************/
+		Testable::TestResult _checkMeanRange(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check max-reduction and that full-res is passed through
+		\**********************************************************************/
+		Testable::TestResult _checkMaxAndPassThrough(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check channels are selected, and bad ones refused
+		\**********************************************************************/
+		Testable::TestResult _checkChannels(void);
+	};
+
+#endif // SUBSCRIPTION_H
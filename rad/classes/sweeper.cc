@@ -0,0 +1,325 @@
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include <libra.h>
+
+#include "rfifilter.h"
+#include "sweeper.h"
+
+/******************************************************************************\
+|* Categorised logging support
+\******************************************************************************/
+#define LOG  qDebug(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define WARN qWarning(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+#define ERR	 qCritical(log_dsp) << QTime::currentTime().toString("hh:mm:ss.zzz")
+
+/******************************************************************************\
+|* Constructor. Plan the hops: trim the edges, and step by what's left
+\******************************************************************************/
+Sweeper::Sweeper(int from,
+				 int to,
+				 int sampleRate,
+				 int fftSize,
+				 double crop,
+				 QObject *parent)
+		:QObject(parent)
+		,_from(from)
+		,_sampleRate(sampleRate)
+		,_fftSize(fftSize)
+		,_edge(0)
+		,_kept(fftSize)
+		,_hops(1)
+		,_bins(fftSize)
+		,_span(sampleRate)
+		,_sweeps(0)
+		,_floor(0)
+	{
+	_edge	= qBound(0, (int)lround(fftSize * crop / 2), fftSize / 2 - 1);
+	_kept	= fftSize - 2 * _edge;
+	_span	= _kept * (double)sampleRate / fftSize;
+	_hops	= qMax(1, (int)ceil((to - from) / _span));
+	_bins	= _hops * _kept;
+
+	LOG << "Sweeping" << from << "to" << this->to() << "Hz in" << _hops
+		<< "hops of" << _span << "Hz," << _bins << "bins";
+	}
+
+/******************************************************************************\
+|* Destructor
+\******************************************************************************/
+Sweeper::~Sweeper(void)
+	{
+	_clear();
+	}
+
+/******************************************************************************\
+|* The frequency to tune to for a hop. Its kept bins start at from + n.span,
+|* and the first of them is {edge} bins into the FFT, whose centre is half-way
+\******************************************************************************/
+int Sweeper::frequency(int64_t hop)
+	{
+	int n		= (int)(hop % _hops);
+	double bin	= (double)_sampleRate / _fftSize;
+	return (int)llround(_from + n * _span + (_fftSize / 2 - _edge) * bin);
+	}
+
+/******************************************************************************\
+|* The frequency the stitched spectrum stops at
+\******************************************************************************/
+int Sweeper::to(void)
+	{
+	return (int)llround(_from + _hops * _span);
+	}
+
+/******************************************************************************\
+|* Add the magnitude of the kept bins into a sum. This is the same display
+|* magnitude the RFI filter gives the other products, so a sweep looks like
+|* a spectrum. No branches in the loop, so that the compiler can vectorise it
+\******************************************************************************/
+void Sweeper::accumulate(const fftw_complex *data,
+						 double *sum,
+						 int first,
+						 int bins)
+	{
+	const fftw_complex *src = data + first;
+	for (int i=0; i<bins; i++)
+		{
+		sum[i]		+= RFIFilter::magnitude(src[i][0], src[i][1]);
+		}
+	}
+
+/******************************************************************************\
+|* A frame has arrived. Frames from a sweep that's already been given up on
+|* are dropped
+\******************************************************************************/
+void Sweeper::frameReady(int64_t hop, int buffer)
+	{
+	DataMgr &dmgr		= DataMgr::instance();
+	fftw_complex *data	= dmgr.asFFT(buffer);
+
+	if ((data == nullptr) || (hop / _hops < _floor))
+		{
+		dmgr.release(buffer);
+		return;
+		}
+
+	Hop& h = _hop(hop);
+	accumulate(data, h.sum, _edge, _kept);
+	h.frames ++;
+	dmgr.release(buffer);
+
+	if ((h.expected >= 0) && (h.frames >= h.expected))
+		_complete(hop);
+	}
+
+/******************************************************************************\
+|* The processor has moved on from a hop. Its frames may all be in already,
+|* or some may still be in the FFT workers
+\******************************************************************************/
+void Sweeper::hopDone(int64_t hop, int frames)
+	{
+	if (hop / _hops < _floor)
+		return;
+
+	Hop& h		= _hop(hop);
+	h.expected	= frames;
+	if (h.frames >= h.expected)
+		_complete(hop);
+	}
+
+/******************************************************************************\
+|* Private method: the accumulator for a hop, made if need be
+\******************************************************************************/
+Sweeper::Hop& Sweeper::_hop(int64_t hop)
+	{
+	if (!_pending.contains(hop))
+		_pending.insert(hop, {new double[_kept](), 0, -1});
+	return _pending[hop];
+	}
+
+/******************************************************************************\
+|* Private method: a hop has all its frames. Write its average into its place
+|* in the sweep, and send the sweep if that was the last hop it needed. A
+|* sweep that's still waiting when it's too far behind has lost frames, so it
+|* won't ever be complete, and goes
+\******************************************************************************/
+void Sweeper::_complete(int64_t hop)
+	{
+	Hop h			= _pending.take(hop);
+	int64_t sweep	= hop / _hops;
+
+	if (!_rows.contains(sweep))
+		_rows.insert(sweep, {QVector<float>(_bins, 0.0f), 0});
+	Row& row		= _rows[sweep];
+
+	float *dst		= row.values.data() + (hop % _hops) * _kept;
+	double scale	= (h.frames > 0) ? 1.0 / h.frames : 0.0;
+	for (int i=0; i<_kept; i++)
+		dst[i] = (float)(h.sum[i] * scale);
+	delete [] h.sum;
+	row.filled ++;
+
+	if (row.filled == _hops)
+		{
+		uint32_t extent	= _bins * sizeof(float);
+		QByteArray msg(sizeof(Preamble) + extent, Qt::Uninitialized);
+
+		Preamble *hdr	= new (msg.data()) Preamble();
+		hdr->extent		= extent;
+		hdr->type		= TYPE_SWEEP;
+		hdr->bins		= _bins;
+		hdr->values		= _bins;
+		memcpy(msg.data() + hdr->offset, row.values.constData(), extent);
+
+		_rows.remove(sweep);
+		_sweeps ++;
+		emit sweepReady(msg);
+		}
+
+	while (_rows.size() > MAX_SWEEPS)
+		{
+		int64_t oldest = _rows.firstKey();
+		WARN << "Sweep" << oldest << "lost frames, dropping it";
+		_rows.remove(oldest);
+		_floor = oldest + 1;
+		}
+
+	while (!_pending.isEmpty() && (_pending.firstKey() / _hops < _floor))
+		delete [] _pending.take(_pending.firstKey()).sum;
+	}
+
+/******************************************************************************\
+|* Private method: give back the accumulators
+\******************************************************************************/
+void Sweeper::_clear(void)
+	{
+	for (const Hop& h : qAsConst(_pending))
+		delete [] h.sum;
+	_pending.clear();
+	_rows.clear();
+	}
+
+
+/******************************************************************************\
+|* Test interface : Return the number of tests we implement
+\******************************************************************************/
+int Sweeper::numTests(void)
+	{
+	return 2;
+	}
+
+/******************************************************************************\
+|* Test interface : identify the class being tested
+\******************************************************************************/
+const char * Sweeper::testClassName(void)
+	{
+	return "Sweeper";
+	}
+
+/******************************************************************************\
+|* Test interface : Run a given test
+\******************************************************************************/
+Testable::TestResult Sweeper::runTest(int idx)
+	{
+	switch (idx)
+		{
+		case 0:
+			return _checkPlan();
+		case 1:
+			return _checkStitch();
+		}
+
+	ERR << "Test requested outside of range";
+	return Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : 100-110 MHz at 2 MHz with 64 bins and a quarter cropped
+|* keeps 48 bins (1.5 MHz) of each hop, so it takes 7 hops. Each hop's kept
+|* bins should start where the last one's stopped
+\******************************************************************************/
+Testable::TestResult Sweeper::_checkPlan(void)
+	{
+	Sweeper plan(100000000, 110000000, 2000000, 64, 0.25);
+	double bin	= 2000000.0 / 64;
+	bool ok		= (plan.edge() == 8)
+				&& (plan.kept() == 48)
+				&& (plan.hops() == 7)
+				&& (plan.bins() == 7 * 48)
+				&& (plan.to() >= 110000000);
+
+	for (int n=0; ok && (n<plan.hops()); n++)
+		{
+		double start	= plan.frequency(n) + (plan.edge() - 32) * bin;
+		ok				= (fabs(start - (100000000 + n * 1500000.0)) <= 1)
+						&& (plan.frequency(n + plan.hops()) == plan.frequency(n));
+		}
+
+	if (!ok)
+		ERR << "Planned" << plan.hops() << "hops of" << plan.kept()
+			<< "bins, or they don't tile the range";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
+
+/******************************************************************************\
+|* Test interface : three hops of a 16-bin FFT keeping 12 bins each. Each hop
+|* has its own level in the kept bins and a huge one in the edges, which
+|* shouldn't show. Frames come in out of order, and one hop is done before
+|* any of its frames are in. Only the last call should complete the sweep
+\******************************************************************************/
+Testable::TestResult Sweeper::_checkStitch(void)
+	{
+	DataMgr &dmgr		= DataMgr::instance();
+	const int size		= 16;
+	Sweeper sweep(1000000, 4600000, 1600000, size, 0.25);
+
+	QList<QByteArray> msgs;
+	connect(&sweep, &Sweeper::sweepReady, this,
+			[&msgs](QByteArray msg) { msgs.append(msg); },
+			Qt::DirectConnection);
+
+	auto frame = [&](int64_t hop, double level)
+		{
+		int64_t buffer		= dmgr.fftBlockFor(size);
+		fftw_complex *data	= dmgr.asFFT(buffer);
+		for (int i=0; i<size; i++)
+			{
+			bool edge	= (i < sweep.edge()) || (i >= sweep.edge() + sweep.kept());
+			data[i][0]	= edge ? 1e6 : level;
+			data[i][1]	= 0;
+			}
+		sweep.frameReady(hop, buffer);
+		};
+
+	frame(1, 3);
+	sweep.hopDone(0, 2);
+	frame(0, 1);
+	frame(2, 7);
+	frame(1, 5);
+	sweep.hopDone(1, 2);
+	bool ok = msgs.isEmpty();
+	frame(0, 2);
+	ok = ok && msgs.isEmpty();
+	sweep.hopDone(2, 1);
+
+	ok = ok && (sweep.kept() == 12) && (sweep.hops() == 3) && (msgs.size() == 1);
+	if (ok)
+		{
+		const Preamble *hdr	= reinterpret_cast<const Preamble *>(msgs[0].constData());
+		const float *values	= reinterpret_cast<const float *>(msgs[0].constData() + hdr->offset);
+		double levels[3][2]	= {{1, 2}, {3, 5}, {7, 7}};
+
+		ok = (hdr->type == TYPE_SWEEP) && (hdr->values == 36);
+		for (int i=0; ok && (i<36); i++)
+			{
+			double *lv		= levels[i / 12];
+			double expect	= 0.025 * (log(pow(lv[0], 4) + 1) + log(pow(lv[1], 4) + 1));
+			ok				= fabs(values[i] - expect) < 1e-5;
+			}
+		}
+
+	if (!ok)
+		ERR << "Stitched" << msgs.size() << "sweeps, or put the hops in the wrong places";
+	return ok ? Testable::TEST_PASS : Testable::TEST_FAIL;
+	}
@@ -0,0 +1,167 @@
+#ifndef SWEEPER_H
+#define SWEEPER_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QVector>
+
+#include <libra.h>
+
+/******************************************************************************\
+|* Stitches the spectra of a sweep, rtl_power-style, into one wide spectrum.
+|*
+|* The processor steps the tuner through a list of hops, each integrating for
+|* a dwell before moving on. The hops overlap, so that the edges of each
+|* spectrum - where the anti-alias filter rolls off - can be trimmed away and
+|* what's left still tiles the range:
+|*
+|*		|edge|------- kept -------|edge|
+|*		                     |edge|------- kept -------|edge|
+|*
+|* Hop n keeps FFT bins [edge, edge+kept), which start at from + n.span, so
+|* the kept bins of the hops follow on from each other with no gaps and no
+|* overlaps. The last hop may run past the end of the range.
+|*
+|* Every frame is tagged with the hop it came from, counted from the start,
+|* so hop/hops is the sweep and hop%hops the place in it. The FFT workers
+|* finish out of order, and the next hop's frames can start coming in before
+|* the last of this one's, so each hop has an accumulator of its own until
+|* the processor says how many frames it had and they've all arrived. Its
+|* average is then written into its place in the sweep, and a full sweep is
+|* sent as a Preamble followed by one float per bin
+\******************************************************************************/
+class Sweeper : public QObject, public Testable
+	{
+	Q_OBJECT
+
+	public:
+		/**********************************************************************\
+		|* Typedefs and enums
+		\**********************************************************************/
+		static const int	MAX_SWEEPS	= 2;	// Sweeps being stitched at once
+
+		typedef struct
+			{
+			double *		sum;				// Kept bins, summed
+			int				frames;				// Frames in the sum
+			int				expected;			// Frames in the hop, -1 = unknown
+			} Hop;
+
+		typedef struct
+			{
+			QVector<float>	values;				// The stitched spectrum
+			int				filled;				// Hops written into it
+			} Row;
+
+	/**************************************************************************\
+	|* Properties
+	\**************************************************************************/
+	GET(int, from);						// Start of the range, Hz
+	GET(int, sampleRate);				// Sample rate at each hop
+	GET(int, fftSize);					// Bins in each hop's FFT
+	GET(int, edge);						// Bins trimmed from each side
+	GET(int, kept);						// Bins kept from each hop
+	GET(int, hops);						// Hops in a sweep
+	GET(int, bins);						// Bins in the stitched spectrum
+	GET(double, span);					// Hz kept from each hop
+	GET(int64_t, sweeps);				// Sweeps sent
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QMap<int64_t, Hop>	_pending;		// Hop number -> its accumulator
+		QMap<int64_t, Row>	_rows;			// Sweep number -> its spectrum
+		int64_t				_floor;			// Sweeps before this are dropped
+
+		/**********************************************************************\
+		|* Private methods
+		\**********************************************************************/
+		Hop& _hop(int64_t hop);
+		void _complete(int64_t hop);
+		void _clear(void);
+
+	signals:
+		/**********************************************************************\
+		|* A sweep is complete: a Preamble followed by the float values
+		\**********************************************************************/
+		void sweepReady(QByteArray msg);
+
+	public:
+		/**********************************************************************\
+		|* Constructor / Destructor. The sweep covers {from} to {to} Hz, hops
+		|* {sampleRate} wide, trimming {crop} of each hop's FFT of {fftSize}
+		\**********************************************************************/
+		explicit Sweeper(int from,
+						 int to,
+						 int sampleRate,
+						 int fftSize,
+						 double crop,
+						 QObject *parent = nullptr);
+		~Sweeper(void);
+
+		/**********************************************************************\
+		|* The frequency to tune to for a hop
+		\**********************************************************************/
+		int frequency(int64_t hop);
+
+		/**********************************************************************\
+		|* The frequency the stitched spectrum actually stops at
+		\**********************************************************************/
+		int to(void);
+
+		/**********************************************************************\
+		|* Add the display magnitude of {bins} bins of {data}, starting at
+		|* {first}, into {sum}
+		\**********************************************************************/
+		static void accumulate(const fftw_complex *data,
+							   double *sum,
+							   int first,
+							   int bins);
+
+	public slots:
+		/**********************************************************************\
+		|* Receive an FFT frame from {hop}. The sweeper releases the buffer
+		\**********************************************************************/
+		void frameReady(int64_t hop, int bufferId);
+
+		/**********************************************************************\
+		|* The processor has moved on from {hop}, having made {frames} for it
+		\**********************************************************************/
+		void hopDone(int64_t hop, int frames);
+
+
+	/**************************************************************************\
+	|* Test interface
+	\**************************************************************************/
+	public:
+		/**********************************************************************\
+		|* Test i/f: return the number of tests available
+		\**********************************************************************/
+		int numTests(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: return the class name
+		\**********************************************************************/
+		const char * testClassName(void) override;
+
+		/**********************************************************************\
+		|* Test i/f: run a test
+		\**********************************************************************/
+		Testable::TestResult runTest(int idx) override;
+
+	private:
+		/**********************************************************************\
+		|* Test i/f: Check the hops tile the range with their edges trimmed
+		\**********************************************************************/
+		Testable::TestResult _checkPlan(void);
+
+		/**********************************************************************\
+		|* Test i/f: Check frames arriving out of order, and hops finishing
+		|* before their frames are in, stitch into the right places
+		\**********************************************************************/
+		Testable::TestResult _checkStitch(void);
+	};
+
+#endif // SWEEPER_H
@@ -2,6 +2,7 @@
 
 #include <libra.h>
 
+#include "metrics.h"
 #include "taskfft.h"
 
 /******************************************************************************\
@@ -19,6 +20,8 @@ TaskFFT::TaskFFT(void)
 		,_data(-1)
 		,_results(-1)
 		,_window(-1)
+		,_queued(Metrics::now())
+		,_frame(-1)
 	{}
 
 /******************************************************************************\
@@ -30,6 +33,8 @@ TaskFFT::TaskFFT(double *iq, int num)
 		, _data(-1)
 		,_results(-1)
 		,_window(-1)
+		,_queued(Metrics::now())
+		,_frame(-1)
 	{
 	Q_ASSERT(num % 2 == 0);
 
@@ -56,6 +61,8 @@ TaskFFT::TaskFFT(double *iq1, int num1, double *iq2, int num2)
 		,_data(-1)
 		,_results(-1)
 		,_window(-1)
+		,_queued(Metrics::now())
+		,_frame(-1)
 	{
 	// Obtain two buffers, one for the I,Q inputs, one for outputs
 	DataMgr &dmgr		= DataMgr::instance();
@@ -117,9 +124,19 @@ void TaskFFT::run(void)
 	fftw_complex *dst = dmgr.asFFT(_results);
 	fftw_execute_dft(_plan, src, dst);
 
+	Metrics &metrics	= Metrics::instance();
+	metrics.add(Metrics::FFT_FRAMES);
+	metrics.time(Metrics::FFT_TASK, Metrics::now() - _queued);
+
 	/**********************************************************************\
-	|* And tell the world we're done
+	|* And tell the world we're done. The correlator and the RFI filter each
+	|* release the results, so a numbered frame is retained once more
 	\**********************************************************************/
+	if (_frame >= 0)
+		{
+		dmgr.retain(_results);
+		emit frameDone(_frame, _results);
+		}
 	emit fftDone(_results);
 	}
 
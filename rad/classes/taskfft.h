@@ -20,6 +20,8 @@ class TaskFFT : public QObject, public QRunnable, public Testable
 	GET(int64_t, results);					// Buffer: Output from FFT
 	SET(fftw_plan, plan, Plan);				// FFT plan for fftw3
 	GETSET(int64_t, window, Window);		// Buffer: FFT windowing data
+	GET(int64_t, queued);					// When it was made, for metrics
+	GETSET(int64_t, frame, Frame);			// Frame number to correlate, or -1
 
 	private:
 		/**********************************************************************\
@@ -54,6 +56,12 @@ class TaskFFT : public QObject, public QRunnable, public Testable
 		\**********************************************************************/
 		void fftDone(int bufferId);
 
+		/**********************************************************************\
+		|* A numbered frame is done, for the correlator. It's sent before
+		|* fftDone(), with a retain of its own on the buffer
+		\**********************************************************************/
+		void frameDone(int64_t frame, int bufferId);
+
 
 	/**************************************************************************\
 	|* Test interface
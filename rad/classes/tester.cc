@@ -1,4 +1,23 @@
+#include <QDir>
+
+#include "calibrationcache.h"
+#include "clientqueue.h"
+#include "correlator.h"
 #include "datamgr.h"
+#include "fragmentassembler.h"
+#include "iqrecorder.h"
+#include "liveaverage.h"
+#include "metrics.h"
+#include "radiosettings.h"
+#include "replayring.h"
+#include "rfifilter.h"
+#include "sourcefile.h"
+#include "sourcesoapy.h"
+#include "sourcesynthetic.h"
+#include "spectrumarchive.h"
+#include "spectrumcodec.h"
+#include "subscription.h"
+#include "sweeper.h"
 #include "taskfft.h"
 #include "tester.h"
 
@@ -9,6 +28,23 @@ Tester::Tester()
 	{
 	_duts.append(&DataMgr::instance());
 	_duts.append(new TaskFFT);
+	_duts.append(new RFIFilter(64, 128, 4.0));
+	_duts.append(new LiveAverage(64, Config::L_WINDOW, 16));
+	_duts.append(new Subscription);
+	_duts.append(new SpectrumCodec);
+	_duts.append(new ClientQueue);
+	_duts.append(new FragmentAssembler);
+	_duts.append(new ReplayRing);
+	_duts.append(new RadioSettings);
+	_duts.append(&Metrics::instance());
+	_duts.append(new CalibrationCache(QDir::tempPath()));
+	_duts.append(new IQRecorder(QDir::tempPath()));
+	_duts.append(new SpectrumArchive(QDir::tempPath()));
+	_duts.append(new SourceFile(QString()));
+	_duts.append(new SourceSynthetic(QString()));
+	_duts.append(new SourceSoapy);
+	_duts.append(new Correlator);
+	_duts.append(new Sweeper(100000000, 102000000, 1000000, 64, 0.25));
 	}
 
 void Tester::test(void)
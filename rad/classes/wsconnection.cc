@@ -0,0 +1,61 @@
+#include <QtWebSockets>
+
+#include <libra.h>
+
+#include "wsconnection.h"
+
+/******************************************************************************\
+|* Constructor
+\******************************************************************************/
+WsConnection::WsConnection(QWebSocket *socket, QObject *parent)
+			 :Connection(parent)
+			 ,_socket(socket)
+	{
+	_socket->setParent(this);
+
+	connect(_socket, &QWebSocket::textMessageReceived,
+			this, &Connection::textReceived);
+	connect(_socket, &QWebSocket::bytesWritten,
+			this, &Connection::bytesWritten);
+	connect(_socket, &QWebSocket::disconnected,
+			this, &Connection::disconnected);
+	}
+
+/******************************************************************************\
+|* Describe the peer
+\******************************************************************************/
+QString WsConnection::identifier(void) const
+	{
+	return QStringLiteral("ws:%1:%2").arg(_socket->peerAddress().toString(),
+										  QString::number(_socket->peerPort()));
+	}
+
+/******************************************************************************\
+|* Send a message as a single binary frame. A TYPE_TEXT message is unwrapped
+|* and goes as a text frame, the way WebSocket clients expect JSON
+\******************************************************************************/
+void WsConnection::sendMessage(const QByteArray& msg)
+	{
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	if ((msg.size() >= (int)sizeof(Preamble)) && (hdr->type == TYPE_TEXT))
+		_socket->sendTextMessage(QString::fromUtf8(msg.constData() + hdr->offset,
+												   hdr->extent));
+	else
+		_socket->sendBinaryMessage(msg);
+	}
+
+/******************************************************************************\
+|* Send text as a text frame
+\******************************************************************************/
+void WsConnection::sendText(const QString& text)
+	{
+	_socket->sendTextMessage(text);
+	}
+
+/******************************************************************************\
+|* Close the connection
+\******************************************************************************/
+void WsConnection::close(const QString& reason)
+	{
+	_socket->close(QWebSocketProtocol::CloseCodePolicyViolated, reason);
+	}
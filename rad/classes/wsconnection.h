@@ -0,0 +1,37 @@
+#ifndef WSCONNECTION_H
+#define WSCONNECTION_H
+
+#include "connection.h"
+
+QT_FORWARD_DECLARE_CLASS(QWebSocket)
+
+/******************************************************************************\
+|* A client connected over WebSocket. Each message is one binary frame, and
+|* commands are text frames
+\******************************************************************************/
+class WsConnection : public Connection
+	{
+	Q_OBJECT
+
+	private:
+		/**********************************************************************\
+		|* Private variables
+		\**********************************************************************/
+		QWebSocket *		_socket;		// The underlying socket
+
+	public:
+		/**********************************************************************\
+		|* Constructor. We take ownership of the socket
+		\**********************************************************************/
+		explicit WsConnection(QWebSocket *socket, QObject *parent = nullptr);
+
+		/**********************************************************************\
+		|* Connection interface
+		\**********************************************************************/
+		QString identifier(void) const override;
+		void sendMessage(const QByteArray& msg) override;
+		void sendText(const QString& text) override;
+		void close(const QString& reason) override;
+	};
+
+#endif // WSCONNECTION_H
@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include "constants.h"
+#include "correlator.h"
 #include "datamgr.h"
 #include "msgio.h"
 #include "processor.h"
@@ -29,7 +30,7 @@ int main(int argc, char *argv[])
 	/**************************************************************************\
 	|* Set up the processing hierarchy
 	\**************************************************************************/
-	Processor processor(cfg, &a);
+	Processor processor(cfg, 0, &a);
 
 	/**************************************************************************\
 	|* Set up the data stream
@@ -55,12 +56,44 @@ int main(int argc, char *argv[])
 	/**************************************************************************\
 	|* Configure the processor
 	\**************************************************************************/
-	processor.init(&mio);
+	processor.init(&mio, &srcmgr);
+
+	/**************************************************************************\
+	|* Every other stream - a second tuner, or another device - gets a
+	|* processing chain of its own, whose products are tagged with its number
+	\**************************************************************************/
+	QList<Processor *> processors;
+	processors.append(&processor);
+	for (int stream=1; stream<srcmgr.streamCount(); stream++)
+		{
+		Processor *chain = new Processor(cfg, stream, &a);
+		chain->init(&mio, &srcmgr);
+		processors.append(chain);
+		}
+
+	/**************************************************************************\
+	|* The first two chains can also be cross-correlated, for interferometry.
+	|* The correlator gets a thread of its own, since it sees every frame of
+	|* both. A sweep moves the first, so there's nothing to correlate
+	\**************************************************************************/
+	QThread correlatorThread;
+	Correlator *correlator = nullptr;
+	if ((processors.size() > 1) && cfg.correlate() && !cfg.sweeping())
+		{
+		correlator = new Correlator();
+		correlator->moveToThread(&correlatorThread);
+		QObject::connect(correlator, &Correlator::visibilitiesReady,
+						 &mio, &MsgIO::newData);
+		correlatorThread.start();
+
+		processors.at(0)->setCorrelator(correlator);
+		processors.at(1)->setCorrelator(correlator);
+		}
 
 	/**************************************************************************\
 	|* Start streaming data in
 	\**************************************************************************/
-	srcmgr.start(&processor);
+	srcmgr.start(processors);
 
 	return a.exec();
 	}
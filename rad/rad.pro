@@ -1,9 +1,12 @@
 QT -= gui
-QT += websockets sql
+QT += network websockets sql
 
 CONFIG += c++17 console
 CONFIG -= app_bundle
 
+# The per-bin DSP loops are written to be auto-vectorised
+QMAKE_CXXFLAGS_RELEASE += -O3
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
@@ -21,17 +24,34 @@ LIBS += -L/usr/local/lib -lusb-1.0 -lsdrplay_api
 }
 
 SOURCES += \
+        classes/archivereader.cc \
+        classes/calibrationcache.cc \
+        classes/clientqueue.cc \
         classes/config.cc \
+        classes/correlator.cc \
         classes/fftaggregator.cc \
+        classes/iqrecorder.cc \
+        classes/liveaverage.cc \
+        classes/metrics.cc \
         classes/msgio.cc \
+        classes/multicastpublisher.cc \
         classes/processor.cc \
-        classes/soapyio.cc \
-        classes/soapyworker.cc \
+        classes/radiosettings.cc \
+        classes/replayring.cc \
+        classes/rfifilter.cc \
+        classes/sourcefile.cc \
         classes/sourcemgr.cc \
         classes/sourcertlsdr.cc \
         classes/sourcesdrplay.cc \
+        classes/sourcesoapy.cc \
+        classes/sourcesynthetic.cc \
+        classes/spectrumarchive.cc \
+        classes/streamconnection.cc \
+        classes/subscription.cc \
+        classes/sweeper.cc \
         classes/taskfft.cc \
         classes/tester.cc \
+        classes/wsconnection.cc \
         main.cc \
         rtlsdr/librtlsdr.c \
         rtlsdr/tuner_e4k.c \
@@ -55,18 +75,36 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    classes/archivereader.h \
+    classes/calibrationcache.h \
+    classes/clientqueue.h \
     classes/config.h \
+    classes/correlator.h \
+    classes/connection.h \
     classes/fftaggregator.h \
+    classes/iqrecorder.h \
+    classes/liveaverage.h \
+    classes/metrics.h \
     classes/msgio.h \
+    classes/multicastpublisher.h \
     classes/processor.h \
-    classes/soapyio.h \
-    classes/soapyworker.h \
+    classes/radiosettings.h \
+    classes/replayring.h \
+    classes/rfifilter.h \
     classes/sourcebase.h \
+    classes/sourcefile.h \
     classes/sourcemgr.h \
     classes/sourcertlsdr.h \
     classes/sourcesdrplay.h \
+    classes/sourcesoapy.h \
+    classes/sourcesynthetic.h \
+    classes/spectrumarchive.h \
+    classes/streamconnection.h \
+    classes/subscription.h \
+    classes/sweeper.h \
     classes/taskfft.h \
     classes/tester.h \
+    classes/wsconnection.h \
     rtlsdr/reg_field.h \
     rtlsdr/rtl-sdr.h \
     rtlsdr/rtl-sdr_export.h \
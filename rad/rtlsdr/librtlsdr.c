@@ -101,6 +101,9 @@ struct rtlsdr_dev {
 	unsigned char **xfer_buf;
 	rtlsdr_read_async_cb_t cb;
 	void *cb_ctx;
+	rtlsdr_buf_alloc_cb_t buf_alloc;
+	rtlsdr_buf_free_cb_t buf_free;
+	void *buf_ctx;
 	enum rtlsdr_async_status async_status;
 	int async_cancel;
 	int use_zerocopy;
@@ -916,6 +919,18 @@ uint32_t rtlsdr_get_center_freq(rtlsdr_dev_t *dev)
 	return dev->freq;
 }
 
+int rtlsdr_set_fast_retune(rtlsdr_dev_t *dev, int on)
+{
+	if (!dev)
+		return -1;
+
+	if (dev->tuner_type != RTLSDR_TUNER_R820T &&
+	    dev->tuner_type != RTLSDR_TUNER_R828D)
+		return -2;
+
+	return r82xx_set_fast_retune(&dev->r82xx_p, on);
+}
+
 int rtlsdr_set_freq_correction(rtlsdr_dev_t *dev, int ppm)
 {
 	int r = 0;
@@ -1697,15 +1712,50 @@ int rtlsdr_read_sync(rtlsdr_dev_t *dev, void *buf, int len, int *n_read)
 	return libusb_bulk_transfer(dev->devh, 0x81, buf, len, n_read, BULK_TIMEOUT);
 }
 
+/* With an allocator set, the filled buffer is handed to the callback to
+ * keep, and the transfer goes straight back out with a fresh one, so the
+ * samples never need copying out of it. If no fresh buffer can be had,
+ * the samples are dropped and the transfer resubmitted as it was */
+static void _rtlsdr_swap_buffer(rtlsdr_dev_t *dev, struct libusb_transfer *xfer)
+{
+	unsigned int i;
+	unsigned char *full = xfer->buffer;
+	unsigned char *fresh = dev->buf_alloc(dev->xfer_buf_len, dev->buf_ctx);
+
+	if (!fresh) {
+		libusb_submit_transfer(xfer);
+		return;
+	}
+
+	for (i = 0; i < dev->xfer_buf_num; ++i) {
+		if (dev->xfer[i] == xfer) {
+			dev->xfer_buf[i] = fresh;
+			break;
+		}
+	}
+
+	xfer->buffer = fresh;
+	libusb_submit_transfer(xfer); /* resubmit transfer */
+
+	if (dev->cb)
+		dev->cb(full, xfer->actual_length, dev->cb_ctx);
+	else
+		dev->buf_free(full, dev->buf_ctx);
+}
+
 static void LIBUSB_CALL _libusb_callback(struct libusb_transfer *xfer)
 {
 	rtlsdr_dev_t *dev = (rtlsdr_dev_t *)xfer->user_data;
 
 	if (LIBUSB_TRANSFER_COMPLETED == xfer->status) {
-		if (dev->cb)
-			dev->cb(xfer->buffer, xfer->actual_length, dev->cb_ctx);
+		if (dev->buf_alloc) {
+			_rtlsdr_swap_buffer(dev, xfer);
+		} else {
+			if (dev->cb)
+				dev->cb(xfer->buffer, xfer->actual_length, dev->cb_ctx);
 
-		libusb_submit_transfer(xfer); /* resubmit transfer */
+			libusb_submit_transfer(xfer); /* resubmit transfer */
+		}
 		dev->xfer_errors = 0;
 	} else if (LIBUSB_TRANSFER_CANCELLED != xfer->status) {
 #ifndef _WIN32
@@ -1751,6 +1801,20 @@ static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
 	dev->xfer_buf = malloc(dev->xfer_buf_num * sizeof(unsigned char *));
 	memset(dev->xfer_buf, 0, dev->xfer_buf_num * sizeof(unsigned char *));
 
+	/* buffers from the application's allocator */
+	if (dev->buf_alloc) {
+		dev->use_zerocopy = 0;
+		for (i = 0; i < dev->xfer_buf_num; ++i) {
+			dev->xfer_buf[i] = dev->buf_alloc(dev->xfer_buf_len,
+							  dev->buf_ctx);
+
+			if (!dev->xfer_buf[i])
+				return -ENOMEM;
+		}
+
+		return 0;
+	}
+
 #if defined(ENABLE_ZEROCOPY) && defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
 	fprintf(stderr, "Allocating %d zero-copy buffers\n", dev->xfer_buf_num);
 
@@ -1829,7 +1893,10 @@ static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev)
 	if (dev->xfer_buf) {
 		for (i = 0; i < dev->xfer_buf_num; ++i) {
 			if (dev->xfer_buf[i]) {
-				if (dev->use_zerocopy) {
+				if (dev->buf_alloc) {
+					dev->buf_free(dev->xfer_buf[i],
+						      dev->buf_ctx);
+				} else if (dev->use_zerocopy) {
 #if defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
 					libusb_dev_mem_free(dev->devh,
 							    dev->xfer_buf[i],
@@ -1848,6 +1915,27 @@ static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev)
 	return 0;
 }
 
+int rtlsdr_set_buffer_allocator(rtlsdr_dev_t *dev,
+				rtlsdr_buf_alloc_cb_t alloc,
+				rtlsdr_buf_free_cb_t release,
+				void *ctx)
+{
+	if (!dev)
+		return -1;
+
+	if (RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	if ((alloc == NULL) != (release == NULL))
+		return -1;
+
+	dev->buf_alloc = alloc;
+	dev->buf_free = release;
+	dev->buf_ctx = ctx;
+
+	return 0;
+}
+
 int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
 			  uint32_t buf_num, uint32_t buf_len)
 {
@@ -152,6 +152,17 @@ RTLSDR_API int rtlsdr_set_center_freq(rtlsdr_dev_t *dev, uint32_t freq);
  */
 RTLSDR_API uint32_t rtlsdr_get_center_freq(rtlsdr_dev_t *dev);
 
+/*!
+ * Enable or disable fast retuning, for sweeps. Retunes within the same band
+ * leave the tuner's input mux alone, and only the registers that change are
+ * written, in one burst. Only the R820T and R828D support it.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param on fast retune, 1 means enabled, 0 disabled
+ * \return 0 on success, -2 if the tuner doesn't support it
+ */
+RTLSDR_API int rtlsdr_set_fast_retune(rtlsdr_dev_t *dev, int on);
+
 /*!
  * Set the frequency correction value for the device.
  *
@@ -372,6 +383,29 @@ RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
 				 uint32_t buf_num,
 				 uint32_t buf_len);
 
+typedef unsigned char *(*rtlsdr_buf_alloc_cb_t)(uint32_t len, void *ctx);
+typedef void(*rtlsdr_buf_free_cb_t)(unsigned char *buf, void *ctx);
+
+/*!
+ * Have the transfer buffers for rtlsdr_read_async() come from the
+ * application. Each filled buffer is then handed to the read callback to
+ * keep, rather than lent to it, and the transfer is resubmitted with a new
+ * buffer from the allocator. The callback must eventually give the buffer
+ * back to wherever the allocator got it from. Buffers still in transfers
+ * when reading stops are passed to the release function.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param alloc function returning a buffer of at least len bytes, or NULL
+ * \param release function taking back a buffer the callback never saw
+ * \param ctx user specific context to pass to both functions
+ *		  set alloc and release to NULL to go back to internal buffers
+ * \return 0 on success, -2 if reading is in progress
+ */
+RTLSDR_API int rtlsdr_set_buffer_allocator(rtlsdr_dev_t *dev,
+					   rtlsdr_buf_alloc_cb_t alloc,
+					   rtlsdr_buf_free_cb_t release,
+					   void *ctx);
+
 /*!
  * Cancel all pending asynchronous operations on the device.
  *
@@ -249,6 +249,11 @@ static int r82xx_write(struct r82xx_priv *priv, uint8_t reg, const uint8_t *val,
 	/* Store the shadow registers */
 	shadow_store(priv, reg, val, len);
 
+	/* Batched writes to shadowed registers are sent by r82xx_flush() */
+	if (priv->batch && reg >= REG_SHADOW_START &&
+	    reg + len <= REG_SHADOW_START + NUM_REGS)
+		return 0;
+
 	do {
 		if (len > priv->cfg->max_i2c_msg_len - 1)
 			size = priv->cfg->max_i2c_msg_len - 1;
@@ -306,6 +311,53 @@ static int r82xx_write_reg_mask(struct r82xx_priv *priv, uint8_t reg, uint8_t va
 	return r82xx_write(priv, reg, &val, 1);
 }
 
+/*
+ * Batched writes, for fast retunes. While batching, writes only go to the
+ * shadow registers. The flush then sends everything from the first byte
+ * that differs from what the chip was last sent to the last, in one burst:
+ * as few I2C transactions as the message length allows, and none at all
+ * for registers that didn't change
+ */
+static void r82xx_begin_batch(struct r82xx_priv *priv)
+{
+	memcpy(priv->sent, priv->regs, NUM_REGS);
+	priv->batch = 1;
+}
+
+static void r82xx_abort_batch(struct r82xx_priv *priv)
+{
+	if (!priv->batch)
+		return;
+
+	/* Nothing was sent, so the shadow goes back to what the chip has */
+	memcpy(priv->regs, priv->sent, NUM_REGS);
+	priv->batch = 0;
+	priv->mux_range = -1;
+}
+
+static int r82xx_flush(struct r82xx_priv *priv)
+{
+	uint8_t data[NUM_REGS];
+	int lo, hi;
+
+	if (!priv->batch)
+		return 0;
+	priv->batch = 0;
+
+	for (lo = 0; lo < NUM_REGS; lo++)
+		if (priv->regs[lo] != priv->sent[lo])
+			break;
+	if (lo == NUM_REGS)
+		return 0;
+
+	for (hi = NUM_REGS - 1; hi > lo; hi--)
+		if (priv->regs[hi] != priv->sent[hi])
+			break;
+
+	memcpy(data, &priv->regs[lo], hi - lo + 1);
+	return r82xx_write(priv, REG_SHADOW_START + lo, data, hi - lo + 1);
+}
+
 static uint8_t r82xx_bitrev(uint8_t byte)
 {
 	const uint8_t lut[16] = { 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
@@ -367,6 +419,11 @@ static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 	}
 	range = &freq_ranges[i];
 
+	/* A fast retune within the same band leaves the mux as it is */
+	if (priv->fast_retune && (int)i == priv->mux_range)
+		return 0;
+	priv->mux_range = -1;
+
 	/* Open Drain */
 	rc = r82xx_write_reg_mask(priv, 0x17, range->open_d, 0x08);
 	if (rc < 0)
@@ -408,7 +465,10 @@ static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 		return rc;
 
 	rc = r82xx_write_reg_mask(priv, 0x09, 0x00, 0x3f);
+	if (rc < 0)
+		return rc;
 
+	priv->mux_range = i;
 	return rc;
 }
 
@@ -463,15 +523,21 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 		mix_div = mix_div << 1;
 	}
 
-	rc = r82xx_read(priv, 0x00, data, sizeof(data));
-	if (rc < 0)
-		return rc;
+	/* A fast retune uses the fine-tune state read at the last lock check,
+	 * which is what the chip would say now */
+	if (priv->fast_retune && priv->vco_fine_tune >= 0) {
+		vco_fine_tune = priv->vco_fine_tune;
+	} else {
+		rc = r82xx_read(priv, 0x00, data, sizeof(data));
+		if (rc < 0)
+			return rc;
+
+		vco_fine_tune = (data[4] & 0x30) >> 4;
+	}
 
 	if (priv->cfg->rafael_chip == CHIP_R828D)
 		vco_power_ref = 1;
 
-	vco_fine_tune = (data[4] & 0x30) >> 4;
-
 	if (vco_fine_tune > vco_power_ref)
 		div_num = div_num - 1;
 	else if (vco_fine_tune < vco_power_ref)
@@ -525,13 +591,26 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 	if (rc < 0)
 		return rc;
 
+	/* Send anything batched up, then look for lock */
+	rc = r82xx_flush(priv);
+	if (rc < 0)
+		return rc;
+
 	for (i = 0; i < 2; i++) {
 //		usleep_range(sleep_time, sleep_time + 1000);
 
-		/* Check if PLL has locked */
-		rc = r82xx_read(priv, 0x00, data, 3);
-		if (rc < 0)
-			return rc;
+		/* Check if PLL has locked. A fast retune reads on to the
+		 * fine-tune state in the same transaction, for next time */
+		if (priv->fast_retune) {
+			rc = r82xx_read(priv, 0x00, data, 5);
+			if (rc < 0)
+				return rc;
+			priv->vco_fine_tune = (data[4] & 0x30) >> 4;
+		} else {
+			rc = r82xx_read(priv, 0x00, data, 3);
+			if (rc < 0)
+				return rc;
+		}
 		if (data[2] & 0x40)
 			break;
 
@@ -767,6 +846,9 @@ static int r82xx_set_tv_standard(struct r82xx_priv *priv,
 	uint8_t lt_att, flt_ext_widest, polyfil_cur;
 	int need_calibration;
 
+	/* The calibration below changes the xtal cap bits the mux sets */
+	priv->mux_range = -1;
+
 	/* BW < 6 MHz */
 	if_khz = 3570;
 	filt_cal_lo = 56000;	/* 52000->56000 */
@@ -1079,6 +1161,10 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 	uint32_t lo_freq = freq + priv->int_freq;
 	uint8_t air_cable1_in;
 
+	/* A fast retune sends the mux and PLL changes in one burst */
+	if (priv->fast_retune)
+		r82xx_begin_batch(priv);
+
 	rc = r82xx_set_mux(priv, lo_freq);
 	if (rc < 0)
 		goto err;
@@ -1100,11 +1186,27 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 	}
 
 err:
+	r82xx_abort_batch(priv);
 	if (rc < 0)
 		fprintf(stderr, "%s: failed=%d\n", __FUNCTION__, rc);
 	return rc;
 }
 
+/*
+ * Fast retune, for sweeps: the mux is left alone while the frequency stays
+ * in the same band, the mux and PLL registers that changed go out in one
+ * burst, and the VCO fine-tune state comes with the lock check rather than
+ * from a read of its own
+ */
+int r82xx_set_fast_retune(struct r82xx_priv *priv, int enable)
+{
+	priv->fast_retune = enable ? 1 : 0;
+	priv->mux_range = -1;
+	priv->vco_fine_tune = -1;
+
+	return 0;
+}
+
 /*
  * r82xx standby logic
  */
@@ -1151,6 +1253,8 @@ int r82xx_standby(struct r82xx_priv *priv)
 
 	/* Force initial calibration */
 	priv->type = -1;
+	priv->mux_range = -1;
+	priv->vco_fine_tune = -1;
 
 	return rc;
 }
@@ -1166,6 +1270,9 @@ int r82xx_init(struct r82xx_priv *priv)
 
 	/* TODO: R828D might need r82xx_xtal_check() */
 	priv->xtal_cap_sel = XTAL_HIGH_CAP_0P;
+	priv->batch = 0;
+	priv->mux_range = -1;
+	priv->vco_fine_tune = -1;
 
 	/* Initialize registers */
 	r82xx_write(priv, 0x05,
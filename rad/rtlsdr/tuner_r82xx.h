@@ -91,6 +91,13 @@ struct r82xx_priv {
 
 	uint32_t			bw;	/* in MHz */
 
+	/* Fast retune, for sweeps */
+	int				fast_retune;
+	int				batch;		/* Writes only go to the shadow */
+	uint8_t				sent[NUM_REGS];	/* Shadow when batching began */
+	int				mux_range;	/* freq_ranges[] set, -1 = none */
+	int				vco_fine_tune;	/* At the last lock, -1 = none */
+
 	void *rtl_dev;
 };
 
@@ -114,6 +121,7 @@ enum r82xx_delivery_system {
 int r82xx_standby(struct r82xx_priv *priv);
 int r82xx_init(struct r82xx_priv *priv);
 int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq);
+int r82xx_set_fast_retune(struct r82xx_priv *priv, int enable);
 int r82xx_set_gain(struct r82xx_priv *priv, int set_manual_gain, int gain);
 int r82xx_set_bandwidth(struct r82xx_priv *priv, int bandwidth,  uint32_t rate);
 
@@ -7,6 +7,17 @@
 #define NETWORK_GROUP		"network"
 #define NET_ADDR_KEY		"network-address"
 #define NET_PORT_KEY		"network-port"
+#define NET_URL_KEY			"network-url"
+
+#define VIEW_GROUP			"view"
+#define CHANNEL_KEY			"channel"
+#define BIN_LO_KEY			"bin-lo"
+#define BIN_HI_KEY			"bin-hi"
+#define DECIMATE_KEY		"decimate"
+#define REDUCE_KEY			"reduce"
+#define ENCODING_KEY		"encoding"
+#define DELTA_KEY			"delta"
+#define COMPRESS_KEY		"compress"
 
 #define DEFAULT_HOST		"shed.gornall.net"
 
@@ -25,6 +36,42 @@ Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
 		_port,
 		({"p",NET_PORT_KEY}, "Address (ip or name) to connect to)", "5417"))
 
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_url,
+		({"u",NET_URL_KEY}, "Server URL: ws://host:port, tcp://host:port, unix:///path or udp://group:port", "url"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_channel,
+		({"c",CHANNEL_KEY}, "Channel (tuner or device) to show", "0"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_binLo,
+		(BIN_LO_KEY, "First bin to ask the daemon for", "0"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_binHi,
+		(BIN_HI_KEY, "Last bin to ask the daemon for (-1 = all)", "-1"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_decimate,
+		({"d",DECIMATE_KEY}, "Bins to fold into each one received", "1"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_reduce,
+		(REDUCE_KEY, "How to fold bins: mean or max", "mean"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_encoding,
+		({"e",ENCODING_KEY}, "Wire format for spectra: f32, f16, u16 or u8", "f32"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_delta,
+		(DELTA_KEY, "Ask for spectra as deltas between keyframes"))
+
+Q_GLOBAL_STATIC_WITH_ARGS(const QCommandLineOption,
+		_compress,
+		(COMPRESS_KEY, "Ask for spectra to be compressed"))
+
 /******************************************************************************\
 |* Constructor
 \******************************************************************************/
@@ -34,6 +81,15 @@ Config::Config()
 	_parser.addOption(*_ipaddress);
 	_parser.addOption(*_help);
 	_parser.addOption(*_port);
+	_parser.addOption(*_url);
+	_parser.addOption(*_channel);
+	_parser.addOption(*_binLo);
+	_parser.addOption(*_binHi);
+	_parser.addOption(*_decimate);
+	_parser.addOption(*_reduce);
+	_parser.addOption(*_encoding);
+	_parser.addOption(*_delta);
+	_parser.addOption(*_compress);
 
 	_parser.parse(QCoreApplication::arguments());
 
@@ -76,3 +132,145 @@ QString Config::networkHost(void)
 	s.endGroup();
 	return host;
 	}
+
+/******************************************************************************\
+|* Get the URL to connect to
+\******************************************************************************/
+QUrl Config::networkUrl(void)
+	{
+	if (_parser.isSet(*_url))
+		return QUrl(_parser.value(*_url));
+
+	QSettings s;
+	s.beginGroup(NETWORK_GROUP);
+	QString url = s.value(NET_URL_KEY, "").toString();
+	s.endGroup();
+	if (url.length() > 0)
+		return QUrl(url);
+
+	QUrl fallback;
+	fallback.setScheme("ws");
+	fallback.setHost(networkHost());
+	fallback.setPort(networkPort());
+	return fallback;
+	}
+
+/******************************************************************************\
+|* Get the channel to show
+\******************************************************************************/
+int Config::channel(void)
+	{
+	if (_parser.isSet(*_channel))
+		return _parser.value(*_channel).toInt();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString channel = s.value(CHANNEL_KEY, "0").toString();
+	s.endGroup();
+	return channel.toInt();
+	}
+
+/******************************************************************************\
+|* Get the first bin to ask for
+\******************************************************************************/
+int Config::binLo(void)
+	{
+	if (_parser.isSet(*_binLo))
+		return _parser.value(*_binLo).toInt();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString bin = s.value(BIN_LO_KEY, "0").toString();
+	s.endGroup();
+	return bin.toInt();
+	}
+
+/******************************************************************************\
+|* Get the last bin to ask for
+\******************************************************************************/
+int Config::binHi(void)
+	{
+	if (_parser.isSet(*_binHi))
+		return _parser.value(*_binHi).toInt();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString bin = s.value(BIN_HI_KEY, "-1").toString();
+	s.endGroup();
+	return bin.toInt();
+	}
+
+/******************************************************************************\
+|* Get the decimation factor
+\******************************************************************************/
+int Config::decimate(void)
+	{
+	if (_parser.isSet(*_decimate))
+		return _parser.value(*_decimate).toInt();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString factor = s.value(DECIMATE_KEY, "1").toString();
+	s.endGroup();
+	return factor.toInt();
+	}
+
+/******************************************************************************\
+|* Get the reduction to use when decimating
+\******************************************************************************/
+QString Config::reduce(void)
+	{
+	if (_parser.isSet(*_reduce))
+		return _parser.value(*_reduce).toLower();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString reduce = s.value(REDUCE_KEY, "mean").toString().toLower();
+	s.endGroup();
+	return reduce;
+	}
+
+/******************************************************************************\
+|* Get the wire format to ask for
+\******************************************************************************/
+QString Config::encoding(void)
+	{
+	if (_parser.isSet(*_encoding))
+		return _parser.value(*_encoding).toLower();
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	QString encoding = s.value(ENCODING_KEY, "f32").toString().toLower();
+	s.endGroup();
+	return encoding;
+	}
+
+/******************************************************************************\
+|* Do we want deltas
+\******************************************************************************/
+bool Config::delta(void)
+	{
+	if (_parser.isSet(*_delta))
+		return true;
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	bool delta = s.value(DELTA_KEY, false).toBool();
+	s.endGroup();
+	return delta;
+	}
+
+/******************************************************************************\
+|* Do we want compression
+\******************************************************************************/
+bool Config::compress(void)
+	{
+	if (_parser.isSet(*_compress))
+		return true;
+
+	QSettings s;
+	s.beginGroup(VIEW_GROUP);
+	bool compress = s.value(COMPRESS_KEY, false).toBool();
+	s.endGroup();
+	return compress;
+	}
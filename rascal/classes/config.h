@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <QCommandLineParser>
+#include <QUrl>
 
 #include "singleton.h"
 
@@ -26,6 +27,44 @@ class Config : public Singleton<Config>
 		\******************************************************************/
 		int networkPort(void);
 
+		/******************************************************************\
+		|* Return the URL to connect to. The scheme picks the transport:
+		|* ws, tcp or unix. Defaults to ws:// on the host and port above
+		\******************************************************************/
+		QUrl networkUrl(void);
+
+		/******************************************************************\
+		|* Return the channel to show, when the server has more than one
+		\******************************************************************/
+		int channel(void);
+
+		/******************************************************************\
+		|* Return the range of bins to ask for, binHi = -1 for all
+		\******************************************************************/
+		int binLo(void);
+		int binHi(void);
+
+		/******************************************************************\
+		|* Return the number of bins to fold into each one we receive
+		\******************************************************************/
+		int decimate(void);
+
+		/******************************************************************\
+		|* Return how to fold bins together: "mean" or "max"
+		\******************************************************************/
+		QString reduce(void);
+
+		/******************************************************************\
+		|* Return the wire format to ask for: "f32", "f16", "u16" or "u8"
+		\******************************************************************/
+		QString encoding(void);
+
+		/******************************************************************\
+		|* Return whether to ask for delta-coded and compressed spectra
+		\******************************************************************/
+		bool delta(void);
+		bool compress(void);
+
 	};
 
 #endif // CONFIG_H
@@ -1,3 +1,4 @@
+#include <QMouseEvent>
 #include <QPainter>
 
 #include <libra.h>
@@ -5,6 +6,7 @@
 #include "constants.h"
 #include "graph.h"
 #include "mainwindow.h"
+#include "msgio.h"
 
 /******************************************************************************\
 |* Categorised logging support
@@ -18,7 +20,7 @@
 Graph::Graph(QWidget *parent)
 	  :QWidget(parent)
 	  ,_redrawImage(true)
-	  ,_binLo(-1)
+	  ,_binLo(0)
 	  ,_binHi(-1)
 	  ,_binMax(-1)
 	  ,_updateMax(-MAXFLOAT)
@@ -29,6 +31,9 @@ Graph::Graph(QWidget *parent)
 	  ,_updateSecs(5)
 	  ,_img(nullptr)
 	  ,_sample(-1)
+	  ,_live(-1)
+	  ,_sweep(-1)
+	  ,_dragFrom(-1)
 	{}
 
 /******************************************************************************\
@@ -38,6 +43,13 @@ void Graph::paintEvent(QPaintEvent *e)
 	{
 	Q_UNUSED(e);
 
+	if (_redrawImage && (_binMax > 0))
+		{
+		QMutexLocker guard(&_lock);
+		_updateImage();
+		_redrawImage = false;
+		}
+
 	if (_img != nullptr)
 		{
 		QPainter qp(this);
@@ -72,28 +84,11 @@ void Graph::updateReceived(int64_t idx)
 
 	DataMgr& dmgr		= DataMgr::instance();
 	dmgr.retain(idx);
-	int num				= dmgr.extent(idx) / sizeof(float);
-	float * data		= dmgr.asFloat(idx);
-
-	/**************************************************************************\
-	|* Now that we have an update, if we don't have the limits on the data to
-	|* process, set it to the size of the incoming data
-	\**************************************************************************/
-	if ((_binLo < 0) || (_binHi < 0))
-		{
-		_binLo	= 1;
-		_binHi	= num-1;
-		_binMax	= num;
-		}
 
 	/**************************************************************************\
 	|* Update the min/max range to include this data
-	\**************************************************************************/\
-	for (int i=_binLo; i<_binHi; i++)
-		{
-		_updateMax = (_updateMax > data[i]) ? _updateMax : data[i];
-		_updateMin = (_updateMin < data[i]) ? _updateMin : data[i];
-		}
+	\**************************************************************************/
+	_extend(idx, _updateMin, _updateMax);
 
 	/**************************************************************************\
 	|* Update the backing data
@@ -107,14 +102,11 @@ void Graph::updateReceived(int64_t idx)
 	_updates.insert(0, idx);
 
 	/**************************************************************************\
-	|* Update the backing image
-	\**************************************************************************/
-	_updateImage();
-
-	/**************************************************************************\
-	|* And issue a repaint
+	|* Mark the backing image stale and ask for a repaint. A burst of messages,
+	|* such as the history sent on connect, then costs one redraw, not one each
 	\**************************************************************************/
-	repaint();
+	_redrawImage = true;
+	update();
 	}
 
 
@@ -127,38 +119,25 @@ void Graph::sampleReceived(int64_t idx)
 
 	DataMgr& dmgr		= DataMgr::instance();
 	dmgr.retain(idx);
-	int num				= dmgr.extent(idx) / sizeof(float);
-	float * data		= dmgr.asFloat(idx);
 
 	/**************************************************************************\
-	|* Now that we have a sample, if we don't have the limits on the data to
-	|* process, set it to the size of the incoming data
+	|* Reduce the sample data down to one entry. A replayed history can start
+	|* with a sample, before there are any updates
 	\**************************************************************************/
-	if ((_binLo < 0) || (_binHi < 0))
+	if (!_updates.isEmpty())
 		{
-		_binLo	= 1;
-		_binHi	= num-1;
-		_binMax	= num;
+		int64_t currentBuffer = _updates[0];
+		for (int64_t buffer : _updates)
+			if (buffer != currentBuffer)
+				dmgr.release(buffer);
+		_updates.clear();
+		_updates.append(currentBuffer);
 		}
 
-	/**************************************************************************\
-	|* Reduce the sample data down to one entry
-	\**************************************************************************/
-	int64_t currentBuffer = _updates[0];
-	for (int64_t buffer : _updates)
-		if (buffer != currentBuffer)
-			dmgr.release(buffer);
-	_updates.clear();
-	_updates.append(currentBuffer);
-
 	/**************************************************************************\
 	|* Update the min/max range to include this data
-	\**************************************************************************/\
-	for (int i=_binLo; i<_binHi; i++)
-		{
-		_sampleMax = (_sampleMax > data[i]) ? _sampleMax : data[i];
-		_sampleMin = (_sampleMin < data[i]) ? _sampleMin : data[i];
-		}
+	\**************************************************************************/
+	_extend(idx, _sampleMin, _sampleMax);
 
 	/**************************************************************************\
 	|* Update the backing data
@@ -168,14 +147,63 @@ void Graph::sampleReceived(int64_t idx)
 	_sample = idx;
 
 	/**************************************************************************\
-	|* Update the backing image
+	|* Mark the backing image stale and ask for a repaint. A burst of messages,
+	|* such as the history sent on connect, then costs one redraw, not one each
 	\**************************************************************************/
-	_updateImage();
+	_redrawImage = true;
+	update();
+	}
+
+/******************************************************************************\
+|* We got a live message. This just replaces the previous one
+\******************************************************************************/
+void Graph::liveReceived(int64_t idx)
+	{
+	QMutexLocker guard(&_lock);
+
+	DataMgr& dmgr		= DataMgr::instance();
+	dmgr.retain(idx);
 
 	/**************************************************************************\
-	|* And issue a repaint
+	|* Share the update range, it's the same kind of data
 	\**************************************************************************/
-	repaint();
+	_extend(idx, _updateMin, _updateMax);
+
+	/**************************************************************************\
+	|* Update the backing data
+	\**************************************************************************/
+	if (_live >= 0)
+		dmgr.release(_live);
+	_live = idx;
+
+	_redrawImage = true;
+	update();
+	}
+
+/******************************************************************************\
+|* We got a sweep message. Like a live one, it just replaces the previous one
+\******************************************************************************/
+void Graph::sweepReceived(int64_t idx)
+	{
+	QMutexLocker guard(&_lock);
+
+	DataMgr& dmgr		= DataMgr::instance();
+	dmgr.retain(idx);
+
+	/**************************************************************************\
+	|* Share the update range, it's the same kind of data
+	\**************************************************************************/
+	_extend(idx, _updateMin, _updateMax);
+
+	/**************************************************************************\
+	|* Update the backing data
+	\**************************************************************************/
+	if (_sweep >= 0)
+		dmgr.release(_sweep);
+	_sweep = idx;
+
+	_redrawImage = true;
+	update();
 	}
 
 /******************************************************************************\
@@ -186,13 +214,128 @@ int Graph::_updatesPerSample(void)
 	return _sampleSecs / _updateSecs;
 	}
 
+/******************************************************************************\
+|* Private Method - Return the last bin in the view
+\******************************************************************************/
+int Graph::_lastBin(void)
+	{
+	return ((_binHi < 0) || (_binHi >= _binMax)) ? _binMax - 1 : _binHi;
+	}
+
+/******************************************************************************\
+|* Private Method - Note the size of the spectrum a message is from, and take
+|* its values in the view into a min/max range. Each value is for {decimate}
+|* bins from {binLo}, and there are only as many as the message holds
+\******************************************************************************/
+void Graph::_extend(int64_t idx, float& lo, float& hi)
+	{
+	const Preamble *hdr	= Msgio::header(idx);
+	int num				= 0;
+	float *data			= Msgio::values(idx, num);
+	if (data == nullptr)
+		return;
+
+	int dec				= (hdr->decimate > 0) ? hdr->decimate : 1;
+	int bins			= (int)hdr->bins;
+	if (bins <= 0)
+		bins = (int)hdr->binLo + num * dec;
+	_binMax				= bins;
+
+	int last			= _lastBin();
+	for (int i=0; i<num; i++)
+		{
+		int bin = (int)hdr->binLo + i * dec;
+		if ((bin < _binLo) || (bin > last))
+			continue;
+		hi = (hi > data[i]) ? hi : data[i];
+		lo = (lo < data[i]) ? lo : data[i];
+		}
+	}
+
+/******************************************************************************\
+|* Private Method - Work the data ranges out again from what we're holding
+\******************************************************************************/
+void Graph::_rescale(void)
+	{
+	_updateMax		= -MAXFLOAT;
+	_updateMin		= MAXFLOAT;
+	_sampleMax		= -MAXFLOAT;
+	_sampleMin		= MAXFLOAT;
+
+	for (int64_t buffer : qAsConst(_updates))
+		_extend(buffer, _updateMin, _updateMax);
+	if (_live >= 0)
+		_extend(_live, _updateMin, _updateMax);
+	if (_sweep >= 0)
+		_extend(_sweep, _updateMin, _updateMax);
+	if (_sample >= 0)
+		_extend(_sample, _sampleMin, _sampleMax);
+	}
+
+/******************************************************************************\
+|* Private Method - Draw one spectrum. Only the values in the view are drawn,
+|* each at the first of the bins it stands for
+\******************************************************************************/
+void Graph::_plot(QPainter& painter,
+				  int64_t idx,
+				  const QRect& R,
+				  float minY,
+				  float ys)
+	{
+	const Preamble *hdr	= Msgio::header(idx);
+	int num				= 0;
+	float *data			= Msgio::values(idx, num);
+	if (data == nullptr)
+		return;
+
+	int last			= _lastBin();
+	int dec				= (hdr->decimate > 0) ? hdr->decimate : 1;
+	float xs			= R.width() / (float)((last > _binLo) ? last - _binLo : 1);
+	int xo				= R.left();
+	int yo				= R.bottom();
+	bool first			= true;
+	int ox = 0, oy = 0;
+
+	for (int i=0; i<num; i++)
+		{
+		int bin = (int)hdr->binLo + i * dec;
+		if ((bin < _binLo) || (bin > last))
+			continue;
+
+		int y = (int)(yo - (data[i] - minY) * ys);
+		int x = (int)(xo + (bin - _binLo) * xs);
+		if (first)
+			painter.drawPoint(x,y);
+		else
+			painter.drawLine(ox, oy, x, y);
+
+		first	= false;
+		ox		= x;
+		oy		= y;
+		}
+	}
+
+/******************************************************************************\
+|* Private Method - Return the bin under an x co-ordinate
+\******************************************************************************/
+int Graph::_binAt(int x)
+	{
+	int left	= MainWindow::DRAW_L;
+	int width	= size().width() - MainWindow::DRAW_L - MainWindow::DRAW_R;
+	int last	= _lastBin();
+
+	if (width <= 0)
+		return _binLo;
+
+	int bin		= _binLo + (int)((x - left) * (float)(last - _binLo) / width);
+	return (bin < _binLo) ? _binLo : (bin > last) ? last : bin;
+	}
+
 /******************************************************************************\
 |* Private Method - Update the backing image
 \******************************************************************************/
 void Graph::_updateImage(void)
 	{
-	DataMgr& dmgr		= DataMgr::instance();
-
 	/**************************************************************************\
 	|* Check to see if we have an image, if not, create it
 	\**************************************************************************/
@@ -223,9 +366,6 @@ void Graph::_updateImage(void)
 	float minY	= ((_updateMin < _sampleMin) ? _updateMin : _sampleMin);
 
 	float ys	= R.height() / (maxY - minY);
-	float xs	= R.width()  / ((float)(_binHi - _binLo));
-	int	  xo	= R.left();
-	int   yo	= R.bottom();
 
 	/**************************************************************************\
 	|* Pen for the contributory updates
@@ -241,27 +381,25 @@ void Graph::_updateImage(void)
 	|* Draw the updates
 	\**************************************************************************/
 	for (int i=0; i<uNum; i++)
-		{
-		int idx		 = _updates.at(i);
-		int ox, oy;
-
-		float * data = dmgr.asFloat(idx);
-		if (data != nullptr)
-			{
-			for (int j=_binLo; j<=_binHi; j++)
-				{
-				int y = (int)(yo - (data[j] - minY) * ys);
-				int x = (int)(xo + j * xs);
-				if (j == _binLo)
-					painter.drawPoint(x,y);
-				else
-					painter.drawLine(ox, oy, x, y);
-
-				ox = x;
-				oy = y;
-				}
-			}
-		}
+		_plot(painter, _updates.at(i), R, minY, ys);
+
+	/**************************************************************************\
+	|* Draw the live average
+	\**************************************************************************/
+	pen = QPen(qRgba(255,0,0,255));
+	painter.setPen(pen);
+
+	if (_live >= 0)
+		_plot(painter, _live, R, minY, ys);
+
+	/**************************************************************************\
+	|* Draw the sweep
+	\**************************************************************************/
+	pen = QPen(qRgba(0,160,0,255));
+	painter.setPen(pen);
+
+	if (_sweep >= 0)
+		_plot(painter, _sweep, R, minY, ys);
 
 	/**************************************************************************\
 	|* Draw the samples
@@ -270,25 +408,7 @@ void Graph::_updateImage(void)
 	painter.setPen(pen);
 
 	if (_sample >= 0)
-		{
-		int ox, oy;
-		float *data = dmgr.asFloat(_sample);
-		if (data != nullptr)
-			{
-			for (int j=_binLo; j<=_binHi; j++)
-				{
-				int y = (int)(yo - (data[j] - minY) * ys);
-				int x = (int)(xo + j * xs);
-				if (j == _binLo)
-					painter.drawPoint(x,y);
-				else
-					painter.drawLine(ox, oy, x, y);
-
-				ox = x;
-				oy = y;
-				}
-			}
-		}
+		_plot(painter, _sample, R, minY, ys);
 
 	/**************************************************************************\
 	|* Draw the axes
@@ -299,3 +419,92 @@ void Graph::_updateImage(void)
 //	painter.drawLine(0, updates, _binMax, updates);
 
 	}
+
+/******************************************************************************\
+|* Start again from nothing, after the server has been reconfigured
+\******************************************************************************/
+void Graph::reset(void)
+	{
+	QMutexLocker guard(&_lock);
+	DataMgr& dmgr		= DataMgr::instance();
+
+	for (int64_t buffer : _updates)
+		dmgr.release(buffer);
+	_updates.clear();
+
+	if (_sample >= 0)
+		dmgr.release(_sample);
+	if (_live >= 0)
+		dmgr.release(_live);
+	if (_sweep >= 0)
+		dmgr.release(_sweep);
+	_sample			= -1;
+	_live			= -1;
+	_sweep			= -1;
+
+	_binMax			= -1;
+	_updateMax		= -MAXFLOAT;
+	_updateMin		= MAXFLOAT;
+	_sampleMax		= -MAXFLOAT;
+	_sampleMin		= MAXFLOAT;
+
+	delete _img;
+	_img			= nullptr;
+	_redrawImage	= true;
+	update();
+	}
+
+/******************************************************************************\
+|* Show a range of bins. What's already held is still good, since each message
+|* says which bins it has, but the scaling has to be worked out again
+\******************************************************************************/
+void Graph::setView(int binLo, int binHi)
+	{
+	binLo			= (binLo < 0) ? 0 : binLo;
+	binHi			= ((binHi >= 0) && (binHi < binLo)) ? binLo : binHi;
+
+	{
+	QMutexLocker guard(&_lock);
+	if ((binLo == _binLo) && (binHi == _binHi))
+		return;
+
+	_binLo			= binLo;
+	_binHi			= binHi;
+	_rescale();
+	_redrawImage	= true;
+	}
+
+	update();
+	emit viewChanged(binLo, binHi);
+	}
+
+/******************************************************************************\
+|* Mouse handling: a drag picks the bins to zoom in on
+\******************************************************************************/
+void Graph::mousePressEvent(QMouseEvent *e)
+	{
+	_dragFrom = (e->button() == Qt::LeftButton) ? e->x() : -1;
+	}
+
+void Graph::mouseReleaseEvent(QMouseEvent *e)
+	{
+	int from	= _dragFrom;
+	_dragFrom	= -1;
+	if ((from < 0) || (_binMax <= 0) || (qAbs(e->x() - from) < 4))
+		return;
+
+	int lo		= _binAt((from < e->x()) ? from : e->x());
+	int hi		= _binAt((from < e->x()) ? e->x() : from);
+	if (hi > lo)
+		setView(lo, hi);
+	}
+
+/******************************************************************************\
+|* Mouse handling: a double-click shows everything again
+\******************************************************************************/
+void Graph::mouseDoubleClickEvent(QMouseEvent *e)
+	{
+	Q_UNUSED(e);
+	_dragFrom = -1;
+	setView(0, -1);
+	}
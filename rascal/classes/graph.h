@@ -7,6 +7,7 @@
 #include "properties.h"
 
 QT_FORWARD_DECLARE_CLASS(QImage)
+QT_FORWARD_DECLARE_CLASS(QPainter)
 
 class Graph : public QWidget
 	{
@@ -17,8 +18,8 @@ class Graph : public QWidget
 	\**************************************************************************/
 	GETSET(bool, redrawImage, RedrawImage);		// Need to redraw  backing img?
 	GET(int, binLo);							// Smallest bin number to show
-	GET(int, binHi);							// Largest bin number to show
-	GET(int, binMax);							// Largest bin available
+	GET(int, binHi);							// Largest, -1 = the last there is
+	GET(int, binMax);							// Bins in the spectrum, or -1
 	GET(float, updateMax);						// Max value in update data
 	GET(float, updateMin);						// Min value in update data
 	GET(float, sampleMax);						// Max value in sample data
@@ -37,12 +38,45 @@ class Graph : public QWidget
 		\**********************************************************************/
 		int _updatesPerSample(void);
 
+		/**********************************************************************\
+		|* Return the last bin in the view
+		\**********************************************************************/
+		int _lastBin(void);
+
+		/**********************************************************************\
+		|* Note the bins a message covers, and widen {lo} and {hi} to take in
+		|* the values it has in the view
+		\**********************************************************************/
+		void _extend(int64_t idx, float& lo, float& hi);
+
+		/**********************************************************************\
+		|* Work out the data ranges again, eg: once the view has changed
+		\**********************************************************************/
+		void _rescale(void);
+
+		/**********************************************************************\
+		|* Draw one spectrum, each value at the bins it came from
+		\**********************************************************************/
+		void _plot(QPainter& painter,
+				   int64_t idx,
+				   const QRect& R,
+				   float minY,
+				   float ys);
+
+		/**********************************************************************\
+		|* Return the bin under an x co-ordinate
+		\**********************************************************************/
+		int _binAt(int x);
+
 		/**********************************************************************\
 		|* Variables
 		\**********************************************************************/
 		QImage *_img;							// The backing image
 		QVector<int64_t> _updates;				// The backing 'update' data
 		int64_t _sample;						// The current 'sample' data
+		int64_t _live;							// The current 'live' data
+		int64_t _sweep;							// The current 'sweep' data
+		int _dragFrom;							// Where a zoom began, or -1
 		QMutex _lock;							// Thread safety
 
 	public:
@@ -56,6 +90,14 @@ class Graph : public QWidget
 		\**********************************************************************/
 		void paintEvent(QPaintEvent *event) override;
 
+		/**********************************************************************\
+		|* Drag across the graph to zoom in on those bins, double-click to see
+		|* them all again
+		\**********************************************************************/
+		void mousePressEvent(QMouseEvent *event) override;
+		void mouseReleaseEvent(QMouseEvent *event) override;
+		void mouseDoubleClickEvent(QMouseEvent *event) override;
+
 
 	public slots:
 		/**********************************************************************\
@@ -68,6 +110,33 @@ class Graph : public QWidget
 		\**********************************************************************/
 		void sampleReceived(int64_t bufferId);
 
+		/**********************************************************************\
+		|* Receive data ready to show on-screen
+		\**********************************************************************/
+		void liveReceived(int64_t bufferId);
+
+		/**********************************************************************\
+		|* Receive data ready to show on-screen
+		\**********************************************************************/
+		void sweepReceived(int64_t bufferId);
+
+		/**********************************************************************\
+		|* The server has been reconfigured: forget everything shown so far
+		\**********************************************************************/
+		void reset(void);
+
+		/**********************************************************************\
+		|* Show bins {binLo} to {binHi}, inclusive. -1 for {binHi} means up to
+		|* the last one
+		\**********************************************************************/
+		void setView(int binLo, int binHi);
+
+	signals:
+		/**********************************************************************\
+		|* The bins on show have changed, so the server can send just those
+		\**********************************************************************/
+		void viewChanged(int binLo, int binHi);
+
 	};
 
 #endif // GRAPH_H
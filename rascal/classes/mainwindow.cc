@@ -3,6 +3,7 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include "config.h"
 #include "constants.h"
 #include "datamgr.h"
 #include "events.h"
@@ -23,6 +24,7 @@ Q_LOGGING_CATEGORY(log_gui, "rascal.ui    ")
 MainWindow::MainWindow(Config *cfg, QWidget *parent)
 		   :QMainWindow(parent)
 		   ,_cfg(cfg)
+		   ,_decimate(1)
 		   ,ui(new Ui::MainWindow)
 	{
 	ui->setupUi(this);\
@@ -81,6 +83,86 @@ void MainWindow::createUI(Msgio *io)
 			_waterfall, &Waterfall::sampleReceived);
 	connect(this, &MainWindow::sampleReady,
 			_graph, &Graph::sampleReceived);
+
+	/**************************************************************************\
+	|* Connect up the data-flow from io->* : live
+	\**************************************************************************/
+	connect(_io, &Msgio::liveReceived,
+			this, &MainWindow::liveReceived);
+	connect(this, &MainWindow::liveReady,
+			_graph, &Graph::liveReceived);
+
+	/**************************************************************************\
+	|* Connect up the data-flow from io->* : sweep. There's nothing else while
+	|* the server is sweeping, and each one is a row in the waterfall
+	\**************************************************************************/
+	connect(_io, &Msgio::sweepReceived,
+			this, &MainWindow::sweepReceived);
+	connect(this, &MainWindow::sweepReady,
+			_waterfall, &Waterfall::updateReceived);
+	connect(this, &MainWindow::sweepReady,
+			_graph, &Graph::sweepReceived);
+
+	/**************************************************************************\
+	|* And a change of settings on the server means starting again
+	\**************************************************************************/
+	connect(_io, &Msgio::configured,
+			this, &MainWindow::configured);
+	connect(_io, &Msgio::demoted,
+			this, &MainWindow::demoted);
+
+	/**************************************************************************\
+	|* The graph's view says what to ask the server for, starting with the
+	|* range given on the commandline
+	\**************************************************************************/
+	connect(_graph, &Graph::viewChanged,
+			this, &MainWindow::viewChanged);
+	_decimate = _cfg->decimate();
+	_graph->setView(_cfg->binLo(), _cfg->binHi());
+	viewChanged(_graph->binLo(), _graph->binHi());
+	}
+
+/******************************************************************************\
+|* The server has new settings. The integration times may have changed, and
+|* the old spectra can't be shown with the new ones
+\******************************************************************************/
+void MainWindow::configured(QJsonObject settings)
+	{
+	int updateSecs = settings.value("updateSecs").toInt(_graph->updateSecs());
+	int sampleSecs = settings.value("sampleSecs").toInt(_graph->sampleSecs());
+	LOG << "Server reconfigured:" << settings.value("frequency").toDouble()
+		<< "Hz," << settings.value("fftSize").toInt() << "bins";
+
+	_graph->setUpdateSecs(updateSecs);
+	_graph->setSampleSecs(sampleSecs);
+	_graph->reset();
+
+	_waterfall->setUpdateSecs(updateSecs);
+	_waterfall->setSampleSecs(sampleSecs);
+	_waterfall->reset();
+	}
+
+/******************************************************************************\
+|* The view has changed. Each message says which bins it holds, so whatever is
+|* still in flight under the old subscription is drawn correctly too
+\******************************************************************************/
+void MainWindow::viewChanged(int binLo, int binHi)
+	{
+	_waterfall->setView(binLo, binHi);
+	_io->subscribe(_cfg->channel(), binLo, binHi, _decimate, _cfg->reduce(),
+				   _cfg->encoding(), _cfg->delta(), _cfg->compress());
+	}
+
+/******************************************************************************\
+|* The server has cut back how much it sends us. Keep to that when the view
+|* changes, so we aren't demoted all over again
+\******************************************************************************/
+void MainWindow::demoted(QJsonObject settings)
+	{
+	_decimate = settings.value("decimate").toInt(_decimate);
+	LOG << "Server demoted us to decimation" << _decimate;
+	ui->statusbar->showMessage(QString("Too slow to keep up: showing every "
+									   "%1 bins").arg(_decimate), 10000);
 	}
 
 /******************************************************************************\
@@ -114,6 +196,36 @@ void MainWindow::sampleReceived(int64_t bufferId)
 	dmgr.release(bufferId);
 	}
 
+/******************************************************************************\
+|* Distribute the live data, handling the retain/release correctly
+\******************************************************************************/
+void MainWindow::liveReceived(int64_t bufferId)
+	{
+	DataMgr& dmgr		= DataMgr::instance();
+
+	/**********************************************************************\
+	|* Buffer comes to us with a retain-count of 1, so make sure it is sent
+	|* to all destinations before we release the bufferId
+	\**********************************************************************/
+	emit liveReady(bufferId);
+	dmgr.release(bufferId);
+	}
+
+/******************************************************************************\
+|* Distribute the sweep data, handling the retain/release correctly
+\******************************************************************************/
+void MainWindow::sweepReceived(int64_t bufferId)
+	{
+	DataMgr& dmgr		= DataMgr::instance();
+
+	/**********************************************************************\
+	|* Buffer comes to us with a retain-count of 1, so make sure it is sent
+	|* to all destinations before we release the bufferId
+	\**********************************************************************/
+	emit sweepReady(bufferId);
+	dmgr.release(bufferId);
+	}
+
 /******************************************************************************\
 |* Menu action: We want to begin calibration
 \******************************************************************************/
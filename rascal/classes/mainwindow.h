@@ -1,6 +1,7 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QJsonObject>
 #include <QMainWindow>
 
 #include "properties.h"
@@ -33,6 +34,7 @@ class MainWindow : public QMainWindow
 	GET(Vcr *, vcr);					// Controls for playback etc
 	GET(Waterfall *, waterfall);		// Waterfall display
 	GET(Msgio *, io);					// Interface to daemon
+	GET(int, decimate);					// Decimation to subscribe with
 
 	public:
 		/**********************************************************************\
@@ -72,6 +74,32 @@ class MainWindow : public QMainWindow
 		\**********************************************************************/
 		void sampleReceived(int64_t bufferId);
 
+		/**********************************************************************\
+		|* Receive live data, and send it on to the destinations
+		\**********************************************************************/
+		void liveReceived(int64_t bufferId);
+
+		/**********************************************************************\
+		|* Receive sweep data, and send it on to the destinations
+		\**********************************************************************/
+		void sweepReceived(int64_t bufferId);
+
+		/**********************************************************************\
+		|* The server has been reconfigured, so start the displays again
+		\**********************************************************************/
+		void configured(QJsonObject settings);
+
+		/**********************************************************************\
+		|* The bins on show have changed: show the same ones in the waterfall,
+		|* and ask the server for just those
+		\**********************************************************************/
+		void viewChanged(int binLo, int binHi);
+
+		/**********************************************************************\
+		|* The server has cut back our subscription, since we were too slow
+		\**********************************************************************/
+		void demoted(QJsonObject settings);
+
 	signals:
 		/**********************************************************************\
 		|* Let those who care, know about new update data
@@ -83,6 +111,16 @@ class MainWindow : public QMainWindow
 		\**********************************************************************/
 		void sampleReady(int64_t bufferId);
 
+		/**********************************************************************\
+		|* Let those who care, know about new live data
+		\**********************************************************************/
+		void liveReady(int64_t bufferId);
+
+		/**********************************************************************\
+		|* Let those who care, know about a new sweep
+		\**********************************************************************/
+		void sweepReady(int64_t bufferId);
+
 	private slots:
 		/**********************************************************************\
 		|* Menu actions unless otherwise annotated
@@ -1,3 +1,7 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
 #include <libra.h>
 
 #include "msgio.h"
@@ -13,6 +17,8 @@ Msgio::Msgio(QString host, int port, QObject *parent)
 	 ,_host(host)
 	 ,_port(port)
 	 ,_isConnected(false)
+	 ,_channel(0)
+	 ,_stream(nullptr)
 	{
 	_url.setHost(host);
 	_url.setPort(port);
@@ -24,6 +30,8 @@ Msgio::Msgio(QUrl url, QObject *parent)
 	  :QObject(parent)
 	  ,_url(url)
 	  ,_isConnected(false)
+	  ,_channel(0)
+	  ,_stream(nullptr)
 	{
 	}
 
@@ -34,12 +42,64 @@ void Msgio::connectToServer(void)
 	{
 	_isConnected = false;
 
-	_url.setScheme("ws");
+	QString scheme = _url.scheme().toLower();
+	if (scheme.length() == 0)
+		_url.setScheme(scheme = "ws");
 
 	LOG << "Connecting to server at " << _url;
-	connect(&_socket, &QWebSocket::connected,
-			this, &Msgio::onConnected);
-	_socket.open(_url);
+	if (scheme == "tcp")
+		{
+		_connectStream(&_tcp);
+		connect(&_tcp, &QTcpSocket::connected,
+				this, &Msgio::onConnected);
+		connect(&_tcp, &QTcpSocket::disconnected,
+				this, &Msgio::closed);
+		_tcp.connectToHost(_url.host(), _url.port(5418));
+		}
+	else if (scheme == "unix")
+		{
+		_connectStream(&_local);
+		connect(&_local, &QLocalSocket::connected,
+				this, &Msgio::onConnected);
+		connect(&_local, &QLocalSocket::disconnected,
+				this, &Msgio::closed);
+		_local.connectToServer(_url.path());
+		}
+	else if (scheme == "udp")
+		{
+		/**********************************************************************\
+		|* Multicast is receive-only, there's nobody to connect to
+		\**********************************************************************/
+		QHostAddress group(_url.host());
+		if (!_udp.bind(QHostAddress::AnyIPv4, _url.port(5419),
+					   QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)
+		 || !_udp.joinMulticastGroup(group))
+			{
+			ERR << "Cannot join multicast group" << _url;
+			return;
+			}
+
+		connect(&_udp, &QUdpSocket::readyRead,
+				this, &Msgio::onDatagrams);
+		_isConnected = true;
+		}
+	else
+		{
+		connect(&_socket, &QWebSocket::connected,
+				this, &Msgio::onConnected);
+		_socket.open(_url);
+		}
+	}
+
+/******************************************************************************\
+|* Use a stream transport
+\******************************************************************************/
+void Msgio::_connectStream(QIODevice *stream)
+	{
+	_stream = stream;
+	_rx.clear();
+	connect(_stream, &QIODevice::readyRead,
+			this, &Msgio::onStreamData);
 	}
 
 
@@ -48,6 +108,13 @@ void Msgio::connectToServer(void)
 \******************************************************************************/
 qint64 Msgio::sendTextMessage(const QString &message)
 	{
+	if (_udp.state() == QAbstractSocket::BoundState)
+		{
+		LOG << "Multicast has no back-channel, not sending" << message;
+		return -1;
+		}
+	if (_isConnected && _stream)
+		return _stream->write(message.toUtf8() + "\n");
 	if (_isConnected)
 		return _socket.sendTextMessage(message);
 	ERR << "Attempted to send text message while disconnected";
@@ -59,12 +126,49 @@ qint64 Msgio::sendTextMessage(const QString &message)
 \******************************************************************************/
 qint64 Msgio::sendBinaryMessage(const QByteArray &data)
 	{
+	if (_isConnected && _stream)
+		{
+		ERR << "Binary messages can't be sent over a stream transport";
+		return -1;
+		}
 	if (_isConnected)
 		return _socket.sendBinaryMessage(data);
 	ERR << "Attempted to send binary message while disconnected";
 	return -1;
 	}
 
+/******************************************************************************\
+|* Ask for a particular view of the data
+\******************************************************************************/
+void Msgio::subscribe(int channel,
+					  int binLo,
+					  int binHi,
+					  int decimate,
+					  const QString& reduce,
+					  const QString& encoding,
+					  bool delta,
+					  bool compress)
+	{
+	_channel = channel;
+
+	QJsonObject cmd;
+	cmd.insert("cmd", "subscribe");
+	cmd.insert("channels", QJsonArray({channel}));
+	cmd.insert("binLo", binLo);
+	cmd.insert("binHi", binHi);
+	cmd.insert("decimate", decimate);
+	cmd.insert("reduce", reduce);
+	cmd.insert("encoding", encoding);
+	cmd.insert("delta", delta);
+	cmd.insert("compress", compress);
+
+	QJsonDocument doc(cmd);
+	_subscription = QString::fromUtf8(doc.toJson(QJsonDocument::Compact));
+
+	if (_isConnected)
+		sendTextMessage(_subscription);
+	}
+
 /******************************************************************************\
 |* Handle connection
 \******************************************************************************/
@@ -72,14 +176,23 @@ void Msgio::onConnected(void)
 	{
 	LOG << "Connected to server";
 
-	connect(&_socket, &QWebSocket::binaryMessageReceived,
-			this, &Msgio::onBinaryMessageReceived);
-	connect(&_socket, &QWebSocket::textMessageReceived,
-			this, &Msgio::onTextMessageReceived);
-	connect(&_socket, &QWebSocket::disconnected,
-			this, &Msgio::closed);
+	if (_stream == &_tcp)
+		_tcp.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+	else if (_stream == nullptr)
+		{
+		connect(&_socket, &QWebSocket::binaryMessageReceived,
+				this, &Msgio::onBinaryMessageReceived);
+		connect(&_socket, &QWebSocket::textMessageReceived,
+				this, &Msgio::onTextMessageReceived);
+		connect(&_socket, &QWebSocket::disconnected,
+				this, &Msgio::closed);
+		}
 
 	_isConnected = true;
+	_decoders.clear();
+
+	if (_subscription.length() > 0)
+		sendTextMessage(_subscription);
 	}
 
 /******************************************************************************\
@@ -97,6 +210,98 @@ void Msgio::closed(void)
 void Msgio::onTextMessageReceived(const QString msg)
 	{
 	LOG << "Got text message " << msg;
+
+	/**************************************************************************\
+	|* A reconfiguration marker means the spectra that follow can't be decoded
+	|* against, or drawn alongside, those that came before
+	\**************************************************************************/
+	QJsonObject json = QJsonDocument::fromJson(msg.toUtf8()).object();
+	if ((json.value("event").toString() == "configured")
+	 && json.value("ok").toBool())
+		{
+		_decoders.clear();
+		emit configured(json);
+		}
+
+	/**************************************************************************\
+	|* If we're too slow, the server halves what it sends. The spectra say
+	|* how they're decimated, so this is only news for whoever subscribes next
+	\**************************************************************************/
+	else if ((json.value("reply").toString() == "subscribe")
+		  && json.value("demoted").toBool())
+		emit demoted(json);
+	}
+
+/******************************************************************************\
+|* Handle data on a stream transport. It's a run of Preamble-framed messages,
+|* so split it up and treat each as if it had been a WebSocket message
+\******************************************************************************/
+void Msgio::onStreamData(void)
+	{
+	_rx.append(_stream->readAll());
+
+	int used = 0;
+	while (_rx.size() - used >= (int)sizeof(Preamble))
+		{
+		const Preamble *hdr = reinterpret_cast<const Preamble *>
+								(_rx.constData() + used);
+		if (hdr->order != 0xAA55)
+			{
+			ERR << "Lost framing on stream, dropping connection";
+			_rx.clear();
+			_stream->close();
+			return;
+			}
+
+		int64_t length = (int64_t)hdr->offset + hdr->extent;
+		if (length < (int64_t)sizeof(Preamble))
+			{
+			ERR << "Bad message length on stream, dropping connection";
+			_rx.clear();
+			_stream->close();
+			return;
+			}
+		if (_rx.size() - used < length)
+			break;
+
+		if (hdr->type == TYPE_TEXT)
+			onTextMessageReceived(QString::fromUtf8(_rx.constData() + used
+														+ hdr->offset,
+													hdr->extent));
+		else
+			onBinaryMessageReceived(_rx.mid(used, length));
+		used += length;
+		}
+
+	_rx.remove(0, used);
+	}
+
+/******************************************************************************\
+|* Handle multicast datagrams. Anything lost just means a spectrum we never
+|* see, the next one will be along shortly
+\******************************************************************************/
+void Msgio::onDatagrams(void)
+	{
+	QByteArray msg;
+	while (_udp.hasPendingDatagrams())
+		{
+		_datagram.resize(_udp.pendingDatagramSize());
+		int size = _udp.readDatagram(_datagram.data(), _datagram.size());
+		if ((size > 0) && _assembler.add(_datagram.constData(), size, msg))
+			onBinaryMessageReceived(msg);
+		}
+	}
+
+/******************************************************************************\
+|* Does a message hold a whole Preamble, and everything that says follows it
+\******************************************************************************/
+bool Msgio::_fits(const QByteArray& msg)
+	{
+	if (msg.size() < (int)sizeof(Preamble))
+		return false;
+
+	const Preamble *hdr = reinterpret_cast<const Preamble *>(msg.constData());
+	return (uint64_t)hdr->offset + hdr->extent <= (uint64_t)msg.size();
 	}
 
 /******************************************************************************\
@@ -112,18 +317,55 @@ void Msgio::onBinaryMessageReceived(const QByteArray &msg)
 		exit(-1);
 		}
 
+	/**************************************************************************\
+	|* Whatever the header claims has to be inside what actually arrived
+	\**************************************************************************/
+	if (!_fits(msg))
+		{
+		ERR << "Dropping malformed message of" << msg.size() << "bytes";
+		return;
+		}
+
 	if (hdr->isByteSwapped())
 		{
 		ERR << "Unimplemented: need to byte-swap incoming message data";
 		return;
 		}
 
+	/**************************************************************************\
+	|* The displays show one channel. Others can still turn up: multicast has
+	|* them all, and some may be in flight from before a change of channel
+	\**************************************************************************/
+	if (hdr->channel != _channel)
+		return;
+
+	/**************************************************************************\
+	|* Undo any compact encoding. Deltas that arrive before their keyframe
+	|* can't be decoded, so are dropped. Each type on each channel is a
+	|* stream of its own, with deltas against its own last spectrum
+	\**************************************************************************/
+	QByteArray decoded;
+	if (hdr->flags != 0)
+		{
+		decoded = _decoders[Stream(hdr->type, hdr->channel)].decode(msg);
+		if ((decoded.size() == 0) || !_fits(decoded))
+			return;
+		ptr = decoded.data();
+		hdr = reinterpret_cast<Preamble*>(ptr);
+		}
+
+	/**************************************************************************\
+	|* The header goes along with the values, since it says which bins they
+	|* are: a view can be a sub-range, decimated, or change from one message
+	|* to the next
+	\**************************************************************************/
 	DataMgr& dmgr		= DataMgr::instance();
-	int block			= dmgr.blockFor(hdr->extent);
+	size_t size			= hdr->offset + hdr->extent;
+	int block			= dmgr.blockFor(size);
 	uint8_t *dst		= dmgr.asUint8(block);
 	if (dst != nullptr)
 		{
-		memcpy(dst, ptr + hdr->offset, hdr->extent);
+		memcpy(dst, ptr, size);
 		switch (hdr->type)
 			{
 			case TYPE_UPDATE:
@@ -136,6 +378,25 @@ void Msgio::onBinaryMessageReceived(const QByteArray &msg)
 				emit sampleReceived(block);
 				break;
 
+			case TYPE_LIVE:
+				emit liveReceived(block);
+				break;
+
+			case TYPE_SWEEP:
+				LOG << "Sweep";
+				emit sweepReceived(block);
+				break;
+
+			case TYPE_VIS_UPDATE:
+			case TYPE_VIS_SAMPLE:
+				if (hdr->values != VIS_PLANES * hdr->bins)
+					ERR << "Visibilities of" << hdr->values << "values for"
+						<< hdr->bins << "bins";
+				else
+					LOG << "Visibilities, which aren't shown";
+				dmgr.release(block);
+				break;
+
 			default:
 				LOG << "Uh ?";
 				dmgr.release(block);
@@ -145,3 +406,30 @@ void Msgio::onBinaryMessageReceived(const QByteArray &msg)
 	else
 		ERR << "Cannot get data for block " << block;
 	}
+
+/******************************************************************************\
+|* Return the header of a block we've handed on
+\******************************************************************************/
+const Preamble * Msgio::header(int64_t bufferId)
+	{
+	DataMgr& dmgr = DataMgr::instance();
+	if (dmgr.extent(bufferId) < sizeof(Preamble))
+		return nullptr;
+	return reinterpret_cast<const Preamble *>(dmgr.asUint8(bufferId));
+	}
+
+/******************************************************************************\
+|* Return the values in a block we've handed on. The message was checked as
+|* it arrived, so they're all there
+\******************************************************************************/
+float * Msgio::values(int64_t bufferId, int& num)
+	{
+	num = 0;
+	const Preamble *hdr = header(bufferId);
+	if (hdr == nullptr)
+		return nullptr;
+
+	num = hdr->extent / sizeof(float);
+	return reinterpret_cast<float *>(DataMgr::instance().asUint8(bufferId)
+									 + hdr->offset);
+	}
@@ -1,10 +1,18 @@
 #ifndef MSGIO_H
 #define MSGIO_H
 
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QMap>
 #include <QObject>
+#include <QPair>
+#include <QTcpSocket>
+#include <QUdpSocket>
 #include <QtWebSockets/QWebSocket>
 
+#include "fragmentassembler.h"
 #include "properties.h"
+#include "spectrumcodec.h"
 
 QT_FORWARD_DECLARE_CLASS(QWebSocket)
 QT_FORWARD_DECLARE_CLASS(QString)
@@ -17,6 +25,8 @@ class Msgio : public QObject
 		/**********************************************************************\
 		|* Typedefs and enums
 		\**********************************************************************/
+		typedef QPair<int,int> Stream;		// Product type, channel
+
 		struct SampleHeader
 			{
 			uint16_t order;
@@ -43,13 +53,37 @@ class Msgio : public QObject
 	GET(QWebSocket, socket);	// Actual socket to use
 	GETSET(QUrl, url, setUrl);	// url to specify connection
 	GET(bool, isConnected);		// Are we connected to the server
+	GET(QString, subscription);	// Subscription to send on connection
+	GET(int, channel);			// The one channel we show
+
+	private:
+		QMap<Stream, SpectrumCodec> _decoders;	// One per type and channel
+		QTcpSocket		_tcp;				// tcp:// transport
+		QLocalSocket	_local;				// unix:// transport
+		QIODevice *		_stream;			// Whichever stream is in use
+		QByteArray		_rx;				// Stream data not yet parsed
+		QUdpSocket		_udp;				// udp:// multicast transport
+		FragmentAssembler _assembler;		// Puts datagrams back together
+		QByteArray		_datagram;			// Reused for each datagram
+
+		/**********************************************************************\
+		|* Connect the stream transport signals
+		\**********************************************************************/
+		void _connectStream(QIODevice *stream);
+
+		/**********************************************************************\
+		|* Check a message is as long as its header says it is
+		\**********************************************************************/
+		static bool _fits(const QByteArray& msg);
 
 	public:
 		explicit Msgio(QString host, int port, QObject *parent = nullptr);
 		explicit Msgio(QUrl url, QObject *parent = nullptr);
 
 	/**********************************************************************\
-	|* Connect to the remote service, or fail in the attempt
+	|* Connect to the remote service, or fail in the attempt. The URL scheme
+	|* picks the transport: ws://host:port (the default), tcp://host:port,
+	|* unix:///path/to/socket or udp://group:port for multicast
 	\**********************************************************************/
 	void connectToServer(void);
 
@@ -59,6 +93,29 @@ class Msgio : public QObject
 	qint64 sendTextMessage(const QString &message);
 	qint64 sendBinaryMessage(const QByteArray &data);
 
+	/**********************************************************************\
+	|* Ask the server for a particular view of the data, on one channel.
+	|* This is sent now if we're connected, and again whenever we
+	|* (re-)connect. Anything from other channels is ignored, since
+	|* multicast sends them all
+	\**********************************************************************/
+	void subscribe(int channel,
+				   int binLo,
+				   int binHi,
+				   int decimate,
+				   const QString& reduce,
+				   const QString& encoding = "f32",
+				   bool delta = false,
+				   bool compress = false);
+
+	/**********************************************************************\
+	|* The blocks handed on hold the whole message, Preamble and all, so the
+	|* displays can tell which bins the values are for. Return the header of
+	|* one, or its values and how many there are
+	\**********************************************************************/
+	static const Preamble * header(int64_t bufferId);
+	static float * values(int64_t bufferId, int& num);
+
 	/**********************************************************************\
 	|* Private slots
 	\**********************************************************************/
@@ -66,6 +123,8 @@ class Msgio : public QObject
 		void onConnected();
 		void onTextMessageReceived(const QString message);
 		void onBinaryMessageReceived(const QByteArray &message);
+		void onStreamData();
+		void onDatagrams();
 		void closed();
 
 	/**********************************************************************\
@@ -74,6 +133,20 @@ class Msgio : public QObject
 	signals:
 		void sampleReceived(int64_t bufferId);
 		void updateReceived(int64_t bufferId);
+		void liveReceived(int64_t bufferId);
+		void sweepReceived(int64_t bufferId);
+
+		/**********************************************************************\
+		|* The server's settings have changed, and nothing from before the
+		|* change should be shown alongside what comes after
+		\**********************************************************************/
+		void configured(QJsonObject settings);
+
+		/**********************************************************************\
+		|* The server couldn't keep up with what we asked for, and has cut the
+		|* subscription back to {settings}
+		\**********************************************************************/
+		void demoted(QJsonObject settings);
 
 	};
 
@@ -3,6 +3,7 @@
 #include <libra.h>
 
 #include "mainwindow.h"
+#include "msgio.h"
 #include "waterfall.h"
 
 #define LOG qDebug(log_gui) << QTime::currentTime().toString("hh:mm:ss.zzz")
@@ -53,8 +54,9 @@ Waterfall::Waterfall(QWidget *parent)
 		  ,_sampleMax(-MAXFLOAT)
 		  ,_sampleMin(MAXFLOAT)
 		  ,_haveData(false)
-		  ,_binLo(-1)
+		  ,_binLo(0)
 		  ,_binHi(-1)
+		  ,_binMax(-1)
 		  ,_img(nullptr)
 	{
 	/**************************************************************************\
@@ -76,6 +78,12 @@ Waterfall::Waterfall(QWidget *parent)
 void Waterfall::paintEvent(QPaintEvent *e)
 	{
 	Q_UNUSED(e);
+	if (_redrawImage && (_binMax > 0))
+		{
+		_updateImage();
+		_redrawImage = false;
+		}
+
 	if (_img == nullptr)
 		{
 		QPainter qp(this);
@@ -115,28 +123,11 @@ void Waterfall::paintEvent(QPaintEvent *e)
 void Waterfall::updateReceived(int64_t idx)
 	{
 	DataMgr& dmgr		= DataMgr::instance();
-	int num				= dmgr.extent(idx) / sizeof(float);
-	float * data		= dmgr.asFloat(idx);
-
-	/**************************************************************************\
-	|* Now that we have an update, if we don't have the limits on the data to
-	|* process, set it to the size of the incoming data
-	\**************************************************************************/
-	if ((_binLo < 0) || (_binHi < 0))
-		{
-		_binLo	= 1;
-		_binHi	= num-1;
-		_binMax	= num;
-		}
 
 	/**************************************************************************\
 	|* Update the min/max range to include this data
-	\**************************************************************************/\
-	for (int i=_binLo; i<_binHi; i++)
-		{
-		_updateMax = (_updateMax > data[i]) ? _updateMax : data[i];
-		_updateMin = (_updateMin < data[i]) ? _updateMin : data[i];
-		}
+	\**************************************************************************/
+	_extend(idx, _updateMin, _updateMax);
 
 	/**************************************************************************\
 	|* Update the backing data
@@ -152,14 +143,11 @@ void Waterfall::updateReceived(int64_t idx)
 		}
 
 	/**************************************************************************\
-	|* Update the backing image
+	|* Mark the backing image stale and ask for a repaint. A burst of messages,
+	|* such as the history sent on connect, then costs one redraw, not one each
 	\**************************************************************************/
-	_updateImage();
-
-	/**************************************************************************\
-	|* And issue a repaint
-	\**************************************************************************/
-	repaint();
+	_redrawImage = true;
+	update();
 	}
 
 /******************************************************************************\
@@ -168,35 +156,18 @@ void Waterfall::updateReceived(int64_t idx)
 void Waterfall::sampleReceived(int64_t idx)
 	{
 	DataMgr& dmgr		= DataMgr::instance();
-	int num				= dmgr.extent(idx) / sizeof(float);
-	float * data		= dmgr.asFloat(idx);
-
-	/**************************************************************************\
-	|* Now that we have an update, if we don't have the limits on the data to
-	|* process, set it to the size of the incoming data
-	\**************************************************************************/
-	if ((_binLo < 0) || (_binHi < 0))
-		{
-		_binLo	= 1;
-		_binHi	= num-1;
-		_binMax	= num;
-		}
 
 	/**************************************************************************\
 	|* Update the min/max range to include this data
-	\**************************************************************************/\
-	for (int i=_binLo; i<_binHi; i++)
-		{
-		_sampleMax = (_sampleMax > data[i]) ? _sampleMax : data[i];
-		_sampleMin = (_sampleMin < data[i]) ? _sampleMin : data[i];
-		}
+	\**************************************************************************/
+	_extend(idx, _sampleMin, _sampleMax);
 
 	/**************************************************************************\
 	|* Update the backing data
 	\**************************************************************************/
 	dmgr.retain(idx);
 	_samples.insert(0, idx);
-	while (_updates.size() > MAX_SAMPLES)
+	while (_samples.size() > MAX_SAMPLES)
 		{
 		int64_t last = _samples.last();
 		dmgr.release(last);
@@ -205,22 +176,26 @@ void Waterfall::sampleReceived(int64_t idx)
 
 	/**************************************************************************\
 	|* Add a black line into the updates count, so we can tell where one sample
-	|* starts and another ends
+	|* starts and another ends. It's the sample's header, so covers the same
+	|* bins, with all its values zero
 	\**************************************************************************/
-	int64_t bufId	= dmgr.blockFor(num, sizeof(float));
-	float *dummy	= dmgr.asFloat(bufId);
-	memset(dummy, 0, num*sizeof(float));
-	_updates.insert(0, bufId);
-
-	/**************************************************************************\
-	|* Update the backing image
-	\**************************************************************************/
-	_updateImage();
+	const Preamble *hdr	= Msgio::header(idx);
+	size_t size			= hdr->offset + hdr->extent;
+	int64_t bufId		= dmgr.blockFor(size);
+	uint8_t *dummy		= dmgr.asUint8(bufId);
+	if (dummy != nullptr)
+		{
+		memcpy(dummy, hdr, hdr->offset);
+		memset(dummy + hdr->offset, 0, hdr->extent);
+		_updates.insert(0, bufId);
+		}
 
 	/**************************************************************************\
-	|* And issue a repaint
+	|* Mark the backing image stale and ask for a repaint. A burst of messages,
+	|* such as the history sent on connect, then costs one redraw, not one each
 	\**************************************************************************/
-	repaint();
+	_redrawImage = true;
+	update();
 	}
 
 /******************************************************************************\
@@ -262,19 +237,26 @@ QColor Waterfall::_getGradientColour(float at)
 \******************************************************************************/
 void Waterfall::_updateImage(void)
 	{
-	DataMgr& dmgr		= DataMgr::instance();
 	int updates			= _updatesHeight();
 
 	/**************************************************************************\
-	|* Check to see if we have an image, if not, create it
+	|* Check to see if we have an image one column per bin in the view, if not,
+	|* create it
 	\**************************************************************************/
+	int width			= _lastBin() - _binLo + 1;
+	if ((_img != nullptr) && (_img->width() != width))
+		{
+		delete _img;
+		_img = nullptr;
+		}
+
 	if (_img == nullptr)
 		{
 		int height	= size().height();
 		if (height  < updates + SEPARATOR + MIN_SAMPLES)
 			height  = updates + SEPARATOR + MIN_SAMPLES;
 
-		_img = new QImage(_binMax, height, QImage::Format_ARGB32);
+		_img = new QImage(width, height, QImage::Format_ARGB32);
 		}
 
 	/**************************************************************************\
@@ -288,21 +270,7 @@ void Waterfall::_updateImage(void)
 	|* Draw the updates
 	\**************************************************************************/
 	for (int i=0; i<_updates.size(); i++)
-		{
-		int idx		 = _updates.at(i);
-		float * data = dmgr.asFloat(idx);
-		if (data != nullptr)
-			{
-			float scale = 1.0f / (_updateMax - _updateMin);
-			for (int j=_binLo; j<_binHi; j++)
-				{
-				float value = (data[j] - _updateMin) * scale;
-				QColor rgb = _getGradientColour(value);
-				painter.setPen(rgb);
-				painter.drawPoint(j,i);
-				}
-			}
-		}
+		_row(painter, _updates.at(i), i, _updateMin, _updateMax);
 
 	/**************************************************************************\
 	|* Draw the white line to separate updates from samples
@@ -310,7 +278,7 @@ void Waterfall::_updateImage(void)
 	QPen pen(QColor::fromRgb(255,255,255));
 	pen.setWidth(SEPARATOR);
 	painter.setPen(pen);
-	painter.drawLine(0, updates, _binMax, updates);
+	painter.drawLine(0, updates, width, updates);
 
 	/**************************************************************************\
 	|* Draw the samples
@@ -320,21 +288,40 @@ void Waterfall::_updateImage(void)
 	max		= (max > _samples.size()) ? _samples.size() : max;
 
 	for (int i=0; i<max; i++)
+		_row(painter, _samples.at(i), i + updates + SEPARATOR,
+			 _sampleMin, _sampleMax);
+	}
+
+/******************************************************************************\
+|* Private Method - Draw one spectrum as a row of the image. Each value is for
+|* {decimate} bins from {binLo}, and only those in the view are drawn
+\******************************************************************************/
+void Waterfall::_row(QPainter& painter, int64_t idx, int y, float min, float max)
+	{
+	const Preamble *hdr	= Msgio::header(idx);
+	int num				= 0;
+	float *data			= Msgio::values(idx, num);
+	if (data == nullptr)
+		return;
+
+	int last			= _lastBin();
+	int dec				= (hdr->decimate > 0) ? hdr->decimate : 1;
+	float scale			= 1.0f / (max - min);
+
+	for (int i=0; i<num; i++)
 		{
-		int y		 = i + updates + SEPARATOR;
-		int idx		 = _samples.at(i);
-		float * data = dmgr.asFloat(idx);
-		if (data != nullptr)
-			{
-			float scale = 1.0f / (_sampleMax - _sampleMin);
-			for (int j=_binLo; j<_binHi; j++)
-				{
-				float value = (data[j] - _sampleMin) * scale;
-				QColor rgb = _getGradientColour(value);
-				painter.setPen(rgb);
-				painter.drawPoint(j,y);
-				}
-			}
+		int from	= (int)hdr->binLo + i * dec;
+		int to		= from + dec - 1;
+		if ((to < _binLo) || (from > last))
+			continue;
+
+		from		= (from < _binLo) ? _binLo : from;
+		to			= (to > last) ? last : to;
+
+		float value = (data[i] - min) * scale;
+		QColor rgb = _getGradientColour(value);
+		painter.setPen(rgb);
+		painter.drawLine(from - _binLo, y, to - _binLo, y);
 		}
 	}
 
@@ -345,3 +332,110 @@ int Waterfall::_updatesHeight(void)
 	{
 	return 1 + _sampleSecs / _updateSecs;
 	}
+
+/******************************************************************************\
+|* Private Method - Return the last bin in the view
+\******************************************************************************/
+int Waterfall::_lastBin(void)
+	{
+	return ((_binHi < 0) || (_binHi >= _binMax)) ? _binMax - 1 : _binHi;
+	}
+
+/******************************************************************************\
+|* Private Method - Note the size of the spectrum a message is from, and take
+|* its values in the view into a min/max range
+\******************************************************************************/
+void Waterfall::_extend(int64_t idx, float& lo, float& hi)
+	{
+	const Preamble *hdr	= Msgio::header(idx);
+	int num				= 0;
+	float *data			= Msgio::values(idx, num);
+	if (data == nullptr)
+		return;
+
+	int dec				= (hdr->decimate > 0) ? hdr->decimate : 1;
+	int bins			= (int)hdr->bins;
+	if (bins <= 0)
+		bins = (int)hdr->binLo + num * dec;
+	_binMax				= bins;
+
+	int last			= _lastBin();
+	for (int i=0; i<num; i++)
+		{
+		int bin = (int)hdr->binLo + i * dec;
+		if ((bin + dec - 1 < _binLo) || (bin > last))
+			continue;
+		hi = (hi > data[i]) ? hi : data[i];
+		lo = (lo < data[i]) ? lo : data[i];
+		}
+	}
+
+/******************************************************************************\
+|* Private Method - Work the data ranges out again from what we're holding.
+|* The separators are all zero, and were never counted, so skip them. They're
+|* the only samples amongst the updates and sweeps
+\******************************************************************************/
+void Waterfall::_rescale(void)
+	{
+	_updateMax		= -MAXFLOAT;
+	_updateMin		= MAXFLOAT;
+	_sampleMax		= -MAXFLOAT;
+	_sampleMin		= MAXFLOAT;
+
+	for (int64_t buffer : qAsConst(_updates))
+		{
+		const Preamble *hdr = Msgio::header(buffer);
+		if ((hdr != nullptr) && (hdr->type != TYPE_SAMPLE))
+			_extend(buffer, _updateMin, _updateMax);
+		}
+	for (int64_t buffer : qAsConst(_samples))
+		_extend(buffer, _sampleMin, _sampleMax);
+	}
+
+/******************************************************************************\
+|* Start again from nothing. Spectra either side of a reconfiguration can have
+|* different bins, so none of the old ones can stay on screen
+\******************************************************************************/
+void Waterfall::reset(void)
+	{
+	DataMgr& dmgr		= DataMgr::instance();
+
+	for (int64_t buffer : _updates)
+		dmgr.release(buffer);
+	_updates.clear();
+
+	for (int64_t buffer : _samples)
+		dmgr.release(buffer);
+	_samples.clear();
+
+	_binMax			= -1;
+	_updateMax		= -MAXFLOAT;
+	_updateMin		= MAXFLOAT;
+	_sampleMax		= -MAXFLOAT;
+	_sampleMin		= MAXFLOAT;
+	_haveData		= false;
+
+	delete _img;
+	_img			= nullptr;
+	_redrawImage	= true;
+	update();
+	}
+
+/******************************************************************************\
+|* Show a range of bins. What's already held is still good, since each message
+|* says which bins it has, but the scaling has to be worked out again and the
+|* image is remade at the new width when it's next drawn
+\******************************************************************************/
+void Waterfall::setView(int binLo, int binHi)
+	{
+	binLo			= (binLo < 0) ? 0 : binLo;
+	binHi			= ((binHi >= 0) && (binHi < binLo)) ? binLo : binHi;
+	if ((binLo == _binLo) && (binHi == _binHi))
+		return;
+
+	_binLo			= binLo;
+	_binHi			= binHi;
+	_rescale();
+	_redrawImage	= true;
+	update();
+	}
@@ -6,6 +6,7 @@
 #include "properties.h"
 
 QT_FORWARD_DECLARE_CLASS(QImage)
+QT_FORWARD_DECLARE_CLASS(QPainter)
 
 
 class Waterfall : public QWidget
@@ -29,8 +30,8 @@ class Waterfall : public QWidget
 	GET(float, sampleMin);						// Min value in sample data
 	GET(bool, haveData);						// Can draw something
 	GET(int, binLo);							// Smallest bin number to show
-	GET(int, binHi);							// Largest bin number to show
-	GET(int, binMax);							// Largest bin available
+	GET(int, binHi);							// Largest, -1 = the last there is
+	GET(int, binMax);							// Bins in the spectrum, or -1
 
 	private:
 		/**********************************************************************\
@@ -48,6 +49,27 @@ class Waterfall : public QWidget
 		\**********************************************************************/
 		int _updatesHeight(void);
 
+		/**********************************************************************\
+		|* Return the last bin in the view
+		\**********************************************************************/
+		int _lastBin(void);
+
+		/**********************************************************************\
+		|* Note the bins a message covers, and widen {lo} and {hi} to take in
+		|* the values it has in the view
+		\**********************************************************************/
+		void _extend(int64_t idx, float& lo, float& hi);
+
+		/**********************************************************************\
+		|* Work out the data ranges again, eg: once the view has changed
+		\**********************************************************************/
+		void _rescale(void);
+
+		/**********************************************************************\
+		|* Draw one spectrum as row {y}, each value across the bins it came from
+		\**********************************************************************/
+		void _row(QPainter& painter, int64_t idx, int y, float min, float max);
+
 		/**********************************************************************\
 		|* Variables
 		\**********************************************************************/
@@ -78,6 +100,17 @@ class Waterfall : public QWidget
 		\**********************************************************************/
 		void sampleReceived(int64_t bufferId);
 
+		/**********************************************************************\
+		|* The server has been reconfigured: forget everything shown so far
+		\**********************************************************************/
+		void reset(void);
+
+		/**********************************************************************\
+		|* Show bins {binLo} to {binHi}, inclusive. -1 for {binHi} means up to
+		|* the last one
+		\**********************************************************************/
+		void setView(int binLo, int binHi);
+
 	};
 
 #endif // WATERFALL_H
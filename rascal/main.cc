@@ -31,16 +31,17 @@ int main(int argc, char *argv[])
 	Config &cfg = Config::instance();
 
 	/**************************************************************************\
-	|* Set up a websocket connection to the server
+	|* Set up a connection to the server, over whatever transport the URL says
 	\**************************************************************************/
-	Msgio  io(cfg.networkHost(), cfg.networkPort());
-	io.connectToServer();
+	Msgio  io(cfg.networkUrl());
 
 	/**************************************************************************\
-	|* Show the window
+	|* Show the window. What to subscribe to follows the graph's view, so that
+	|* has to be set up before connecting
 	\**************************************************************************/
 	MainWindow w(&cfg);
 	w.createUI(&io);
+	io.connectToServer();
 	w.show();
 
 	/**************************************************************************\
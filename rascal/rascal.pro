@@ -1,4 +1,4 @@
-QT       += core gui websockets
+QT       += core gui network websockets
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 